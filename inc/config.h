@@ -5,6 +5,8 @@
 // Project includes
 #include "servo.h"
 #include "receiver.h"
+#include "sensors.h"
+#include "movement.h"
 
 // Include all needed SMF32F4 libraries
 #include "../lib/inc/stm32f4xx.h"
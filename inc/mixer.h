@@ -0,0 +1,99 @@
+/** @file    mixer.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Motor mixer: Maps the roll, pitch, yaw and throttle demands onto the
+ *           motors of the selected frame geometry with one matrix-vector product
+ *           and keeps the attitude authority when a motor saturates (airmode).
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MIXER_H
+#define MIXER_H
+
+#include "servo.h"
+
+// Frame geometries; the motors are numbered clockwise seen from above, starting with
+// the first motor right of the nose. The first motor turns counter clockwise and the
+// direction alternates from motor to motor.
+#define MIXER_QUAD_X 0
+#define MIXER_QUAD_PLUS 1
+#define MIXER_HEXA_X 2
+#define MIXER_OCTO_X 3
+#ifndef MIXER_GEOMETRY
+#define MIXER_GEOMETRY MIXER_QUAD_X
+#endif // MIXER_GEOMETRY
+
+// Number of motors of MIXER_GEOMETRY, each needs its own servo output
+#if MIXER_GEOMETRY == MIXER_OCTO_X
+#define MIXER_GEOMETRY_MOTORS 8
+#elif MIXER_GEOMETRY == MIXER_HEXA_X
+#define MIXER_GEOMETRY_MOTORS 6
+#else
+#define MIXER_GEOMETRY_MOTORS 4
+#endif
+
+// Mixed axes: roll (positive rolls right), pitch (positive lifts the nose) and yaw (positive
+// turns the nose right); the throttle is added afterwards by the desaturation
+#define MIXER_AXES 3
+#define MIXER_ROLL 0
+#define MIXER_PITCH 1
+#define MIXER_YAW 2
+#define MIXER_MOTORS_MAX 8
+
+/**
+ * @typedef Mixer_Demand
+ * @brief  Demands of the controller
+ */
+typedef struct {
+	float axis[MIXER_AXES];    //!< Roll, pitch and yaw: -1..1
+	float throttle;            //!< Collective thrust: 0..1
+} Mixer_Demand;
+
+// Number of mixes which had to be desaturated
+extern volatile u32 mixer_saturations;
+
+// Core clock cycles the last mixer_mix() took
+extern volatile u32 mixer_cycles;
+
+/**
+ * @brief  Select the frame geometry
+ * @param  geometry  MIXER_QUAD_X, MIXER_QUAD_PLUS, MIXER_HEXA_X or MIXER_OCTO_X
+ * @retval u8 Number of motors of the geometry; the caller has to check it against SERVO_CHANNELS
+ */
+u8 mixer_init(u8 geometry);
+
+/**
+ * @brief  Mix the demands onto the motors
+ *         If the axes need a larger range than the motors have, they are scaled down
+ *         together so their ratio is kept; the throttle is then shifted to keep all motors
+ *         inside 0..1. This gives up throttle before attitude authority.
+ * @param  demand  The demands
+ * @param  motor  Receives one output 0..1 per motor of the geometry
+ * @retval u8 1 if the mix was desaturated
+ */
+u8 mixer_mix(const Mixer_Demand* demand, float* motor);
+
+/**
+ * @brief  Mix the demands and send them to the servo outputs
+ *         Motors beyond SERVO_CHANNELS are mixed but have no output, see movement_init().
+ * @param  demand  The demands
+ * @retval None
+ */
+void mixer_output(const Mixer_Demand* demand);
+
+#endif // MIXER_H
@@ -23,12 +23,21 @@
 #ifndef MOVEMENT_H
 #define MOVEMENT_H
 
+#include "mixer.h"
+
+// Initialize the mixer with MIXER_GEOMETRY; returns 0 if it has more motors than servo outputs
+u8 movement_init();
+
 // Move in xyz-axis; negative values means backward
-void move_x(const i8 value);
-void move_y(const i8 value);
-void move_z(const i8 value);
+// x is forward (pitch), y is right (roll) and z is up (throttle)
+void move_x(const s8 value);
+void move_y(const s8 value);
+void move_z(const s8 value);
 
 // special moves; negative values means backward
-void rotate(const i8 value);
+void rotate(const s8 value);
+
+// Mix all moves and send them to the motors; call once per control loop
+void movement_update();
 
 #endif // MOVEMENT_H
\ No newline at end of file
@@ -32,6 +32,35 @@
 #include "../lib/inc/peripherals/stm32f4xx_tim.h"
 #include "../lib/inc/peripherals/misc.h" // High level functions for NVIC and SysTick (add-on to CMSIS functions)
 
+// Receiver modes:
+// POLL samples all receiver ports in TIM2_IRQHandler every tick,
+// CAPTURE measures the pulses with timer input capture channels and DMA,
+// PPM decodes a CPPM sum signal with up to 12 channels on a single pin,
+// SERIAL receives SBUS, IBUS or CRSF frames with up to 16 channels on a USART,
+// SAMPLE copies the receiver port by DMA with 1MHz and decodes the edges in blocks.
+// Select the mode with RECEIVER_MODE=... on the make command line.
+#define RECEIVER_MODE_POLL 0
+#define RECEIVER_MODE_CAPTURE 1
+#define RECEIVER_MODE_PPM 2
+#define RECEIVER_MODE_SERIAL 3
+#define RECEIVER_MODE_SAMPLE 4
+#ifndef RECEIVER_MODE
+#define RECEIVER_MODE RECEIVER_MODE_POLL
+#endif // RECEIVER_MODE
+
+#if RECEIVER_MODE == RECEIVER_MODE_PPM
+#define RECEIVER_CHANNELS 12
+#elif RECEIVER_MODE == RECEIVER_MODE_SERIAL
+#define RECEIVER_CHANNELS 16
+#else
+#define RECEIVER_CHANNELS 8
+#endif
+
+// Valid servo pulses are between 1ms and 2ms, some transmitters go a bit beyond
+#define RECEIVER_PULSE_MIN 1000
+#define RECEIVER_PULSE_MAX 2000
+#define RECEIVER_PULSE_TOLERANCE 200
+
 // Receiver ports
 #define RECEIVER1 GPIO_Pin_7
 #define RECEIVER2 GPIO_Pin_8
@@ -52,13 +81,97 @@
 #define RECEIVER_TIM_COUNTER 1000
 #define RECEIVER_TIM_MICROSECOND 100
 
-extern volatile u16 receiver_position[8];
-extern volatile u16 receiver_position_read[8];
+// Highest value receiver_get_pos() returns; except in poll mode each step is one microsecond
+#if RECEIVER_MODE == RECEIVER_MODE_POLL
+#define RECEIVER_POSITION_MAX RECEIVER_TIM_MICROSECOND
+#else
+#define RECEIVER_POSITION_MAX (RECEIVER_PULSE_MAX - RECEIVER_PULSE_MIN)
+#endif
+
+#include "receiver_quality.h"
+
+#if RECEIVER_MODE == RECEIVER_MODE_CAPTURE
+#include "receiver_capture.h"
+#elif RECEIVER_MODE == RECEIVER_MODE_PPM
+#include "receiver_ppm.h"
+#elif RECEIVER_MODE == RECEIVER_MODE_SERIAL
+#include "receiver_serial.h"
+#elif RECEIVER_MODE == RECEIVER_MODE_SAMPLE
+#include "receiver_sample.h"
+#endif
+
+/**
+ * @typedef Receiver_Snapshot
+ * @brief  All channels of one coherent receiver frame
+ */
+typedef struct {
+	u16 position[RECEIVER_CHANNELS]; //!< Channel positions like returned by receiver_get_pos()
+	u32 sequence;                    //!< Number of the frame, incremented with every published frame
+	u32 timestamp;                   //!< Time when the frame was published, see receiver_now()
+	u32 stale;                       //!< Bitmask of the channels without update within the failsafe timeout
+	u8 failsafe;                     //!< Set if all channels are stale, the receiver lost the signal
+} Receiver_Snapshot;
+
+// Working copy of the decoders; only receiver_publish() makes them visible to readers
+extern volatile u16 receiver_position[RECEIVER_CHANNELS];
+extern volatile u16 receiver_position_read[RECEIVER_CHANNELS];
 extern volatile u16 receiver_count;
 
+// Number of snapshot reads and how many retries they needed in total
+extern volatile u32 receiver_snapshot_reads;
+extern volatile u32 receiver_snapshot_retries;
+
 void receiver_gpio_init();
 void receiver_init();
 u16 receiver_get_pos(u16 num);
+
+/**
+ * @brief  Current time for the receiver timestamps
+ * @param  None
+ * @retval u32 The core clock cycle counter (DWT)
+ */
+u32 receiver_now();
+
+/**
+ * @brief  Time between two timestamps of receiver_now()
+ * @param  from  The earlier timestamp
+ * @param  to  The later timestamp
+ * @retval u32 Elapsed time in microseconds
+ */
+u32 receiver_elapsed(u32 from, u32 to);
+
+/**
+ * @brief  Check if the receiver lost the signal
+ * @param  None
+ * @retval u8 1 if no channel got an update within the failsafe timeout
+ */
+u8 receiver_failsafe();
+
+/**
+ * @brief  Copy all channels of the newest published frame
+ *         Lock free: The reader never disables interrupts and the decoders never wait
+ *         for a reader, it just retries if a frame was published while copying.
+ * @param  snapshot  Receives the channels, frame sequence and timestamp
+ * @retval u16 Number of retries needed
+ */
+u16 receiver_get_snapshot(Receiver_Snapshot* snapshot);
+
+/**
+ * @brief  Set the raw position of a channel in the working copy; used by the decoders
+ * @param  num  Number of the channel
+ * @param  position  The decoded position
+ * @retval None
+ */
+void receiver_set_pos(u16 num, u16 position);
+
+/**
+ * @brief  Filter all channels set since the last call and publish them as a new frame
+ *         Called by the decoders only; they must not preempt each other.
+ * @param  None
+ * @retval None
+ */
+void receiver_publish();
+
 void TIM2_IRQHandler(void);
 
 #endif // RECEIVER_H
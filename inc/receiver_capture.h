@@ -0,0 +1,88 @@
+/** @file    receiver_capture.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Receiver decoding with timer input capture channels. Every edge on a
+ *           receiver line is latched by the timer and copied by DMA into a small
+ *           ring buffer, so the pulse widths are measured with 1µs resolution;
+ *           the half and full transfer interrupts of the DMA decode them.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECEIVER_CAPTURE_H
+#define RECEIVER_CAPTURE_H
+
+// Include STM32F4x libraries we need here
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/stm32f4xx_dma.h"
+#include "../lib/inc/peripherals/stm32f4xx_gpio.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "../lib/inc/peripherals/stm32f4xx_tim.h"
+#include "../lib/inc/peripherals/misc.h"
+
+// Capture ports:
+// Only PE9, PE11, PE13 and PE14 of the receiver pins have a timer input (TIM1 CH1-4),
+// the channels 5-8 are captured by TIM2 CH1-4 on PA15, PB3, PB10 and PB11.
+// Both timers are counting with 1MHz, so one tick is exactly one microsecond.
+#define RECEIVER_CAPTURE_TIM_FREQUENCY 1000000
+#define RECEIVER_CAPTURE_TIM_PERIOD 0xFFFF
+
+// Number of edges each DMA ring buffer can hold; this must be a power of two.
+// Every half of the ring raises an interrupt which decodes it, with 2 edges this is
+// after every edge, so a lost edge never delays the decoding of the next pulse. The
+// interrupt has the time until the edge after the next one, at least the width of
+// one pulse, before the DMA overwrites the edge it decodes.
+#define RECEIVER_CAPTURE_EDGES 2
+
+/**
+ * @brief  Configure all capture pins in alternate function mode
+ * @param  None
+ * @retval None
+ */
+void receiver_capture_gpio_init();
+
+/**
+ * @brief  Configure TIM1/TIM2 in input capture mode on both edges, start the DMA streams
+ *         and enable their half and full transfer interrupts
+ * @param  None
+ * @retval None
+ */
+void receiver_capture_init();
+
+/**
+ * @brief  Decode the pulse widths from a ring of captured edge timestamps
+ *         A pulse is the time between two edges which lies inside the valid servo pulse
+ *         range, the pause between two pulses is always much longer and ignored.
+ * @param  edges  Ring buffer with RECEIVER_CAPTURE_EDGES timestamps in microseconds
+ * @param  read  Index of the first edge not yet decoded; updated to the write index
+ * @param  write  Index of the next edge the DMA will write
+ * @param  last  Timestamp of the last decoded edge; updated with the last edge
+ * @param  width  Receives the last valid pulse width in microseconds
+ * @retval u8 1 if a new pulse width was decoded, 0 otherwise
+ */
+u8 receiver_capture_decode(const volatile u16* edges, u16* read, u16 write, u16* last, u16* width);
+
+void DMA2_Stream1_IRQHandler(void);
+void DMA2_Stream2_IRQHandler(void);
+void DMA2_Stream6_IRQHandler(void);
+void DMA2_Stream4_IRQHandler(void);
+void DMA1_Stream5_IRQHandler(void);
+void DMA1_Stream6_IRQHandler(void);
+void DMA1_Stream1_IRQHandler(void);
+void DMA1_Stream7_IRQHandler(void);
+
+#endif // RECEIVER_CAPTURE_H
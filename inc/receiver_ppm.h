@@ -0,0 +1,78 @@
+/** @file    receiver_ppm.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   CPPM/PPM sum signal decoding: All channels are transmitted one after the
+ *           other on a single wire and separated by a long sync gap.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECEIVER_PPM_H
+#define RECEIVER_PPM_H
+
+// Include STM32F4x libraries we need here
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/stm32f4xx_gpio.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "../lib/inc/peripherals/stm32f4xx_tim.h"
+#include "../lib/inc/peripherals/misc.h"
+
+// PPM input: TIM1 CH1 on PE9 (the former RECEIVER3 pin), counting with 1MHz
+#define RECEIVER_PPM_PIN GPIO_Pin_9
+#define RECEIVER_PPM_SOURCE GPIO_PinSource9
+#define RECEIVER_PPM_REGISTER GPIOE
+#define RECEIVER_PPM_TIM_FREQUENCY 1000000
+
+// Every interval between two rising edges longer than this is the sync gap (µs)
+#define RECEIVER_PPM_SYNC_MIN 3000
+
+// A frame needs at least this amount of channels to be accepted
+#define RECEIVER_PPM_CHANNELS_MIN 4
+
+// A frame with less channels than before is taken for truncated by a lost edge, until
+// that many frames in a row had the same shorter length; then the receiver really
+// switched to less channels, e.g. after a model change on the transmitter.
+#define RECEIVER_PPM_CHANNELS_REPEAT 3
+
+extern volatile u8 receiver_ppm_channels;
+extern volatile u32 receiver_ppm_frames;
+extern volatile u32 receiver_ppm_errors;
+
+/**
+ * @brief  Configure the PPM input pin in alternate function mode
+ * @param  None
+ * @retval None
+ */
+void receiver_ppm_gpio_init();
+
+/**
+ * @brief  Configure TIM1 CH1 to capture the rising edges and enable the capture interrupt
+ * @param  None
+ * @retval None
+ */
+void receiver_ppm_init();
+
+/**
+ * @brief  Feed one rising edge into the PPM decoder
+ * @param  timestamp  Capture time of the edge in microseconds (16bit, overflow is fine)
+ * @retval u8 1 if the edge completed a valid frame which was published to receiver_position[]
+ */
+u8 receiver_ppm_edge(u16 timestamp);
+
+void TIM1_CC_IRQHandler(void);
+
+#endif // RECEIVER_PPM_H
@@ -0,0 +1,78 @@
+/** @file    receiver_protocol.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Frame parsers for the serial receiver protocols SBUS, IBUS and CRSF.
+ *           The parsers work in place on a ring buffer (the DMA receive buffer) and
+ *           do not depend on any STM32 peripheral, so they can be used on the host too.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECEIVER_PROTOCOL_H
+#define RECEIVER_PROTOCOL_H
+
+#include <stdint.h>
+
+// Maximum number of channels any of the protocols delivers
+#define RECEIVER_PROTOCOL_CHANNELS 16
+
+// SBUS: 100000 baud, 8E2, inverted; 0x0F, 22 bytes with 16 * 11bit channels, flags, 0x00
+#define RECEIVER_SBUS_FRAME_LENGTH 25
+#define RECEIVER_SBUS_START 0x0F
+#define RECEIVER_SBUS_FLAG_FRAME_LOST 0x04
+#define RECEIVER_SBUS_FLAG_FAILSAFE 0x08
+
+// IBUS: 115200 baud, 8N1; 0x20, 0x40, 14 * 16bit channels, 16bit checksum
+#define RECEIVER_IBUS_FRAME_LENGTH 32
+#define RECEIVER_IBUS_LENGTH 0x20
+#define RECEIVER_IBUS_COMMAND 0x40
+#define RECEIVER_IBUS_CHANNELS 14
+
+// CRSF: 420000 baud, 8N1; address, length, type, payload, CRC8 (poly 0xD5) over type and payload
+#define RECEIVER_CRSF_ADDRESS 0xC8
+#define RECEIVER_CRSF_FRAME_LENGTH_MAX 64
+#define RECEIVER_CRSF_TYPE_RC_CHANNELS 0x16
+#define RECEIVER_CRSF_RC_PAYLOAD 22
+
+/**
+ * @brief  Parses one frame at the start position of a ring buffer
+ *         All parsers share this signature. The channels are returned in microseconds.
+ * @param  ring  The ring buffer, its size must be a power of two
+ * @param  mask  Size of the ring buffer minus one
+ * @param  start  Index of the first unparsed byte
+ * @param  available  Number of unparsed bytes from start on
+ * @param  channels  Receives the channel values, RECEIVER_PROTOCOL_CHANNELS entries
+ * @param  count  Receives the number of decoded channels, 0 if the frame has no channel data
+ * @retval uint16_t Number of bytes consumed; 0 if the frame is not complete yet
+ */
+typedef uint16_t (*Receiver_ProtocolParser)(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t available, uint16_t* channels, uint8_t* count);
+
+uint16_t receiver_sbus_parse(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t available, uint16_t* channels, uint8_t* count);
+uint16_t receiver_ibus_parse(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t available, uint16_t* channels, uint8_t* count);
+uint16_t receiver_crsf_parse(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t available, uint16_t* channels, uint8_t* count);
+
+/**
+ * @brief  CRC8 with the polynomial 0xD5 (DVB-S2) as used by CRSF
+ * @param  ring  The ring buffer, its size must be a power of two
+ * @param  mask  Size of the ring buffer minus one
+ * @param  start  Index of the first byte
+ * @param  length  Number of bytes
+ * @retval uint8_t The CRC
+ */
+uint8_t receiver_crsf_crc(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t length);
+
+#endif // RECEIVER_PROTOCOL_H
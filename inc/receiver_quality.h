@@ -0,0 +1,98 @@
+/** @file    receiver_quality.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Signal quality of the receiver channels: Glitch rejection, stale channel
+ *           and failsafe detection and statistics about dropped frames and jitter.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECEIVER_QUALITY_H
+#define RECEIVER_QUALITY_H
+
+#include "../lib/inc/stm32f4xx.h"
+
+// Default time in microseconds without an update after which a channel is stale
+#define RECEIVER_FAILSAFE_TIMEOUT 100000
+
+// A value further away from the median of the last three than this is counted as glitch
+#define RECEIVER_GLITCH_THRESHOLD (RECEIVER_POSITION_MAX / 10)
+
+// An update interval longer than 3/2 of the average one counts as dropped frame
+#define RECEIVER_DROP_NUMERATOR 3
+#define RECEIVER_DROP_DENOMINATOR 2
+
+// After this many late updates in a row the frame rate changed, the late intervals are
+// no longer counted as dropped frames but taken into the average interval
+#define RECEIVER_LATE_ADAPT 4
+
+// Averages are exponential with a weight of 1 / 2^RECEIVER_QUALITY_SHIFT for a new value
+#define RECEIVER_QUALITY_SHIFT 3
+
+/**
+ * @typedef Receiver_ChannelStats
+ * @brief  Signal quality of one receiver channel
+ */
+typedef struct {
+	u32 updated;     //!< Timestamp of the last update, see receiver_now()
+	u32 interval;    //!< Average update interval in microseconds
+	u32 jitter;      //!< Average deviation of the update interval in microseconds
+	u32 jitterMax;   //!< Largest deviation of the update interval in microseconds
+	u32 frames;      //!< Number of updates
+	u32 dropped;     //!< Number of updates which came too late, a frame was lost
+	u32 glitches;    //!< Number of values rejected by the median filter
+	u16 history[2];  //!< The last two raw values for the median filter
+	u8 late;         //!< Number of late updates in a row
+} Receiver_ChannelStats;
+
+/**
+ * @brief  Reset all statistics and set the failsafe timeout
+ * @param  timeout  Time in microseconds after which a channel without an update is stale
+ * @retval None
+ */
+void receiver_quality_init(u32 timeout);
+
+/**
+ * @brief  Filter a new value of a channel and update its statistics
+ *         Constant time, called for every updated channel when a frame is published.
+ * @param  num  Number of the channel
+ * @param  position  The raw position from the decoder
+ * @param  now  The current time, see receiver_now()
+ * @retval u16 The median of the last three values
+ */
+u16 receiver_quality_filter(u8 num, u16 position, u32 now);
+
+/**
+ * @brief  Check if a channel got no update within the failsafe timeout
+ *         The state is latched until the next update, so the timer overflow can not make
+ *         a lost channel valid again. Only the readers keep the latch, the statistics
+ *         written by the interrupts are just read.
+ * @param  num  Number of the channel
+ * @param  now  The current time, see receiver_now()
+ * @retval u8 1 if the channel is stale or never got an update
+ */
+u8 receiver_quality_stale(u8 num, u32 now);
+
+/**
+ * @brief  Copy the statistics of one channel
+ * @param  num  Number of the channel
+ * @param  stats  Receives the statistics
+ * @retval None
+ */
+void receiver_quality_stats(u8 num, Receiver_ChannelStats* stats);
+
+#endif // RECEIVER_QUALITY_H
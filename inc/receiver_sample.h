@@ -0,0 +1,94 @@
+/** @file    receiver_sample.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Receiver decoding by sampling the receiver port with DMA like a logic
+ *           analyzer. A timer requests a copy of GPIOE->IDR every microsecond, the
+ *           edges of all channels are decoded in blocks of half a buffer.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECEIVER_SAMPLE_H
+#define RECEIVER_SAMPLE_H
+
+// Include STM32F4x libraries we need here
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/stm32f4xx_dma.h"
+#include "../lib/inc/peripherals/stm32f4xx_gpio.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "../lib/inc/peripherals/stm32f4xx_tim.h"
+#include "../lib/inc/peripherals/misc.h"
+
+// Sampling:
+// The update event of TIM8 requests DMA2 Stream1 Channel7 to copy the input register
+// of the receiver port into a circular buffer. Only DMA2 can access the AHB1 GPIOs.
+#define RECEIVER_SAMPLE_FREQUENCY 1000000
+#define RECEIVER_SAMPLE_DMA_STREAM DMA2_Stream1
+#define RECEIVER_SAMPLE_DMA_CHANNEL DMA_Channel_7
+#define RECEIVER_SAMPLE_DMA_IRQn DMA2_Stream1_IRQn
+#define RECEIVER_SAMPLE_DMA_IT_HT DMA_IT_HTIF1
+#define RECEIVER_SAMPLE_DMA_IT_TC DMA_IT_TCIF1
+
+// Number of samples in the circular buffer; each half is decoded in one interrupt,
+// with 1024 samples this is one interrupt every 512µs
+#define RECEIVER_SAMPLE_BUFFER 1024
+
+// Bit of the first receiver pin in the input register; RECEIVER1..8 are consecutive pins
+#define RECEIVER_SAMPLE_SHIFT 7
+
+/**
+ * @typedef Receiver_SampleDecoder
+ * @brief  State of the sample decoder between two blocks
+ */
+typedef struct {
+	u16 last;                       //!< Last sample of the previous block
+	u32 time;                       //!< Number of the next sample, counts up with the sample frequency
+	u32 rise[RECEIVER_CHANNELS];    //!< Sample number of the last rising edge per channel
+	u16 width[RECEIVER_CHANNELS];   //!< Last valid pulse width per channel in microseconds
+} Receiver_SampleDecoder;
+
+extern volatile u32 receiver_sample_blocks;
+
+/**
+ * @brief  Configure the receiver pins as inputs
+ * @param  None
+ * @retval None
+ */
+void receiver_sample_gpio_init();
+
+/**
+ * @brief  Start TIM8 with the sample frequency and the circular DMA from the input register
+ * @param  None
+ * @retval None
+ */
+void receiver_sample_init();
+
+/**
+ * @brief  Decode a block of input register samples for all channels at once
+ *         Unchanged samples are skipped with a single compare, only samples with an edge
+ *         on any receiver pin are looked at per channel. A pulse is the time between a
+ *         rising and the next falling edge inside the valid servo pulse range.
+ * @param  decoder  Decoder state, initialize it to zero
+ * @param  samples  Samples of the receiver port input register
+ * @param  count  Number of samples
+ * @retval u32 Bitmask of the channels with a new pulse width in decoder->width
+ */
+u32 receiver_sample_decode(Receiver_SampleDecoder* decoder, const volatile u16* samples, u16 count);
+
+void DMA2_Stream1_IRQHandler(void);
+
+#endif // RECEIVER_SAMPLE_H
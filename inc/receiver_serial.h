@@ -0,0 +1,92 @@
+/** @file    receiver_serial.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Serial receiver input (SBUS, IBUS or CRSF) on USART2. The bytes are written
+ *           by DMA into a circular buffer and parsed in place whenever the line gets idle.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECEIVER_SERIAL_H
+#define RECEIVER_SERIAL_H
+
+// Include STM32F4x libraries we need here
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/stm32f4xx_dma.h"
+#include "../lib/inc/peripherals/stm32f4xx_gpio.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "../lib/inc/peripherals/stm32f4xx_usart.h"
+#include "../lib/inc/peripherals/misc.h"
+
+#include "receiver_protocol.h"
+
+// Serial protocols, select one with RECEIVER_SERIAL_PROTOCOL
+// SBUS is an inverted signal, the STM32F4 USART can not invert so an external inverter is needed.
+#define RECEIVER_SERIAL_SBUS 0
+#define RECEIVER_SERIAL_IBUS 1
+#define RECEIVER_SERIAL_CRSF 2
+#ifndef RECEIVER_SERIAL_PROTOCOL
+#define RECEIVER_SERIAL_PROTOCOL RECEIVER_SERIAL_CRSF
+#endif // RECEIVER_SERIAL_PROTOCOL
+
+// USART2 RX on PA3, received by DMA1 Stream5 Channel4
+#define RECEIVER_SERIAL_USART USART2
+#define RECEIVER_SERIAL_USART_CLK RCC_APB1Periph_USART2
+#define RECEIVER_SERIAL_USART_IRQn USART2_IRQn
+#define RECEIVER_SERIAL_PIN GPIO_Pin_3
+#define RECEIVER_SERIAL_SOURCE GPIO_PinSource3
+#define RECEIVER_SERIAL_REGISTER GPIOA
+#define RECEIVER_SERIAL_AF GPIO_AF_USART2
+#define RECEIVER_SERIAL_DMA_STREAM DMA1_Stream5
+#define RECEIVER_SERIAL_DMA_CHANNEL DMA_Channel_4
+#define RECEIVER_SERIAL_DMA_IRQn DMA1_Stream5_IRQn
+#define RECEIVER_SERIAL_DMA_IT_HT DMA_IT_HTIF5
+#define RECEIVER_SERIAL_DMA_IT_TC DMA_IT_TCIF5
+
+// Size of the circular DMA buffer; a power of two holding at least two frames
+#define RECEIVER_SERIAL_BUFFER 128
+
+extern volatile u32 receiver_serial_frames;
+extern volatile u32 receiver_serial_errors;
+
+/**
+ * @brief  Configure the USART RX pin in alternate function mode
+ * @param  None
+ * @retval None
+ */
+void receiver_serial_gpio_init();
+
+/**
+ * @brief  Configure the USART for the selected protocol, start the circular RX DMA
+ *         and enable the idle line interrupt
+ * @param  None
+ * @retval None
+ */
+void receiver_serial_init();
+
+/**
+ * @brief  Parse all complete frames received since the last call and publish them
+ *         Called from the idle line and DMA interrupts.
+ * @param  None
+ * @retval None
+ */
+void receiver_serial_process();
+
+void USART2_IRQHandler(void);
+void DMA1_Stream5_IRQHandler(void);
+
+#endif // RECEIVER_SERIAL_H
@@ -30,8 +30,14 @@
 #include "../lib/inc/peripherals/stm32f4xx_tim.h"
 #include "../lib/inc/peripherals/stm32f4xx_gpio.h"
 #include "../lib/inc/peripherals/stm32f4xx_spi.h"
+#include "../lib/inc/peripherals/stm32f4xx_exti.h"
+#include "../lib/inc/peripherals/stm32f4xx_syscfg.h"
 
+#include "sensors_time.h"
+#include "sensors_calibration.h"
+#include "sensors_filter.h"
 #include "../sensors/inc/lis302dl.h"
+#include "../sensors/inc/l3g4200d.h"
 
 // SPI Interface
 #define SENSORS_SPI                       SPI1
@@ -80,6 +86,59 @@
 #define SENSORS_SPI_INT2_EXTI_PIN_SOURCE  EXTI_PinSource1
 #define SENSORS_SPI_INT2_EXTI_IRQn        EXTI1_IRQn
 
+// FIFO watermark interrupt (INT2) of the external L3G4200D gyro
+#define SENSORS_GYRO_INT2_PIN             GPIO_Pin_5
+#define SENSORS_GYRO_INT2_GPIO_PORT       GPIOE
+#define SENSORS_GYRO_INT2_GPIO_CLK        RCC_AHB1Periph_GPIOE
+#define SENSORS_GYRO_INT2_EXTI_LINE       EXTI_Line5
+#define SENSORS_GYRO_INT2_EXTI_PORT_SOURCE EXTI_PortSourceGPIOE
+#define SENSORS_GYRO_INT2_EXTI_PIN_SOURCE EXTI_PinSource5
+#define SENSORS_GYRO_INT2_EXTI_IRQn       EXTI9_5_IRQn
+
+// The accelerometer runs with 400Hz and signals each sample on INT1,
+// the gyro runs with 800Hz and signals every SENSORS_GYRO_WATERMARK samples on INT2
+#define SENSORS_GYRO_WATERMARK            8
+
+// The 8bit accelerometer samples are low-pass filtered down to 400Hz / SENSORS_ACCEL_DECIMATION
+// (1, 2, 4 or 8); each halving of the rate adds half a bit of resolution
+#ifndef SENSORS_ACCEL_DECIMATION
+#define SENSORS_ACCEL_DECIMATION          4
+#endif
+#define SENSORS_ACCEL_SAMPLE_PERIOD       2500 // Microseconds at 400Hz until the real period is measured
+
+// The gyro is on the SPI bus unless SENSORS_GYRO_BUS_TYPE selects SENSORS_BUS_I2C (make GYRO_BUS=i2c)
+#ifndef SENSORS_GYRO_BUS_TYPE
+#define SENSORS_GYRO_BUS_TYPE             SENSORS_BUS_SPI
+#endif
+#if SENSORS_GYRO_BUS_TYPE == SENSORS_BUS_I2C
+#define SENSORS_GYRO_BUS                  (&L3G4200D_I2cBus)
+#else
+#define SENSORS_GYRO_BUS                  (&L3G4200D_SpiBus)
+#endif
+#define SENSORS_GYRO_SAMPLE_PERIOD        1250 // Microseconds at 800Hz until the real period is measured
+#define SENSORS_GYRO_TEMP_INTERVAL        100  // Watermarks between two temperature reads, once a second
+
+// Long intervals in a row after which the data rate has changed, the period is measured again
+#define SENSORS_TIMING_RESEED             4
+
+/**
+ * Timing of one data ready interrupt line, all times in microseconds
+ */
+typedef struct {
+	u32 samples;    //!< Samples read
+	u32 missed;     //!< Samples lost: gaps between two interrupts longer than one period
+	u32 busy;       //!< Interrupts which found the bus busy and queued their read
+	u32 period;     //!< Averaged time between two interrupts
+	u32 jitter;     //!< Deviation of the last interrupt from the averaged period
+	u32 jitterMax;
+	u32 gaps;       //!< Long intervals in a row, see SENSORS_TIMING_RESEED
+	u32 latency;    //!< Time from the last interrupt until its data was read
+	u32 latencyMax;
+} Sensors_Timing;
+
+extern volatile Sensors_Timing sensors_accel_timing;
+extern volatile Sensors_Timing sensors_gyro_timing;
+
 /**
  * @brief  Initialize all IO ports, timers and interrupts, etc. for all sensors
  * @param  None
@@ -87,4 +146,102 @@
  */
 void sensors_init_gpio();
 
+/**
+ * @brief  Configure the sensors and start the interrupt driven sampling; afterwards only the
+ *         data ready interrupts access the bus, the blocking sensor functions must not be used
+ * @param  None
+ * @retval None
+ */
+void sensors_init();
+
+/**
+ * @brief  Recover the SPI from a stuck transfer and read the sensors whose data ready line
+ *         is still active without a read running, e.g. after an edge was lost.
+ *         Call it from the main loop.
+ * @param  None
+ * @retval None
+ */
+void sensors_update();
+
+/**
+ * @brief  Newest acceleration, low-pass filtered and decimated by SENSORS_ACCEL_DECIMATION
+ * @param  out  Receives X, Y and Z in mg
+ * @retval u32 Number of the sample, increases with every new one
+ */
+u32 sensors_get_acceleration(s32* out);
+
+/**
+ * @brief  Newest angular rate
+ * @param  out  Receives X, Y and Z in millidegrees per second
+ * @retval u32 Number of the sample, increases with every new one
+ */
+u32 sensors_get_rotation(s32* out);
+
+/**
+ * @brief  Acceleration resampled at a given time, e.g. the control loop tick; the samples
+ *         before and after the time are interpolated linearly
+ * @param  time  Time from sensors_time_now() in microseconds
+ * @param  out  Receives X, Y and Z in mg
+ * @retval u8 1 if interpolated, 0 if the newest (or oldest) sample was held
+ */
+u8 sensors_get_acceleration_at(u32 time, s32* out);
+
+/**
+ * @brief  Angular rate resampled at a given time, e.g. the control loop tick; the samples
+ *         before and after the time are interpolated linearly
+ * @param  time  Time from sensors_time_now() in microseconds
+ * @param  out  Receives X, Y and Z in millidegrees per second
+ * @retval u8 1 if interpolated, 0 if the newest (or oldest) sample was held
+ */
+u8 sensors_get_rotation_at(u32 time, s32* out);
+
+/**
+ * @brief  Check if the gyro bias was estimated; this happens as soon as the vehicle was still
+ *         for SENSORS_CAL_STILL_SAMPLES samples and is refined on every later still period
+ * @param  None
+ * @retval u8 1 if calibrated, 0 otherwise
+ */
+u8 sensors_calibrated();
+
+/**
+ * @brief  Tell if the vehicle is on the ground and disarmed; only then the still windows
+ *         update the gyro bias. Grounded after sensors_init().
+ * @param  grounded  1 if on the ground and disarmed, 0 when armed
+ * @retval None
+ */
+void sensors_set_grounded(u8 grounded);
+
+/**
+ * @brief  Set offset (in mg) and scale of the accelerometer axes, e.g. from a six side calibration
+ * @param  calibration  The calibration
+ * @retval None
+ */
+void sensors_set_accel_calibration(const Sensors_AxisCalibration* calibration);
+
+/**
+ * @brief  Set the scale of the gyro axes; their offset comes from the temperature model
+ * @param  scale  Scale of X, Y and Z
+ * @retval None
+ */
+void sensors_set_gyro_scale(const float* scale);
+
+/**
+ * @brief  Temperature of the gyro, relative to an unknown offset
+ * @param  None
+ * @retval s8 Temperature in °C
+ */
+s8 sensors_get_temperature();
+
+/**
+ * @brief  Update the timing of a data ready line with a new interrupt
+ * @param  timing  The timing to update
+ * @param  interval  Time since the last interrupt in microseconds
+ * @param  samples  Samples signaled by one interrupt
+ * @retval None
+ */
+void sensors_timing_update(volatile Sensors_Timing* timing, u32 interval, u32 samples);
+
+void EXTI0_IRQHandler(void);
+void EXTI9_5_IRQHandler(void);
+
 #endif // SENSORS_H
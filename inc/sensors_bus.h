@@ -0,0 +1,93 @@
+/** @file    sensors_bus.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Transfers and transport interface shared by the SPI and the I2C bus, so
+ *           a sensor driver runs on both without knowing which one it is on.
+ * 
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SENSORS_BUS_H
+#define SENSORS_BUS_H
+
+#include "../lib/inc/stm32f4xx.h"
+
+// Status of a transfer
+#define SENSORS_BUS_IDLE                  0
+#define SENSORS_BUS_BUSY                  1
+#define SENSORS_BUS_DONE                  2
+#define SENSORS_BUS_ERROR                 3
+#define SENSORS_BUS_QUEUED                4
+
+// Type of a bus
+#define SENSORS_BUS_SPI                   0
+#define SENSORS_BUS_I2C                   1
+
+// Failed transfers in a row after which a device is degraded, and good ones in a row to be healthy again
+#define SENSORS_BUS_DEGRADED_FAILURES     3
+#define SENSORS_BUS_HEALTHY_TRANSFERS     100
+
+/**
+ * Error counters and state of one device on a bus
+ */
+typedef struct {
+	u32 errors;             //!< Failed attempts, bus errors and timeouts
+	u32 timeouts;           //!< Attempts which did not finish in time
+	u32 retries;            //!< Attempts repeated after a recovery
+	u32 failures;           //!< Transfers which failed after all retries
+	u32 recoveries;         //!< Reinitializations of the bus
+	u32 recoveryTime;       //!< Microseconds the last recovery took
+	u32 recoveryTimeMax;
+	u16 failedInRow;        //!< Transfers failed one after the other
+	u16 goodInRow;          //!< Transfers finished one after the other
+	volatile u8 degraded;   //!< Set after SENSORS_BUS_DEGRADED_FAILURES failures in a row
+} Sensors_BusHealth;
+
+/**
+ * One transfer to a register of a device; the first byte of tx is the register address.
+ * 
+ * SPI: full duplex, tx and rx may point to the same buffer, every byte is sent before its
+ *      answer is received. Without tx zeros are sent, without rx the answer is dropped.
+ * I2C: without rx all bytes of tx are written. With rx the register address is written and
+ *      after a repeated start length - 1 bytes are read into rx[1..], rx[0] is not touched.
+ * 
+ * So a driver uses the same buffer layout on both buses: the address at [0], the data behind.
+ */
+typedef struct Sensors_Transfer {
+	const void* device;     //!< Sensors_SpiDevice or Sensors_I2cDevice, depends on the bus
+	const u8* tx;
+	u8* rx;
+	u16 length;
+	void (*callback)(struct Sensors_Transfer* transfer); //!< Called from the bus interrupt when finished, may be 0
+	void* context;          //!< Free for the owner of the transfer
+	volatile u8 status;     //!< SENSORS_BUS_IDLE, _QUEUED, _BUSY, _DONE or _ERROR
+	struct Sensors_Transfer* next; //!< Used by the queue
+} Sensors_Transfer;
+
+/**
+ * A device on a bus and the functions to run transfers to it
+ */
+typedef struct {
+	u8 type;                //!< SENSORS_BUS_SPI or SENSORS_BUS_I2C, the register address flags differ
+	const void* device;     //!< Set into every transfer
+	u8 (*start)(Sensors_Transfer* transfer);             //!< Start or queue, 1 on success
+	u8 (*busy)(void);                                     //!< 1 while a transfer runs on the bus
+	u8 (*wait)(Sensors_Transfer* transfer, u32 timeout);  //!< Wait and return the status
+} Sensors_Bus;
+
+#endif // SENSORS_BUS_H
@@ -0,0 +1,133 @@
+/** @file    sensors_calibration.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Sensor calibration: still detection by running variance, per axis offset
+ *           and scale and a linear temperature model of the gyro bias which is
+ *           refined every time the vehicle is still.
+ * 
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SENSORS_CALIBRATION_H
+#define SENSORS_CALIBRATION_H
+
+#include "../lib/inc/stm32f4xx.h"
+
+// Samples of one still window: 0.5s of the gyro at 800Hz. The bias is estimated as soon
+// as one window is still, there is no fixed startup delay.
+#define SENSORS_CAL_STILL_SAMPLES         400
+
+// After this many samples a window whose variance is too high is started over
+#define SENSORS_CAL_MIN_SAMPLES           32
+
+// Highest variance of a still vehicle per axis: (0.5dps)² for the gyro, (40mg)² for the accelerometer
+#define SENSORS_CAL_GYRO_VARIANCE         250000.0f
+#define SENSORS_CAL_ACCEL_VARIANCE        1600.0f
+
+// Highest mean angular rate of a still window in mdps: the first one may be anywhere within the
+// zero rate level of the L3G4200D (±75dps at 2000dps), later ones only this close to the model.
+// A slow and steady rotation is just as quiet as a still vehicle and must not become the bias.
+#define SENSORS_CAL_GYRO_BIAS             75000.0f
+#define SENSORS_CAL_GYRO_DRIFT            5000.0f
+
+// Weight of the older bias estimates for each new one, and the lowest temperature
+// variance in °C² from which on the slope of the bias is estimated
+#define SENSORS_CAL_TEMP_FORGET           0.95f
+#define SENSORS_CAL_TEMP_SPREAD           4.0f
+
+/**
+ * Running mean and variance of three axes (Welford)
+ */
+typedef struct {
+	u32 count;
+	float mean[3];
+	float m2[3];     //!< Sum of the squared differences from the mean
+} Sensors_Variance;
+
+/**
+ * Calibration of three axes: out = (raw - offset) * scale
+ */
+typedef struct {
+	float offset[3];
+	float scale[3];
+} Sensors_AxisCalibration;
+
+/**
+ * Bias over temperature: bias(T) = mean(bias) + slope * (T - mean(T)),
+ * the means are exponentially weighted sums of the still window estimates
+ */
+typedef struct {
+	float weight;     //!< Sum of the weights, 0 without any estimate
+	float temp;       //!< Weighted sum of T
+	float temp2;      //!< Weighted sum of T²
+	float bias[3];    //!< Weighted sum of the bias
+	float tempBias[3];//!< Weighted sum of T * bias
+	float slope[3];   //!< Bias change per °C
+} Sensors_TempModel;
+
+/**
+ * @brief  Start a new window
+ * @param  variance  The window
+ * @retval None
+ */
+void sensors_variance_reset(Sensors_Variance* variance);
+
+/**
+ * @brief  Add a sample to the window
+ * @param  variance  The window
+ * @param  value  X, Y and Z
+ * @retval None
+ */
+void sensors_variance_add(Sensors_Variance* variance, const s32* value);
+
+/**
+ * @brief  Check if the sample variance of all axes is at most the limit
+ * @param  variance  The window
+ * @param  limit  Highest variance
+ * @retval u8 1 if still, 0 if moving or less than two samples are in the window
+ */
+u8 sensors_variance_still(const Sensors_Variance* variance, float limit);
+
+/**
+ * @brief  Apply a calibration
+ * @param  calibration  Offset and scale
+ * @param  raw  X, Y and Z
+ * @param  out  Receives the calibrated X, Y and Z
+ * @retval None
+ */
+void sensors_calibration_apply(const Sensors_AxisCalibration* calibration, const s32* raw, s32* out);
+
+/**
+ * @brief  Add the bias estimated at a temperature to the model
+ * @param  model  The model
+ * @param  temperature  Temperature in °C
+ * @param  bias  Bias of X, Y and Z
+ * @retval None
+ */
+void sensors_temp_model_update(Sensors_TempModel* model, float temperature, const float* bias);
+
+/**
+ * @brief  Bias of the model at a temperature
+ * @param  model  The model
+ * @param  temperature  Temperature in °C
+ * @param  bias  Receives the bias of X, Y and Z, zero without any estimate
+ * @retval None
+ */
+void sensors_temp_model_bias(const Sensors_TempModel* model, float temperature, float* bias);
+
+#endif // SENSORS_CALIBRATION_H
@@ -0,0 +1,76 @@
+/** @file    sensors_filter.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Decimating FIR low-pass filter for the accelerometer: it runs at its highest
+ *           data rate and every output averages several 8bit samples, which removes the
+ *           aliases above the output rate and adds resolution below one digit.
+ * 
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SENSORS_FILTER_H
+#define SENSORS_FILTER_H
+
+#include "../lib/inc/stm32f4xx.h"
+
+// Longest filter, the one for a decimation by 8; filters exist for the factors 1, 2, 4 and 8
+#define SENSORS_FILTER_MAX_TAPS           47
+
+/**
+ * A FIR filter which keeps every factor-th output, laid out like arm_fir_decimate_instance_q15
+ * but for three axes which get one sample after the other. The output is only computed
+ * when it is kept, so one output costs taps multiply-accumulates per axis.
+ */
+typedef struct {
+	u8 factor;              //!< Decimation factor M, 1 passes every sample through
+	u8 taps;                //!< Number of coefficients, 6 * M - 1
+	u8 phase;               //!< Samples since the last output
+	u8 index;               //!< Position of the newest sample in the delay line
+	const s16* coeffs;      //!< q15 coefficients with a sum of 1.0
+	s16 state[3][2 * SENSORS_FILTER_MAX_TAPS]; //!< Delay line of each axis, stored twice so it is read without a wrap
+} Sensors_Decimator;
+
+/**
+ * @brief  Select the low-pass filter for a decimation factor and clear the delay line.
+ *         The filter passes up to a quarter of the output rate and damps everything
+ *         from three quarters of the output rate on by at least 38dB.
+ * @param  decimator  The filter
+ * @param  factor  1, 2, 4 or 8
+ * @retval u8 1 on success, 0 if there is no filter for the factor
+ */
+u8 sensors_decimator_init(Sensors_Decimator* decimator, u8 factor);
+
+/**
+ * @brief  Add a sample and compute the output after every factor-th sample. Samples are
+ *         saturated to the range of s16, the output is rounded.
+ * @param  decimator  The filter
+ * @param  in  X, Y and Z
+ * @param  out  Receives the filtered X, Y and Z, may be the same as in
+ * @retval u8 1 if out was written, 0 otherwise
+ */
+u8 sensors_decimator_push(Sensors_Decimator* decimator, const s32* in, s32* out);
+
+/**
+ * @brief  Delay of the output behind the newest sample, half the filter length
+ * @param  decimator  The filter
+ * @param  period  Time between two input samples
+ * @retval u32 Delay in the unit of period
+ */
+u32 sensors_decimator_delay(const Sensors_Decimator* decimator, u32 period);
+
+#endif // SENSORS_FILTER_H
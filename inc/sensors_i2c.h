@@ -0,0 +1,143 @@
+/** @file    sensors_i2c.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Non-blocking I2C master for the sensors. Transfers are queued like on the
+ *           SPI bus and run as a state machine in the I2C event interrupt; register
+ *           reads use a repeated start and receive their data by DMA. A bus held low
+ *           by a slave is freed by clocking SCL.
+ * 
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SENSORS_I2C_H
+#define SENSORS_I2C_H
+
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/misc.h"
+#include "../lib/inc/peripherals/stm32f4xx_dma.h"
+#include "../lib/inc/peripherals/stm32f4xx_gpio.h"
+#include "../lib/inc/peripherals/stm32f4xx_i2c.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "sensors_bus.h"
+
+// I2C1 on PB6 (SCL) and PB9 (SDA), the discovery board has pull-ups there for the audio DAC
+#define SENSORS_I2C                       I2C1
+#define SENSORS_I2C_CLK                   RCC_APB1Periph_I2C1
+#define SENSORS_I2C_SPEED                 400000
+#define SENSORS_I2C_GPIO_PORT             GPIOB
+#define SENSORS_I2C_GPIO_CLK              RCC_AHB1Periph_GPIOB
+#define SENSORS_I2C_SCL_PIN               GPIO_Pin_6
+#define SENSORS_I2C_SCL_SOURCE            GPIO_PinSource6
+#define SENSORS_I2C_SDA_PIN               GPIO_Pin_9
+#define SENSORS_I2C_SDA_SOURCE            GPIO_PinSource9
+#define SENSORS_I2C_AF                    GPIO_AF_I2C1
+#define SENSORS_I2C_EV_IRQn               I2C1_EV_IRQn
+#define SENSORS_I2C_ER_IRQn               I2C1_ER_IRQn
+
+// I2C1 RX is served by DMA1 Stream0 or Stream5 on Channel1; Stream5 belongs to the capture
+// receiver and DShot. Only reads use the DMA, the few bytes of a write are sent from the interrupt.
+#define SENSORS_I2C_DMA_CLK               RCC_AHB1Periph_DMA1
+#define SENSORS_I2C_DMA_CHANNEL           DMA_Channel_1
+#define SENSORS_I2C_DMA_RX_STREAM         DMA1_Stream0
+#define SENSORS_I2C_DMA_RX_FLAGS          (DMA_FLAG_TCIF0 | DMA_FLAG_HTIF0 | DMA_FLAG_TEIF0 | DMA_FLAG_DMEIF0 | DMA_FLAG_FEIF0)
+#define SENSORS_I2C_DMA_RX_IRQn           DMA1_Stream0_IRQn
+
+// A slave stuck in the middle of a byte releases SDA after at most nine clocks
+#define SENSORS_I2C_RECOVERY_CLOCKS       9
+
+// A transfer which does not finish in SENSORS_I2C_TIMEOUT(length) microseconds has failed.
+// One byte with its acknowledge takes 22.5µs at 400kHz, the base covers both addresses, the
+// repeated start and the interrupt latency. After a failure, a timeout as well as a NACK or
+// bus error, the bus is recovered and the transfer repeated up to SENSORS_I2C_RETRIES times
+// before it ends with SENSORS_BUS_ERROR.
+#define SENSORS_I2C_TIMEOUT_BASE          200
+#define SENSORS_I2C_TIMEOUT_BYTE          25
+#define SENSORS_I2C_TIMEOUT(length)       (SENSORS_I2C_TIMEOUT_BASE + (u32)(length) * SENSORS_I2C_TIMEOUT_BYTE)
+#define SENSORS_I2C_RETRIES               2
+
+// Errors which end a transfer
+#define SENSORS_I2C_SR1_ERRORS            (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR | I2C_SR1_TIMEOUT)
+
+/**
+ * One device on the bus
+ */
+typedef struct {
+	u8 address;             //!< 7bit slave address
+	Sensors_BusHealth* health;  //!< Error counters of the device
+} Sensors_I2cDevice;
+
+// Finished and failed transfers, transfers which had to wait in the queue and bus recoveries
+extern volatile u32 sensors_i2c_transfers;
+extern volatile u32 sensors_i2c_errors;
+extern volatile u32 sensors_i2c_queued;
+extern volatile u32 sensors_i2c_recoveries;
+
+/**
+ * @brief  Configure the pins, the I2C, its DMA stream and interrupts and free the bus
+ * @param  None
+ * @retval None
+ */
+void sensors_i2c_init();
+
+/**
+ * @brief  Start a transfer or queue it behind the running ones and return immediately.
+ *         Can be called from any interrupt and the main loop.
+ * @param  transfer  The transfer, it has to stay valid until its status is SENSORS_BUS_DONE or _ERROR
+ * @retval u8 1 if the transfer was started or queued, 0 if it is still pending or empty
+ */
+u8 sensors_i2c_start(Sensors_Transfer* transfer);
+
+/**
+ * @brief  Check if a transfer is running on the bus
+ * @param  None
+ * @retval u8 1 while a transfer is running
+ */
+u8 sensors_i2c_busy();
+
+/**
+ * @brief  Wait until a transfer is finished; on a timeout the running transfer is aborted
+ *         with an error without a retry and the bus is recovered
+ * @param  transfer  The transfer to wait for
+ * @param  timeout  Number of polls before giving up
+ * @retval u8 Status of the transfer
+ */
+u8 sensors_i2c_wait(Sensors_Transfer* transfer, u32 timeout);
+
+/**
+ * @brief  Check if the running transfer is overdue, e.g. SCL is stretched forever or an event
+ *         got lost. The bus is recovered and a stuck transfer repeated or ended with
+ *         SENSORS_BUS_ERROR, then the next queued one is started. Has to be called once
+ *         per control loop.
+ * @param  None
+ * @retval u8 1 if the bus had to be recovered
+ */
+u8 sensors_i2c_check();
+
+/**
+ * @brief  Free a bus which is held by a slave: clock SCL until SDA is released, send a stop
+ *         condition and reset the I2C. The running transfer, if any, has to be finished before.
+ * @param  None
+ * @retval None
+ */
+void sensors_i2c_recover();
+
+void I2C1_EV_IRQHandler(void);
+void I2C1_ER_IRQHandler(void);
+void DMA1_Stream0_IRQHandler(void);
+
+#endif // SENSORS_I2C_H
@@ -0,0 +1,126 @@
+/** @file    sensors_spi.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Non-blocking SPI bus manager for the sensors. Transfers to any device on
+ *           the bus are queued and run back to back over DMA, each one selects its chip
+ *           with its own clock and mode; the caller is told by a status flag and an
+ *           optional callback.
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SENSORS_SPI_H
+#define SENSORS_SPI_H
+
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/misc.h"
+#include "../lib/inc/peripherals/stm32f4xx_dma.h"
+#include "../lib/inc/peripherals/stm32f4xx_gpio.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "../lib/inc/peripherals/stm32f4xx_spi.h"
+#include "sensors_bus.h"
+
+// SPI1 requests are only served by DMA2: RX on Stream0 and TX on Stream5, both Channel3.
+// Stream3 and Stream2 would also work but are used by the BSRR servo and capture receiver modes.
+#define SENSORS_SPI_DMA_CLK               RCC_AHB1Periph_DMA2
+#define SENSORS_SPI_DMA_CHANNEL           DMA_Channel_3
+#define SENSORS_SPI_DMA_RX_STREAM         DMA2_Stream0
+#define SENSORS_SPI_DMA_RX_FLAGS          (DMA_FLAG_TCIF0 | DMA_FLAG_HTIF0 | DMA_FLAG_TEIF0 | DMA_FLAG_DMEIF0 | DMA_FLAG_FEIF0)
+#define SENSORS_SPI_DMA_RX_IRQn           DMA2_Stream0_IRQn
+#define SENSORS_SPI_DMA_TX_STREAM         DMA2_Stream5
+#define SENSORS_SPI_DMA_TX_FLAGS          (DMA_FLAG_TCIF5 | DMA_FLAG_HTIF5 | DMA_FLAG_TEIF5 | DMA_FLAG_DMEIF5 | DMA_FLAG_FEIF5)
+
+// Bits of SPI->CR1 a device can choose
+#define SENSORS_SPI_CR1_DEVICE            (SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_BR)
+
+// A transfer which does not finish in SENSORS_SPI_TIMEOUT(length) microseconds has failed.
+// One byte takes 1.6µs at the slowest device clock of 5.25MHz, the base covers the latency
+// of the DMA interrupt. After a failure the bus is reinitialized and the transfer repeated
+// up to SENSORS_SPI_RETRIES times before it ends with SENSORS_BUS_ERROR.
+#define SENSORS_SPI_TIMEOUT_BASE          100
+#define SENSORS_SPI_TIMEOUT_BYTE          2
+#define SENSORS_SPI_TIMEOUT(length)       (SENSORS_SPI_TIMEOUT_BASE + (u32)(length) * SENSORS_SPI_TIMEOUT_BYTE)
+#define SENSORS_SPI_RETRIES               2
+
+/**
+ * One device on the bus: its chip select and the clock it runs with
+ */
+typedef struct {
+	GPIO_TypeDef* csPort;   //!< Chip select, low while a transfer to the device runs
+	u16 csPin;
+	u16 mode;               //!< SPI_CPOL_* | SPI_CPHA_*
+	u16 prescaler;          //!< SPI_BaudRatePrescaler_*, the fastest one the device supports
+	Sensors_BusHealth* health;  //!< Error counters of the device
+} Sensors_SpiDevice;
+
+// Finished and failed transfers, transfers which had to wait in the queue
+extern volatile u32 sensors_spi_transfers;
+extern volatile u32 sensors_spi_errors;
+extern volatile u32 sensors_spi_queued;
+
+/**
+ * @brief  Configure SENSORS_SPI as master, its DMA streams and interrupt; the clock and the
+ *         pins have to be initialized before by sensors_init_gpio()
+ * @param  None
+ * @retval None
+ */
+void sensors_spi_init();
+
+/**
+ * @brief  Configure the chip select of a device as output and deselect it
+ * @param  device  The device
+ * @retval None
+ */
+void sensors_spi_device_init(const Sensors_SpiDevice* device);
+
+/**
+ * @brief  Start a transfer or queue it behind the running ones and return immediately.
+ *         Queued transfers are started one after the other from the DMA interrupt, each
+ *         with the clock of its device. Can be called from any interrupt and the main loop.
+ * @param  transfer  The transfer, it has to stay valid until its status is SENSORS_BUS_DONE or _ERROR
+ * @retval u8 1 if the transfer was started or queued, 0 if it is still pending or empty
+ */
+u8 sensors_spi_start(Sensors_Transfer* transfer);
+
+/**
+ * @brief  Check if a transfer is running on the bus
+ * @param  None
+ * @retval u8 1 while a transfer is running
+ */
+u8 sensors_spi_busy();
+
+/**
+ * @brief  Wait until a transfer is finished. A stuck bus is recovered while waiting, so the
+ *         transfer normally ends with SENSORS_BUS_DONE or _ERROR.
+ * @param  transfer  The transfer to wait for
+ * @param  timeout  Number of polls before giving up
+ * @retval u8 Status of the transfer, SENSORS_BUS_BUSY or _QUEUED on a timeout
+ */
+u8 sensors_spi_wait(Sensors_Transfer* transfer, u32 timeout);
+
+/**
+ * @brief  Check if the running transfer is overdue. A stuck transfer deselects its device,
+ *         the SPI is reset by SPI_I2S_DeInit(), configured again and the transfer repeated
+ *         or ended with SENSORS_BUS_ERROR. Has to be called once per control loop.
+ * @param  None
+ * @retval u8 1 if the bus had to be recovered
+ */
+u8 sensors_spi_check();
+
+void DMA2_Stream0_IRQHandler(void);
+
+#endif // SENSORS_SPI_H
@@ -0,0 +1,84 @@
+/** @file    sensors_time.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Free running microsecond timebase and timestamped sample streams. Every
+ *           sample is stamped at its data ready edge, so streams with different
+ *           output data rates can be resampled onto the same control loop tick.
+ * 
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SENSORS_TIME_H
+#define SENSORS_TIME_H
+
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "../lib/inc/peripherals/stm32f4xx_tim.h"
+
+// TIM5 is the second 32bit timer and not used by anything else; TIM2 belongs to the receiver.
+// It counts microseconds from APB1 with SystemCoreClock / 2 and wraps after 71 minutes.
+#define SENSORS_TIME_TIM                  TIM5
+#define SENSORS_TIME_TIM_CLK              RCC_APB1Periph_TIM5
+#define SENSORS_TIME_FREQUENCY            1000000
+
+// Samples one stream remembers; a power of two which holds at least two gyro FIFO watermarks
+#define SENSORS_STREAM_SIZE               32
+
+/**
+ * Ring of timestamped samples with three axes
+ */
+typedef struct {
+	u32 time[SENSORS_STREAM_SIZE];      //!< Microseconds of the data ready edge
+	s32 value[SENSORS_STREAM_SIZE][3];
+	volatile u32 count;                 //!< Samples pushed so far, the newest is at (count - 1)
+} Sensors_Stream;
+
+/**
+ * @brief  Start the microsecond timebase
+ * @param  None
+ * @retval None
+ */
+void sensors_time_init();
+
+/**
+ * @brief  Current time of the timebase
+ * @param  None
+ * @retval u32 Microseconds since sensors_time_init()
+ */
+u32 sensors_time_now();
+
+/**
+ * @brief  Append a sample to a stream, the oldest one is overwritten
+ * @param  stream  The stream
+ * @param  time  Timestamp of the sample in microseconds
+ * @param  value  X, Y and Z of the sample
+ * @retval None
+ */
+void sensors_stream_push(Sensors_Stream* stream, u32 time, const s32* value);
+
+/**
+ * @brief  Linear interpolation of a stream at the given time. A time after the newest
+ *         sample gets the newest sample, one before the oldest gets the oldest sample.
+ * @param  stream  The stream
+ * @param  time  Time in microseconds to resample at
+ * @param  out  Receives X, Y and Z
+ * @retval u8 1 if the time lies between two samples, 0 if a sample was held or the stream is empty
+ */
+u8 sensors_stream_sample(const Sensors_Stream* stream, u32 time, s32* out);
+
+#endif // SENSORS_TIME_H
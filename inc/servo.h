@@ -31,6 +31,33 @@
 #include "../lib/inc/peripherals/stm32f4xx_tim.h"
 #include "../lib/inc/peripherals/misc.h" // High level functions for NVIC and SysTick (add-on to CMSIS functions)
 
+// Servo output modes:
+// SOFT switches the servo ports in TIM3_IRQHandler every tick,
+// PWM generates the pulses with the TIM3 output compare channels without any interrupt,
+// DSHOT sends digital DShot frames to the ESCs on the same TIM3 channels,
+// ONESHOT sends one OneShot125 or Multishot pulse with every servo_commit(),
+// BSRR streams a precomputed waveform by DMA into the servo port, up to 16 servos.
+// Select the mode with SERVO_MODE=... on the make command line.
+#define SERVO_MODE_SOFT 0
+#define SERVO_MODE_PWM 1
+#define SERVO_MODE_DSHOT 2
+#define SERVO_MODE_ONESHOT 3
+#define SERVO_MODE_BSRR 4
+#ifndef SERVO_MODE
+#define SERVO_MODE SERVO_MODE_SOFT
+#endif // SERVO_MODE
+
+// Only the BSRR mode can drive more than the four servos, select them with SERVO_BSRR_CHANNELS
+#if (SERVO_MODE == SERVO_MODE_BSRR) && defined(SERVO_BSRR_CHANNELS)
+#define SERVO_CHANNELS SERVO_BSRR_CHANNELS
+#else
+#define SERVO_CHANNELS 4
+#endif
+
+// Servo pulses are between 1ms and 2ms
+#define SERVO_PULSE_MIN 1000
+#define SERVO_PULSE_MAX 2000
+
 // Servo ports
 #define SERVO1 GPIO_Pin_0
 #define SERVO2 GPIO_Pin_1
@@ -39,6 +66,16 @@
 #define SERVO_REGISTER GPIOD
 #define SERVO_PORTS (SERVO1 | SERVO2 | SERVO3 | SERVO4)
 
+// Timer outputs of all modes except SOFT:
+// The servo ports PD0-PD3 have no timer output, TIM3 CH1-4 is routed to PC6, PC7, PB0 and PB1.
+#define SERVO_OUT1 GPIO_Pin_6
+#define SERVO_OUT2 GPIO_Pin_7
+#define SERVO_OUT3 GPIO_Pin_0
+#define SERVO_OUT4 GPIO_Pin_1
+#define SERVO_OUT_REGISTER_C GPIOC
+#define SERVO_OUT_REGISTER_B GPIOB
+#define SERVO_OUT_AF GPIO_AF_TIM3
+
 // Servo resolution:
 // The servo needs a signal from 1-2 ms and a beginning high of 1ms
 // The timer is running on 1MHz; a persiod of 20000 is a tick every 20µs
@@ -48,13 +85,59 @@
 #define SERVO_TIM_COUNTER 1000
 #define SERVO_TIM_MICROSECOND 100
 
-extern volatile float servo_angle[4];
-extern volatile u16 servo_period[4];
+// Highest position servo_set_pos() accepts; in PWM mode each step is one microsecond,
+// in DShot mode one step of the 2000 throttle steps, in OneShot mode a 1/1000 of the range,
+// in BSRR mode one microsecond rounded down to SERVO_BSRR_RESOLUTION
+#if SERVO_MODE == SERVO_MODE_SOFT
+#define SERVO_POSITION_MAX (SERVO_TIM_COUNTER - 2)
+#elif SERVO_MODE == SERVO_MODE_DSHOT
+#define SERVO_POSITION_MAX 2000
+#else
+#define SERVO_POSITION_MAX (SERVO_PULSE_MAX - SERVO_PULSE_MIN)
+#endif
+
+#if SERVO_MODE == SERVO_MODE_PWM
+#include "servo_pwm.h"
+#elif SERVO_MODE == SERVO_MODE_DSHOT
+#include "servo_dshot.h"
+#elif SERVO_MODE == SERVO_MODE_ONESHOT
+#include "servo_oneshot.h"
+#elif SERVO_MODE == SERVO_MODE_BSRR
+#include "servo_bsrr.h"
+#endif
+
+extern volatile float servo_angle[SERVO_CHANNELS];
+extern volatile u16 servo_period[SERVO_CHANNELS];
 extern volatile u16 servo_count;
 
+// Commits replaced by a newer one before they were output, and frames which started
+// without a new commit and repeated the last positions (SOFT mode)
+extern volatile u32 servo_commit_skipped;
+extern volatile u32 servo_commit_late;
+
 void servo_gpio_init();
 void servo_init();
+
+/**
+ * @brief  Set the position of one servo; commits all positions with the new one
+ * @param  num  Number of the servo
+ * @param  position  Position 0..SERVO_POSITION_MAX
+ * @retval None
+ */
 void servo_set_pos(u16 num, u16 position);
+
+/**
+ * @brief  Set the positions of all servos at once, no output frame mixes old and new ones.
+ *         In SOFT mode the positions are staged and published at the next frame start;
+ *         in PWM mode they are switched together with the next timer update; in DShot
+ *         mode the frames of all motors are sent in one burst; in OneShot mode this
+ *         starts one pulse per motor; in BSRR mode the waveform is switched at the
+ *         next frame start. Call it once per control loop.
+ * @param  position  SERVO_CHANNELS positions 0..SERVO_POSITION_MAX
+ * @retval None
+ */
+void servo_commit(const u16* position);
+
 void TIM3_IRQHandler(void);
 
 #endif // SERVO_H
\ No newline at end of file
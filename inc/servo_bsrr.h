@@ -0,0 +1,88 @@
+/** @file    servo_bsrr.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Software PWM on any pin of the servo port without CPU load. A precomputed
+ *           waveform of BSRR words is written by timer-triggered DMA into the port,
+ *           the CPU only updates the waveform when a position changes.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SERVO_BSRR_H
+#define SERVO_BSRR_H
+
+// Include STM32F4x libraries we need here
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/stm32f4xx_dma.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "../lib/inc/peripherals/stm32f4xx_tim.h"
+#include "../lib/inc/peripherals/misc.h"
+
+// Output pins:
+// Servo n is on pin (SERVO_BSRR_SHIFT + n) of SERVO_REGISTER, up to 12 servos on PD0-PD11.
+// On the Discovery board PD4 and PD5 are used by the audio DAC and USB, PD12-PD15 drive the LEDs.
+#ifndef SERVO_BSRR_SHIFT
+#define SERVO_BSRR_SHIFT 0
+#endif // SERVO_BSRR_SHIFT
+#define SERVO_BSRR_PINS ((u16)(((1UL << SERVO_CHANNELS) - 1) << SERVO_BSRR_SHIFT))
+
+// Waveform resolution in microseconds and the frame rate in Hz.
+// Only the GPIO ports on AHB1 are reachable by DMA2, so the steps are clocked by TIM8
+// (CH2 compare request on DMA2 Stream3 Channel7); TIM3 restarts the waveform every frame.
+#ifndef SERVO_BSRR_RESOLUTION
+#define SERVO_BSRR_RESOLUTION 1
+#endif // SERVO_BSRR_RESOLUTION
+#ifndef SERVO_BSRR_RATE
+#define SERVO_BSRR_RATE 50
+#endif // SERVO_BSRR_RATE
+#define SERVO_BSRR_TIM_FREQUENCY 1000000
+
+// One BSRR word per step up to the longest pulse: step 0 sets all pins, the step at the
+// end of each pulse resets its pin, all other words are zero and do not change the port.
+#define SERVO_BSRR_STEPS (SERVO_PULSE_MAX / SERVO_BSRR_RESOLUTION + 1)
+
+/**
+ * @brief  Configure TIM8 and the DMA stream for the waveform and TIM3 for the frame start
+ * @param  None
+ * @retval None
+ */
+void servo_bsrr_init();
+
+/**
+ * @brief  Set the positions of the servos; the waveform is only rebuilt if one of them
+ *         changed and is output from the next frame on.
+ * @param  first  First servo to set
+ * @param  count  Number of servos
+ * @param  position  Positions 0..SERVO_POSITION_MAX
+ * @retval None
+ */
+void servo_bsrr_write(u16 first, u16 count, const u16* position);
+
+/**
+ * @brief  Move the pulse ends in a waveform from the old to the new widths
+ *         The waveform has to be built with the old widths before; a zeroed waveform
+ *         with all widths 0 is a valid start. Widths are limited to the waveform length.
+ * @param  wave  SERVO_BSRR_STEPS BSRR words, step 0 has to set all pins
+ * @param  old  Pulse widths in steps the waveform holds, updated with the new widths
+ * @param  width  New pulse widths in steps
+ * @param  count  Number of servos
+ * @param  shift  Pin of the first servo
+ * @retval None
+ */
+void servo_bsrr_build(u32* wave, u16* old, const u16* width, u8 count, u8 shift);
+
+#endif // SERVO_BSRR_H
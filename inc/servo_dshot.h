@@ -0,0 +1,203 @@
+/** @file    servo_dshot.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   DShot150/300/600 digital ESC protocol. The frames of all four motors
+ *           are encoded into compare values and streamed by one DMA burst per bit
+ *           into the TIM3 compare registers.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SERVO_DSHOT_H
+#define SERVO_DSHOT_H
+
+// Include STM32F4x libraries we need here
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/stm32f4xx_dma.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "../lib/inc/peripherals/stm32f4xx_tim.h"
+
+// Bitrate in kbit/s: 150, 300 or 600
+#ifndef SERVO_DSHOT_RATE
+#define SERVO_DSHOT_RATE 600
+#endif // SERVO_DSHOT_RATE
+
+// TIM3 runs with the APB1 timer clock without prescaler, one timer period is one bit.
+// A one is high for 3/4 of the bit, a zero for 3/8.
+#define SERVO_DSHOT_TIM_FREQUENCY (SystemCoreClock / 2)
+#define SERVO_DSHOT_BIT_PERIOD (SERVO_DSHOT_TIM_FREQUENCY / (SERVO_DSHOT_RATE * 1000))
+#define SERVO_DSHOT_BIT_ONE (SERVO_DSHOT_BIT_PERIOD * 3 / 4)
+#define SERVO_DSHOT_BIT_ZERO (SERVO_DSHOT_BIT_PERIOD * 3 / 8)
+
+// The update event of TIM3 requests DMA1 Stream2 Channel5, which writes CCR1-CCR4 in one
+// burst through TIM3->DMAR. Each frame is followed by two zero slots so the lines stay low.
+#define SERVO_DSHOT_DMA_STREAM DMA1_Stream2
+#define SERVO_DSHOT_DMA_CHANNEL DMA_Channel_5
+#define SERVO_DSHOT_DMA_FLAGS (DMA_FLAG_TCIF2 | DMA_FLAG_HTIF2 | DMA_FLAG_TEIF2 | DMA_FLAG_DMEIF2 | DMA_FLAG_FEIF2)
+#define SERVO_DSHOT_FRAME_BITS 16
+#define SERVO_DSHOT_SLOTS (SERVO_DSHOT_FRAME_BITS + 2)
+#define SERVO_DSHOT_BUFFER (SERVO_DSHOT_SLOTS * SERVO_CHANNELS)
+
+// Bidirectional DShot: The lines are inverted and after each frame the ESCs answer on the
+// same line with their eRPM. TIM3 switches to input capture on both edges and the edges of
+// each motor are copied by its own DMA stream: CH1-CH4 on DMA1 Stream4, 5, 7 and 2, Channel5.
+// Stream5 and Stream7 are also used by the serial and the capture receiver.
+#ifndef SERVO_DSHOT_BIDIR
+#define SERVO_DSHOT_BIDIR 0
+#endif // SERVO_DSHOT_BIDIR
+
+// The reply is GCR encoded with 5/4 of the bitrate: 21 bits which give at most 21 edges
+#define SERVO_DSHOT_GCR_BIT (SERVO_DSHOT_BIT_PERIOD * 4 / 5)
+#define SERVO_DSHOT_GCR_BITS 21
+#define SERVO_DSHOT_EDGES 22
+#define SERVO_DSHOT_TELEMETRY_INVALID 0xFFFF
+
+// Number of magnet poles of the motors, the eRPM is the RPM times half of the poles
+#ifndef SERVO_MOTOR_POLES
+#define SERVO_MOTOR_POLES 14
+#endif // SERVO_MOTOR_POLES
+
+// Frame values: 0 stops the motor, 1-47 are commands and 48-2047 the throttle
+#define SERVO_DSHOT_THROTTLE_MIN 48
+#define SERVO_DSHOT_THROTTLE_MAX 2047
+
+// Commands; only accepted by the ESC while the motor is stopped
+#define SERVO_DSHOT_CMD_MOTOR_STOP 0
+#define SERVO_DSHOT_CMD_BEEP1 1
+#define SERVO_DSHOT_CMD_BEEP2 2
+#define SERVO_DSHOT_CMD_BEEP3 3
+#define SERVO_DSHOT_CMD_BEEP4 4
+#define SERVO_DSHOT_CMD_BEEP5 5
+#define SERVO_DSHOT_CMD_ESC_INFO 6
+#define SERVO_DSHOT_CMD_SPIN_DIRECTION_1 7
+#define SERVO_DSHOT_CMD_SPIN_DIRECTION_2 8
+#define SERVO_DSHOT_CMD_3D_MODE_OFF 9
+#define SERVO_DSHOT_CMD_3D_MODE_ON 10
+#define SERVO_DSHOT_CMD_SETTINGS_REQUEST 11
+#define SERVO_DSHOT_CMD_SAVE_SETTINGS 12
+#define SERVO_DSHOT_CMD_SPIN_DIRECTION_NORMAL 20
+#define SERVO_DSHOT_CMD_SPIN_DIRECTION_REVERSED 21
+#define SERVO_DSHOT_CMD_MAX 47
+
+// Settings commands must be received several times in a row before the ESC applies them
+#define SERVO_DSHOT_CMD_REPEAT 6
+
+// Number of updates dropped because the previous frame was still sent
+extern volatile u32 servo_dshot_skipped;
+
+// Core clock cycles the last encoding of all four frames took, see receiver_now()
+extern volatile u32 servo_dshot_encode_cycles;
+
+// Valid and invalid eRPM replies per motor in bidirectional mode
+extern volatile u32 servo_dshot_telemetry_frames[SERVO_CHANNELS];
+extern volatile u32 servo_dshot_telemetry_errors[SERVO_CHANNELS];
+
+/**
+ * @brief  Start TIM3 with the bit period and prepare the burst DMA
+ * @param  None
+ * @retval None
+ */
+void servo_dshot_init();
+
+/**
+ * @brief  Encode one frame for each motor and send them; a pending command of
+ *         servo_dshot_command() is sent instead of a stop, a throttle cancels it
+ * @param  value  SERVO_CHANNELS frame values: 0 or SERVO_DSHOT_THROTTLE_MIN..SERVO_DSHOT_THROTTLE_MAX
+ * @retval None
+ */
+void servo_dshot_update(const u16* value);
+
+/**
+ * @brief  Set the positions of the motors and send the frames of all motors
+ * @param  first  First motor to set
+ * @param  count  Number of motors
+ * @param  position  Positions 0..SERVO_POSITION_MAX; 0 stops the motor
+ * @retval None
+ */
+void servo_dshot_write(u16 first, u16 count, const u16* position);
+
+/**
+ * @brief  Send a command with the next updates while the motor is stopped
+ * @param  num  Number of the motor
+ * @param  command  One of SERVO_DSHOT_CMD_*
+ * @retval u8 1 if the command is pending, 0 if the last frame of the motor was a throttle
+ */
+u8 servo_dshot_command(u16 num, u8 command);
+
+/**
+ * @brief  Build a DShot frame: 11 bit value, telemetry request bit and 4 bit checksum
+ * @param  value  Frame value 0..SERVO_DSHOT_THROTTLE_MAX
+ * @param  telemetry  1 to request telemetry, always set for commands
+ * @retval u16 The frame, sent with the most significant bit first
+ */
+u16 servo_dshot_frame(u16 value, u8 telemetry);
+
+/**
+ * @brief  Encode a frame into compare values, one per bit
+ * @param  buffer  Receives SERVO_DSHOT_FRAME_BITS compare values
+ * @param  stride  Distance between two bits in the buffer; the motors are interleaved
+ * @param  frame  The frame of servo_dshot_frame()
+ * @param  one  Compare value of a one
+ * @param  zero  Compare value of a zero
+ * @retval None
+ */
+void servo_dshot_encode(u16* buffer, u16 stride, u16 frame, u16 one, u16 zero);
+
+/**
+ * @brief  Electrical RPM of a motor from the last valid reply in bidirectional mode
+ * @param  num  Number of the motor
+ * @retval u32 eRPM, 0 if the motor stands still or never answered
+ */
+u32 servo_dshot_get_erpm(u16 num);
+
+/**
+ * @brief  Mechanical RPM of a motor, the eRPM divided by half of SERVO_MOTOR_POLES
+ * @param  num  Number of the motor
+ * @retval u32 RPM
+ */
+u32 servo_dshot_get_rpm(u16 num);
+
+/**
+ * @brief  Decode a GCR reply from the timestamps of its edges
+ *         Each interval between two edges is a one followed by zeros, the length of the
+ *         interval gives the number of bits. The bits are translated back from the
+ *         transitions to GCR and every 5 bit group to a nibble by a table.
+ * @param  edges  Captured timer values of the edges, starting with the start bit
+ * @param  count  Number of edges
+ * @param  bit  Length of one GCR bit in timer ticks
+ * @retval u16 The 16 bit reply including its checksum, SERVO_DSHOT_TELEMETRY_INVALID on errors
+ */
+u16 servo_dshot_gcr_decode(const volatile u16* edges, u8 count, u16 bit);
+
+/**
+ * @brief  Check the checksum of a reply; the XOR of all four nibbles is 0xF
+ * @param  telemetry  Reply of servo_dshot_gcr_decode()
+ * @retval u8 1 if the checksum is valid
+ */
+u8 servo_dshot_telemetry_crc(u16 telemetry);
+
+/**
+ * @brief  Convert a reply into eRPM; the reply holds the period of one electrical
+ *         revolution in microseconds as a 9 bit mantissa and a 3 bit shift
+ * @param  telemetry  Reply with a valid checksum
+ * @retval u32 eRPM, 0 if the motor stands still
+ */
+u32 servo_dshot_erpm(u16 telemetry);
+
+void DMA1_Stream2_IRQHandler(void);
+
+#endif // SERVO_DSHOT_H
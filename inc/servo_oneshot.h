@@ -0,0 +1,87 @@
+/** @file    servo_oneshot.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   OneShot125 and Multishot ESC pulses. TIM3 runs in one pulse mode and
+ *           every update of the control loop triggers exactly one pulse per motor,
+ *           so the ESC gets the new value without waiting for a PWM frame.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SERVO_ONESHOT_H
+#define SERVO_ONESHOT_H
+
+// Include STM32F4x libraries we need here
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "../lib/inc/peripherals/stm32f4xx_tim.h"
+
+// Protocols, select one with SERVO_ONESHOT_PROTOCOL
+// OneShot125 pulses are 125-250µs long, Multishot pulses 5-25µs.
+#define SERVO_ONESHOT_125 0
+#define SERVO_ONESHOT_MULTISHOT 1
+#ifndef SERVO_ONESHOT_PROTOCOL
+#define SERVO_ONESHOT_PROTOCOL SERVO_ONESHOT_125
+#endif // SERVO_ONESHOT_PROTOCOL
+
+// Pulse range of the protocols in nanoseconds
+#define SERVO_ONESHOT125_MIN 125000
+#define SERVO_ONESHOT125_MAX 250000
+#define SERVO_MULTISHOT_MIN 5000
+#define SERVO_MULTISHOT_MAX 25000
+#if SERVO_ONESHOT_PROTOCOL == SERVO_ONESHOT_MULTISHOT
+#define SERVO_ONESHOT_MIN SERVO_MULTISHOT_MIN
+#define SERVO_ONESHOT_MAX SERVO_MULTISHOT_MAX
+#else
+#define SERVO_ONESHOT_MIN SERVO_ONESHOT125_MIN
+#define SERVO_ONESHOT_MAX SERVO_ONESHOT125_MAX
+#endif
+
+// TIM3 runs with the APB1 timer clock without prescaler, 84 ticks per microsecond
+#define SERVO_ONESHOT_TIM_FREQUENCY (SystemCoreClock / 2)
+#define SERVO_ONESHOT_TICKS_PER_US (SERVO_ONESHOT_TIM_FREQUENCY / 1000000)
+
+// Number of pulses not started because the one before was still running
+extern volatile u32 servo_oneshot_skipped;
+
+/**
+ * @brief  Configure TIM3 in one pulse mode with all four channels in PWM2 mode
+ * @param  None
+ * @retval None
+ */
+void servo_oneshot_init();
+
+/**
+ * @brief  Set the positions of the motors and start one pulse on all motors
+ * @param  first  First motor to set
+ * @param  count  Number of motors
+ * @param  position  Positions 0..SERVO_POSITION_MAX
+ * @retval None
+ */
+void servo_oneshot_write(u16 first, u16 count, const u16* position);
+
+/**
+ * @brief  Pulse width of a position in timer ticks
+ * @param  position  Position 0..SERVO_POSITION_MAX, larger values are limited
+ * @param  min  Shortest pulse of the protocol in nanoseconds
+ * @param  max  Longest pulse of the protocol in nanoseconds
+ * @param  ticks  Timer ticks per microsecond
+ * @retval u16 Pulse width in timer ticks
+ */
+u16 servo_oneshot_pulse(u16 position, u32 min, u32 max, u32 ticks);
+
+#endif // SERVO_ONESHOT_H
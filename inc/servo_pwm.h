@@ -0,0 +1,80 @@
+/** @file    servo_pwm.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Servo and ESC pulses generated by the TIM3 output compare channels.
+ *           The compare registers are preloaded, so all channels take a new pulse
+ *           width at the same update event and no interrupt is needed.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SERVO_PWM_H
+#define SERVO_PWM_H
+
+// Include STM32F4x libraries we need here
+#include "../lib/inc/stm32f4xx.h"
+#include "../lib/inc/peripherals/stm32f4xx_rcc.h"
+#include "../lib/inc/peripherals/stm32f4xx_tim.h"
+
+// The timer counts with 1MHz, one tick is one microsecond of pulse width.
+// The frame rate is the update rate of the timer; 50Hz for servos up to 490Hz for ESCs.
+#define SERVO_PWM_TIM_FREQUENCY 1000000
+#define SERVO_PWM_RATE_MIN 50
+#define SERVO_PWM_RATE_MAX 490
+#ifndef SERVO_PWM_RATE
+#define SERVO_PWM_RATE 50
+#endif // SERVO_PWM_RATE
+
+/**
+ * @brief  Start TIM3 with SERVO_PWM_RATE and all four channels in PWM1 mode with preload
+ * @param  None
+ * @retval None
+ */
+void servo_pwm_init();
+
+/**
+ * @brief  Change the frame rate; takes effect with the next update event
+ * @param  rate  Frame rate in Hz, limited to SERVO_PWM_RATE_MIN..SERVO_PWM_RATE_MAX
+ * @retval None
+ */
+void servo_pwm_set_rate(u16 rate);
+
+/**
+ * @brief  Auto reload value of the timer for a frame rate
+ * @param  rate  Frame rate in Hz
+ * @retval u16 Value for TIMx->ARR, the rate is limited to the valid range
+ */
+u16 servo_pwm_period(u16 rate);
+
+/**
+ * @brief  Compare value of a channel for a servo position
+ * @param  position  Position 0..SERVO_POSITION_MAX, larger values are limited
+ * @retval u16 Value for TIMx->CCRx, the pulse width in timer ticks
+ */
+u16 servo_pwm_compare(u16 position);
+
+/**
+ * @brief  Write the compare registers of the channels; the preload makes them active
+ *         at the next update event
+ * @param  first  First channel to write
+ * @param  count  Number of channels
+ * @param  position  Positions of the channels
+ * @retval None
+ */
+void servo_pwm_write(u16 first, u16 count, const u16* position);
+
+#endif // SERVO_PWM_H
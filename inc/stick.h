@@ -0,0 +1,121 @@
+/** @file    stick.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Stick shaping between the receiver and the controller: Deadband, expo and
+ *           rates by lookup tables with linear interpolation.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STICK_H
+#define STICK_H
+
+#include "receiver.h"
+
+// Shaped channels: roll, pitch, yaw and throttle are the receiver channels 0-3
+#define STICK_CHANNELS 4
+#define STICK_ROLL 0
+#define STICK_PITCH 1
+#define STICK_YAW 2
+#define STICK_THROTTLE 3
+
+// The stick is normalized to -STICK_RANGE..STICK_RANGE with the center at 0,
+// the table has a point every STICK_STEP
+#define STICK_RANGE 1000
+#define STICK_STEP 50
+#define STICK_TABLE_POINTS (2 * STICK_RANGE / STICK_STEP + 1)
+
+// Default curves: expo and rate in percent, deadband in STICK_RANGE units around the center
+#ifndef STICK_ROLL_EXPO
+#define STICK_ROLL_EXPO 30
+#define STICK_ROLL_RATE 100
+#define STICK_ROLL_DEADBAND 20
+#endif
+#ifndef STICK_PITCH_EXPO
+#define STICK_PITCH_EXPO 30
+#define STICK_PITCH_RATE 100
+#define STICK_PITCH_DEADBAND 20
+#endif
+#ifndef STICK_YAW_EXPO
+#define STICK_YAW_EXPO 20
+#define STICK_YAW_RATE 100
+#define STICK_YAW_DEADBAND 40
+#endif
+#ifndef STICK_THROTTLE_EXPO
+#define STICK_THROTTLE_EXPO 0
+#define STICK_THROTTLE_RATE 100
+#define STICK_THROTTLE_DEADBAND 0
+#endif
+
+/**
+ * The curve: y = rate * ((1 - expo) * x + expo * x^3) for x in -1..1
+ * These macros are constant expressions, so the default tables are computed by
+ * the compiler. stick_set_curve() uses the same formula to rebuild a table.
+ */
+#define STICK_X(i) (-STICK_RANGE + (i) * STICK_STEP)
+#define STICK_CUBE(a) ((a) * (a) / STICK_RANGE * (a) / STICK_RANGE)
+#define STICK_CURVE_ABS(a, e, r) ((r) * ((a) * (100 - (e)) + STICK_CUBE(a) * (e)) / 10000)
+#define STICK_CURVE(x, e, r) ((x) < 0 ? -STICK_CURVE_ABS(-(x), e, r) : STICK_CURVE_ABS(x, e, r))
+#define STICK_POINT(i, e, r) ((s16)STICK_CURVE(STICK_X(i), e, r))
+#define STICK_TABLE(e, r) { \
+	STICK_POINT(0, e, r), STICK_POINT(1, e, r), STICK_POINT(2, e, r), STICK_POINT(3, e, r), STICK_POINT(4, e, r), \
+	STICK_POINT(5, e, r), STICK_POINT(6, e, r), STICK_POINT(7, e, r), STICK_POINT(8, e, r), STICK_POINT(9, e, r), \
+	STICK_POINT(10, e, r), STICK_POINT(11, e, r), STICK_POINT(12, e, r), STICK_POINT(13, e, r), STICK_POINT(14, e, r), \
+	STICK_POINT(15, e, r), STICK_POINT(16, e, r), STICK_POINT(17, e, r), STICK_POINT(18, e, r), STICK_POINT(19, e, r), \
+	STICK_POINT(20, e, r), STICK_POINT(21, e, r), STICK_POINT(22, e, r), STICK_POINT(23, e, r), STICK_POINT(24, e, r), \
+	STICK_POINT(25, e, r), STICK_POINT(26, e, r), STICK_POINT(27, e, r), STICK_POINT(28, e, r), STICK_POINT(29, e, r), \
+	STICK_POINT(30, e, r), STICK_POINT(31, e, r), STICK_POINT(32, e, r), STICK_POINT(33, e, r), STICK_POINT(34, e, r), \
+	STICK_POINT(35, e, r), STICK_POINT(36, e, r), STICK_POINT(37, e, r), STICK_POINT(38, e, r), STICK_POINT(39, e, r), \
+	STICK_POINT(40, e, r) }
+
+/**
+ * @typedef Stick_Curve
+ * @brief  Curve parameters and the lookup table of one channel
+ */
+typedef struct {
+	u8 expo;        //!< Expo in percent; 0 is linear, 100 is a pure cubic curve
+	u8 rate;        //!< Rate in percent of STICK_RANGE at full stick deflection
+	u16 deadband;   //!< Deadband around the center in STICK_RANGE units
+	s16 table[STICK_TABLE_POINTS];
+} Stick_Curve;
+
+/**
+ * @brief  Change the curve of a channel and rebuild its lookup table
+ * @param  num  Number of the channel (STICK_ROLL, ...)
+ * @param  expo  Expo in percent
+ * @param  rate  Rate in percent
+ * @param  deadband  Deadband around the center in STICK_RANGE units
+ * @retval None
+ */
+void stick_set_curve(u8 num, u8 expo, u8 rate, u16 deadband);
+
+/**
+ * @brief  Shape a receiver position
+ * @param  num  Number of the channel (STICK_ROLL, ...)
+ * @param  position  Receiver position 0..RECEIVER_POSITION_MAX
+ * @retval s16 Shaped value in -STICK_RANGE * rate / 100..STICK_RANGE * rate / 100
+ */
+s16 stick_shape(u8 num, u16 position);
+
+/**
+ * @brief  Read a receiver channel and shape it
+ * @param  num  Number of the channel (STICK_ROLL, ...)
+ * @retval s16 Shaped value, see stick_shape()
+ */
+s16 stick_get(u8 num);
+
+#endif // STICK_H
@@ -43,6 +43,7 @@ int main(void) {
 	init_gpio();
 	servo_gpio_init();
 	receiver_gpio_init();
+	sensors_init_gpio();
 	
 	// Interrupt priority: 2 bits for priority and 2 bits for sub priority
 	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2 | RCC_APB1Periph_TIM3, ENABLE);
@@ -51,6 +52,13 @@ int main(void) {
 	// Initialize all systems, inetrrupts, etc.
 	servo_init();
 	receiver_init();
+	sensors_init();
+	
+	// All LEDs on: the frame geometry has more motors than servo outputs, never arm
+	if (!movement_init()) {
+		GPIO_SetBits(LED_REGISTER, LED_PORTS);
+		while (1);
+	}
 	
 	// Just initialize some dummy LED values to toggle them for testing
 	GPIO_SetBits(LED_REGISTER, LED3 | LED4);
@@ -61,7 +69,8 @@ int main(void) {
 		
 		//GPIO_ToggleBits(LED_REGISTER, LED1 | LED2 | LED3 | LED4);
 		
-		// The first receiver port controls the LEDs
+		// Restart stuck sensor reads; the first receiver port controls the LEDs
+		sensors_update();
 		if (receiver_get_pos(1) > 0) {
 			GPIO_SetBits(LED_REGISTER, LED3 | LED4);
 			GPIO_ResetBits(LED_REGISTER, LED1 | LED2);
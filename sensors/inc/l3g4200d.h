@@ -30,6 +30,39 @@
 #include "../../lib/inc/peripherals/misc.h"
 #include "../../lib/inc/peripherals/stm32f4xx_gpio.h"
 #include "../../lib/inc/peripherals/stm32f4xx_spi.h"
+#include "../../inc/sensors_spi.h"
+#include "../../inc/sensors_i2c.h"
+
+// Chip select and clock of the L3G4200D on the SPI bus, its address on the I2C bus, and its
+// errors on whichever bus it is
+extern const Sensors_SpiDevice L3G4200D_Device;
+extern Sensors_BusHealth L3G4200D_Health;
+extern const Sensors_I2cDevice L3G4200D_I2cDevice;
+
+// The L3G4200D on the SPI or on the I2C bus, every function takes one of them
+extern const Sensors_Bus L3G4200D_SpiBus;
+extern const Sensors_Bus L3G4200D_I2cBus;
+
+/**
+ * @def L3G4200D_MAX_TIMEOUT
+ * @brief Maximum Timeout for waiting for the bus and a transfer in loops.
+ * 
+ * You can redefine this in your global configuration file.
+ */
+#ifndef L3G4200D_MAX_TIMEOUT
+#define L3G4200D_MAX_TIMEOUT              4096
+#endif // L3G4200D_MAX_TIMEOUT
+
+/**
+ * @def L3G4200D_FIFO_SIZE
+ * @brief The FIFO holds 32 samples of all three axes, 6 bytes each.
+ * 
+ * A burst read from OUT_X_L wraps around after OUT_Z_H while the FIFO is enabled,
+ * so the whole FIFO is read in one transfer of L3G4200D_MAX_TRANSFER bytes.
+ */
+#define L3G4200D_FIFO_SIZE                32
+#define L3G4200D_SAMPLE_SIZE              6
+#define L3G4200D_MAX_TRANSFER             (L3G4200D_FIFO_SIZE * L3G4200D_SAMPLE_SIZE)
 
 
 
@@ -603,4 +636,174 @@
  */
 #define L3G4200D_DURATION                   0x38
 
+/**** END: L3G4200D-Registers ****/
+
+/**
+ * @def L3G4200D_READ, L3G4200D_MULTIPLE
+ * @brief Flags in the SPI address byte: read access and address auto increment
+ */
+#define L3G4200D_READ                     0x80
+#define L3G4200D_MULTIPLE                 0x40
+#define L3G4200D_DUMMY_BYTE               ((uint8_t)0x00)
+
+/**
+ * @def L3G4200D_I2C_ADDRESS, L3G4200D_I2C_MULTIPLE
+ * @brief 7bit slave address with SDO high (0x68 with SDO low) and the auto increment
+ *        flag in the I2C sub address; the direction is part of the slave address there
+ */
+#define L3G4200D_I2C_ADDRESS              0x69
+#define L3G4200D_I2C_MULTIPLE             0x80
+
+/**
+ * @def L3G4200D_ODR_, L3G4200D_FS_
+ * @brief Output data rates and full scales for the L3G4200D_Config
+ * 
+ * The bandwidth 0-3 selects the Cut-Off of the rate, see L3G4200D_CTRL_REG1_ADDR
+ */
+#define L3G4200D_ODR_100                  0x00
+#define L3G4200D_ODR_200                  0x01
+#define L3G4200D_ODR_400                  0x02
+#define L3G4200D_ODR_800                  0x03
+#define L3G4200D_FS_250                   0x00
+#define L3G4200D_FS_500                   0x01
+#define L3G4200D_FS_2000                  0x02
+
+/**
+ * @def L3G4200D_CTRL_REG_, L3G4200D_FIFO_
+ * @brief Bits in the control, FIFO control and FIFO source registers
+ */
+#define L3G4200D_CTRL_REG1_AXES           0x07
+#define L3G4200D_CTRL_REG1_PD             0x08
+#define L3G4200D_CTRL_REG3_I2_WTM         0x04
+#define L3G4200D_CTRL_REG3_I2_ORUN        0x02
+#define L3G4200D_CTRL_REG4_BDU            0x80
+#define L3G4200D_CTRL_REG5_FIFO_EN        0x40
+#define L3G4200D_FIFO_MODE_BYPASS         0x00
+#define L3G4200D_FIFO_MODE_STREAM         0x40
+#define L3G4200D_FIFO_WTM                 0x1F
+#define L3G4200D_FIFO_SRC_WTM             0x80
+#define L3G4200D_FIFO_SRC_OVRN            0x40
+#define L3G4200D_FIFO_SRC_EMPTY           0x20
+#define L3G4200D_FIFO_SRC_FSS             0x1F
+
+/**** Types ****/
+
+/**
+ * Configuration of the L3G4200D; Watermark 0 runs without FIFO, every other value
+ * runs the FIFO in stream mode and signals on INT2 when it holds Watermark samples.
+ */
+typedef struct {
+	uint8_t DataRate;  //!< L3G4200D_ODR_*
+	uint8_t Bandwidth; //!< 0-3
+	uint8_t FullScale; //!< L3G4200D_FS_*
+	uint8_t Watermark; //!< 0-31
+} L3G4200D_Config;
+
+/**
+ * One raw sample of all three axes
+ */
+typedef struct {
+	int16_t X;
+	int16_t Y;
+	int16_t Z;
+} L3G4200D_Sample;
+
+// Number of FIFO reads which found an overrun, samples were lost before them
+extern volatile uint32_t L3G4200D_FifoOverruns;
+
+/**** Functions ****/
+
+/**
+ * @brief  Write the configuration to the L3G4200D; CTRL_REG1-5 in one burst and the FIFO mode
+ * @param  bus  L3G4200D_SpiBus or L3G4200D_I2cBus
+ * @param  pConfig  Pointer to the configuration to write
+ * @retval void
+ */
+void L3G4200D_Init(const Sensors_Bus* bus, const L3G4200D_Config* pConfig);
+
+/**
+ * @brief  Read data from a L3G4200D and wait until it is received (at most L3G4200D_MAX_TRANSFER bytes).
+ * @param  bus  L3G4200D_SpiBus or L3G4200D_I2cBus
+ * @param  pBuffer  Pointer to the buffer for the received data
+ * @param  readAddr  L3G4200D Internal address from the register to read from
+ * @param  numByteToRead  Number of bytes to read from the L3G4200D
+ * @retval uint8_t 1 if the data was read, 0 on a timeout
+ */
+uint8_t L3G4200D_Read(const Sensors_Bus* bus, uint8_t* pBuffer, uint8_t readAddr, uint16_t numByteToRead);
+
+/**
+ * @brief  Writes data to the L3G4200D and wait until it is sent (at most L3G4200D_MAX_TRANSFER bytes).
+ * @param  bus  L3G4200D_SpiBus or L3G4200D_I2cBus
+ * @param  pBuffer  Pointer to the buffer containing the data to be written to the L3G4200D
+ * @param  writeAddr  L3G4200D's internal address to write to
+ * @param  numByteToWrite  Number of bytes to write
+ * @retval uint8_t 1 if the data was written, 0 on a timeout
+ */
+uint8_t L3G4200D_Write(const Sensors_Bus* bus, const uint8_t* pBuffer, uint8_t writeAddr, uint16_t numByteToWrite);
+
+/**
+ * @brief  Start reading data from a L3G4200D and return without waiting for it.
+ * @param  bus  L3G4200D_SpiBus or L3G4200D_I2cBus
+ * @param  transfer  The transfer to use, it must stay valid until it is finished
+ * @param  pBuffer  Buffer with numByteToRead + 1 bytes; the data is received from pBuffer[1] on
+ * @param  readAddr  L3G4200D Internal address from the register to read from
+ * @param  numByteToRead  Number of bytes to read from the L3G4200D
+ * @param  callback  Called from the bus interrupt when the data is there, may be 0
+ * @retval uint8_t 1 if the transfer was started or queued, 0 if it is still pending
+ */
+uint8_t L3G4200D_ReadAsync(const Sensors_Bus* bus, Sensors_Transfer* transfer, uint8_t* pBuffer, uint8_t readAddr, uint16_t numByteToRead, void (*callback)(Sensors_Transfer*));
+
+/**
+ * @brief  Number of samples in the FIFO
+ * @param  bus  L3G4200D_SpiBus or L3G4200D_I2cBus
+ * @retval uint8_t 0-32 samples
+ */
+uint8_t L3G4200D_FifoLevel(const Sensors_Bus* bus);
+
+/**
+ * @brief  Drain up to count samples from the FIFO in one auto increment burst
+ * @param  bus  L3G4200D_SpiBus or L3G4200D_I2cBus
+ * @param  pSamples  Receives the samples, oldest first
+ * @param  count  Maximum number of samples to read, at most L3G4200D_FIFO_SIZE
+ * @retval uint8_t Number of samples read
+ */
+uint8_t L3G4200D_ReadFifo(const Sensors_Bus* bus, L3G4200D_Sample* pSamples, uint8_t count);
+
+/**
+ * @brief  Start draining count samples from the FIFO and return without waiting for them;
+ *         decode them with L3G4200D_DecodeSamples(&pBuffer[1], ...) when the transfer is done.
+ * @param  bus  L3G4200D_SpiBus or L3G4200D_I2cBus
+ * @param  transfer  The transfer to use, it must stay valid until it is finished
+ * @param  pBuffer  Buffer with count * L3G4200D_SAMPLE_SIZE + 1 bytes
+ * @param  count  Number of samples to read, at most L3G4200D_FIFO_SIZE
+ * @param  callback  Called from the bus interrupt when the samples are there, may be 0
+ * @retval uint8_t 1 if the transfer was started or queued, 0 if it is still pending
+ */
+uint8_t L3G4200D_ReadFifoAsync(const Sensors_Bus* bus, Sensors_Transfer* transfer, uint8_t* pBuffer, uint8_t count, void (*callback)(Sensors_Transfer*));
+
+/**
+ * @brief  Number of samples in the FIFO from the FIFO_SRC register value
+ * @param  src  Value of L3G4200D_FIFO_SRC_REG_ADDR
+ * @retval uint8_t 0-32 samples
+ */
+uint8_t L3G4200D_FifoSamples(uint8_t src);
+
+/**
+ * @brief  Convert raw bytes of OUT_X_L..OUT_Z_H into samples
+ * @param  pBuffer  count * L3G4200D_SAMPLE_SIZE bytes, the low byte of each axis first
+ * @param  pSamples  Receives the samples
+ * @param  count  Number of samples
+ * @retval void
+ */
+void L3G4200D_DecodeSamples(const uint8_t* pBuffer, L3G4200D_Sample* pSamples, uint8_t count);
+
+/**
+ * @brief  Angular rate of a sample in millidegrees per second
+ * @param  pSample  The raw sample
+ * @param  fullScale  L3G4200D_FS_* the sample was measured with
+ * @param  out  Receives the X, Y and Z rate
+ * @retval void
+ */
+void L3G4200D_AngularRate(const L3G4200D_Sample* pSample, uint8_t fullScale, int32_t* out);
+
 #endif // L3G4200D_H
@@ -29,11 +29,16 @@
 #include "../../lib/inc/peripherals/misc.h"
 #include "../../lib/inc/peripherals/stm32f4xx_gpio.h"
 #include "../../lib/inc/peripherals/stm32f4xx_spi.h"
+#include "../../inc/sensors_spi.h"
 
 // TODO: Make this configurabe on each command through a different API
 // use sensors.h for this
 #define LIS302DL_SPI  SPI1
 
+// Chip select and clock of the LIS302DL on the bus, its errors and whether it is degraded
+extern const Sensors_SpiDevice LIS302DL_Device;
+extern Sensors_BusHealth LIS302DL_Health;
+
 // see http://www.st.com/st-web-ui/static/active/en/resource/technical/document/datasheet/CD00135460.pdf
 
 /**
@@ -48,15 +53,49 @@
 #define LIS302DL_MAX_TIMEOUT              4096
 #endif // LIS302DL_MAX_TIMEOUT
 
+/**
+ * @def LIS302DL_MAX_TRANSFER
+ * @brief Maximum number of bytes LIS302DL_Read and LIS302DL_Write move in one transfer.
+ * 
+ * The whole register map is 64 bytes long, so a longer burst is never needed.
+ */
+#define LIS302DL_MAX_TRANSFER             64
+
+/**
+ * @def LIS302DL_SHADOW_
+ * @brief Configuration registers 0x20-0x3F the driver keeps a copy of.
+ * 
+ * Every write goes through to the device and updates the copy, so reading a
+ * configuration register needs no transfer. Status, output and source registers
+ * change on their own and are never cached (bit n stands for register 0x20 + n).
+ */
+#define LIS302DL_SHADOW_BASE              0x20
+#define LIS302DL_SHADOW_SIZE              32
+#define LIS302DL_SHADOW_REGISTERS         0xF9DD0007
+
+/**
+ * @def LIS302DL_SAMPLE_SIZE
+ * @brief Bytes of one sample burst: STATUS_REG, the unused 0x28 and OUT_X to OUT_Z with the gaps between.
+ */
+#define LIS302DL_SAMPLE_SIZE              7
+
+/**
+ * @var LIS302DL_Overruns
+ * @brief Samples with ZYXOR set: a complete set was overwritten before it was read
+ * @var LIS302DL_AxisOverruns
+ * @brief Overruns of the single axes X, Y and Z (XOR, YOR, ZOR)
+ */
+extern volatile uint32_t LIS302DL_Overruns;
+extern volatile uint32_t LIS302DL_AxisOverruns[3];
+
 /**
  * @brief This function is called whenever a timeout occure during communication.
  * 
- * This function is called whenever a timeout condition occure during communication
- * (waiting for transmit data register empty flag(TXE) or waitig for receive an empty
- * data register flag(RXNE)). The default implementation just stops all further communication
- * and proceeds an empty loop so the whole application stops working.
- * Typically a user implementation of this callback should reset the peripheral memory
- * and re-initialize communication or in worst case reset the complete application.
+ * This function is called whenever a blocking transfer failed or did not finish in time.
+ * The bus layer has already reset the SPI and repeated the transfer, the error is counted
+ * in LIS302DL_Health and the failed call returns its status. The default implementation
+ * therefore does nothing; a user implementation may e.g. reboot the device or reset the
+ * complete application once LIS302DL_Health.degraded is set.
  * In case of a user implementation, just define LIS302DL_USE_CUSTOM_TIMEOUT_CALLBACK
  * and implement the function u32 LIS302DL_TIMEOUT_UserCallback(void).
  * 
@@ -254,6 +293,11 @@ uint32_t LIS302DL_TIMEOUT_UserCallback(void);
  *        1: a new data for X axis is available
  */
 #define LIS302DL_STATUS_REG_ADDR           0x27
+#define LIS302DL_STATUS_ZYXOR              0x80
+#define LIS302DL_STATUS_ZOR                0x40
+#define LIS302DL_STATUS_YOR                0x20
+#define LIS302DL_STATUS_XOR                0x10
+#define LIS302DL_STATUS_ZYXDA              0x08
 
 /**
  * @def LIS302DL_OUT_X_ADDR
@@ -766,6 +810,28 @@ typedef struct {
 	uint8_t XAxisEnabled : 1;   //!< X-Axis (0: Disabled, 1: Enabled)
 } LIS302DL_Config;
 
+/**
+ * @typedef LIS302DL_Register
+ * @brief  One register and its value for LIS302DL_WriteRegisters
+ */
+typedef struct {
+	uint8_t Address;
+	uint8_t Value;
+} LIS302DL_Register;
+
+/**
+ * @typedef LIS302DL_Sample
+ * @brief  One sample together with its status
+ */
+typedef struct {
+	uint8_t NewData : 1;  //!< A new set of data was available (ZYXDA); X, Y and Z are only valid if set
+	uint8_t Overrun : 1;  //!< At least one set was overwritten before it was read (ZYXOR)
+	uint8_t Status;       //!< The raw STATUS_REG
+	int32_t X;            //!< X-axis in mg
+	int32_t Y;            //!< Y-axis in mg
+	int32_t Z;            //!< Z-axis in mg
+} LIS302DL_Sample;
+
 /**
  * @typedef LIS302DL_GlobalInterruptConfig
  * @brief  Used for the "movement" interrupt configuration (FreeFall/WakeUp) in CTRL_REG2
@@ -834,11 +900,6 @@ typedef struct {
 	uint8_t X_Low : 1; //!< Interrupt on Z-Axis with acceleration values lower than preset threshold occurred
 } LIS302DL_WakeupInterruptData;
 
-/**** Macros ****/
-// TODO: Create functions from these to be able to use more that only one sensor on different SPI ports
-#define LIS302DL_CS_LOW()       GPIO_ResetBits(LIS302DL_SPI_CS_GPIO_PORT, LIS302DL_SPI_CS_PIN)
-#define LIS302DL_CS_HIGH()      GPIO_SetBits(LIS302DL_SPI_CS_GPIO_PORT, LIS302DL_SPI_CS_PIN)
-
 /**
  * @brief  Write the configuration to the LIS302DL device
  * @param  spi  Pointer to the SPI on which the data should be sent/set/received
@@ -856,24 +917,91 @@ void LIS302DL_Init(SPI_TypeDef* spi, const LIS302DL_Config* config);
 void LIS302DL_GetConfiguration(SPI_TypeDef* spi, volatile LIS302DL_Config* config);
 
 /**
- * @brief  Read data from a LIS302DL.
+ * @brief  Read data from a LIS302DL and wait until it is received (at most LIS302DL_MAX_TRANSFER bytes).
  * @param  spi  Pointer to the SPI on which the data should be sent/set/received
  * @param  pBuffer  Pointer to the buffer for the received data
  * @param  readAddr  LIS302DL Internal address from the register to read from
  * @param  numByteToRead  Number of bytes to read from the LIS302DL
- * @retval void
+ * @retval uint8_t SENSORS_BUS_DONE, SENSORS_BUS_ERROR if the bus failed, SENSORS_BUS_BUSY or _QUEUED on a timeout
  */
-void LIS302DL_Read(SPI_TypeDef* spi, uint8_t* pBuffer, uint8_t readAddr, uint16_t numByteToRead);
+uint8_t LIS302DL_Read(SPI_TypeDef* spi, uint8_t* pBuffer, uint8_t readAddr, uint16_t numByteToRead);
 
 /**
- * @brief  Writes one byte to the LIS302DL.
+ * @brief  Writes data to the LIS302DL and wait until it is sent (at most LIS302DL_MAX_TRANSFER bytes).
  * @param  spi  Pointer to the SPI on which the data should be sent/set/received
  * @param  pBuffer  Pointer to the buffer  containing the data to be written to the LIS302DL.
  * @param  writeAddr  LIS302DL's internal address to write to.
  * @param  NumByteToWrite  Number of bytes to write.
+ * @retval uint8_t SENSORS_BUS_DONE, SENSORS_BUS_ERROR if the bus failed, SENSORS_BUS_BUSY or _QUEUED on a timeout;
+ *         the shadow copy is dropped after a failure
+ */
+uint8_t LIS302DL_Write(SPI_TypeDef* spi, uint8_t* pBuffer, uint8_t writeAddr, uint16_t numByteToWrite);
+
+/**
+ * @brief  Start reading data from a LIS302DL and return without waiting for it.
+ *         The transfer status changes to SENSORS_BUS_DONE when the data is in the buffer.
+ * @param  spi  Pointer to the SPI on which the data should be sent/set/received
+ * @param  transfer  The transfer to use, it must stay valid until it is finished
+ * @param  pBuffer  Buffer with numByteToRead + 1 bytes; the data is received from pBuffer[1] on
+ * @param  readAddr  LIS302DL Internal address from the register to read from
+ * @param  numByteToRead  Number of bytes to read from the LIS302DL
+ * @param  callback  Called from the DMA interrupt when the data is there, may be 0
+ * @retval uint8_t 1 if the transfer was started or queued, 0 if it is still pending
+ */
+uint8_t LIS302DL_ReadAsync(SPI_TypeDef* spi, Sensors_Transfer* transfer, uint8_t* pBuffer, uint8_t readAddr, uint16_t numByteToRead, void (*callback)(Sensors_Transfer*));
+
+/**
+ * @brief  Start writing data to a LIS302DL and return without waiting for it.
+ * @param  spi  Pointer to the SPI on which the data should be sent/set/received
+ * @param  transfer  The transfer to use, it must stay valid until it is finished
+ * @param  pBuffer  Buffer with numByteToWrite + 1 bytes; pBuffer[0] receives the address, the data starts at pBuffer[1]
+ * @param  writeAddr  LIS302DL's internal address to write to.
+ * @param  numByteToWrite  Number of bytes to write.
+ * @param  callback  Called from the DMA interrupt when the data is written, may be 0
+ * @retval uint8_t 1 if the transfer was started or queued, 0 if it is still pending
+ */
+uint8_t LIS302DL_WriteAsync(SPI_TypeDef* spi, Sensors_Transfer* transfer, uint8_t* pBuffer, uint8_t writeAddr, uint16_t numByteToWrite, void (*callback)(Sensors_Transfer*));
+
+/**
+ * @brief  Read one register; configuration registers are answered from the shadow copy
+ * @param  spi  Pointer to the SPI on which the data should be sent/set/received
+ * @param  readAddr  LIS302DL Internal address from the register to read from
+ * @retval uint8_t The register value
+ */
+uint8_t LIS302DL_ReadRegister(SPI_TypeDef* spi, uint8_t readAddr);
+
+/**
+ * @brief  Write one register if its value differs from the shadow copy
+ * @param  spi  Pointer to the SPI on which the data should be sent/set/received
+ * @param  writeAddr  LIS302DL's internal address to write to
+ * @param  value  The new value
+ * @retval void
+ */
+void LIS302DL_WriteRegister(SPI_TypeDef* spi, uint8_t writeAddr, uint8_t value);
+
+/**
+ * @brief  Write several registers at once. Unchanged registers are skipped, registers
+ *         with consecutive addresses are sent in one burst.
+ * @param  spi  Pointer to the SPI on which the data should be sent/set/received
+ * @param  pRegisters  Registers and values, sorted by address
+ * @param  count  Number of registers
+ * @retval void
+ */
+void LIS302DL_WriteRegisters(SPI_TypeDef* spi, const LIS302DL_Register* pRegisters, uint8_t count);
+
+/**
+ * @brief  Forget the shadow copy, e.g. after the device lost its configuration
+ * @param  None
  * @retval void
  */
-void LIS302DL_Write(SPI_TypeDef* spi, uint8_t* pBuffer, uint8_t writeAddr, uint16_t numByteToWrite);
+void LIS302DL_InvalidateShadow(void);
+
+/**
+ * @brief  Sensitivity of the configured full scale from the shadow copy
+ * @param  spi  Pointer to the SPI on which the data should be sent/set/received
+ * @retval uint8_t 18 or 72 mg per digit
+ */
+uint8_t LIS302DL_Sensitivity(SPI_TypeDef* spi);
 
 /**
  * @brief  Read the LIS302DL output register and calculate the acceleration based like:
@@ -884,6 +1012,33 @@ void LIS302DL_Write(SPI_TypeDef* spi, uint8_t* pBuffer, uint8_t writeAddr, uint1
  */
 void LIS302DL_Acceleration(SPI_TypeDef* spi, int32_t* out);
 
+/**
+ * @brief  Read STATUS_REG and all axes in one burst and convert them if there is new data
+ * @param  spi  Pointer to the SPI on which the data should be sent/set/received
+ * @param  pSample  Receives the sample
+ * @retval uint8_t 1 if a new sample was read, 0 otherwise
+ */
+uint8_t LIS302DL_ReadSample(SPI_TypeDef* spi, LIS302DL_Sample* pSample);
+
+/**
+ * @brief  Start reading STATUS_REG and all axes in one burst without waiting
+ * @param  spi  Pointer to the SPI on which the data should be sent/set/received
+ * @param  transfer  The transfer, must not be used until the callback is called
+ * @param  pBuffer  Buffer with LIS302DL_SAMPLE_SIZE + 1 bytes, the sample starts at pBuffer[1]
+ * @param  callback  Called from the DMA interrupt when the sample is received, can be 0
+ * @retval uint8_t 1 if the transfer was started or queued, 0 otherwise
+ */
+uint8_t LIS302DL_ReadSampleAsync(SPI_TypeDef* spi, Sensors_Transfer* transfer, uint8_t* pBuffer, void (*callback)(Sensors_Transfer*));
+
+/**
+ * @brief  Decode a sample burst and count the overruns; the axes are only converted if ZYXDA is set
+ * @param  pBuffer  The LIS302DL_SAMPLE_SIZE bytes starting with STATUS_REG
+ * @param  sensitivity  mg per digit, see LIS302DL_Sensitivity
+ * @param  pSample  Receives the sample
+ * @retval uint8_t 1 if the sample holds new data, 0 otherwise
+ */
+uint8_t LIS302DL_DecodeSample(const uint8_t* pBuffer, uint8_t sensitivity, LIS302DL_Sample* pSample);
+
 /**
  * @brief  Rebot the memory content of a LIS302DL device
  *         This is done by setting BOOT in CTRL_REG2
@@ -24,4 +24,230 @@
  */
 #include "../inc/l3g4200d.h"
 
+volatile uint32_t L3G4200D_FifoOverruns = 0;
+
+// The L3G4200D is not on the discovery board, it shares SPI1 with the LIS302DL and selects on PE6.
+// It runs in SPI mode 3 with at most 10MHz.
+Sensors_BusHealth L3G4200D_Health;
+const Sensors_SpiDevice L3G4200D_Device = { GPIOE, GPIO_Pin_6, SPI_CPOL_High | SPI_CPHA_2Edge, SPI_BaudRatePrescaler_16, &L3G4200D_Health };
+const Sensors_I2cDevice L3G4200D_I2cDevice = { L3G4200D_I2C_ADDRESS, &L3G4200D_Health };
+
+const Sensors_Bus L3G4200D_SpiBus = { SENSORS_BUS_SPI, &L3G4200D_Device, sensors_spi_start, sensors_spi_busy, sensors_spi_wait };
+const Sensors_Bus L3G4200D_I2cBus = { SENSORS_BUS_I2C, &L3G4200D_I2cDevice, sensors_i2c_start, sensors_i2c_busy, sensors_i2c_wait };
+
+/**** Private declarations ****/
+
+// Sensitivity of the full scales in 1/100 millidegrees per second and digit
+static const uint16_t _L3G4200D_Sensitivity[3] = { 875, 1750, 7000 };
+
+// Transfer and buffer of the blocking functions, the address byte is in front
+static Sensors_Transfer _L3G4200D_BlockingTransfer;
+static uint8_t _L3G4200D_Buffer[L3G4200D_MAX_TRANSFER + 1];
+
+static uint8_t _L3G4200D_Address(const Sensors_Bus* bus, uint8_t addr, uint8_t read, uint16_t count);
+static uint8_t _L3G4200D_Transfer(const Sensors_Bus* bus, Sensors_Transfer* transfer, uint8_t* tx, uint8_t* rx, uint16_t length, void (*callback)(Sensors_Transfer*));
+static uint8_t _L3G4200D_Wait(const Sensors_Bus* bus, uint16_t length);
+
+
+/**** Public implementations ****/
+
+void L3G4200D_Init(const Sensors_Bus* bus, const L3G4200D_Config* pConfig) {
+	uint8_t ctrl[5];
+	uint8_t fifo;
+	
+	// All axes on, the data rate and bandwidth in the upper bits
+	ctrl[0] = (uint8_t)((pConfig->DataRate & 0x03) << 6) | (uint8_t)((pConfig->Bandwidth & 0x03) << 4) | L3G4200D_CTRL_REG1_PD | L3G4200D_CTRL_REG1_AXES;
+	ctrl[1] = 0x00;
+	ctrl[2] = pConfig->Watermark ? (L3G4200D_CTRL_REG3_I2_WTM | L3G4200D_CTRL_REG3_I2_ORUN) : 0x00;
+	ctrl[3] = L3G4200D_CTRL_REG4_BDU | (uint8_t)((pConfig->FullScale & 0x03) << 4);
+	ctrl[4] = pConfig->Watermark ? L3G4200D_CTRL_REG5_FIFO_EN : 0x00;
+	fifo = pConfig->Watermark ? (L3G4200D_FIFO_MODE_STREAM | (pConfig->Watermark & L3G4200D_FIFO_WTM)) : L3G4200D_FIFO_MODE_BYPASS;
+	
+	L3G4200D_Write(bus, ctrl, L3G4200D_CTRL_REG1_ADDR, 5);
+	L3G4200D_Write(bus, &fifo, L3G4200D_FIFO_CTRL_REG_ADDR, 1);
+}
+
+
+uint8_t L3G4200D_Read(const Sensors_Bus* bus, uint8_t* pBuffer, uint8_t readAddr, uint16_t numByteToRead) {
+	uint16_t i;
+	
+	if (numByteToRead > L3G4200D_MAX_TRANSFER) {
+		numByteToRead = L3G4200D_MAX_TRANSFER;
+	}
+	
+	// Loop while the last blocking transfer is still pending; or we ran into a timeout
+	i = L3G4200D_MAX_TIMEOUT;
+	while (!L3G4200D_ReadAsync(bus, &_L3G4200D_BlockingTransfer, _L3G4200D_Buffer, readAddr, numByteToRead, 0)) {
+		if ((i--) == 0) {
+			return 0;
+		}
+	}
+	if (!_L3G4200D_Wait(bus, numByteToRead)) {
+		return 0;
+	}
+	
+	// The received data follows the answer to the address byte
+	for (i = 0; i < numByteToRead; i++) {
+		pBuffer[i] = _L3G4200D_Buffer[i + 1];
+	}
+	return 1;
+}
+
+
+uint8_t L3G4200D_Write(const Sensors_Bus* bus, const uint8_t* pBuffer, uint8_t writeAddr, uint16_t numByteToWrite) {
+	uint16_t i;
+	
+	if (numByteToWrite > L3G4200D_MAX_TRANSFER) {
+		numByteToWrite = L3G4200D_MAX_TRANSFER;
+	}
+	
+	// For writing multiple bytes we need to set the auto increment flag
+	_L3G4200D_Buffer[0] = _L3G4200D_Address(bus, writeAddr, 0, numByteToWrite);
+	for (i = 0; i < numByteToWrite; i++) {
+		_L3G4200D_Buffer[i + 1] = pBuffer[i];
+	}
+	
+	// Loop while the last blocking transfer is still pending; or we ran into a timeout
+	i = L3G4200D_MAX_TIMEOUT;
+	while (!_L3G4200D_Transfer(bus, &_L3G4200D_BlockingTransfer, _L3G4200D_Buffer, 0, numByteToWrite + 1, 0)) {
+		if ((i--) == 0) {
+			return 0;
+		}
+	}
+	return _L3G4200D_Wait(bus, numByteToWrite);
+}
+
+
+uint8_t L3G4200D_ReadAsync(const Sensors_Bus* bus, Sensors_Transfer* transfer, uint8_t* pBuffer, uint8_t readAddr, uint16_t numByteToRead, void (*callback)(Sensors_Transfer*)) {
+	uint16_t i;
+	
+	// Send the address followed by dummy bytes to generate the clock, the data is received into the same buffer
+	pBuffer[0] = _L3G4200D_Address(bus, readAddr, 1, numByteToRead);
+	for (i = 1; i <= numByteToRead; i++) {
+		pBuffer[i] = L3G4200D_DUMMY_BYTE;
+	}
+	return _L3G4200D_Transfer(bus, transfer, pBuffer, pBuffer, numByteToRead + 1, callback);
+}
+
+
+uint8_t L3G4200D_FifoLevel(const Sensors_Bus* bus) {
+	uint8_t src = 0x00;
+	
+	if (!L3G4200D_Read(bus, &src, L3G4200D_FIFO_SRC_REG_ADDR, 1)) {
+		return 0;
+	}
+	if (src & L3G4200D_FIFO_SRC_OVRN) {
+		L3G4200D_FifoOverruns++;
+	}
+	return L3G4200D_FifoSamples(src);
+}
+
+
+uint8_t L3G4200D_ReadFifo(const Sensors_Bus* bus, L3G4200D_Sample* pSamples, uint8_t count) {
+	uint8_t level = L3G4200D_FifoLevel(bus);
+	
+	if (count > level) {
+		count = level;
+	}
+	if (!count || !L3G4200D_Read(bus, _L3G4200D_Buffer, L3G4200D_OUT_X_L_ADDR, count * L3G4200D_SAMPLE_SIZE)) {
+		return 0;
+	}
+	
+	// L3G4200D_Read copied the data to the start of the buffer
+	L3G4200D_DecodeSamples(_L3G4200D_Buffer, pSamples, count);
+	return count;
+}
+
+
+uint8_t L3G4200D_ReadFifoAsync(const Sensors_Bus* bus, Sensors_Transfer* transfer, uint8_t* pBuffer, uint8_t count, void (*callback)(Sensors_Transfer*)) {
+	if (count > L3G4200D_FIFO_SIZE) {
+		count = L3G4200D_FIFO_SIZE;
+	}
+	
+	// The address wraps from OUT_Z_H back to OUT_X_L, each 6 bytes pop the next sample
+	return L3G4200D_ReadAsync(bus, transfer, pBuffer, L3G4200D_OUT_X_L_ADDR, count * L3G4200D_SAMPLE_SIZE, callback);
+}
+
+
+uint8_t L3G4200D_FifoSamples(uint8_t src) {
+	if (src & L3G4200D_FIFO_SRC_EMPTY) {
+		return 0;
+	}
+	
+	// FSS counts up to 31, an overrun means all 32 levels are filled
+	if (src & L3G4200D_FIFO_SRC_OVRN) {
+		return L3G4200D_FIFO_SIZE;
+	}
+	return src & L3G4200D_FIFO_SRC_FSS;
+}
+
+
+void L3G4200D_DecodeSamples(const uint8_t* pBuffer, L3G4200D_Sample* pSamples, uint8_t count) {
+	// With BLE = 0 the low byte is on the lower address
+	while (count > 0) {
+		pSamples->X = (int16_t)(pBuffer[0] | (pBuffer[1] << 8));
+		pSamples->Y = (int16_t)(pBuffer[2] | (pBuffer[3] << 8));
+		pSamples->Z = (int16_t)(pBuffer[4] | (pBuffer[5] << 8));
+		pBuffer += L3G4200D_SAMPLE_SIZE;
+		pSamples++;
+		count--;
+	}
+}
+
+
+void L3G4200D_AngularRate(const L3G4200D_Sample* pSample, uint8_t fullScale, int32_t* out) {
+	int32_t sensitivity = _L3G4200D_Sensitivity[fullScale > L3G4200D_FS_2000 ? L3G4200D_FS_2000 : fullScale];
+	
+	out[0] = (pSample->X * sensitivity) / 100;
+	out[1] = (pSample->Y * sensitivity) / 100;
+	out[2] = (pSample->Z * sensitivity) / 100;
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Register address with the access flags of the bus
+ * @param  bus  The bus of the device
+ * @param  addr  Register address
+ * @param  read  1 for reading, 0 for writing
+ * @param  count  Number of bytes, more than one need the auto increment
+ * @retval uint8_t The address byte
+ */
+static uint8_t _L3G4200D_Address(const Sensors_Bus* bus, uint8_t addr, uint8_t read, uint16_t count) {
+	if (bus->type == SENSORS_BUS_I2C) {
+		return addr | (count > 1 ? L3G4200D_I2C_MULTIPLE : 0x00);
+	}
+	return addr | (read ? L3G4200D_READ : 0x00) | (count > 1 ? L3G4200D_MULTIPLE : 0x00);
+}
+
+/**
+ * @brief  Fill in a transfer to the L3G4200D and start or queue it
+ * @param  bus  The bus of the device
+ * @param  transfer  The transfer to start
+ * @param  tx  Bytes to send
+ * @param  rx  Buffer for the received bytes, may be the same as tx or 0
+ * @param  length  Number of bytes including the address
+ * @param  callback  Called when the transfer is finished, may be 0
+ * @retval uint8_t 1 if the transfer was started or queued, 0 if it is still pending
+ */
+static uint8_t _L3G4200D_Transfer(const Sensors_Bus* bus, Sensors_Transfer* transfer, uint8_t* tx, uint8_t* rx, uint16_t length, void (*callback)(Sensors_Transfer*)) {
+	transfer->device = bus->device;
+	transfer->tx = tx;
+	transfer->rx = rx;
+	transfer->length = length;
+	transfer->callback = callback;
+	return bus->start(transfer);
+}
+
+/**
+ * @brief  Wait for the end of the blocking transfer
+ * @param  bus  The bus of the device
+ * @param  length  Number of data bytes
+ * @retval uint8_t 1 if the transfer is finished, 0 on a timeout
+ */
+static uint8_t _L3G4200D_Wait(const Sensors_Bus* bus, uint16_t length) {
+	return bus->wait(&_L3G4200D_BlockingTransfer, L3G4200D_MAX_TIMEOUT * (length + 1)) == SENSORS_BUS_DONE;
+}
+
 
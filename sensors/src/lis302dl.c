@@ -23,9 +23,28 @@
  */
 #include "../inc/lis302dl.h"
 
+// The discovery board selects the LIS302DL on PE3, it runs in SPI mode 0
+Sensors_BusHealth LIS302DL_Health;
+const Sensors_SpiDevice LIS302DL_Device = { GPIOE, GPIO_Pin_3, SPI_CPOL_Low | SPI_CPHA_1Edge, SPI_BaudRatePrescaler_4, &LIS302DL_Health };
+
+volatile uint32_t LIS302DL_Overruns = 0;
+volatile uint32_t LIS302DL_AxisOverruns[3] = { 0, 0, 0 };
+
 /**** Private declarations ****/
 
-static uint8_t _LIS302DL_SendByte(SPI_TypeDef* spi, uint8_t byte);
+// Transfer and buffer of the blocking LIS302DL_Read and LIS302DL_Write, the address byte is in front
+static Sensors_Transfer _LIS302DL_BlockingTransfer;
+static uint8_t _LIS302DL_Buffer[LIS302DL_MAX_TRANSFER + 1];
+
+// Copy of the configuration registers, bit n of the valid mask stands for register LIS302DL_SHADOW_BASE + n
+static uint8_t _LIS302DL_Shadow[LIS302DL_SHADOW_SIZE];
+static uint32_t _LIS302DL_ShadowValid = 0;
+
+static uint8_t _LIS302DL_ShadowHas(uint8_t addr);
+static void _LIS302DL_ShadowStore(uint8_t addr, const uint8_t* pData, uint16_t count);
+
+static uint8_t _LIS302DL_Transfer(Sensors_Transfer* transfer, const uint8_t* tx, uint8_t* rx, uint16_t length, void (*callback)(Sensors_Transfer*));
+static uint8_t _LIS302DL_Start(SPI_TypeDef* spi, uint8_t (*start)(SPI_TypeDef*, Sensors_Transfer*, uint8_t*, uint8_t, uint16_t, void (*)(Sensors_Transfer*)), uint8_t addr, uint16_t length);
 
 
 /**** Public implementations ****/
@@ -42,13 +61,13 @@ void LIS302DL_Init(SPI_TypeDef* spi, const LIS302DL_Config* pConfig) {
 	cnf |= pConfig->YAxisEnabled ? (uint8_t)LIS302DL_BIT6 : 0x00;
 	cnf |= pConfig->XAxisEnabled ? (uint8_t)LIS302DL_BIT7 : 0x00;
 	
-	LIS302DL_Write(&cnf, LIS302DL_CTRL_REG1_ADDR, 1);
+	LIS302DL_WriteRegister(spi, LIS302DL_CTRL_REG1_ADDR, cnf);
 }
 
 
 void LIS302DL_GetConfiguration(SPI_TypeDef* spi, volatile LIS302DL_Config* pConfig) {
 	uint8_t cnf = 0x00;
-	LIS302DL_Read(&cnf, LIS302DL_CTRL_REG1_ADDR, 1);
+	cnf = LIS302DL_ReadRegister(spi, LIS302DL_CTRL_REG1_ADDR);
 	
 	// Map received data into the configuration; Data is delivered in BigEndian
 	pConfig->DataRate = cnf & (uint8_t)LIS302DL_BIT0 ? 0x01 : 0x00;
@@ -65,7 +84,7 @@ void LIS302DL_GetConfiguration(SPI_TypeDef* spi, volatile LIS302DL_Config* pConf
 void LIS302DL_GlobalInterruptConfiguration(SPI_TypeDef* spi, LIS302DL_GlobalInterruptConfig* pConfig) {
 	// Get the current configuration
 	uint8_t cnf = 0x00;
-	LIS302DL_Read(&cnf, LIS302DL_CTRL_REG2_ADDR, 1);
+	cnf = LIS302DL_ReadRegister(spi, LIS302DL_CTRL_REG2_ADDR);
 	
 	// Unset the bits we want configure
 	cnf &= (uint8_t)~(LIS302DL_BIT3 | LIS302DL_BIT4 | LIS302DL_BIT5 | LIS302DL_BIT6 | LIS302DL_BIT7);
@@ -76,13 +95,13 @@ void LIS302DL_GlobalInterruptConfiguration(SPI_TypeDef* spi, LIS302DL_GlobalInte
 	cnf |= pConfig->Interrupt_2 ? (uint8_t)LIS302DL_BIT5 : 0x00;
 	cnf |= (pConfig->CutOffFrequency <= (uint8_t)LIS302DL_HIGHPASS_CUTOFF_SLOW) ? pConfig->CutOffFrequency : 0x00;
 	
-	LIS302DL_Write(&cnf, LIS302DL_CTRL_REG2_ADDR, 1);
+	LIS302DL_WriteRegister(spi, LIS302DL_CTRL_REG2_ADDR, cnf);
 }
 
 
 void LIS302DL_GetGlobalInterruptConfiguration(SPI_TypeDef* spi, LIS302DL_GlobalInterruptConfig* pConfig) {
 	uint8_t cnf = 0x00;
-	LIS302DL_Read(&cnf, LIS302DL_CTRL_REG2_ADDR, 1);
+	cnf = LIS302DL_ReadRegister(spi, LIS302DL_CTRL_REG2_ADDR);
 	
 	// Map received data into the configuration; Data is delivered in BigEndian
 	pConfig->SendData = cnf & (uint8_t)LIS302DL_BIT3 ? 0x01 : 0x00;
@@ -104,13 +123,13 @@ void LIS302DL_WakeupInterruptConfiguration(SPI_TypeDef* spi, LIS302DL_WakeupInte
 	cnf |= pConfig->X_High ? (uint8_t)LIS302DL_BIT6 : 0x00;
 	cnf |= pConfig->X_Low ? (uint8_t)LIS302DL_BIT7 : 0x00;
 	
-	LIS302DL_Write(&cnf, ((intNum & LIS302DL_INTERRUPT_NUM_2) ? LIS302DL_FF_WU_CFG2_REG_ADDR : LIS302DL_FF_WU_CFG1_REG_ADDR), 1);
+	LIS302DL_WriteRegister(spi, ((intNum & LIS302DL_INTERRUPT_NUM_2) ? LIS302DL_FF_WU_CFG2_REG_ADDR : LIS302DL_FF_WU_CFG1_REG_ADDR), cnf);
 }
 
 
 void LIS302DL_GetWakeupInterruptConfiguration(SPI_TypeDef* spi, LIS302DL_WakeupInterruptConfig* pConfig, uint8_t intNum) {
 	uint8_t cnf = 0x00;
-	LIS302DL_Read(&cnf, ((intNum & LIS302DL_INTERRUPT_NUM_2) ? LIS302DL_FF_WU_CFG2_REG_ADDR : LIS302DL_FF_WU_CFG1_REG_ADDR), 1);
+	cnf = LIS302DL_ReadRegister(spi, ((intNum & LIS302DL_INTERRUPT_NUM_2) ? LIS302DL_FF_WU_CFG2_REG_ADDR : LIS302DL_FF_WU_CFG1_REG_ADDR));
 	
 	// Map received data into the configuration; Data is delivered in BigEndian
 	pConfig->CombineInterrupts = cnf & (uint8_t)LIS302DL_BIT0 ? 0x01 : 0x00;
@@ -126,7 +145,7 @@ void LIS302DL_GetWakeupInterruptConfiguration(SPI_TypeDef* spi, LIS302DL_WakeupI
 
 void LIS302DL_GetWakeupInterruptData(SPI_TypeDef* spi, LIS302DL_WakeupInterruptData* pData, uint8_t intNum) {
 	uint8_t tmpreg = 0x00;
-	LIS302DL_Read(&tmpreg, ((intNum & LIS302DL_INTERRUPT_NUM_2) ? LIS302DL_FF_WU_SRC2_REG_ADDR : LIS302DL_FF_WU_SRC1_REG_ADDR), 1);
+	tmpreg = LIS302DL_ReadRegister(spi, ((intNum & LIS302DL_INTERRUPT_NUM_2) ? LIS302DL_FF_WU_SRC2_REG_ADDR : LIS302DL_FF_WU_SRC1_REG_ADDR));
 	
 	// Map received data into the configuration; Data is delivered in BigEndian
 	pData->Active = tmpreg & (uint8_t)LIS302DL_BIT1 ? 0x01 : 0x00;
@@ -150,13 +169,13 @@ void LIS302DL_ClickInterruptConfiguration(SPI_TypeDef* spi, LIS302DL_ClickInterr
 	cnf |= pConfig->DoubleClick_X ? (uint8_t)LIS302DL_BIT6 : 0x00;
 	cnf |= pConfig->SingleClick_X ? (uint8_t)LIS302DL_BIT7 : 0x00;
 	
-	LIS302DL_Write(&cnf, LIS302DL_CLICK_CFG_REG_ADDR, 1);
+	LIS302DL_WriteRegister(spi, LIS302DL_CLICK_CFG_REG_ADDR, cnf);
 }
 
 
 void LIS302DL_GetClickInterruptConfiguration(SPI_TypeDef* spi, LIS302DL_ClickInterruptConfig* pConfig) {
 	uint8_t cnf = 0x00;
-	LIS302DL_Read(&cnf, LIS302DL_CLICK_CFG_REG_ADDR, 1);
+	cnf = LIS302DL_ReadRegister(spi, LIS302DL_CLICK_CFG_REG_ADDR);
 	
 	// Map received data into the configuration; Data is delivered in BigEndian
 	pConfig->Latched = cnf & (uint8_t)LIS302DL_BIT1 ? 0x01 : 0x00;
@@ -171,7 +190,7 @@ void LIS302DL_GetClickInterruptConfiguration(SPI_TypeDef* spi, LIS302DL_ClickInt
 
 void LIS302DL_GetClickInterruptData(SPI_TypeDef* spi, LIS302DL_ClickInterruptData* pData) {
 	uint8_t tmpreg = 0x00;
-	LIS302DL_Read(&tmpreg, LIS302DL_CLICK_SRC_REG_ADDR, 1);
+	tmpreg = LIS302DL_ReadRegister(spi, LIS302DL_CLICK_SRC_REG_ADDR);
 	
 	// Map received data into the configuration; Data is delivered in BigEndian
 	pData->Active = tmpreg & (uint8_t)LIS302DL_BIT1 ? 0x01 : 0x00;
@@ -184,7 +203,54 @@ void LIS302DL_GetClickInterruptData(SPI_TypeDef* spi, LIS302DL_ClickInterruptDat
 }
 
 
-void LIS302DL_Read(SPI_TypeDef* spi, uint8_t* pBuffer, uint8_t readAddr, uint16_t numByteToRead) {
+uint8_t LIS302DL_Read(SPI_TypeDef* spi, uint8_t* pBuffer, uint8_t readAddr, uint16_t numByteToRead) {
+	uint16_t i;
+	uint8_t status;
+	
+	if (numByteToRead > LIS302DL_MAX_TRANSFER) {
+		numByteToRead = LIS302DL_MAX_TRANSFER;
+	}
+	
+	// Start the transfer as soon as the bus is free and wait for the data
+	status = _LIS302DL_Start(spi, LIS302DL_ReadAsync, readAddr, numByteToRead);
+	if (status != SENSORS_BUS_DONE) {
+		return status;
+	}
+	
+	// The received data follows the answer to the address byte
+	for (i = 0; i < numByteToRead; i++) {
+		pBuffer[i] = _LIS302DL_Buffer[i + 1];
+	}
+	_LIS302DL_ShadowStore(readAddr, pBuffer, numByteToRead);
+	return status;
+}
+
+
+uint8_t LIS302DL_Write(SPI_TypeDef* spi, uint8_t* pBuffer, uint8_t writeAddr, uint16_t numByteToWrite) {
+	uint16_t i;
+	uint8_t status;
+	
+	if (numByteToWrite > LIS302DL_MAX_TRANSFER) {
+		numByteToWrite = LIS302DL_MAX_TRANSFER;
+	}
+	
+	// The address byte is sent in front of the data
+	for (i = 0; i < numByteToWrite; i++) {
+		_LIS302DL_Buffer[i + 1] = pBuffer[i];
+	}
+	status = _LIS302DL_Start(spi, LIS302DL_WriteAsync, writeAddr, numByteToWrite);
+	
+	// The shadow copy was written through, but the device may not have the new values
+	if (status != SENSORS_BUS_DONE) {
+		LIS302DL_InvalidateShadow();
+	}
+	return status;
+}
+
+
+uint8_t LIS302DL_ReadAsync(SPI_TypeDef* spi, Sensors_Transfer* transfer, uint8_t* pBuffer, uint8_t readAddr, uint16_t numByteToRead, void (*callback)(Sensors_Transfer*)) {
+	uint16_t i;
+	
 	// For reading multiple bytes we need to set bit 0 (RW) and 1 (MS)
 	if(numByteToRead > 1) {
 		readAddr |= (uint8_t)(LIS302DL_BIT0 | LIS302DL_BIT1);
@@ -192,175 +258,289 @@ void LIS302DL_Read(SPI_TypeDef* spi, uint8_t* pBuffer, uint8_t readAddr, uint16_
 		readAddr |= (uint8_t)LIS302DL_BIT0;
 	}
 	
-	// Set chip select Low at the start of the transmission
-	LIS302DL_CS_LOW();
-	
-	// Send the address of the indexed register
-	_LIS302DL_SendByte(spi, readAddr);
-	
-	// Receive the data that will be read from the device (MSB First)
-	// Send a dummy byte (0x00) to generate the SPI clock to LIS302DL (Slave device) and receive data.
-	while (numByteToRead > 0) {
-		*pBuffer = _LIS302DL_SendByte(spi, (uint8_t)LIS302DL_DUMMY_BYTE);
-		numByteToRead--;
-		pBuffer++;
+	// Send the address of the indexed register followed by dummy bytes (0x00) to generate the SPI clock
+	// for the data (MSB First); the data is received into the same buffer
+	pBuffer[0] = readAddr;
+	for (i = 1; i <= numByteToRead; i++) {
+		pBuffer[i] = (uint8_t)LIS302DL_DUMMY_BYTE;
 	}
-	
-	// Set chip select High at the end of the transmission
-	LIS302DL_CS_HIGH();
+	return _LIS302DL_Transfer(transfer, pBuffer, pBuffer, numByteToRead + 1, callback);
 }
 
 
-void LIS302DL_Write(SPI_TypeDef* spi, uint8_t* pBuffer, uint8_t writeAddr, uint16_t numByteToWrite) {
+uint8_t LIS302DL_WriteAsync(SPI_TypeDef* spi, Sensors_Transfer* transfer, uint8_t* pBuffer, uint8_t writeAddr, uint16_t numByteToWrite, void (*callback)(Sensors_Transfer*)) {
+	// Write through the shadow copy
+	_LIS302DL_ShadowStore(writeAddr, &pBuffer[1], numByteToWrite);
+	
 	// For writing multiple bytes we need to set bit 1 (MS)
 	if (numByteToWrite > 1) {
 		writeAddr |= (uint8_t)LIS302DL_BIT1;
 	}
 	
-	// Set chip select Low at the start of the transmission
-	LIS302DL_CS_LOW();
+	// Send the Address of the indexed register followed by the data (MSB First), the answer is not needed
+	pBuffer[0] = writeAddr;
+	return _LIS302DL_Transfer(transfer, pBuffer, 0, numByteToWrite + 1, callback);
+}
+
+
+void LIS302DL_Acceleration(SPI_TypeDef* spi, int32_t* out) {
+	uint8_t buffer[5];
+	uint8_t sensitivity, i = 0;
 	
-	LIS302DL_Read(spi);
+	// The FS bit comes from the shadow copy of the Control-Register-1
+	sensitivity = LIS302DL_Sensitivity(spi);
 	
-	// Send the Address of the indexed register
-	_LIS302DL_SendByte(spi, writeAddr);
+	// Read out the X,Y,Z output data in one burst. Between them is one byte each which is not used, therefore 5 bytes
+	LIS302DL_Read(spi, buffer, LIS302DL_OUT_X_ADDR, 5);
 	
-	// Send the data that will be written into the device (MSB First)
-	while (numByteToWrite >= 1) {
-		_LIS302DL_SendByte(spi, *pBuffer);
-		numByteToWrite--;
-		pBuffer++;
+	// Multiply axis values wtith the sensitivity.
+	// Only use the first, third and fifth byte, the second and fourth is not used.
+	// OUT_X (29), OUT_Y (2B), OUT_Z (2D) --> 2A and 2C is not used --> buffer[2 * i]
+	for (i = 0; i < 3; i++) {
+		*out = (int32_t)(sensitivity * (s8)buffer[2 * i]);
+		out++;
 	}
+}
+
+
+uint8_t LIS302DL_ReadSample(SPI_TypeDef* spi, LIS302DL_Sample* pSample) {
+	uint8_t buffer[LIS302DL_SAMPLE_SIZE];
 	
-	// Set chip select High at the end of the transmission
-	LIS302DL_CS_HIGH();
+	LIS302DL_Read(spi, buffer, LIS302DL_STATUS_REG_ADDR, LIS302DL_SAMPLE_SIZE);
+	return LIS302DL_DecodeSample(buffer, LIS302DL_Sensitivity(spi), pSample);
 }
 
 
-void LIS302DL_Acceleration(SPI_TypeDef* spi, int32_t* out) {
-	uint8_t buffer[6];
-	uint8_t crtl, i = 0;
+uint8_t LIS302DL_ReadSampleAsync(SPI_TypeDef* spi, Sensors_Transfer* transfer, uint8_t* pBuffer, void (*callback)(Sensors_Transfer*)) {
+	return LIS302DL_ReadAsync(spi, transfer, pBuffer, LIS302DL_STATUS_REG_ADDR, LIS302DL_SAMPLE_SIZE, callback);
+}
+
+
+uint8_t LIS302DL_DecodeSample(const uint8_t* pBuffer, uint8_t sensitivity, LIS302DL_Sample* pSample) {
+	uint8_t status = pBuffer[0];
+	
+	pSample->Status = status;
+	pSample->NewData = (status & LIS302DL_STATUS_ZYXDA) ? 1 : 0;
+	pSample->Overrun = (status & LIS302DL_STATUS_ZYXOR) ? 1 : 0;
+	
+	if (status & LIS302DL_STATUS_ZYXOR) {
+		LIS302DL_Overruns++;
+	}
+	if (status & LIS302DL_STATUS_XOR) {
+		LIS302DL_AxisOverruns[0]++;
+	}
+	if (status & LIS302DL_STATUS_YOR) {
+		LIS302DL_AxisOverruns[1]++;
+	}
+	if (status & LIS302DL_STATUS_ZOR) {
+		LIS302DL_AxisOverruns[2]++;
+	}
 	
-	// Read out the Control-Register-1 to get the FS value
-	LIS302DL_Read(spi, &crtl, LIS302DL_CTRL_REG1_ADDR, 1);
+	// The same data as last time, nothing to convert
+	if (!pSample->NewData) {
+		return 0;
+	}
 	
-	// Read out the X,Y,Z output data. Between them is one byte each which is not used, therefore 6 bytes
-	LIS302DL_Read(spi, buffer, LIS302DL_OUT_X_ADDR, 6);
+	// STATUS (27), unused (28), OUT_X (29), unused (2A), OUT_Y (2B), unused (2C), OUT_Z (2D)
+	pSample->X = (int32_t)(sensitivity * (s8)pBuffer[2]);
+	pSample->Y = (int32_t)(sensitivity * (s8)pBuffer[4]);
+	pSample->Z = (int32_t)(sensitivity * (s8)pBuffer[6]);
+	return 1;
+}
+
+
+uint8_t LIS302DL_ReadRegister(SPI_TypeDef* spi, uint8_t readAddr) {
+	uint8_t value = 0x00;
 	
-	// Check for the FS bit is set or not.
-	// Multiply axis values wtith the sensitivity and all these values with each other.
-	// Only use the first, third and fifth byte, the second and third is not used.
-	// OUT_X (29), OUT_Y (2B), OUT_Z (2D) --> 2A and 2C is not used --> buffer[2 * i]
-	switch (crtl & (uint8_t)LIS302DL_BIT2) {
-		// FS bit is 0 ==> Sensitivity typical value = 18 milligals/digit
-		case 0:
-			for (i = 0; i < 3; i++) {
-				*out = (int32_t)(18 * (i8)buffer[2 * i]);
-				out++;
+	if (_LIS302DL_ShadowHas(readAddr)) {
+		return _LIS302DL_Shadow[readAddr - LIS302DL_SHADOW_BASE];
+	}
+	LIS302DL_Read(spi, &value, readAddr, 1);
+	return value;
+}
+
+
+void LIS302DL_WriteRegister(SPI_TypeDef* spi, uint8_t writeAddr, uint8_t value) {
+	LIS302DL_Register reg = { writeAddr, value };
+	LIS302DL_WriteRegisters(spi, &reg, 1);
+}
+
+
+void LIS302DL_WriteRegisters(SPI_TypeDef* spi, const LIS302DL_Register* pRegisters, uint8_t count) {
+	uint8_t data[LIS302DL_SHADOW_SIZE];
+	uint8_t i, first, length, changed;
+	
+	for (i = 0; i < count; ) {
+		// Collect a run of consecutive addresses, only the part up to the last changed register is sent
+		first = pRegisters[i].Address;
+		length = 0;
+		changed = 0;
+		do {
+			data[length++] = pRegisters[i].Value;
+			if (!_LIS302DL_ShadowHas(pRegisters[i].Address) || (_LIS302DL_Shadow[pRegisters[i].Address - LIS302DL_SHADOW_BASE] != pRegisters[i].Value)) {
+				changed = length;
 			}
-			break;
+			i++;
+		} while ((i < count) && (length < LIS302DL_SHADOW_SIZE) && (pRegisters[i].Address == first + length));
 		
-		// FS bit is 1 ==> Sensitivity typical value = 72 milligals/digit
-		case (uint8_t)LIS302DL_BIT2:
-			for(i = 0; i < 3; i++) {
-				*out = (int32_t)(72 * (i8)buffer[2 * i]);
-				out++;
-			}         
-			break;
-		default:
-			break;
+		if (changed) {
+			LIS302DL_Write(spi, data, first, changed);
+		}
 	}
 }
 
 
+void LIS302DL_InvalidateShadow(void) {
+	_LIS302DL_ShadowValid = 0;
+}
+
+
+uint8_t LIS302DL_Sensitivity(SPI_TypeDef* spi) {
+	// FS bit is 0 ==> Sensitivity typical value = 18 milligals/digit, FS bit is 1 ==> 72 milligals/digit
+	return (LIS302DL_ReadRegister(spi, LIS302DL_CTRL_REG1_ADDR) & (uint8_t)LIS302DL_BIT2) ? 72 : 18;
+}
+
+
 void LIS302DL_Reboot(SPI_TypeDef* spi) {
 	uint8_t tmpreg;
 	
 	// Read the CTRL_REG2, enable the reboot memory flag and write it back
-	LIS302DL_Read(spi, &tmpreg, LIS302DL_CTRL_REG2_ADDR, 1);
+	tmpreg = LIS302DL_ReadRegister(spi, LIS302DL_CTRL_REG2_ADDR);
 	tmpreg |= (uint8_t)LIS302DL_BIT1;
-	LIS302DL_Write(spi, &tmpreg, LIS302DL_CTRL_REG2_ADDR, 1);
+	LIS302DL_WriteRegister(spi, LIS302DL_CTRL_REG2_ADDR, tmpreg);
+	
+	// All registers are loaded with their defaults again
+	LIS302DL_InvalidateShadow();
 }
 
 
-void LIS302DL_ChangeScaleMode(SPI_TypeDef* spi, bool fullScaleEnable) {
+void LIS302DL_ChangeScaleMode(SPI_TypeDef* spi, uint8_t fullScaleEnable) {
 	uint8_t tmpreg;
 	
 	// Read the CTRL_REG1, enable/disable the FS memory flag and write it back
-	LIS302DL_Read(spi, &tmpreg, LIS302DL_CTRL_REG1_ADDR, 1);
+	tmpreg = LIS302DL_ReadRegister(spi, LIS302DL_CTRL_REG1_ADDR);
 	tmpreg &= (uint8_t)~LIS302DL_BIT2; // Unset the FS bit
 	if (!fullScaleEnable) { // If the bit is not set, we are in ±2.3g mode (full scale)
 		tmpreg |= (uint8_t)LIS302DL_BIT2;
 	}
-	LIS302DL_Write(spi, &tmpreg, LIS302DL_CTRL_REG1_ADDR, 1);
+	LIS302DL_WriteRegister(spi, LIS302DL_CTRL_REG1_ADDR, tmpreg);
 }
 
 
-void LIS302D_ChangeDataRate(SPI_TypeDef* spi, bool enableHighSpeed) {
+void LIS302D_ChangeDataRate(SPI_TypeDef* spi, uint8_t enableHighSpeed) {
 	uint8_t tmpreg;
 	
 	// Read the CTRL_REG1, enable/disable the DR memory flag and write it back
-	LIS302DL_Read(spi, &tmpreg, LIS302DL_CTRL_REG1_ADDR, 1);
+	tmpreg = LIS302DL_ReadRegister(spi, LIS302DL_CTRL_REG1_ADDR);
 	tmpreg &= (uint8_t)~LIS302DL_BIT0; // Unset the FS bit
 	if (!enableHighSpeed) { // If the bit is set, we are on 400Hz, otherwise on 100Hz
 		tmpreg |= (uint8_t)LIS302DL_BIT0;
 	}
-	LIS302DL_Write(spi, &tmpreg, LIS302DL_CTRL_REG1_ADDR, 1);
+	LIS302DL_WriteRegister(spi, LIS302DL_CTRL_REG1_ADDR, tmpreg);
 }
 
 
-void LIS302D_ChangePowerControl(SPI_TypeDef* spi, bool enableActiveMode) {
+void LIS302D_ChangePowerControl(SPI_TypeDef* spi, uint8_t enableActiveMode) {
 	uint8_t tmpreg;
 	
 	// Read the CTRL_REG1, enable/disable the PD memory flag and write it back
-	LIS302DL_Read(spi, &tmpreg, LIS302DL_CTRL_REG1_ADDR, 1);
+	tmpreg = LIS302DL_ReadRegister(spi, LIS302DL_CTRL_REG1_ADDR);
 	tmpreg &= (uint8_t)~LIS302DL_BIT1; // Unset the FS bit
 	if (enableActiveMode) { // If the bit is set, we are in active mode, else in power down control
 		tmpreg |= (uint8_t)LIS302DL_BIT1;
 	}
-	LIS302DL_Write(spi, &tmpreg, LIS302DL_CTRL_REG1_ADDR, 1);
+	LIS302DL_WriteRegister(spi, LIS302DL_CTRL_REG1_ADDR, tmpreg);
 }
 
 /**** Private implementations ****/
 
 /**
- * @brief  Send one Byte through the SPI interface and return the received Byte
- * @param  uint8_t byte  The byte to send
- * @retval uint8_t The received byte value
+ * @brief  Check if the shadow copy holds a valid value for the register
+ * @param  addr  Address of the register
+ * @retval uint8_t 1 if the register is cached, 0 otherwise
  */
-static uint8_t _LIS302DL_SendByte(SPI_TypeDef* spi, uint8_t byte) {
-	volatile uint32_t _LIS302DL_Timeout = LIS302DL_MAX_TIMEOUT;
-	
-	// Loop while DR register in not empty; or we ran into a timeout
-	_LIS302DL_Timeout = LIS302DL_MAX_TIMEOUT;
-	while (SPI_I2S_GetFlagStatus(spi, SPI_I2S_FLAG_TXE) == RESET) {
-		if ((_LIS302DL_Timeout--) == 0) {
-			return LIS302DL_TIMEOUT_UserCallback();
+static uint8_t _LIS302DL_ShadowHas(uint8_t addr) {
+	if ((addr < LIS302DL_SHADOW_BASE) || (addr >= LIS302DL_SHADOW_BASE + LIS302DL_SHADOW_SIZE)) {
+		return 0;
+	}
+	return (_LIS302DL_ShadowValid & (1UL << (addr - LIS302DL_SHADOW_BASE))) ? 1 : 0;
+}
+
+/**
+ * @brief  Update the shadow copy with values written to or read from the device
+ * @param  addr  Address of the first register
+ * @param  pData  The register values
+ * @param  count  Number of registers
+ * @retval None
+ */
+static void _LIS302DL_ShadowStore(uint8_t addr, const uint8_t* pData, uint16_t count) {
+	uint8_t index;
+	
+	for (; count > 0; count--, addr++, pData++) {
+		index = addr - LIS302DL_SHADOW_BASE;
+		if ((addr >= LIS302DL_SHADOW_BASE) && (index < LIS302DL_SHADOW_SIZE) && (LIS302DL_SHADOW_REGISTERS & (1UL << index))) {
+			_LIS302DL_Shadow[index] = *pData;
+			_LIS302DL_ShadowValid |= 1UL << index;
 		}
 	}
+}
+
+/**
+ * @brief  Fill in a transfer to the LIS302DL and start or queue it
+ * @param  transfer  The transfer to start
+ * @param  tx  Bytes to send
+ * @param  rx  Buffer for the received bytes, may be the same as tx or 0
+ * @param  length  Number of bytes including the address
+ * @param  callback  Called when the transfer is finished, may be 0
+ * @retval uint8_t 1 if the transfer was started or queued, 0 if it is still pending
+ */
+static uint8_t _LIS302DL_Transfer(Sensors_Transfer* transfer, const uint8_t* tx, uint8_t* rx, uint16_t length, void (*callback)(Sensors_Transfer*)) {
+	transfer->device = &LIS302DL_Device;
+	transfer->tx = tx;
+	transfer->rx = rx;
+	transfer->length = length;
+	transfer->callback = callback;
+	return sensors_spi_start(transfer);
+}
+
+/**
+ * @brief  Run a blocking transfer on _LIS302DL_Buffer: wait for the bus, start the transfer and wait for its end
+ * @param  spi  Pointer to the SPI on which the data should be sent/set/received
+ * @param  start  LIS302DL_ReadAsync or LIS302DL_WriteAsync
+ * @param  addr  LIS302DL Internal address of the first register
+ * @param  length  Number of data bytes
+ * @retval uint8_t SENSORS_BUS_DONE, SENSORS_BUS_ERROR if the bus failed even after a recovery,
+ *         SENSORS_BUS_BUSY or _QUEUED on a timeout
+ */
+static uint8_t _LIS302DL_Start(SPI_TypeDef* spi, uint8_t (*start)(SPI_TypeDef*, Sensors_Transfer*, uint8_t*, uint8_t, uint16_t, void (*)(Sensors_Transfer*)), uint8_t addr, uint16_t length) {
+	volatile uint32_t _LIS302DL_Timeout = LIS302DL_MAX_TIMEOUT;
+	uint8_t status;
 	
-	// Send a Byte through the SPI peripheral
-	SPI_I2S_SendData(spi, byte);
-	
-	// Wait to receive a Byte; or we ran into a timeout
-	_LIS302DL_Timeout = LIS302DL_MAX_TIMEOUT;
-	while (SPI_I2S_GetFlagStatus(spi, SPI_I2S_FLAG_RXNE) == RESET) {
+	// Loop while the last blocking transfer is still pending; or we ran into a timeout
+	while (!start(spi, &_LIS302DL_BlockingTransfer, _LIS302DL_Buffer, addr, length, 0)) {
+		sensors_spi_check();
 		if ((_LIS302DL_Timeout--) == 0) {
-			return LIS302DL_TIMEOUT_UserCallback();
+			LIS302DL_TIMEOUT_UserCallback();
+			return SENSORS_BUS_BUSY;
 		}
 	}
 	
-	/* Return the Byte read from the SPI bus */
-	return (uint8_t)SPI_I2S_ReceiveData(spi);
+	// Wait for all bytes, a stuck bus is recovered meanwhile; or we ran into a timeout
+	status = sensors_spi_wait(&_LIS302DL_BlockingTransfer, LIS302DL_MAX_TIMEOUT * (length + 1));
+	if (status != SENSORS_BUS_DONE) {
+		LIS302DL_TIMEOUT_UserCallback();
+	}
+	return status;
 }
 
 #ifndef LIS302DL_USE_CUSTOM_TIMEOUT_CALLBACK
 /**
- * @brief  Basic management for timeouts blocks all further communications by default and therefore halt the application
+ * @brief  Basic management for timeouts, the bus is already recovered and the error counted
+ *         in LIS302DL_Health, so the failed call just returns its status
  * @param  None
- * @retval None
+ * @retval uint32_t 0
  */
 uint32_t LIS302DL_TIMEOUT_UserCallback(void) {
-	while (1);
+	return 0;
 }
 #endif // LIS302DL_USE_CUSTOM_TIMEOUT_CALLBACK
@@ -0,0 +1,155 @@
+/** @file    mixer.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Motor mixer: Maps the roll, pitch, yaw and throttle demands onto the
+ *           motors of the selected frame geometry with one matrix-vector product
+ *           and keeps the attitude authority when a motor saturates (airmode).
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/mixer.h"
+#include "../inc/receiver.h"
+
+volatile u32 mixer_saturations = 0;
+volatile u32 mixer_cycles = 0;
+
+/**** Private declarations ****/
+
+// Mixer matrices: one row per motor with the roll, pitch and yaw factors
+static const float mixer_quad_x[4][MIXER_AXES] = {
+	{ -1.0f,  1.0f,  1.0f },
+	{ -1.0f, -1.0f, -1.0f },
+	{  1.0f, -1.0f,  1.0f },
+	{  1.0f,  1.0f, -1.0f }
+};
+
+static const float mixer_quad_plus[4][MIXER_AXES] = {
+	{  0.0f,  1.0f,  1.0f },
+	{ -1.0f,  0.0f, -1.0f },
+	{  0.0f, -1.0f,  1.0f },
+	{  1.0f,  0.0f, -1.0f }
+};
+
+static const float mixer_hexa_x[6][MIXER_AXES] = {
+	{ -0.5f,  0.866025f,  1.0f },
+	{ -1.0f,  0.0f,      -1.0f },
+	{ -0.5f, -0.866025f,  1.0f },
+	{  0.5f, -0.866025f, -1.0f },
+	{  1.0f,  0.0f,       1.0f },
+	{  0.5f,  0.866025f, -1.0f }
+};
+
+static const float mixer_octo_x[8][MIXER_AXES] = {
+	{ -0.382683f,  0.923880f,  1.0f },
+	{ -0.923880f,  0.382683f, -1.0f },
+	{ -0.923880f, -0.382683f,  1.0f },
+	{ -0.382683f, -0.923880f, -1.0f },
+	{  0.382683f, -0.923880f,  1.0f },
+	{  0.923880f, -0.382683f, -1.0f },
+	{  0.923880f,  0.382683f,  1.0f },
+	{  0.382683f,  0.923880f, -1.0f }
+};
+
+static const float (*mixer_matrix)[MIXER_AXES] = mixer_quad_x;
+static u8 mixer_motors = 4;
+
+
+/**** Public implementations ****/
+
+u8 mixer_init(u8 geometry) {
+	switch (geometry) {
+		case MIXER_QUAD_PLUS:
+			mixer_matrix = mixer_quad_plus;
+			mixer_motors = 4;
+			break;
+		case MIXER_HEXA_X:
+			mixer_matrix = mixer_hexa_x;
+			mixer_motors = 6;
+			break;
+		case MIXER_OCTO_X:
+			mixer_matrix = mixer_octo_x;
+			mixer_motors = 8;
+			break;
+		default:
+			mixer_matrix = mixer_quad_x;
+			mixer_motors = 4;
+			break;
+	}
+	return mixer_motors;
+}
+
+u8 mixer_mix(const Mixer_Demand* demand, float* motor) {
+	u32 start = receiver_now();
+	float min = 0.0f, max = 0.0f, range, throttle;
+	u8 i, saturated = 0;
+
+	// Matrix-vector product of the axes, the extremes are needed for the desaturation
+	for (i = 0; i < mixer_motors; i++) {
+		motor[i] = mixer_matrix[i][MIXER_ROLL] * demand->axis[MIXER_ROLL]
+		         + mixer_matrix[i][MIXER_PITCH] * demand->axis[MIXER_PITCH]
+		         + mixer_matrix[i][MIXER_YAW] * demand->axis[MIXER_YAW];
+		if (!i || (motor[i] < min)) {
+			min = motor[i];
+		}
+		if (!i || (motor[i] > max)) {
+			max = motor[i];
+		}
+	}
+
+	// More than the full motor range: scale all axes down together
+	range = max - min;
+	if (range > 1.0f) {
+		for (i = 0; i < mixer_motors; i++) {
+			motor[i] /= range;
+		}
+		min /= range;
+		max /= range;
+		saturated = 1;
+	}
+
+	// Shift the throttle so the lowest motor is not below 0 and the highest not above 1
+	throttle = demand->throttle;
+	if (throttle + min < 0.0f) {
+		throttle = -min;
+		saturated = 1;
+	} else if (throttle + max > 1.0f) {
+		throttle = 1.0f - max;
+		saturated = 1;
+	}
+	for (i = 0; i < mixer_motors; i++) {
+		motor[i] += throttle;
+	}
+
+	if (saturated) {
+		mixer_saturations++;
+	}
+	mixer_cycles = receiver_now() - start;
+	return saturated;
+}
+
+void mixer_output(const Mixer_Demand* demand) {
+	float motor[MIXER_MOTORS_MAX];
+	u16 position[SERVO_CHANNELS];
+	u8 i;
+
+	mixer_mix(demand, motor);
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		position[i] = (i < mixer_motors) ? (u16)(motor[i] * SERVO_POSITION_MAX + 0.5f) : 0;
+	}
+	servo_commit(position);
+}
@@ -22,19 +22,35 @@
  */
 #include "../inc/movement.h"
 
-void move_x(const i8 value) {
-	
+#if MIXER_GEOMETRY_MOTORS > SERVO_CHANNELS
+#error "MIXER_GEOMETRY has more motors than SERVO_CHANNELS"
+#endif
+
+static Mixer_Demand movement_demand = { { 0.0f, 0.0f, 0.0f }, 0.0f };
+
+u8 movement_init() {
+	// A motor without an output would never get thrust, do not fly with it
+	return mixer_init(MIXER_GEOMETRY) <= SERVO_CHANNELS;
+}
+
+void move_x(const s8 value) {
+	// Nose down to move forward
+	movement_demand.axis[MIXER_PITCH] = -(float)value / 128.0f;
+}
+
+void move_y(const s8 value) {
+	movement_demand.axis[MIXER_ROLL] = (float)value / 128.0f;
 }
 
-void move_y(const i8 value) {
-	
+void move_z(const s8 value) {
+	movement_demand.throttle = ((float)value + 128.0f) / 255.0f;
 }
 
-void move_z(const i8 value) {
-	
+void rotate(const s8 value) {
+	movement_demand.axis[MIXER_YAW] = (float)value / 128.0f;
 }
 
-void rotate(const i8 value) {
-	
+void movement_update() {
+	mixer_output(&movement_demand);
 }
 
@@ -23,11 +23,43 @@
  */
 #include "../inc/receiver.h"
 
-volatile u16 receiver_position[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
-volatile u16 receiver_position_read[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+volatile u16 receiver_position[RECEIVER_CHANNELS] = { 0 };
+volatile u16 receiver_position_read[RECEIVER_CHANNELS] = { 0 };
 volatile u16 receiver_count = 0;
+volatile u32 receiver_snapshot_reads = 0;
+volatile u32 receiver_snapshot_retries = 0;
+
+// The DWT cycle counter is not part of the CMSIS version in lib/inc/core
+#define RECEIVER_DWT_CTRL (*(volatile u32*)0xE0001000)
+#define RECEIVER_DWT_CYCCNT (*(volatile u32*)0xE0001004)
+#define RECEIVER_DWT_CTRL_CYCCNTENA 0x00000001
+
+/**
+ * Published frames: Two buffers, the sequence counter tells which one is valid.
+ * An odd sequence means a frame is written into the buffer ((sequence >> 1) + 1) & 1,
+ * an even one that the buffer (sequence >> 1) & 1 holds the newest frame.
+ */
+typedef struct {
+	u16 position[RECEIVER_CHANNELS];
+	u32 timestamp;
+} Receiver_Frame;
+
+static volatile Receiver_Frame receiver_frames[2];
+static volatile u32 receiver_sequence = 0;
+
+// Channels set by the decoder since the last published frame
+static u32 receiver_updated = 0;
 
 void receiver_gpio_init() {
+#if RECEIVER_MODE == RECEIVER_MODE_CAPTURE
+	receiver_capture_gpio_init();
+#elif RECEIVER_MODE == RECEIVER_MODE_PPM
+	receiver_ppm_gpio_init();
+#elif RECEIVER_MODE == RECEIVER_MODE_SERIAL
+	receiver_serial_gpio_init();
+#elif RECEIVER_MODE == RECEIVER_MODE_SAMPLE
+	receiver_sample_gpio_init();
+#else
 	GPIO_InitTypeDef GPIO_Config;
 	GPIO_Config.GPIO_Pin = RECEIVER_PORTS;
 	GPIO_Config.GPIO_Mode = GPIO_Mode_IN;
@@ -35,10 +67,26 @@ void receiver_gpio_init() {
 	GPIO_Config.GPIO_Speed = GPIO_Speed_100MHz;
 	GPIO_Config.GPIO_PuPd = GPIO_PuPd_UP;
 	GPIO_Init(RECEIVER_REGISTER, &GPIO_Config);
+#endif
 }
 
 void receiver_init() {
-	// ---------- Interrupt configuration for the servos on TIM3 ---------- //
+	// Enable the cycle counter for the frame timestamps
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	RECEIVER_DWT_CYCCNT = 0;
+	RECEIVER_DWT_CTRL |= RECEIVER_DWT_CTRL_CYCCNTENA;
+	receiver_quality_init(RECEIVER_FAILSAFE_TIMEOUT);
+	
+#if RECEIVER_MODE == RECEIVER_MODE_CAPTURE
+	receiver_capture_init();
+#elif RECEIVER_MODE == RECEIVER_MODE_PPM
+	receiver_ppm_init();
+#elif RECEIVER_MODE == RECEIVER_MODE_SERIAL
+	receiver_serial_init();
+#elif RECEIVER_MODE == RECEIVER_MODE_SAMPLE
+	receiver_sample_init();
+#else
+	// ---------- Interrupt configuration for the receiver on TIM2 ---------- //
 	NVIC_InitTypeDef NVIC_InitStructure;
 	NVIC_InitStructure.NVIC_IRQChannel = TIM2_IRQn;
 	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
@@ -46,7 +94,7 @@ void receiver_init() {
 	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
 	NVIC_Init(&NVIC_InitStructure);
 	
-	// ---------- TIM3 / Time Management configuration ---------- //
+	// ---------- TIM2 / Time Management configuration ---------- //
 	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
 	
 	// STM32F4 runs at 84 MHz and we need 50Hz (20 milliseconds)
@@ -54,90 +102,204 @@ void receiver_init() {
 	TIM_TimeBaseStructure.TIM_Period = RECEIVER_TIM_PERIOD - 1; // 1 Hz / 20 = 50000 Hz (20000 ms)
 	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
 	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
-	TIM_TimeBaseInit(TIM3, &TIM_TimeBaseStructure);
+	TIM_TimeBaseInit(TIM2, &TIM_TimeBaseStructure);
 	
 	TIM_Cmd(TIM2, ENABLE);
-	TIM_ITConfig(TIM3, TIM_IT_Update, ENABLE);
+	TIM_ITConfig(TIM2, TIM_IT_Update, ENABLE);
 	//TIM_CtrlPWMOutputs(TIM2, ENABLE);
+#endif
 }
 
 u16 receiver_get_pos(u16 num) {
-	if ((num <= sizeof(receiver_position)/sizeof(u16)) && (receiver_position[num] <= RECEIVER_TIM_MICROSECOND)) {
-		return receiver_position[num];
+	u16 position;
+	if (num < RECEIVER_CHANNELS) {
+		// A single channel is always consistent, no need for a full snapshot
+		position = receiver_frames[(receiver_sequence >> 1) & 1].position[num];
+		if (position <= RECEIVER_POSITION_MAX) {
+			return position;
+		}
 	}
 	return 0;
 }
 
+u32 receiver_now() {
+	return RECEIVER_DWT_CYCCNT;
+}
+
+u32 receiver_elapsed(u32 from, u32 to) {
+	return (to - from) / (SystemCoreClock / 1000000);
+}
+
+u8 receiver_failsafe() {
+	u32 now = receiver_now();
+	u8 i;
+	for (i = 0; i < RECEIVER_CHANNELS; i++) {
+		if (!receiver_quality_stale(i, now)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+u16 receiver_get_snapshot(Receiver_Snapshot* snapshot) {
+	u32 start, end;
+	u16 retries = 0;
+	u8 i;
+	
+	while (1) {
+		start = receiver_sequence;
+		__DMB();
+		
+		// Copy the newest completed frame; while a frame is written (odd sequence)
+		// this is still the one before, so the reader never has to wait for the writer
+		const volatile Receiver_Frame* frame = &receiver_frames[(start >> 1) & 1];
+		for (i = 0; i < RECEIVER_CHANNELS; i++) {
+			snapshot->position[i] = frame->position[i] <= RECEIVER_POSITION_MAX ? frame->position[i] : 0;
+		}
+		snapshot->timestamp = frame->timestamp;
+		
+		// The buffer is only overwritten by the second frame started after ours
+		__DMB();
+		end = receiver_sequence;
+		if ((end - (start & ~1UL)) <= 2) {
+			break;
+		}
+		retries++;
+	}
+	
+	snapshot->sequence = start >> 1;
+	
+	// Stale channels are checked against now, not against the time of the frame
+	snapshot->stale = 0;
+	u32 now = receiver_now();
+	for (i = 0; i < RECEIVER_CHANNELS; i++) {
+		if (receiver_quality_stale(i, now)) {
+			snapshot->stale |= 1UL << i;
+		}
+	}
+	snapshot->failsafe = (snapshot->stale == (u32)((1ULL << RECEIVER_CHANNELS) - 1));
+	
+	receiver_snapshot_reads++;
+	receiver_snapshot_retries += retries;
+	return retries;
+}
+
+void receiver_set_pos(u16 num, u16 position) {
+	receiver_position[num] = position;
+	receiver_updated |= 1UL << num;
+}
+
+void receiver_publish() {
+	u32 sequence = receiver_sequence + 1;
+	const volatile Receiver_Frame* last = &receiver_frames[(sequence >> 1) & 1];
+	volatile Receiver_Frame* frame = &receiver_frames[((sequence >> 1) + 1) & 1];
+	u32 now = receiver_now();
+	u8 i;
+	
+	// Mark the write as in progress before touching the buffer
+	receiver_sequence = sequence;
+	__DMB();
+	
+	// Updated channels are filtered, all others keep the value of the last frame
+	for (i = 0; i < RECEIVER_CHANNELS; i++) {
+		if (receiver_updated & (1UL << i)) {
+			frame->position[i] = receiver_quality_filter(i, receiver_position[i], now);
+		} else {
+			frame->position[i] = last->position[i];
+		}
+	}
+	frame->timestamp = now;
+	receiver_updated = 0;
+	
+	__DMB();
+	receiver_sequence = sequence + 1;
+}
+
+#if RECEIVER_MODE == RECEIVER_MODE_POLL
 /**
  * Interrupt handler for TIM2
  */
 void TIM2_IRQHandler(void) {
 	if (TIM_GetITStatus(TIM2, TIM_IT_Update)) {
 		u16 port = 0;
+		u8 updated = 0;
+		TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
 		
 		// Read out all receiver ports
 		if (RECEIVER_REGISTER->IDR & RECEIVER1) {
 			receiver_position_read[port]++;
 		} else if (receiver_position_read[port] >= RECEIVER_TIM_MICROSECOND) {
-			receiver_position[port] = receiver_position_read[port] - RECEIVER_TIM_MICROSECOND;
+			receiver_set_pos(port, receiver_position_read[port] - RECEIVER_TIM_MICROSECOND);
 			receiver_position_read[port] = 0;
+			updated = 1;
 		}
 		port++;
 		
 		if (RECEIVER_REGISTER->IDR & RECEIVER2) {
 			receiver_position_read[port]++;
 		} else if (receiver_position_read[port] >= RECEIVER_TIM_MICROSECOND) {
-			receiver_position[port] = receiver_position_read[port] - RECEIVER_TIM_MICROSECOND;
+			receiver_set_pos(port, receiver_position_read[port] - RECEIVER_TIM_MICROSECOND);
 			receiver_position_read[port] = 0;
+			updated = 1;
 		}
 		port++;
 		
 		if (RECEIVER_REGISTER->IDR & RECEIVER3) {
 			receiver_position_read[port]++;
 		} else if (receiver_position_read[port] >= RECEIVER_TIM_MICROSECOND) {
-			receiver_position[port] = receiver_position_read[port] - RECEIVER_TIM_MICROSECOND;
+			receiver_set_pos(port, receiver_position_read[port] - RECEIVER_TIM_MICROSECOND);
 			receiver_position_read[port] = 0;
+			updated = 1;
 		}
 		port++;
 		
 		if (RECEIVER_REGISTER->IDR & RECEIVER4) {
 			receiver_position_read[port]++;
 		} else if (receiver_position_read[port] >= RECEIVER_TIM_MICROSECOND) {
-			receiver_position[port] = receiver_position_read[port] - RECEIVER_TIM_MICROSECOND;
+			receiver_set_pos(port, receiver_position_read[port] - RECEIVER_TIM_MICROSECOND);
 			receiver_position_read[port] = 0;
+			updated = 1;
 		}
 		port++;
 		
 		if (RECEIVER_REGISTER->IDR & RECEIVER5) {
 			receiver_position_read[port]++;
 		} else if (receiver_position_read[port] >= RECEIVER_TIM_MICROSECOND) {
-			receiver_position[port] = receiver_position_read[port] - RECEIVER_TIM_MICROSECOND;
+			receiver_set_pos(port, receiver_position_read[port] - RECEIVER_TIM_MICROSECOND);
 			receiver_position_read[port] = 0;
+			updated = 1;
 		}
 		port++;
 		
 		if (RECEIVER_REGISTER->IDR & RECEIVER6) {
 			receiver_position_read[port]++;
 		} else if (receiver_position_read[port] >= RECEIVER_TIM_MICROSECOND) {
-			receiver_position[port] = receiver_position_read[port] - RECEIVER_TIM_MICROSECOND;
+			receiver_set_pos(port, receiver_position_read[port] - RECEIVER_TIM_MICROSECOND);
 			receiver_position_read[port] = 0;
+			updated = 1;
 		}
 		port++;
 		
 		if (RECEIVER_REGISTER->IDR & RECEIVER7) {
 			receiver_position_read[port]++;
 		} else if (receiver_position_read[port] >= RECEIVER_TIM_MICROSECOND) {
-			receiver_position[port] = receiver_position_read[port] - RECEIVER_TIM_MICROSECOND;
+			receiver_set_pos(port, receiver_position_read[port] - RECEIVER_TIM_MICROSECOND);
 			receiver_position_read[port] = 0;
+			updated = 1;
 		}
 		port++;
 		
 		if (RECEIVER_REGISTER->IDR & RECEIVER8) {
 			receiver_position_read[port]++;
 		} else if (receiver_position_read[port] >= RECEIVER_TIM_MICROSECOND) {
-			receiver_position[port] = receiver_position_read[port] - RECEIVER_TIM_MICROSECOND;
+			receiver_set_pos(port, receiver_position_read[port] - RECEIVER_TIM_MICROSECOND);
 			receiver_position_read[port] = 0;
+			updated = 1;
 		}
 		
+		if (updated) {
+			receiver_publish();
+		}
 	}
 }
+#endif // RECEIVER_MODE == RECEIVER_MODE_POLL
@@ -0,0 +1,253 @@
+/** @file    receiver_capture.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Receiver decoding with timer input capture channels. Every edge on a
+ *           receiver line is latched by the timer and copied by DMA into a small
+ *           ring buffer, so the pulse widths are measured with 1µs resolution;
+ *           the half and full transfer interrupts of the DMA decode them.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/receiver.h"
+
+#if RECEIVER_MODE == RECEIVER_MODE_CAPTURE
+
+/**** Private declarations ****/
+
+/**
+ * Everything needed to capture one receiver channel: the timer channel, the DMA
+ * stream which copies the capture register and the input pin.
+ */
+typedef struct {
+	TIM_TypeDef* timer;
+	u16 channel;          //!< TIM_Channel_x
+	u16 dmaSource;        //!< TIM_DMA_CCx
+	volatile u32* ccr;    //!< Capture register the DMA reads from
+	DMA_Stream_TypeDef* stream;
+	u32 dmaChannel;       //!< DMA_Channel_x of the stream
+	u32 dmaIt;            //!< DMA_IT_HTIFx | DMA_IT_TCIFx of the stream
+	u8 irq;               //!< Interrupt of the stream
+	GPIO_TypeDef* port;
+	u16 pin;
+	u8 source;
+	u8 af;
+} Receiver_CaptureChannel;
+
+static const Receiver_CaptureChannel receiver_capture_channels[RECEIVER_CHANNELS] = {
+	{ TIM1, TIM_Channel_1, TIM_DMA_CC1, &TIM1->CCR1, DMA2_Stream1, DMA_Channel_6, DMA_IT_HTIF1 | DMA_IT_TCIF1, DMA2_Stream1_IRQn, GPIOE, GPIO_Pin_9,  GPIO_PinSource9,  GPIO_AF_TIM1 },
+	{ TIM1, TIM_Channel_2, TIM_DMA_CC2, &TIM1->CCR2, DMA2_Stream2, DMA_Channel_6, DMA_IT_HTIF2 | DMA_IT_TCIF2, DMA2_Stream2_IRQn, GPIOE, GPIO_Pin_11, GPIO_PinSource11, GPIO_AF_TIM1 },
+	{ TIM1, TIM_Channel_3, TIM_DMA_CC3, &TIM1->CCR3, DMA2_Stream6, DMA_Channel_6, DMA_IT_HTIF6 | DMA_IT_TCIF6, DMA2_Stream6_IRQn, GPIOE, GPIO_Pin_13, GPIO_PinSource13, GPIO_AF_TIM1 },
+	{ TIM1, TIM_Channel_4, TIM_DMA_CC4, &TIM1->CCR4, DMA2_Stream4, DMA_Channel_6, DMA_IT_HTIF4 | DMA_IT_TCIF4, DMA2_Stream4_IRQn, GPIOE, GPIO_Pin_14, GPIO_PinSource14, GPIO_AF_TIM1 },
+	{ TIM2, TIM_Channel_1, TIM_DMA_CC1, &TIM2->CCR1, DMA1_Stream5, DMA_Channel_3, DMA_IT_HTIF5 | DMA_IT_TCIF5, DMA1_Stream5_IRQn, GPIOA, GPIO_Pin_15, GPIO_PinSource15, GPIO_AF_TIM2 },
+	{ TIM2, TIM_Channel_2, TIM_DMA_CC2, &TIM2->CCR2, DMA1_Stream6, DMA_Channel_3, DMA_IT_HTIF6 | DMA_IT_TCIF6, DMA1_Stream6_IRQn, GPIOB, GPIO_Pin_3,  GPIO_PinSource3,  GPIO_AF_TIM2 },
+	{ TIM2, TIM_Channel_3, TIM_DMA_CC3, &TIM2->CCR3, DMA1_Stream1, DMA_Channel_3, DMA_IT_HTIF1 | DMA_IT_TCIF1, DMA1_Stream1_IRQn, GPIOB, GPIO_Pin_10, GPIO_PinSource10, GPIO_AF_TIM2 },
+	{ TIM2, TIM_Channel_4, TIM_DMA_CC4, &TIM2->CCR4, DMA1_Stream7, DMA_Channel_3, DMA_IT_HTIF7 | DMA_IT_TCIF7, DMA1_Stream7_IRQn, GPIOB, GPIO_Pin_11, GPIO_PinSource11, GPIO_AF_TIM2 }
+};
+
+// DMA ring buffers with the captured edges and the decoder state per channel
+static volatile u16 receiver_capture_edges[RECEIVER_CHANNELS][RECEIVER_CAPTURE_EDGES];
+static u16 receiver_capture_read[RECEIVER_CHANNELS];
+static u16 receiver_capture_last[RECEIVER_CHANNELS];
+
+static void _receiver_capture_timer_init(TIM_TypeDef* timer, u32 clock);
+static void _receiver_capture_drain(u8 num);
+
+
+/**** Public implementations ****/
+
+void receiver_capture_gpio_init() {
+	GPIO_InitTypeDef GPIO_Config;
+	u8 i;
+
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOA | RCC_AHB1Periph_GPIOB | RCC_AHB1Periph_GPIOE, ENABLE);
+
+	GPIO_Config.GPIO_Mode = GPIO_Mode_AF;
+	GPIO_Config.GPIO_OType = GPIO_OType_PP;
+	GPIO_Config.GPIO_Speed = GPIO_Speed_100MHz;
+	GPIO_Config.GPIO_PuPd = GPIO_PuPd_UP;
+
+	for (i = 0; i < RECEIVER_CHANNELS; i++) {
+		GPIO_Config.GPIO_Pin = receiver_capture_channels[i].pin;
+		GPIO_Init(receiver_capture_channels[i].port, &GPIO_Config);
+		GPIO_PinAFConfig(receiver_capture_channels[i].port, receiver_capture_channels[i].source, receiver_capture_channels[i].af);
+	}
+}
+
+void receiver_capture_init() {
+	TIM_ICInitTypeDef TIM_ICInitStructure;
+	DMA_InitTypeDef DMA_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+	u8 i;
+
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1 | RCC_AHB1Periph_DMA2, ENABLE);
+
+	// TIM1 is clocked from APB2 with SystemCoreClock, TIM2 from APB1 with SystemCoreClock / 2
+	_receiver_capture_timer_init(TIM1, SystemCoreClock);
+	_receiver_capture_timer_init(TIM2, SystemCoreClock / 2);
+
+	// Capture on both edges, the pulse is told apart from the pause by its length
+	TIM_ICStructInit(&TIM_ICInitStructure);
+	TIM_ICInitStructure.TIM_ICPolarity = TIM_ICPolarity_BothEdge;
+	TIM_ICInitStructure.TIM_ICSelection = TIM_ICSelection_DirectTI;
+	TIM_ICInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+	TIM_ICInitStructure.TIM_ICFilter = 0x03; // Ignore spikes shorter than 8 timer clocks
+
+	// Each capture register is copied by its own DMA stream into a circular buffer
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+	DMA_InitStructure.DMA_BufferSize = RECEIVER_CAPTURE_EDGES;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+
+	// The half and full transfer interrupts decode the ring half the DMA just filled,
+	// all with the same priority, so receiver_publish() is never preempted by another channel
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+
+	for (i = 0; i < RECEIVER_CHANNELS; i++) {
+		const Receiver_CaptureChannel* ch = &receiver_capture_channels[i];
+
+		TIM_ICInitStructure.TIM_Channel = ch->channel;
+		TIM_ICInit(ch->timer, &TIM_ICInitStructure);
+
+		DMA_DeInit(ch->stream);
+		DMA_InitStructure.DMA_Channel = ch->dmaChannel;
+		DMA_InitStructure.DMA_PeripheralBaseAddr = (u32)ch->ccr;
+		DMA_InitStructure.DMA_Memory0BaseAddr = (u32)receiver_capture_edges[i];
+		DMA_Init(ch->stream, &DMA_InitStructure);
+		DMA_ITConfig(ch->stream, DMA_IT_HT | DMA_IT_TC, ENABLE);
+		DMA_Cmd(ch->stream, ENABLE);
+
+		NVIC_InitStructure.NVIC_IRQChannel = ch->irq;
+		NVIC_Init(&NVIC_InitStructure);
+
+		TIM_DMACmd(ch->timer, ch->dmaSource, ENABLE);
+		receiver_capture_read[i] = 0;
+	}
+
+	TIM_Cmd(TIM1, ENABLE);
+	TIM_Cmd(TIM2, ENABLE);
+}
+
+u8 receiver_capture_decode(const volatile u16* edges, u16* read, u16 write, u16* last, u16* width) {
+	u8 found = 0;
+	u16 delta;
+
+	while (*read != write) {
+		// Unsigned arithmetic handles the timer overflow between two edges
+		delta = edges[*read] - *last;
+		*last = edges[*read];
+		*read = (*read + 1) & (RECEIVER_CAPTURE_EDGES - 1);
+
+		if ((delta >= RECEIVER_PULSE_MIN - RECEIVER_PULSE_TOLERANCE) && (delta <= RECEIVER_PULSE_MAX + RECEIVER_PULSE_TOLERANCE)) {
+			// Clamp the measured pulse into the valid servo range
+			if (delta < RECEIVER_PULSE_MIN) {
+				delta = RECEIVER_PULSE_MIN;
+			} else if (delta > RECEIVER_PULSE_MAX) {
+				delta = RECEIVER_PULSE_MAX;
+			}
+			*width = delta;
+			found = 1;
+		}
+	}
+	return found;
+}
+
+
+/**
+ * Interrupt handlers of the capture DMA streams, in the order of the channels
+ */
+void DMA2_Stream1_IRQHandler(void) {
+	_receiver_capture_drain(0);
+}
+
+void DMA2_Stream2_IRQHandler(void) {
+	_receiver_capture_drain(1);
+}
+
+void DMA2_Stream6_IRQHandler(void) {
+	_receiver_capture_drain(2);
+}
+
+void DMA2_Stream4_IRQHandler(void) {
+	_receiver_capture_drain(3);
+}
+
+void DMA1_Stream5_IRQHandler(void) {
+	_receiver_capture_drain(4);
+}
+
+void DMA1_Stream6_IRQHandler(void) {
+	_receiver_capture_drain(5);
+}
+
+void DMA1_Stream1_IRQHandler(void) {
+	_receiver_capture_drain(6);
+}
+
+void DMA1_Stream7_IRQHandler(void) {
+	_receiver_capture_drain(7);
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Let the timer run free with 1MHz over the full 16bit range
+ * @param  timer  The timer to configure
+ * @param  clock  The input clock of the timer in Hz
+ * @retval None
+ */
+static void _receiver_capture_timer_init(TIM_TypeDef* timer, u32 clock) {
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	TIM_TimeBaseStructure.TIM_Prescaler = (u16)(clock / RECEIVER_CAPTURE_TIM_FREQUENCY) - 1;
+	TIM_TimeBaseStructure.TIM_Period = RECEIVER_CAPTURE_TIM_PERIOD;
+	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(timer, &TIM_TimeBaseStructure);
+}
+
+/**
+ * @brief  Decode all new edges of one channel and publish its pulse width
+ * @param  num  Number of the channel
+ * @retval None
+ */
+static void _receiver_capture_drain(u8 num) {
+	const Receiver_CaptureChannel* ch = &receiver_capture_channels[num];
+	u16 write, width;
+
+	DMA_ClearITPendingBit(ch->stream, ch->dmaIt);
+
+	// The DMA counts the remaining transfers down, this gives the next write index
+	write = (RECEIVER_CAPTURE_EDGES - DMA_GetCurrDataCounter(ch->stream)) & (RECEIVER_CAPTURE_EDGES - 1);
+	if (receiver_capture_decode(receiver_capture_edges[num], &receiver_capture_read[num], write, &receiver_capture_last[num], &width)) {
+		receiver_set_pos(num, width - RECEIVER_PULSE_MIN);
+		receiver_publish();
+	}
+}
+
+#endif // RECEIVER_MODE == RECEIVER_MODE_CAPTURE
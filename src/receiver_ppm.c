@@ -0,0 +1,168 @@
+/** @file    receiver_ppm.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   CPPM/PPM sum signal decoding: All channels are transmitted one after the
+ *           other on a single wire and separated by a long sync gap.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/receiver.h"
+
+#if RECEIVER_MODE == RECEIVER_MODE_PPM
+
+volatile u8 receiver_ppm_channels = 0;
+volatile u32 receiver_ppm_frames = 0;
+volatile u32 receiver_ppm_errors = 0;
+
+// Decoder state of the frame currently received
+static u16 receiver_ppm_frame[RECEIVER_CHANNELS];
+static u16 receiver_ppm_last = 0;
+static u8 receiver_ppm_index = 0;
+static u8 receiver_ppm_valid = 0;
+
+// Length of the last shorter frames and how many of them came in a row
+static u8 receiver_ppm_shorter = 0;
+static u8 receiver_ppm_repeats = 0;
+
+static u8 _receiver_ppm_complete(u8 channels);
+
+void receiver_ppm_gpio_init() {
+	GPIO_InitTypeDef GPIO_Config;
+
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOE, ENABLE);
+
+	GPIO_Config.GPIO_Pin = RECEIVER_PPM_PIN;
+	GPIO_Config.GPIO_Mode = GPIO_Mode_AF;
+	GPIO_Config.GPIO_OType = GPIO_OType_PP;
+	GPIO_Config.GPIO_Speed = GPIO_Speed_100MHz;
+	GPIO_Config.GPIO_PuPd = GPIO_PuPd_UP;
+	GPIO_Init(RECEIVER_PPM_REGISTER, &GPIO_Config);
+	GPIO_PinAFConfig(RECEIVER_PPM_REGISTER, RECEIVER_PPM_SOURCE, GPIO_AF_TIM1);
+}
+
+void receiver_ppm_init() {
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
+
+	// ---------- Interrupt configuration for the capture channel on TIM1 ---------- //
+	NVIC_InitTypeDef NVIC_InitStructure;
+	NVIC_InitStructure.NVIC_IRQChannel = TIM1_CC_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+
+	// ---------- TIM1 / Free running with 1MHz ---------- //
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	TIM_TimeBaseStructure.TIM_Prescaler = (u16)(SystemCoreClock / RECEIVER_PPM_TIM_FREQUENCY) - 1; // TIM1 runs on APB2
+	TIM_TimeBaseStructure.TIM_Period = 0xFFFF;
+	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(TIM1, &TIM_TimeBaseStructure);
+
+	// Capture the rising edges only, the interval between two of them is one channel
+	TIM_ICInitTypeDef TIM_ICInitStructure;
+	TIM_ICStructInit(&TIM_ICInitStructure);
+	TIM_ICInitStructure.TIM_Channel = TIM_Channel_1;
+	TIM_ICInitStructure.TIM_ICPolarity = TIM_ICPolarity_Rising;
+	TIM_ICInitStructure.TIM_ICSelection = TIM_ICSelection_DirectTI;
+	TIM_ICInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+	TIM_ICInitStructure.TIM_ICFilter = 0x03;
+	TIM_ICInit(TIM1, &TIM_ICInitStructure);
+
+	TIM_Cmd(TIM1, ENABLE);
+	TIM_ITConfig(TIM1, TIM_IT_CC1, ENABLE);
+}
+
+u8 receiver_ppm_edge(u16 timestamp) {
+	u16 interval = timestamp - receiver_ppm_last;
+	u8 i, published = 0;
+	receiver_ppm_last = timestamp;
+
+	if (interval >= RECEIVER_PPM_SYNC_MIN) {
+		// Sync gap: Publish the frame if it is complete. A frame with less channels
+		// than the ones before was truncated (lost edge) and is dropped as well.
+		if (receiver_ppm_valid && (receiver_ppm_index >= RECEIVER_PPM_CHANNELS_MIN) && _receiver_ppm_complete(receiver_ppm_index)) {
+			for (i = 0; i < receiver_ppm_index; i++) {
+				receiver_set_pos(i, receiver_ppm_frame[i] - RECEIVER_PULSE_MIN);
+			}
+			receiver_publish();
+			receiver_ppm_channels = receiver_ppm_index;
+			receiver_ppm_frames++;
+			published = 1;
+		} else if (receiver_ppm_valid && receiver_ppm_index) {
+			receiver_ppm_errors++;
+		}
+		receiver_ppm_index = 0;
+		receiver_ppm_valid = 1;
+		return published;
+	}
+
+	// Nothing to do until the first sync gap was seen or after an error in this frame
+	if (!receiver_ppm_valid) {
+		return 0;
+	}
+
+	if ((interval < RECEIVER_PULSE_MIN - RECEIVER_PULSE_TOLERANCE) || (interval > RECEIVER_PULSE_MAX + RECEIVER_PULSE_TOLERANCE) || (receiver_ppm_index >= RECEIVER_CHANNELS)) {
+		receiver_ppm_errors++;
+		receiver_ppm_valid = 0;
+		return 0;
+	}
+
+	// Clamp small jitter beyond the limits into the valid range
+	if (interval < RECEIVER_PULSE_MIN) {
+		interval = RECEIVER_PULSE_MIN;
+	} else if (interval > RECEIVER_PULSE_MAX) {
+		interval = RECEIVER_PULSE_MAX;
+	}
+	receiver_ppm_frame[receiver_ppm_index++] = interval;
+	return 0;
+}
+
+/**
+ * @brief  Check the length of a frame against the ones before. A shorter frame is only
+ *         complete if RECEIVER_PPM_CHANNELS_REPEAT frames in a row had this length.
+ * @param  channels  Number of channels in the frame
+ * @retval u8 1 if the frame is complete
+ */
+static u8 _receiver_ppm_complete(u8 channels) {
+	if (channels >= receiver_ppm_channels) {
+		receiver_ppm_repeats = 0;
+		return 1;
+	}
+
+	if (channels == receiver_ppm_shorter) {
+		receiver_ppm_repeats++;
+	} else {
+		receiver_ppm_shorter = channels;
+		receiver_ppm_repeats = 1;
+	}
+	return receiver_ppm_repeats >= RECEIVER_PPM_CHANNELS_REPEAT;
+}
+
+/**
+ * Interrupt handler for the TIM1 capture channel
+ */
+void TIM1_CC_IRQHandler(void) {
+	if (TIM_GetITStatus(TIM1, TIM_IT_CC1)) {
+		// Reading the capture register clears the interrupt flag
+		receiver_ppm_edge((u16)TIM_GetCapture1(TIM1));
+	}
+}
+
+#endif // RECEIVER_MODE == RECEIVER_MODE_PPM
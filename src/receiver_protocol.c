@@ -0,0 +1,185 @@
+/** @file    receiver_protocol.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Frame parsers for the serial receiver protocols SBUS, IBUS and CRSF.
+ *           The parsers work in place on a ring buffer (the DMA receive buffer) and
+ *           do not depend on any STM32 peripheral, so they can be used on the host too.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/receiver_protocol.h"
+
+/**** Private declarations ****/
+
+// Byte at a position relative to start, wrapped around the ring
+#define RING(offset) ring[(start + (offset)) & mask]
+
+static const uint8_t receiver_crsf_crc_table[256] = {
+	0x00, 0xD5, 0x7F, 0xAA, 0xFE, 0x2B, 0x81, 0x54, 0x29, 0xFC, 0x56, 0x83, 0xD7, 0x02, 0xA8, 0x7D,
+	0x52, 0x87, 0x2D, 0xF8, 0xAC, 0x79, 0xD3, 0x06, 0x7B, 0xAE, 0x04, 0xD1, 0x85, 0x50, 0xFA, 0x2F,
+	0xA4, 0x71, 0xDB, 0x0E, 0x5A, 0x8F, 0x25, 0xF0, 0x8D, 0x58, 0xF2, 0x27, 0x73, 0xA6, 0x0C, 0xD9,
+	0xF6, 0x23, 0x89, 0x5C, 0x08, 0xDD, 0x77, 0xA2, 0xDF, 0x0A, 0xA0, 0x75, 0x21, 0xF4, 0x5E, 0x8B,
+	0x9D, 0x48, 0xE2, 0x37, 0x63, 0xB6, 0x1C, 0xC9, 0xB4, 0x61, 0xCB, 0x1E, 0x4A, 0x9F, 0x35, 0xE0,
+	0xCF, 0x1A, 0xB0, 0x65, 0x31, 0xE4, 0x4E, 0x9B, 0xE6, 0x33, 0x99, 0x4C, 0x18, 0xCD, 0x67, 0xB2,
+	0x39, 0xEC, 0x46, 0x93, 0xC7, 0x12, 0xB8, 0x6D, 0x10, 0xC5, 0x6F, 0xBA, 0xEE, 0x3B, 0x91, 0x44,
+	0x6B, 0xBE, 0x14, 0xC1, 0x95, 0x40, 0xEA, 0x3F, 0x42, 0x97, 0x3D, 0xE8, 0xBC, 0x69, 0xC3, 0x16,
+	0xEF, 0x3A, 0x90, 0x45, 0x11, 0xC4, 0x6E, 0xBB, 0xC6, 0x13, 0xB9, 0x6C, 0x38, 0xED, 0x47, 0x92,
+	0xBD, 0x68, 0xC2, 0x17, 0x43, 0x96, 0x3C, 0xE9, 0x94, 0x41, 0xEB, 0x3E, 0x6A, 0xBF, 0x15, 0xC0,
+	0x4B, 0x9E, 0x34, 0xE1, 0xB5, 0x60, 0xCA, 0x1F, 0x62, 0xB7, 0x1D, 0xC8, 0x9C, 0x49, 0xE3, 0x36,
+	0x19, 0xCC, 0x66, 0xB3, 0xE7, 0x32, 0x98, 0x4D, 0x30, 0xE5, 0x4F, 0x9A, 0xCE, 0x1B, 0xB1, 0x64,
+	0x72, 0xA7, 0x0D, 0xD8, 0x8C, 0x59, 0xF3, 0x26, 0x5B, 0x8E, 0x24, 0xF1, 0xA5, 0x70, 0xDA, 0x0F,
+	0x20, 0xF5, 0x5F, 0x8A, 0xDE, 0x0B, 0xA1, 0x74, 0x09, 0xDC, 0x76, 0xA3, 0xF7, 0x22, 0x88, 0x5D,
+	0xD6, 0x03, 0xA9, 0x7C, 0x28, 0xFD, 0x57, 0x82, 0xFF, 0x2A, 0x80, 0x55, 0x01, 0xD4, 0x7E, 0xAB,
+	0x84, 0x51, 0xFB, 0x2E, 0x7A, 0xAF, 0x05, 0xD0, 0xAD, 0x78, 0xD2, 0x07, 0x53, 0x86, 0x2C, 0xF9
+};
+
+static void _receiver_unpack_11bit(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t* channels);
+
+
+/**** Public implementations ****/
+
+uint16_t receiver_sbus_parse(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t available, uint16_t* channels, uint8_t* count) {
+	uint8_t i, flags;
+	*count = 0;
+
+	// Skip everything until the start byte
+	if (RING(0) != RECEIVER_SBUS_START) {
+		return 1;
+	}
+	if (available < RECEIVER_SBUS_FRAME_LENGTH) {
+		return 0;
+	}
+
+	// The end byte is 0x00 for SBUS, SBUS2 uses the lower nibble 0x4 with telemetry slots
+	if ((RING(RECEIVER_SBUS_FRAME_LENGTH - 1) != 0x00) && ((RING(RECEIVER_SBUS_FRAME_LENGTH - 1) & 0x0F) != 0x04)) {
+		return 1;
+	}
+
+	// No usable channel data in failsafe, the receiver repeats the failsafe values
+	flags = RING(RECEIVER_SBUS_FRAME_LENGTH - 2);
+	if (flags & RECEIVER_SBUS_FLAG_FAILSAFE) {
+		return RECEIVER_SBUS_FRAME_LENGTH;
+	}
+
+	_receiver_unpack_11bit(ring, mask, start + 1, channels);
+	for (i = 0; i < RECEIVER_PROTOCOL_CHANNELS; i++) {
+		// 172..1811 maps to 988..2012µs
+		channels[i] = ((channels[i] * 5) >> 3) + 880;
+	}
+	*count = RECEIVER_PROTOCOL_CHANNELS;
+	return RECEIVER_SBUS_FRAME_LENGTH;
+}
+
+uint16_t receiver_ibus_parse(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t available, uint16_t* channels, uint8_t* count) {
+	uint16_t sum = 0xFFFF;
+	uint8_t i;
+	*count = 0;
+
+	if ((RING(0) != RECEIVER_IBUS_LENGTH) || ((available > 1) && (RING(1) != RECEIVER_IBUS_COMMAND))) {
+		return 1;
+	}
+	if (available < RECEIVER_IBUS_FRAME_LENGTH) {
+		return 0;
+	}
+
+	// The checksum is 0xFFFF minus all bytes before it
+	for (i = 0; i < RECEIVER_IBUS_FRAME_LENGTH - 2; i++) {
+		sum -= RING(i);
+	}
+	if (sum != (uint16_t)(RING(RECEIVER_IBUS_FRAME_LENGTH - 2) | (RING(RECEIVER_IBUS_FRAME_LENGTH - 1) << 8))) {
+		return 1;
+	}
+
+	// The channels are sent little endian in microseconds; the upper nibble is used by some
+	// receivers for channels 15-18 and is ignored here
+	for (i = 0; i < RECEIVER_IBUS_CHANNELS; i++) {
+		channels[i] = (RING(2 + 2 * i) | (RING(3 + 2 * i) << 8)) & 0x0FFF;
+	}
+	*count = RECEIVER_IBUS_CHANNELS;
+	return RECEIVER_IBUS_FRAME_LENGTH;
+}
+
+uint16_t receiver_crsf_parse(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t available, uint16_t* channels, uint8_t* count) {
+	uint8_t i, length;
+	*count = 0;
+
+	if (RING(0) != RECEIVER_CRSF_ADDRESS) {
+		return 1;
+	}
+	if (available < 2) {
+		return 0;
+	}
+
+	// The length counts type, payload and CRC
+	length = RING(1);
+	if ((length < 2) || (length > RECEIVER_CRSF_FRAME_LENGTH_MAX - 2)) {
+		return 1;
+	}
+	if (available < length + 2) {
+		return 0;
+	}
+	if (receiver_crsf_crc(ring, mask, start + 2, length - 1) != RING(length + 1)) {
+		return 1;
+	}
+
+	// Link statistics, telemetry etc. are valid frames without channel data
+	if ((RING(2) == RECEIVER_CRSF_TYPE_RC_CHANNELS) && (length == RECEIVER_CRSF_RC_PAYLOAD + 2)) {
+		_receiver_unpack_11bit(ring, mask, start + 3, channels);
+		for (i = 0; i < RECEIVER_PROTOCOL_CHANNELS; i++) {
+			// 172..1811 maps to 988..2012µs with 992 in the center
+			channels[i] = 1500 + ((((int32_t)channels[i] - 992) * 5) >> 3);
+		}
+		*count = RECEIVER_PROTOCOL_CHANNELS;
+	}
+	return length + 2;
+}
+
+uint8_t receiver_crsf_crc(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t length) {
+	uint8_t crc = 0;
+	uint16_t i;
+	for (i = 0; i < length; i++) {
+		crc = receiver_crsf_crc_table[crc ^ RING(i)];
+	}
+	return crc;
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Unpack 16 channels with 11 bits each, LSB first, as used by SBUS and CRSF
+ * @param  ring  The ring buffer
+ * @param  mask  Size of the ring buffer minus one
+ * @param  start  Index of the first data byte
+ * @param  channels  Receives the 16 raw channel values
+ * @retval None
+ */
+static void _receiver_unpack_11bit(const volatile uint8_t* ring, uint16_t mask, uint16_t start, uint16_t* channels) {
+	uint32_t bits = 0;
+	uint8_t available = 0, i, offset = 0;
+
+	for (i = 0; i < RECEIVER_PROTOCOL_CHANNELS; i++) {
+		while (available < 11) {
+			bits |= (uint32_t)RING(offset++) << available;
+			available += 8;
+		}
+		channels[i] = bits & 0x07FF;
+		bits >>= 11;
+		available -= 11;
+	}
+}
@@ -0,0 +1,148 @@
+/** @file    receiver_quality.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Signal quality of the receiver channels: Glitch rejection, stale channel
+ *           and failsafe detection and statistics about dropped frames and jitter.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/receiver.h"
+
+/**** Private declarations ****/
+
+static Receiver_ChannelStats receiver_quality[RECEIVER_CHANNELS];
+static u32 receiver_quality_timeout = RECEIVER_FAILSAFE_TIMEOUT;
+
+// Latch of receiver_quality_stale(), owned by the readers: the number of updates plus one
+// when the channel got stale, 0 while it is not latched
+static u32 receiver_quality_lost[RECEIVER_CHANNELS];
+
+static u16 _receiver_quality_median(u16 a, u16 b, u16 c);
+
+
+/**** Public implementations ****/
+
+void receiver_quality_init(u32 timeout) {
+	u8 i;
+	for (i = 0; i < RECEIVER_CHANNELS; i++) {
+		Receiver_ChannelStats* stats = &receiver_quality[i];
+		stats->updated = 0;
+		stats->interval = 0;
+		stats->jitter = 0;
+		stats->jitterMax = 0;
+		stats->frames = 0;
+		stats->dropped = 0;
+		stats->glitches = 0;
+		stats->history[0] = 0;
+		stats->history[1] = 0;
+		stats->late = 0;
+		receiver_quality_lost[i] = 0;
+	}
+	receiver_quality_timeout = timeout;
+}
+
+u16 receiver_quality_filter(u8 num, u16 position, u32 now) {
+	Receiver_ChannelStats* stats = &receiver_quality[num];
+	u32 interval, deviation;
+	u16 median;
+
+	if (stats->frames) {
+		interval = receiver_elapsed(stats->updated, now);
+
+		// Late updates mean lost frames, they are not part of the average interval;
+		// unless they keep coming late, then the receiver changed its frame rate
+		if (stats->interval && (interval * RECEIVER_DROP_DENOMINATOR > stats->interval * RECEIVER_DROP_NUMERATOR) && (stats->late < RECEIVER_LATE_ADAPT - 1)) {
+			stats->late++;
+			stats->dropped++;
+		} else {
+			if (!stats->interval || (interval * RECEIVER_DROP_DENOMINATOR <= stats->interval * RECEIVER_DROP_NUMERATOR)) {
+				stats->late = 0;
+			}
+			if (!stats->interval) {
+				stats->interval = interval;
+			}
+			deviation = (interval > stats->interval) ? (interval - stats->interval) : (stats->interval - interval);
+			if (deviation > stats->jitterMax) {
+				stats->jitterMax = deviation;
+			}
+			stats->interval += ((s32)interval - (s32)stats->interval) >> RECEIVER_QUALITY_SHIFT;
+			stats->jitter += ((s32)deviation - (s32)stats->jitter) >> RECEIVER_QUALITY_SHIFT;
+		}
+	} else {
+		// Fill the median filter with the first value
+		stats->history[0] = position;
+		stats->history[1] = position;
+	}
+
+	median = _receiver_quality_median(stats->history[0], stats->history[1], position);
+	if ((position > median + RECEIVER_GLITCH_THRESHOLD) || (median > position + RECEIVER_GLITCH_THRESHOLD)) {
+		stats->glitches++;
+	}
+
+	stats->history[0] = stats->history[1];
+	stats->history[1] = position;
+
+	// The timestamp first, so a reader never sees the new count with the old time
+	stats->updated = now;
+	__DMB();
+	stats->frames++;
+	return median;
+}
+
+u8 receiver_quality_stale(u8 num, u32 now) {
+	const volatile Receiver_ChannelStats* stats = &receiver_quality[num];
+	u32 frames, updated;
+
+	// The count first, an update in between only makes the timestamp newer
+	frames = stats->frames;
+	__DMB();
+	updated = stats->updated;
+
+	if (!frames || (receiver_quality_lost[num] == frames + 1)) {
+		return 1;
+	}
+	if (receiver_elapsed(updated, now) > receiver_quality_timeout) {
+		receiver_quality_lost[num] = frames + 1;
+		return 1;
+	}
+	return 0;
+}
+
+void receiver_quality_stats(u8 num, Receiver_ChannelStats* stats) {
+	*stats = receiver_quality[num];
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Median of three values
+ * @param  a  First value
+ * @param  b  Second value
+ * @param  c  Third value
+ * @retval u16 The median
+ */
+static u16 _receiver_quality_median(u16 a, u16 b, u16 c) {
+	if (a > b) {
+		u16 t = a; a = b; b = t;
+	}
+	if (b > c) {
+		b = c;
+	}
+	return (a > b) ? a : b;
+}
@@ -0,0 +1,186 @@
+/** @file    receiver_sample.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Receiver decoding by sampling the receiver port with DMA like a logic
+ *           analyzer. A timer requests a copy of GPIOE->IDR every microsecond, the
+ *           edges of all channels are decoded in blocks of half a buffer.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/receiver.h"
+
+#if RECEIVER_MODE == RECEIVER_MODE_SAMPLE
+
+volatile u32 receiver_sample_blocks = 0;
+
+// Circular DMA buffer with the samples and the decoder state
+static volatile u16 receiver_sample_buffer[RECEIVER_SAMPLE_BUFFER];
+static Receiver_SampleDecoder receiver_sample_decoder;
+
+static void _receiver_sample_block(const volatile u16* samples);
+
+void receiver_sample_gpio_init() {
+	GPIO_InitTypeDef GPIO_Config;
+
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOE, ENABLE);
+
+	GPIO_Config.GPIO_Pin = RECEIVER_PORTS;
+	GPIO_Config.GPIO_Mode = GPIO_Mode_IN;
+	GPIO_Config.GPIO_OType = GPIO_OType_PP;
+	GPIO_Config.GPIO_Speed = GPIO_Speed_100MHz;
+	GPIO_Config.GPIO_PuPd = GPIO_PuPd_UP;
+	GPIO_Init(RECEIVER_REGISTER, &GPIO_Config);
+}
+
+void receiver_sample_init() {
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	DMA_InitTypeDef DMA_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM8, ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+
+	// ---------- DMA copies the input register on every TIM8 update ---------- //
+	DMA_DeInit(RECEIVER_SAMPLE_DMA_STREAM);
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = RECEIVER_SAMPLE_DMA_CHANNEL;
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (u32)&RECEIVER_REGISTER->IDR;
+	DMA_InitStructure.DMA_Memory0BaseAddr = (u32)receiver_sample_buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+	DMA_InitStructure.DMA_BufferSize = RECEIVER_SAMPLE_BUFFER;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh; // A late request shifts the sample time
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+	DMA_Init(RECEIVER_SAMPLE_DMA_STREAM, &DMA_InitStructure);
+	DMA_ITConfig(RECEIVER_SAMPLE_DMA_STREAM, DMA_IT_HT | DMA_IT_TC, ENABLE);
+	DMA_Cmd(RECEIVER_SAMPLE_DMA_STREAM, ENABLE);
+
+	// ---------- Interrupt configuration for the half and full buffer ---------- //
+	NVIC_InitStructure.NVIC_IRQChannel = RECEIVER_SAMPLE_DMA_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+
+	// ---------- TIM8 runs with the sample frequency ---------- //
+	// TIM8 is clocked from APB2 with SystemCoreClock
+	TIM_TimeBaseStructure.TIM_Prescaler = 0;
+	TIM_TimeBaseStructure.TIM_Period = (SystemCoreClock / RECEIVER_SAMPLE_FREQUENCY) - 1;
+	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(TIM8, &TIM_TimeBaseStructure);
+
+	// Start with the pin levels at startup, so a high line is not taken as a rising edge
+	receiver_sample_decoder.last = RECEIVER_REGISTER->IDR;
+	receiver_sample_decoder.time = 0;
+
+	TIM_DMACmd(TIM8, TIM_DMA_Update, ENABLE);
+	TIM_Cmd(TIM8, ENABLE);
+}
+
+u32 receiver_sample_decode(Receiver_SampleDecoder* decoder, const volatile u16* samples, u16 count) {
+	u32 found = 0, width;
+	u16 sample, changed, last = decoder->last;
+	u32 time = decoder->time;
+	u16 i;
+	u8 ch;
+
+	for (i = 0; i < count; i++, time++) {
+		sample = samples[i];
+		changed = (sample ^ last) & RECEIVER_PORTS;
+		last = sample;
+
+		// Most samples have no edge at all, they cost one compare
+		if (!changed) {
+			continue;
+		}
+
+		changed >>= RECEIVER_SAMPLE_SHIFT;
+		sample >>= RECEIVER_SAMPLE_SHIFT;
+		for (ch = 0; changed; ch++, changed >>= 1, sample >>= 1) {
+			if (!(changed & 1)) {
+				continue;
+			}
+			if (sample & 1) {
+				decoder->rise[ch] = time;
+				continue;
+			}
+
+			// Falling edge: unsigned arithmetic handles the overflow of the sample counter
+			width = (time - decoder->rise[ch]) * (1000000 / RECEIVER_SAMPLE_FREQUENCY);
+			if ((width >= RECEIVER_PULSE_MIN - RECEIVER_PULSE_TOLERANCE) && (width <= RECEIVER_PULSE_MAX + RECEIVER_PULSE_TOLERANCE)) {
+				if (width < RECEIVER_PULSE_MIN) {
+					width = RECEIVER_PULSE_MIN;
+				} else if (width > RECEIVER_PULSE_MAX) {
+					width = RECEIVER_PULSE_MAX;
+				}
+				decoder->width[ch] = width;
+				found |= 1UL << ch;
+			}
+		}
+	}
+
+	decoder->last = last;
+	decoder->time = time;
+	return found;
+}
+
+/**
+ * Interrupt handler for the sample DMA stream; each half of the buffer is decoded
+ * while the DMA fills the other one
+ */
+void DMA2_Stream1_IRQHandler(void) {
+	if (DMA_GetITStatus(RECEIVER_SAMPLE_DMA_STREAM, RECEIVER_SAMPLE_DMA_IT_HT)) {
+		DMA_ClearITPendingBit(RECEIVER_SAMPLE_DMA_STREAM, RECEIVER_SAMPLE_DMA_IT_HT);
+		_receiver_sample_block(&receiver_sample_buffer[0]);
+	}
+	if (DMA_GetITStatus(RECEIVER_SAMPLE_DMA_STREAM, RECEIVER_SAMPLE_DMA_IT_TC)) {
+		DMA_ClearITPendingBit(RECEIVER_SAMPLE_DMA_STREAM, RECEIVER_SAMPLE_DMA_IT_TC);
+		_receiver_sample_block(&receiver_sample_buffer[RECEIVER_SAMPLE_BUFFER / 2]);
+	}
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Decode one half of the sample buffer and publish the new pulse widths
+ * @param  samples  First sample of the half buffer
+ * @retval None
+ */
+static void _receiver_sample_block(const volatile u16* samples) {
+	u32 found = receiver_sample_decode(&receiver_sample_decoder, samples, RECEIVER_SAMPLE_BUFFER / 2);
+	u8 i;
+
+	receiver_sample_blocks++;
+	if (found) {
+		for (i = 0; i < RECEIVER_CHANNELS; i++) {
+			if (found & (1UL << i)) {
+				receiver_set_pos(i, receiver_sample_decoder.width[i] - RECEIVER_PULSE_MIN);
+			}
+		}
+		receiver_publish();
+	}
+}
+
+#endif // RECEIVER_MODE == RECEIVER_MODE_SAMPLE
@@ -0,0 +1,176 @@
+/** @file    receiver_serial.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Serial receiver input (SBUS, IBUS or CRSF) on USART2. The bytes are written
+ *           by DMA into a circular buffer and parsed in place whenever the line gets idle.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/receiver.h"
+
+#if RECEIVER_MODE == RECEIVER_MODE_SERIAL
+
+volatile u32 receiver_serial_frames = 0;
+volatile u32 receiver_serial_errors = 0;
+
+// Circular DMA buffer and the index of the first byte not parsed yet
+static volatile u8 receiver_serial_buffer[RECEIVER_SERIAL_BUFFER];
+static u16 receiver_serial_read = 0;
+
+#if RECEIVER_SERIAL_PROTOCOL == RECEIVER_SERIAL_SBUS
+static const Receiver_ProtocolParser receiver_serial_parse = receiver_sbus_parse;
+#elif RECEIVER_SERIAL_PROTOCOL == RECEIVER_SERIAL_IBUS
+static const Receiver_ProtocolParser receiver_serial_parse = receiver_ibus_parse;
+#else
+static const Receiver_ProtocolParser receiver_serial_parse = receiver_crsf_parse;
+#endif
+
+void receiver_serial_gpio_init() {
+	GPIO_InitTypeDef GPIO_Config;
+
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOA, ENABLE);
+
+	GPIO_Config.GPIO_Pin = RECEIVER_SERIAL_PIN;
+	GPIO_Config.GPIO_Mode = GPIO_Mode_AF;
+	GPIO_Config.GPIO_OType = GPIO_OType_PP;
+	GPIO_Config.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_Config.GPIO_PuPd = GPIO_PuPd_UP;
+	GPIO_Init(RECEIVER_SERIAL_REGISTER, &GPIO_Config);
+	GPIO_PinAFConfig(RECEIVER_SERIAL_REGISTER, RECEIVER_SERIAL_SOURCE, RECEIVER_SERIAL_AF);
+}
+
+void receiver_serial_init() {
+	USART_InitTypeDef USART_InitStructure;
+	DMA_InitTypeDef DMA_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+
+	RCC_APB1PeriphClockCmd(RECEIVER_SERIAL_USART_CLK, ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1, ENABLE);
+
+	// ---------- USART configuration for the selected protocol ---------- //
+	USART_StructInit(&USART_InitStructure);
+#if RECEIVER_SERIAL_PROTOCOL == RECEIVER_SERIAL_SBUS
+	USART_InitStructure.USART_BaudRate = 100000;
+	USART_InitStructure.USART_WordLength = USART_WordLength_9b; // 8 data bits plus parity
+	USART_InitStructure.USART_StopBits = USART_StopBits_2;
+	USART_InitStructure.USART_Parity = USART_Parity_Even;
+#elif RECEIVER_SERIAL_PROTOCOL == RECEIVER_SERIAL_IBUS
+	USART_InitStructure.USART_BaudRate = 115200;
+#else
+	USART_InitStructure.USART_BaudRate = 420000;
+#endif
+	USART_InitStructure.USART_Mode = USART_Mode_Rx;
+	USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+	USART_Init(RECEIVER_SERIAL_USART, &USART_InitStructure);
+
+	// ---------- DMA writes all received bytes into the circular buffer ---------- //
+	DMA_DeInit(RECEIVER_SERIAL_DMA_STREAM);
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = RECEIVER_SERIAL_DMA_CHANNEL;
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (u32)&RECEIVER_SERIAL_USART->DR;
+	DMA_InitStructure.DMA_Memory0BaseAddr = (u32)receiver_serial_buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+	DMA_InitStructure.DMA_BufferSize = RECEIVER_SERIAL_BUFFER;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+	DMA_Init(RECEIVER_SERIAL_DMA_STREAM, &DMA_InitStructure);
+
+	// Half and full buffer interrupts catch frames which are sent back to back without idle line
+	DMA_ITConfig(RECEIVER_SERIAL_DMA_STREAM, DMA_IT_HT | DMA_IT_TC, ENABLE);
+	DMA_Cmd(RECEIVER_SERIAL_DMA_STREAM, ENABLE);
+
+	// ---------- Interrupt configuration for idle line and DMA ---------- //
+	NVIC_InitStructure.NVIC_IRQChannel = RECEIVER_SERIAL_USART_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+	NVIC_InitStructure.NVIC_IRQChannel = RECEIVER_SERIAL_DMA_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
+
+	USART_DMACmd(RECEIVER_SERIAL_USART, USART_DMAReq_Rx, ENABLE);
+	USART_ITConfig(RECEIVER_SERIAL_USART, USART_IT_IDLE, ENABLE);
+	USART_Cmd(RECEIVER_SERIAL_USART, ENABLE);
+}
+
+void receiver_serial_process() {
+	u16 channels[RECEIVER_PROTOCOL_CHANNELS];
+	u16 write, available, consumed;
+	u8 count, i;
+
+	// The DMA counts the remaining transfers down, this gives the next write index
+	write = (RECEIVER_SERIAL_BUFFER - DMA_GetCurrDataCounter(RECEIVER_SERIAL_DMA_STREAM)) & (RECEIVER_SERIAL_BUFFER - 1);
+	available = (write - receiver_serial_read) & (RECEIVER_SERIAL_BUFFER - 1);
+
+	while (available) {
+		consumed = receiver_serial_parse(receiver_serial_buffer, RECEIVER_SERIAL_BUFFER - 1, receiver_serial_read, available, channels, &count);
+		if (!consumed) {
+			break; // Wait for the rest of the frame
+		}
+		if (consumed == 1) {
+			receiver_serial_errors++; // Resynchronisation, count each skipped byte
+		}
+		receiver_serial_read = (receiver_serial_read + consumed) & (RECEIVER_SERIAL_BUFFER - 1);
+		available -= consumed;
+
+		if (count) {
+			for (i = 0; (i < count) && (i < RECEIVER_CHANNELS); i++) {
+				if (channels[i] < RECEIVER_PULSE_MIN) {
+					channels[i] = RECEIVER_PULSE_MIN;
+				} else if (channels[i] > RECEIVER_PULSE_MAX) {
+					channels[i] = RECEIVER_PULSE_MAX;
+				}
+				receiver_set_pos(i, channels[i] - RECEIVER_PULSE_MIN);
+			}
+			receiver_publish();
+			receiver_serial_frames++;
+		}
+	}
+}
+
+/**
+ * Interrupt handler for USART2; the idle line marks the end of a frame
+ */
+void USART2_IRQHandler(void) {
+	if (USART_GetITStatus(RECEIVER_SERIAL_USART, USART_IT_IDLE)) {
+		// The idle flag is cleared by reading SR followed by DR
+		USART_ReceiveData(RECEIVER_SERIAL_USART);
+		receiver_serial_process();
+	}
+}
+
+/**
+ * Interrupt handler for the USART2 RX DMA stream
+ */
+void DMA1_Stream5_IRQHandler(void) {
+	if (DMA_GetITStatus(RECEIVER_SERIAL_DMA_STREAM, RECEIVER_SERIAL_DMA_IT_HT)) {
+		DMA_ClearITPendingBit(RECEIVER_SERIAL_DMA_STREAM, RECEIVER_SERIAL_DMA_IT_HT);
+		receiver_serial_process();
+	}
+	if (DMA_GetITStatus(RECEIVER_SERIAL_DMA_STREAM, RECEIVER_SERIAL_DMA_IT_TC)) {
+		DMA_ClearITPendingBit(RECEIVER_SERIAL_DMA_STREAM, RECEIVER_SERIAL_DMA_IT_TC);
+		receiver_serial_process();
+	}
+}
+
+#endif // RECEIVER_MODE == RECEIVER_MODE_SERIAL
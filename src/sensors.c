@@ -22,11 +22,75 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "../inc/sensors.h"
+#include "../inc/sensors_spi.h"
 
+#if (SENSORS_ACCEL_DECIMATION != 1) && (SENSORS_ACCEL_DECIMATION != 2) && (SENSORS_ACCEL_DECIMATION != 4) && (SENSORS_ACCEL_DECIMATION != 8)
+#error "SENSORS_ACCEL_DECIMATION has to be 1, 2, 4 or 8"
+#endif
+
+volatile Sensors_Timing sensors_accel_timing;
+volatile Sensors_Timing sensors_gyro_timing;
+
+/**** Private declarations ****/
+
+// Data ready on INT1 (CTRL_REG3 I1_CFG = 100)
+#define SENSORS_ACCEL_INT1_DATA_READY 0x04
+
+static Sensors_Transfer sensors_accel_transfer;
+static u8 sensors_accel_buffer[LIS302DL_SAMPLE_SIZE + 1];
+static volatile u8 sensors_accel_reading = 0;
+static volatile u8 sensors_accel_retry = 0;
+static u32 sensors_accel_edge = 0;
+static u8 sensors_accel_sensitivity = 18;
+static Sensors_Decimator sensors_accel_decimator;
+
+static Sensors_Transfer sensors_gyro_transfer;
+static u8 sensors_gyro_buffer[SENSORS_GYRO_WATERMARK * L3G4200D_SAMPLE_SIZE + 1];
+static volatile u8 sensors_gyro_reading = 0;
+static volatile u8 sensors_gyro_retry = 0;
+static u32 sensors_gyro_edge = 0;
+
+// Every gyro sample with the time of its data ready edge and every filtered accelerometer
+// sample with the time it stands for, for resampling onto the control loop
+static Sensors_Stream sensors_accel_stream;
+static Sensors_Stream sensors_gyro_stream;
+
+// The gyro temperature is read every SENSORS_GYRO_TEMP_INTERVAL watermarks
+static Sensors_Transfer sensors_temp_transfer;
+static u8 sensors_temp_buffer[2];
+static volatile u8 sensors_temp_reading = 0;
+static u8 sensors_temp_countdown = 0;
+static volatile s8 sensors_gyro_temperature = 0;
+
+// Calibration: the gyro offset follows the temperature model, both scales are set by the user
+static Sensors_AxisCalibration sensors_accel_calibration = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f } };
+static Sensors_AxisCalibration sensors_gyro_calibration = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f } };
+static Sensors_TempModel sensors_gyro_model;
+static Sensors_Variance sensors_still_accel;
+static Sensors_Variance sensors_still_gyro;
+static volatile u8 sensors_is_calibrated = 0;
+static volatile u8 sensors_is_grounded = 1;
+
+// The newest values are published in the buffer (sequence & 1), the other one is written
+static volatile s32 sensors_acceleration[2][3];
+static volatile s32 sensors_rotation[2][3];
+static volatile u32 sensors_accel_sequence = 0;
+static volatile u32 sensors_gyro_sequence = 0;
+
+static void _sensors_accel_read(void);
+static void _sensors_gyro_read(void);
+static void _sensors_accel_done(Sensors_Transfer* transfer);
+static void _sensors_gyro_done(Sensors_Transfer* transfer);
+static void _sensors_temp_done(Sensors_Transfer* transfer);
+static void _sensors_latency(volatile Sensors_Timing* timing, u32 edge);
+static void _sensors_pending(void);
+static void _sensors_still(void);
+
+
+/**** Public implementations ****/
 
 void sensors_init_gpio() {
 	GPIO_InitTypeDef GPIO_InitStructure;
-	SPI_InitTypeDef  SPI_InitStructure;
 	
 	// Enable the SPI periphery for LIS203DL (Discovery-Kit OnBoard gyro)
 	RCC_APB2PeriphClockCmd(SENSORS_SPI_CLK, ENABLE);
@@ -60,21 +124,9 @@ void sensors_init_gpio() {
 	GPIO_InitStructure.GPIO_Pin = SENSORS_SPI_MISO_PIN;
 	GPIO_Init(SENSORS_SPI_MISO_GPIO_PORT, &GPIO_InitStructure);
 	
-	// Configure SPI for the LIS203DL sensor on SPI-1 to send/receive bytes in fullduplex mode (4-wire)
-	SPI_I2S_DeInit(SENSORS_SPI);
-	SPI_InitStructure.SPI_Direction = SPI_Direction_2Lines_FullDuplex;
-	SPI_InitStructure.SPI_DataSize = SPI_DataSize_8b;
-	SPI_InitStructure.SPI_CPOL = SPI_CPOL_Low;
-	SPI_InitStructure.SPI_CPHA = SPI_CPHA_1Edge;
-	SPI_InitStructure.SPI_NSS = SPI_NSS_Soft;
-	SPI_InitStructure.SPI_BaudRatePrescaler = SPI_BaudRatePrescaler_4;
-	SPI_InitStructure.SPI_FirstBit = SPI_FirstBit_MSB;
-	SPI_InitStructure.SPI_CRCPolynomial = 7;
-	SPI_InitStructure.SPI_Mode = SPI_Mode_Master;
-	SPI_Init(SENSORS_SPI, &SPI_InitStructure);
-	
-	// Enable the SPI-1 bus
-	SPI_Cmd(SENSORS_SPI, ENABLE);
+	// SPI-1 runs the LIS203DL sensor, its transfers run over DMA and are timed by the timebase
+	sensors_time_init();
+	sensors_spi_init();
 	
 	// Configure GPIO PIN for LIS203DL Chip select
 	GPIO_InitStructure.GPIO_Pin   = SENSORS_SPI_CS_PIN;
@@ -86,6 +138,14 @@ void sensors_init_gpio() {
 	// Bring the chip up / enable
 	GPIO_SetBits(SENSORS_SPI_CS_GPIO_PORT, SENSORS_SPI_CS_PIN);
 	
+#if SENSORS_GYRO_BUS_TYPE == SENSORS_BUS_I2C
+	// The L3G4200D gyro is on its own I2C bus
+	sensors_i2c_init();
+#else
+	// The L3G4200D gyro shares the bus with its own chip select
+	sensors_spi_device_init(&L3G4200D_Device);
+#endif
+	
 	// Configure GPIO pins to detect Interrupts
 	GPIO_InitStructure.GPIO_Mode  = GPIO_Mode_IN;
 	GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
@@ -99,4 +159,428 @@ void sensors_init_gpio() {
 	// Interrupt 2 from LIS203DL
 	GPIO_InitStructure.GPIO_Pin = SENSORS_SPI_INT2_PIN;
 	GPIO_Init(SENSORS_SPI_INT2_GPIO_PORT, &GPIO_InitStructure);
+	
+	// Interrupt 2 from L3G4200D, kept low if no gyro is connected
+	GPIO_InitStructure.GPIO_Pin = SENSORS_GYRO_INT2_PIN;
+	GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_DOWN;
+	GPIO_Init(SENSORS_GYRO_INT2_GPIO_PORT, &GPIO_InitStructure);
+}
+
+void sensors_init() {
+	// The accelerometer runs at its highest data rate of 400Hz, it is decimated in software
+	LIS302DL_Config accel = { .DataRate = 1, .PowerDown = 1, .FullScale = 0, .SelfTest_P = 0, .SelfTest_M = 0, .ZAxisEnabled = 1, .YAxisEnabled = 1, .XAxisEnabled = 1 };
+	L3G4200D_Config gyro = { L3G4200D_ODR_800, 3, L3G4200D_FS_2000, SENSORS_GYRO_WATERMARK };
+	EXTI_InitTypeDef EXTI_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+	
+	sensors_variance_reset(&sensors_still_accel);
+	sensors_variance_reset(&sensors_still_gyro);
+	sensors_decimator_init(&sensors_accel_decimator, SENSORS_ACCEL_DECIMATION);
+	
+	// Configure the sensors with the blocking functions, no interrupt is running yet
+	LIS302DL_Init(SENSORS_SPI, &accel);
+	LIS302DL_WriteRegister(SENSORS_SPI, LIS302DL_CTRL_REG3_ADDR, SENSORS_ACCEL_INT1_DATA_READY);
+	sensors_accel_sensitivity = LIS302DL_Sensitivity(SENSORS_SPI);
+	L3G4200D_Init(SENSORS_GYRO_BUS, &gyro);
+	
+	// Connect the data ready lines to their EXTI lines
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_SYSCFG, ENABLE);
+	SYSCFG_EXTILineConfig(SENSORS_SPI_INT1_EXTI_PORT_SOURCE, SENSORS_SPI_INT1_EXTI_PIN_SOURCE);
+	SYSCFG_EXTILineConfig(SENSORS_GYRO_INT2_EXTI_PORT_SOURCE, SENSORS_GYRO_INT2_EXTI_PIN_SOURCE);
+	
+	EXTI_InitStructure.EXTI_Line = SENSORS_SPI_INT1_EXTI_LINE | SENSORS_GYRO_INT2_EXTI_LINE;
+	EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
+	EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising;
+	EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+	EXTI_Init(&EXTI_InitStructure);
+	
+	// Same preemption priority as the SPI DMA and I2C interrupts, so they never interrupt each other
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_InitStructure.NVIC_IRQChannel = SENSORS_SPI_INT1_EXTI_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
+	NVIC_InitStructure.NVIC_IRQChannel = SENSORS_GYRO_INT2_EXTI_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
+	
+	// A line which is already active has no edge anymore
+	sensors_update();
+}
+
+void sensors_update() {
+	// A stuck transfer is ended here, it never blocks the sensors for longer than one loop
+	sensors_spi_check();
+#if SENSORS_GYRO_BUS_TYPE == SENSORS_BUS_I2C
+	sensors_i2c_check();
+#endif
+	if (!sensors_accel_reading && GPIO_ReadInputDataBit(SENSORS_SPI_INT1_GPIO_PORT, SENSORS_SPI_INT1_PIN)) {
+		sensors_accel_retry = 1;
+		EXTI_GenerateSWInterrupt(SENSORS_SPI_INT1_EXTI_LINE);
+	}
+	if (!sensors_gyro_reading && GPIO_ReadInputDataBit(SENSORS_GYRO_INT2_GPIO_PORT, SENSORS_GYRO_INT2_PIN)) {
+		sensors_gyro_retry = 1;
+		EXTI_GenerateSWInterrupt(SENSORS_GYRO_INT2_EXTI_LINE);
+	}
+}
+
+u32 sensors_get_acceleration(s32* out) {
+	u32 sequence;
+	do {
+		sequence = sensors_accel_sequence;
+		out[0] = sensors_acceleration[sequence & 1][0];
+		out[1] = sensors_acceleration[sequence & 1][1];
+		out[2] = sensors_acceleration[sequence & 1][2];
+	} while (sequence != sensors_accel_sequence);
+	return sequence;
+}
+
+u8 sensors_get_acceleration_at(u32 time, s32* out) {
+	u32 count;
+	u8 interpolated;
+	do {
+		count = sensors_accel_stream.count;
+		interpolated = sensors_stream_sample(&sensors_accel_stream, time, out);
+	} while (count != sensors_accel_stream.count);
+	return interpolated;
+}
+
+u8 sensors_get_rotation_at(u32 time, s32* out) {
+	u32 count;
+	u8 interpolated;
+	do {
+		count = sensors_gyro_stream.count;
+		interpolated = sensors_stream_sample(&sensors_gyro_stream, time, out);
+	} while (count != sensors_gyro_stream.count);
+	return interpolated;
+}
+
+u8 sensors_calibrated() {
+	return sensors_is_calibrated;
+}
+
+void sensors_set_grounded(u8 grounded) {
+	sensors_is_grounded = grounded;
+}
+
+void sensors_set_accel_calibration(const Sensors_AxisCalibration* calibration) {
+	__disable_irq();
+	sensors_accel_calibration = *calibration;
+	__enable_irq();
+}
+
+void sensors_set_gyro_scale(const float* scale) {
+	__disable_irq();
+	sensors_gyro_calibration.scale[0] = scale[0];
+	sensors_gyro_calibration.scale[1] = scale[1];
+	sensors_gyro_calibration.scale[2] = scale[2];
+	__enable_irq();
+}
+
+s8 sensors_get_temperature() {
+	return sensors_gyro_temperature;
+}
+
+u32 sensors_get_rotation(s32* out) {
+	u32 sequence;
+	do {
+		sequence = sensors_gyro_sequence;
+		out[0] = sensors_rotation[sequence & 1][0];
+		out[1] = sensors_rotation[sequence & 1][1];
+		out[2] = sensors_rotation[sequence & 1][2];
+	} while (sequence != sensors_gyro_sequence);
+	return sequence;
+}
+
+void sensors_timing_update(volatile Sensors_Timing* timing, u32 interval, u32 samples) {
+	u32 lost;
+	
+	if (!interval) {
+		return;
+	}
+	if (!timing->period) {
+		timing->period = interval;
+		return;
+	}
+	
+	// A gap of more than one and a half periods lost the interrupts between; but when they
+	// keep coming like this the device runs slower than measured, start over with its period
+	if (interval > timing->period + (timing->period >> 1)) {
+		if (++timing->gaps >= SENSORS_TIMING_RESEED) {
+			timing->period = interval;
+			timing->gaps = 0;
+			return;
+		}
+		lost = (interval + (timing->period >> 1)) / timing->period - 1;
+		timing->missed += lost * samples;
+		return;
+	}
+	timing->gaps = 0;
+	
+	timing->jitter = (interval > timing->period) ? (interval - timing->period) : (timing->period - interval);
+	if (timing->jitter > timing->jitterMax) {
+		timing->jitterMax = timing->jitter;
+	}
+	timing->period = (u32)((s32)timing->period + ((s32)interval - (s32)timing->period) / 8);
+}
+
+/**
+ * Data ready interrupt of the accelerometer
+ */
+void EXTI0_IRQHandler(void) {
+	u32 now;
+	if (EXTI_GetITStatus(SENSORS_SPI_INT1_EXTI_LINE) != RESET) {
+		EXTI_ClearITPendingBit(SENSORS_SPI_INT1_EXTI_LINE);
+		
+		// A retry from sensors_update() is no new sample
+		if (sensors_accel_retry) {
+			sensors_accel_retry = 0;
+		} else {
+			now = sensors_time_now();
+			if (sensors_accel_edge) {
+				sensors_timing_update(&sensors_accel_timing, now - sensors_accel_edge, 1);
+			}
+			sensors_accel_edge = now;
+		}
+		_sensors_accel_read();
+	}
+}
+
+/**
+ * FIFO watermark interrupt of the gyro
+ */
+void EXTI9_5_IRQHandler(void) {
+	u32 now;
+	if (EXTI_GetITStatus(SENSORS_GYRO_INT2_EXTI_LINE) != RESET) {
+		EXTI_ClearITPendingBit(SENSORS_GYRO_INT2_EXTI_LINE);
+		
+		if (sensors_gyro_retry) {
+			sensors_gyro_retry = 0;
+		} else {
+			now = sensors_time_now();
+			if (sensors_gyro_edge) {
+				sensors_timing_update(&sensors_gyro_timing, now - sensors_gyro_edge, SENSORS_GYRO_WATERMARK);
+			}
+			sensors_gyro_edge = now;
+		}
+		_sensors_gyro_read();
+	}
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Start reading STATUS and OUT_X..OUT_Z of the accelerometer if it is not read already,
+ *         a pending read is checked for its timeout first
+ * @param  None
+ * @retval None
+ */
+static void _sensors_accel_read(void) {
+	if (sensors_accel_reading) {
+		sensors_spi_check();
+		if (sensors_accel_reading) {
+			return;
+		}
+	}
+	sensors_accel_reading = 1;
+	if (sensors_spi_busy()) {
+		sensors_accel_timing.busy++; // Queued behind the running transfer
+	}
+	if (!LIS302DL_ReadSampleAsync(SENSORS_SPI, &sensors_accel_transfer, sensors_accel_buffer, _sensors_accel_done)) {
+		sensors_accel_reading = 0;
+	}
+}
+
+/**
+ * @brief  Start draining one watermark of samples from the gyro FIFO if it is not read already,
+ *         a pending read is checked for its timeout first
+ * @param  None
+ * @retval None
+ */
+static void _sensors_gyro_read(void) {
+	if (sensors_gyro_reading) {
+#if SENSORS_GYRO_BUS_TYPE == SENSORS_BUS_I2C
+		sensors_i2c_check();
+#else
+		sensors_spi_check();
+#endif
+		if (sensors_gyro_reading) {
+			return;
+		}
+	}
+	sensors_gyro_reading = 1;
+	if (SENSORS_GYRO_BUS->busy()) {
+		sensors_gyro_timing.busy++;
+	}
+	if (!L3G4200D_ReadFifoAsync(SENSORS_GYRO_BUS, &sensors_gyro_transfer, sensors_gyro_buffer, SENSORS_GYRO_WATERMARK, _sensors_gyro_done)) {
+		sensors_gyro_reading = 0;
+	}
+}
+
+/**
+ * @brief  Filter the acceleration and publish every SENSORS_ACCEL_DECIMATION-th sample,
+ *         called from the SPI DMA interrupt
+ * @param  transfer  The finished transfer
+ * @retval None
+ */
+static void _sensors_accel_done(Sensors_Transfer* transfer) {
+	LIS302DL_Sample sample;
+	s32 raw[3];
+	u32 period;
+	u8 next = (sensors_accel_sequence + 1) & 1;
+	
+	_sensors_latency(&sensors_accel_timing, sensors_accel_edge);
+	// A retriggered read can find the sample already read, it is not published twice
+	if ((transfer->status == SENSORS_BUS_DONE) && LIS302DL_DecodeSample(&sensors_accel_buffer[1], sensors_accel_sensitivity, &sample)) {
+		raw[0] = sample.X;
+		raw[1] = sample.Y;
+		raw[2] = sample.Z;
+		sensors_accel_timing.samples++;
+		
+		// The still detection sees every sample, the limits are made for the unfiltered noise
+		sensors_variance_add(&sensors_still_accel, raw);
+		
+		// The filtered sample lags half the filter length behind the edge
+		if (sensors_decimator_push(&sensors_accel_decimator, raw, raw)) {
+			period = sensors_accel_timing.period ? sensors_accel_timing.period : SENSORS_ACCEL_SAMPLE_PERIOD;
+			sensors_calibration_apply(&sensors_accel_calibration, raw, (s32*)sensors_acceleration[next]);
+			sensors_accel_sequence++;
+			sensors_stream_push(&sensors_accel_stream, sensors_accel_edge - sensors_decimator_delay(&sensors_accel_decimator, period), (const s32*)sensors_acceleration[next]);
+		}
+		_sensors_still();
+	}
+	sensors_accel_reading = 0;
+	_sensors_pending();
+}
+
+/**
+ * @brief  Stamp and stream every sample of one watermark and publish their mean angular rate,
+ *         called from the bus interrupt
+ * @param  transfer  The finished transfer
+ * @retval None
+ */
+static void _sensors_gyro_done(Sensors_Transfer* transfer) {
+	L3G4200D_Sample samples[SENSORS_GYRO_WATERMARK];
+	s32 raw[3];
+	s32 rate[3];
+	s32 sum[3] = { 0, 0, 0 };
+	u32 period;
+	u8 next = (sensors_gyro_sequence + 1) & 1;
+	u8 i;
+	
+	_sensors_latency(&sensors_gyro_timing, sensors_gyro_edge);
+	if (transfer->status == SENSORS_BUS_DONE) {
+		// The newest sample of the watermark was ready at the edge, the older ones one sample period each before
+		period = sensors_gyro_timing.period ? (sensors_gyro_timing.period / SENSORS_GYRO_WATERMARK) : SENSORS_GYRO_SAMPLE_PERIOD;
+		
+		L3G4200D_DecodeSamples(&sensors_gyro_buffer[1], samples, SENSORS_GYRO_WATERMARK);
+		for (i = 0; i < SENSORS_GYRO_WATERMARK; i++) {
+			L3G4200D_AngularRate(&samples[i], L3G4200D_FS_2000, (int32_t*)raw);
+			sensors_variance_add(&sensors_still_gyro, raw);
+			sensors_calibration_apply(&sensors_gyro_calibration, raw, rate);
+			sensors_stream_push(&sensors_gyro_stream, sensors_gyro_edge - (SENSORS_GYRO_WATERMARK - 1 - i) * period, rate);
+			sum[0] += rate[0];
+			sum[1] += rate[1];
+			sum[2] += rate[2];
+		}
+		sensors_rotation[next][0] = sum[0] / SENSORS_GYRO_WATERMARK;
+		sensors_rotation[next][1] = sum[1] / SENSORS_GYRO_WATERMARK;
+		sensors_rotation[next][2] = sum[2] / SENSORS_GYRO_WATERMARK;
+		sensors_gyro_sequence++;
+		sensors_gyro_timing.samples += SENSORS_GYRO_WATERMARK;
+		_sensors_still();
+		
+		// Queue a temperature read behind the next transfers from time to time
+		if (!sensors_temp_countdown-- && !sensors_temp_reading) {
+			sensors_temp_countdown = SENSORS_GYRO_TEMP_INTERVAL;
+			sensors_temp_reading = L3G4200D_ReadAsync(SENSORS_GYRO_BUS, &sensors_temp_transfer, sensors_temp_buffer, L3G4200D_OUT_TEMP_ADDR, 1, _sensors_temp_done);
+		}
+	}
+	sensors_gyro_reading = 0;
+	_sensors_pending();
+}
+
+/**
+ * @brief  Store the gyro temperature and move the gyro offset along the bias model,
+ *         called from the bus interrupt
+ * @param  transfer  The finished transfer
+ * @retval None
+ */
+static void _sensors_temp_done(Sensors_Transfer* transfer) {
+	if (transfer->status == SENSORS_BUS_DONE) {
+		// OUT_TEMP counts -1 per °C from an unknown offset, only the changes are of interest
+		sensors_gyro_temperature = -(s8)sensors_temp_buffer[1];
+		if (sensors_is_calibrated) {
+			sensors_temp_model_bias(&sensors_gyro_model, sensors_gyro_temperature, sensors_gyro_calibration.offset);
+		}
+	}
+	sensors_temp_reading = 0;
+}
+
+/**
+ * @brief  Check the still windows after new samples; a moving vehicle starts them over, a window
+ *         which stayed still on the ground adds its mean angular rate as bias to the temperature
+ *         model if it is plausible as bias
+ * @param  None
+ * @retval None
+ */
+static void _sensors_still(void) {
+	float bias[3];
+	float limit;
+	u8 i;
+	
+	if (((sensors_still_gyro.count >= SENSORS_CAL_MIN_SAMPLES) && !sensors_variance_still(&sensors_still_gyro, SENSORS_CAL_GYRO_VARIANCE))
+	 || ((sensors_still_accel.count >= SENSORS_CAL_MIN_SAMPLES) && !sensors_variance_still(&sensors_still_accel, SENSORS_CAL_ACCEL_VARIANCE))) {
+		sensors_variance_reset(&sensors_still_gyro);
+		sensors_variance_reset(&sensors_still_accel);
+		return;
+	}
+	if ((sensors_still_gyro.count < SENSORS_CAL_STILL_SAMPLES) || (sensors_still_accel.count < SENSORS_CAL_MIN_SAMPLES)) {
+		return;
+	}
+	
+	// An armed vehicle may hover or turn steadily, a window with a too large mean turns steadily
+	sensors_temp_model_bias(&sensors_gyro_model, sensors_gyro_temperature, bias);
+	limit = sensors_is_calibrated ? SENSORS_CAL_GYRO_DRIFT : SENSORS_CAL_GYRO_BIAS;
+	for (i = 0; i < 3; i++) {
+		bias[i] = sensors_still_gyro.mean[i] - bias[i];
+		if (!sensors_is_grounded || (bias[i] > limit) || (bias[i] < -limit)) {
+			sensors_variance_reset(&sensors_still_gyro);
+			sensors_variance_reset(&sensors_still_accel);
+			return;
+		}
+	}
+	
+	sensors_temp_model_update(&sensors_gyro_model, sensors_gyro_temperature, sensors_still_gyro.mean);
+	sensors_temp_model_bias(&sensors_gyro_model, sensors_gyro_temperature, sensors_gyro_calibration.offset);
+	sensors_is_calibrated = 1;
+	sensors_variance_reset(&sensors_still_gyro);
+	sensors_variance_reset(&sensors_still_accel);
+}
+
+/**
+ * @brief  Store the time from the data ready interrupt until now as latency
+ * @param  timing  The timing of the line
+ * @param  edge  Time of the interrupt in microseconds
+ * @retval None
+ */
+static void _sensors_latency(volatile Sensors_Timing* timing, u32 edge) {
+	timing->latency = sensors_time_now() - edge;
+	if (timing->latency > timing->latencyMax) {
+		timing->latencyMax = timing->latency;
+	}
+}
+
+/**
+ * @brief  Read a sensor whose data ready line is still active, a new sample came in during the read
+ * @param  None
+ * @retval None
+ */
+static void _sensors_pending(void) {
+	if (GPIO_ReadInputDataBit(SENSORS_SPI_INT1_GPIO_PORT, SENSORS_SPI_INT1_PIN)) {
+		_sensors_accel_read();
+	}
+	if (GPIO_ReadInputDataBit(SENSORS_GYRO_INT2_GPIO_PORT, SENSORS_GYRO_INT2_PIN)) {
+		_sensors_gyro_read();
+	}
 }
@@ -0,0 +1,109 @@
+/** @file    sensors_calibration.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Sensor calibration: still detection by running variance, per axis offset
+ *           and scale and a linear temperature model of the gyro bias which is
+ *           refined every time the vehicle is still.
+ * 
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/sensors_calibration.h"
+
+/**** Public implementations ****/
+
+void sensors_variance_reset(Sensors_Variance* variance) {
+	u8 i;
+	variance->count = 0;
+	for (i = 0; i < 3; i++) {
+		variance->mean[i] = 0.0f;
+		variance->m2[i] = 0.0f;
+	}
+}
+
+void sensors_variance_add(Sensors_Variance* variance, const s32* value) {
+	float delta;
+	u8 i;
+	
+	variance->count++;
+	for (i = 0; i < 3; i++) {
+		delta = (float)value[i] - variance->mean[i];
+		variance->mean[i] += delta / (float)variance->count;
+		variance->m2[i] += delta * ((float)value[i] - variance->mean[i]);
+	}
+}
+
+u8 sensors_variance_still(const Sensors_Variance* variance, float limit) {
+	u8 i;
+	
+	if (variance->count < 2) {
+		return 0;
+	}
+	
+	// m2 / (count - 1) <= limit without the division
+	for (i = 0; i < 3; i++) {
+		if (variance->m2[i] > limit * (float)(variance->count - 1)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void sensors_calibration_apply(const Sensors_AxisCalibration* calibration, const s32* raw, s32* out) {
+	u8 i;
+	for (i = 0; i < 3; i++) {
+		out[i] = (s32)(((float)raw[i] - calibration->offset[i]) * calibration->scale[i]);
+	}
+}
+
+void sensors_temp_model_update(Sensors_TempModel* model, float temperature, const float* bias) {
+	float meanTemp, meanBias, spread;
+	u8 i;
+	
+	model->weight = model->weight * SENSORS_CAL_TEMP_FORGET + 1.0f;
+	model->temp = model->temp * SENSORS_CAL_TEMP_FORGET + temperature;
+	model->temp2 = model->temp2 * SENSORS_CAL_TEMP_FORGET + temperature * temperature;
+	
+	meanTemp = model->temp / model->weight;
+	spread = model->temp2 / model->weight - meanTemp * meanTemp;
+	
+	for (i = 0; i < 3; i++) {
+		model->bias[i] = model->bias[i] * SENSORS_CAL_TEMP_FORGET + bias[i];
+		model->tempBias[i] = model->tempBias[i] * SENSORS_CAL_TEMP_FORGET + temperature * bias[i];
+		
+		// The slope is only estimated over a wide enough temperature range, until then the last one is kept
+		if (spread >= SENSORS_CAL_TEMP_SPREAD) {
+			meanBias = model->bias[i] / model->weight;
+			model->slope[i] = (model->tempBias[i] / model->weight - meanTemp * meanBias) / spread;
+		}
+	}
+}
+
+void sensors_temp_model_bias(const Sensors_TempModel* model, float temperature, float* bias) {
+	float meanTemp;
+	u8 i;
+	
+	if (model->weight <= 0.0f) {
+		bias[0] = bias[1] = bias[2] = 0.0f;
+		return;
+	}
+	meanTemp = model->temp / model->weight;
+	for (i = 0; i < 3; i++) {
+		bias[i] = model->bias[i] / model->weight + model->slope[i] * (temperature - meanTemp);
+	}
+}
@@ -0,0 +1,131 @@
+/** @file    sensors_filter.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Decimating FIR low-pass filter for the accelerometer: it runs at its highest
+ *           data rate and every output averages several 8bit samples, which removes the
+ *           aliases above the output rate and adds resolution below one digit.
+ * 
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/sensors_filter.h"
+
+/**** Private declarations ****/
+
+// Hamming windowed sinc low-pass filters with their cutoff at half the output rate,
+// the zero taps at both ends are left out. They are symmetric, so they are the same
+// in the time reversed order arm_fir_decimate expects.
+static const s16 sensors_filter_decimate2[11] = {
+	295, 0, -1876, 0, 9779, 16372, 9779, 0, -1876, 0, 295
+};
+static const s16 sensors_filter_decimate4[23] = {
+	64, 147, 176, 0, -443, -937, -971, 0, 2124, 4886, 7248, 8180,
+	7248, 4886, 2124, 0, -971, -937, -443, 0, 176, 147, 64
+};
+static const s16 sensors_filter_decimate8[47] = {
+	15, 32, 53, 74, 89, 88, 61, 0, -97, -221, -355, -469, -525, -485, -317, 0,
+	467, 1062, 1741, 2442, 3094, 3623, 3969, 4086, 3969, 3623, 3094, 2442, 1741, 1062, 467, 0,
+	-317, -485, -525, -469, -355, -221, -97, 0, 61, 88, 89, 74, 53, 32, 15
+};
+
+
+/**** Public implementations ****/
+
+u8 sensors_decimator_init(Sensors_Decimator* decimator, u8 factor) {
+	u8 i, j;
+	
+	switch (factor) {
+		case 1:
+			decimator->coeffs = 0;
+			decimator->taps = 1;
+			break;
+		case 2:
+			decimator->coeffs = sensors_filter_decimate2;
+			decimator->taps = sizeof(sensors_filter_decimate2) / sizeof(s16);
+			break;
+		case 4:
+			decimator->coeffs = sensors_filter_decimate4;
+			decimator->taps = sizeof(sensors_filter_decimate4) / sizeof(s16);
+			break;
+		case 8:
+			decimator->coeffs = sensors_filter_decimate8;
+			decimator->taps = sizeof(sensors_filter_decimate8) / sizeof(s16);
+			break;
+		default:
+			return 0;
+	}
+	
+	decimator->factor = factor;
+	decimator->phase = 0;
+	decimator->index = 0;
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 2 * SENSORS_FILTER_MAX_TAPS; j++) {
+			decimator->state[i][j] = 0;
+		}
+	}
+	return 1;
+}
+
+u8 sensors_decimator_push(Sensors_Decimator* decimator, const s32* in, s32* out) {
+	const s16* state;
+	s32 sample, sum;
+	u8 i, k;
+	
+	if (decimator->factor == 1) {
+		out[0] = in[0];
+		out[1] = in[1];
+		out[2] = in[2];
+		return 1;
+	}
+	
+	// The newest sample is at index and at index + taps, the oldest one follows it
+	decimator->index++;
+	if (decimator->index >= decimator->taps) {
+		decimator->index = 0;
+	}
+	for (i = 0; i < 3; i++) {
+		sample = in[i];
+		if (sample > 32767) {
+			sample = 32767;
+		} else if (sample < -32768) {
+			sample = -32768;
+		}
+		decimator->state[i][decimator->index] = (s16)sample;
+		decimator->state[i][decimator->index + decimator->taps] = (s16)sample;
+	}
+	
+	if (++decimator->phase < decimator->factor) {
+		return 0;
+	}
+	decimator->phase = 0;
+	
+	// The sum of the absolute coefficients is below 1.4, the sum can not overflow
+	for (i = 0; i < 3; i++) {
+		state = &decimator->state[i][decimator->index + 1];
+		sum = 0;
+		for (k = 0; k < decimator->taps; k++) {
+			sum += (s32)decimator->coeffs[k] * state[k];
+		}
+		out[i] = (sum + (1 << 14)) >> 15;
+	}
+	return 1;
+}
+
+u32 sensors_decimator_delay(const Sensors_Decimator* decimator, u32 period) {
+	return (u32)(decimator->taps - 1) / 2 * period;
+}
@@ -0,0 +1,518 @@
+/** @file    sensors_i2c.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Non-blocking I2C master for the sensors. Transfers are queued like on the
+ *           SPI bus and run as a state machine in the I2C event interrupt; register
+ *           reads use a repeated start and receive their data by DMA. A bus held low
+ *           by a slave is freed by clocking SCL.
+ * 
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/sensors_i2c.h"
+#include "../inc/sensors_time.h"
+
+volatile u32 sensors_i2c_transfers = 0;
+volatile u32 sensors_i2c_errors = 0;
+volatile u32 sensors_i2c_queued = 0;
+volatile u32 sensors_i2c_recoveries = 0;
+
+/**** Private declarations ****/
+
+// States of the running transfer
+#define SENSORS_I2C_IDLE          0
+#define SENSORS_I2C_START         1 // Start sent, the address for writing follows
+#define SENSORS_I2C_ADDRESS       2 // Address sent, waiting for the ACK
+#define SENSORS_I2C_WRITE         3 // Sending the register address and the data
+#define SENSORS_I2C_RESTART       4 // Repeated start sent, the address for reading follows
+#define SENSORS_I2C_READ_ADDRESS  5
+#define SENSORS_I2C_READ          6 // Receiving by DMA, or the single byte by RXNE
+
+// The running transfer, 0 while the bus is idle, and the transfers waiting behind it
+static Sensors_Transfer* volatile sensors_i2c_current = 0;
+static Sensors_Transfer* sensors_i2c_head = 0;
+static Sensors_Transfer* sensors_i2c_tail = 0;
+static volatile u8 sensors_i2c_state = SENSORS_I2C_IDLE;
+static u16 sensors_i2c_index = 0;
+static u32 sensors_i2c_started;
+static u8 sensors_i2c_attempt;
+
+static void _sensors_i2c_configure(void);
+static void _sensors_i2c_pins(GPIOMode_TypeDef mode);
+static void _sensors_i2c_delay(void);
+static void _sensors_i2c_begin(Sensors_Transfer* transfer);
+static void _sensors_i2c_run(Sensors_Transfer* transfer);
+static void _sensors_i2c_fail(u8 timeout);
+static void _sensors_i2c_finish(u8 status);
+static void _sensors_i2c_health(Sensors_BusHealth* health, u8 status);
+
+
+/**** Public implementations ****/
+
+void sensors_i2c_init() {
+	DMA_InitTypeDef DMA_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+	
+	RCC_AHB1PeriphClockCmd(SENSORS_I2C_GPIO_CLK | SENSORS_I2C_DMA_CLK, ENABLE);
+	RCC_APB1PeriphClockCmd(SENSORS_I2C_CLK, ENABLE);
+	
+	GPIO_PinAFConfig(SENSORS_I2C_GPIO_PORT, SENSORS_I2C_SCL_SOURCE, SENSORS_I2C_AF);
+	GPIO_PinAFConfig(SENSORS_I2C_GPIO_PORT, SENSORS_I2C_SDA_SOURCE, SENSORS_I2C_AF);
+	
+	// The data register is copied byte by byte into the buffer
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = SENSORS_I2C_DMA_CHANNEL;
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (u32)&SENSORS_I2C->DR;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+	DMA_InitStructure.DMA_BufferSize = 1;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+	DMA_DeInit(SENSORS_I2C_DMA_RX_STREAM);
+	DMA_Init(SENSORS_I2C_DMA_RX_STREAM, &DMA_InitStructure);
+	DMA_ITConfig(SENSORS_I2C_DMA_RX_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+	
+	// Same preemption priority as the SPI DMA and the data ready interrupts, none interrupts another
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_InitStructure.NVIC_IRQChannel = SENSORS_I2C_EV_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
+	NVIC_InitStructure.NVIC_IRQChannel = SENSORS_I2C_ER_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
+	NVIC_InitStructure.NVIC_IRQChannel = SENSORS_I2C_DMA_RX_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
+	
+	// A slave may still hold the bus from before a reset of the controller
+	sensors_i2c_recover();
+	sensors_i2c_recoveries = 0;
+}
+
+u8 sensors_i2c_start(Sensors_Transfer* transfer) {
+	u32 primask;
+	
+	if (!transfer->length || (transfer->rx && (transfer->length < 2))) {
+		return 0;
+	}
+	
+	// The queue is shared by all interrupts and the main loop
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if ((transfer->status == SENSORS_BUS_BUSY) || (transfer->status == SENSORS_BUS_QUEUED)) {
+		__set_PRIMASK(primask);
+		return 0;
+	}
+	if (sensors_i2c_current) {
+		transfer->status = SENSORS_BUS_QUEUED;
+		transfer->next = 0;
+		if (sensors_i2c_tail) {
+			sensors_i2c_tail->next = transfer;
+		} else {
+			sensors_i2c_head = transfer;
+		}
+		sensors_i2c_tail = transfer;
+		sensors_i2c_queued++;
+	} else {
+		_sensors_i2c_begin(transfer);
+	}
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+u8 sensors_i2c_busy() {
+	return sensors_i2c_current != 0;
+}
+
+u8 sensors_i2c_wait(Sensors_Transfer* transfer, u32 timeout) {
+	u32 primask;
+	
+	while ((transfer->status == SENSORS_BUS_BUSY) || (transfer->status == SENSORS_BUS_QUEUED)) {
+		if (!timeout--) {
+			// The running transfer hangs, e.g. SCL is stretched forever; give up on it and free the bus
+			primask = __get_PRIMASK();
+			__disable_irq();
+			if (sensors_i2c_current) {
+				sensors_i2c_attempt = SENSORS_I2C_RETRIES;
+				_sensors_i2c_fail(1);
+			}
+			__set_PRIMASK(primask);
+			break;
+		}
+	}
+	return transfer->status;
+}
+
+u8 sensors_i2c_check() {
+	u32 primask;
+	u8 recovered = 0;
+	
+	// The bus interrupts must not finish the transfer while it is taken down
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (sensors_i2c_current && ((sensors_time_now() - sensors_i2c_started) > SENSORS_I2C_TIMEOUT(sensors_i2c_current->length))) {
+		_sensors_i2c_fail(1);
+		recovered = 1;
+	}
+	__set_PRIMASK(primask);
+	return recovered;
+}
+
+void sensors_i2c_recover() {
+	u8 i;
+	
+	SENSORS_I2C->CR1 &= ~I2C_CR1_PE;
+	
+	// Take over both lines as open drain outputs, released
+	GPIO_SetBits(SENSORS_I2C_GPIO_PORT, SENSORS_I2C_SCL_PIN | SENSORS_I2C_SDA_PIN);
+	_sensors_i2c_pins(GPIO_Mode_OUT);
+	_sensors_i2c_delay();
+	
+	// A slave holding SDA low is waiting for the rest of its byte, clock it out
+	for (i = 0; (i < SENSORS_I2C_RECOVERY_CLOCKS) && !GPIO_ReadInputDataBit(SENSORS_I2C_GPIO_PORT, SENSORS_I2C_SDA_PIN); i++) {
+		GPIO_ResetBits(SENSORS_I2C_GPIO_PORT, SENSORS_I2C_SCL_PIN);
+		_sensors_i2c_delay();
+		GPIO_SetBits(SENSORS_I2C_GPIO_PORT, SENSORS_I2C_SCL_PIN);
+		_sensors_i2c_delay();
+	}
+	
+	// Start and stop condition: SDA falls and rises while SCL is high, every slave is reset
+	GPIO_ResetBits(SENSORS_I2C_GPIO_PORT, SENSORS_I2C_SDA_PIN);
+	_sensors_i2c_delay();
+	GPIO_SetBits(SENSORS_I2C_GPIO_PORT, SENSORS_I2C_SDA_PIN);
+	_sensors_i2c_delay();
+	
+	// Back to the I2C; a software reset clears a BUSY flag left from the glitch and a pending
+	// start or stop, all registers are configured again
+	_sensors_i2c_pins(GPIO_Mode_AF);
+	SENSORS_I2C->CR1 = I2C_CR1_SWRST;
+	SENSORS_I2C->CR1 = 0;
+	_sensors_i2c_configure();
+	sensors_i2c_recoveries++;
+}
+
+/**
+ * Event interrupt of the I2C, runs the state machine of the transfer
+ */
+void I2C1_EV_IRQHandler(void) {
+	Sensors_Transfer* transfer = sensors_i2c_current;
+	const Sensors_I2cDevice* device;
+	DMA_Stream_TypeDef* rx = SENSORS_I2C_DMA_RX_STREAM;
+	u16 sr1 = SENSORS_I2C->SR1;
+	u16 count;
+	
+	if (!transfer) {
+		SENSORS_I2C->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN);
+		return;
+	}
+	device = transfer->device;
+	
+	// Start or repeated start: send the address, for writing the register address first
+	if (sr1 & I2C_SR1_SB) {
+		if (sensors_i2c_state == SENSORS_I2C_RESTART) {
+			count = transfer->length - 1;
+			if (count == 1) {
+				// A single byte is not acknowledged, the NACK is prepared before the address
+				SENSORS_I2C->CR1 &= ~I2C_CR1_ACK;
+			} else {
+				// The DMA receives all bytes, the hardware does not acknowledge the last one (LAST)
+				SENSORS_I2C->CR1 |= I2C_CR1_ACK;
+				DMA_ClearFlag(rx, SENSORS_I2C_DMA_RX_FLAGS);
+				rx->M0AR = (u32)&transfer->rx[1];
+				rx->NDTR = count;
+				rx->CR |= DMA_SxCR_EN;
+				SENSORS_I2C->CR2 |= I2C_CR2_DMAEN | I2C_CR2_LAST;
+			}
+			SENSORS_I2C->DR = (u8)(device->address << 1) | 0x01;
+			sensors_i2c_state = SENSORS_I2C_READ_ADDRESS;
+		} else {
+			SENSORS_I2C->DR = (u8)(device->address << 1);
+			sensors_i2c_state = SENSORS_I2C_ADDRESS;
+		}
+		return;
+	}
+	
+	// Address acknowledged, it is cleared by reading SR2 after SR1
+	if (sr1 & I2C_SR1_ADDR) {
+		(void)SENSORS_I2C->SR2;
+		if (sensors_i2c_state == SENSORS_I2C_READ_ADDRESS) {
+			sensors_i2c_state = SENSORS_I2C_READ;
+			if (transfer->length - 1 == 1) {
+				// The stop has to be set right after ADDR is cleared, the byte comes with RXNE
+				SENSORS_I2C->CR1 |= I2C_CR1_STOP;
+				SENSORS_I2C->CR2 |= I2C_CR2_ITBUFEN;
+			}
+		} else {
+			sensors_i2c_state = SENSORS_I2C_WRITE;
+			sensors_i2c_index = 0;
+			SENSORS_I2C->CR2 |= I2C_CR2_ITBUFEN;
+		}
+		return;
+	}
+	
+	if (sensors_i2c_state == SENSORS_I2C_WRITE) {
+		// A read only sends the register address before the repeated start
+		count = transfer->rx ? 1 : transfer->length;
+		if ((sr1 & I2C_SR1_TXE) && (sensors_i2c_index < count)) {
+			SENSORS_I2C->DR = transfer->tx[sensors_i2c_index++];
+			if (sensors_i2c_index == count) {
+				SENSORS_I2C->CR2 &= ~I2C_CR2_ITBUFEN; // Wait for BTF, the last byte is on the line
+			}
+		} else if (sr1 & I2C_SR1_BTF) {
+			if (transfer->rx) {
+				sensors_i2c_state = SENSORS_I2C_RESTART;
+				SENSORS_I2C->CR1 |= I2C_CR1_START;
+			} else {
+				SENSORS_I2C->CR1 |= I2C_CR1_STOP;
+				_sensors_i2c_finish(SENSORS_BUS_DONE);
+			}
+		}
+		return;
+	}
+	
+	// The single byte of a read
+	if ((sensors_i2c_state == SENSORS_I2C_READ) && (sr1 & I2C_SR1_RXNE)) {
+		transfer->rx[1] = (u8)SENSORS_I2C->DR;
+		_sensors_i2c_finish(SENSORS_BUS_DONE);
+	}
+}
+
+/**
+ * Error interrupt of the I2C: NACK, bus error, lost arbitration, overrun or timeout
+ */
+void I2C1_ER_IRQHandler(void) {
+	u16 sr1 = SENSORS_I2C->SR1;
+	
+	SENSORS_I2C->SR1 = sr1 & ~SENSORS_I2C_SR1_ERRORS;
+	
+	// After a lost arbitration the bus belongs to another master, otherwise it is released
+	if (!(sr1 & I2C_SR1_ARLO)) {
+		SENSORS_I2C->CR1 |= I2C_CR1_STOP;
+	}
+	if (sensors_i2c_current) {
+		_sensors_i2c_fail(0);
+	}
+}
+
+/**
+ * Interrupt handler for the I2C RX DMA stream, ends a read
+ */
+void DMA1_Stream0_IRQHandler(void) {
+	if (DMA_GetITStatus(SENSORS_I2C_DMA_RX_STREAM, DMA_IT_TEIF0)) {
+		DMA_ClearITPendingBit(SENSORS_I2C_DMA_RX_STREAM, DMA_IT_TEIF0);
+		SENSORS_I2C->CR1 |= I2C_CR1_STOP;
+		if (sensors_i2c_current) {
+			_sensors_i2c_fail(0);
+		}
+	} else if (DMA_GetITStatus(SENSORS_I2C_DMA_RX_STREAM, DMA_IT_TCIF0)) {
+		DMA_ClearITPendingBit(SENSORS_I2C_DMA_RX_STREAM, DMA_IT_TCIF0);
+		SENSORS_I2C->CR1 |= I2C_CR1_STOP;
+		_sensors_i2c_finish(SENSORS_BUS_DONE);
+	}
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Initialize the I2C as master and enable it
+ * @param  None
+ * @retval None
+ */
+static void _sensors_i2c_configure(void) {
+	I2C_InitTypeDef I2C_InitStructure;
+	
+	I2C_InitStructure.I2C_ClockSpeed = SENSORS_I2C_SPEED;
+	I2C_InitStructure.I2C_Mode = I2C_Mode_I2C;
+	I2C_InitStructure.I2C_DutyCycle = I2C_DutyCycle_2;
+	I2C_InitStructure.I2C_OwnAddress1 = 0x00;
+	I2C_InitStructure.I2C_Ack = I2C_Ack_Enable;
+	I2C_InitStructure.I2C_AcknowledgedAddress = I2C_AcknowledgedAddress_7bit;
+	I2C_Init(SENSORS_I2C, &I2C_InitStructure);
+	I2C_Cmd(SENSORS_I2C, ENABLE);
+}
+
+/**
+ * @brief  Configure SCL and SDA as open drain with pull-up
+ * @param  mode  GPIO_Mode_AF for the I2C or GPIO_Mode_OUT for the recovery
+ * @retval None
+ */
+static void _sensors_i2c_pins(GPIOMode_TypeDef mode) {
+	GPIO_InitTypeDef GPIO_InitStructure;
+	
+	GPIO_InitStructure.GPIO_Pin = SENSORS_I2C_SCL_PIN | SENSORS_I2C_SDA_PIN;
+	GPIO_InitStructure.GPIO_Mode = mode;
+	GPIO_InitStructure.GPIO_OType = GPIO_OType_OD;
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_UP;
+	GPIO_Init(SENSORS_I2C_GPIO_PORT, &GPIO_InitStructure);
+}
+
+/**
+ * @brief  Wait about half a clock period of 100kHz for the recovery
+ * @param  None
+ * @retval None
+ */
+static void _sensors_i2c_delay(void) {
+	volatile u32 count = SystemCoreClock / 1000000;
+	while (count--);
+}
+
+/**
+ * @brief  Run a transfer for the first time
+ *         Interrupts have to be disabled or this is called from the bus interrupts.
+ * @param  transfer  The transfer to run
+ * @retval None
+ */
+static void _sensors_i2c_begin(Sensors_Transfer* transfer) {
+	sensors_i2c_attempt = 0;
+	_sensors_i2c_run(transfer);
+}
+
+/**
+ * @brief  Send the start condition of a transfer, the event interrupt does the rest.
+ *         Interrupts have to be disabled or this is called from the bus interrupts.
+ * @param  transfer  The transfer to run
+ * @retval None
+ */
+static void _sensors_i2c_run(Sensors_Transfer* transfer) {
+	u16 timeout = 0xFFFF;
+	
+	sensors_i2c_current = transfer;
+	sensors_i2c_started = sensors_time_now();
+	transfer->status = SENSORS_BUS_BUSY;
+	
+	// The stop of the last transfer has to be on the line before the next start
+	while ((SENSORS_I2C->CR1 & I2C_CR1_STOP) && --timeout);
+	if (!timeout || (SENSORS_I2C->SR2 & I2C_SR2_BUSY)) {
+		sensors_i2c_recover();
+	}
+	
+	sensors_i2c_state = SENSORS_I2C_START;
+	SENSORS_I2C->CR2 |= I2C_CR2_ITEVTEN | I2C_CR2_ITERREN;
+	SENSORS_I2C->CR1 |= I2C_CR1_ACK | I2C_CR1_START;
+}
+
+/**
+ * @brief  Count the failed attempt of the running transfer, recover the bus and repeat the
+ *         transfer or end it with SENSORS_BUS_ERROR after SENSORS_I2C_RETRIES.
+ *         Interrupts have to be disabled or this is called from the bus interrupts.
+ * @param  timeout  1 if the transfer did not finish in time
+ * @retval None
+ */
+static void _sensors_i2c_fail(u8 timeout) {
+	Sensors_Transfer* transfer = sensors_i2c_current;
+	const Sensors_I2cDevice* device = transfer->device;
+	Sensors_BusHealth* health = device->health;
+	u32 start = sensors_time_now();
+	u32 time;
+	
+	health->errors++;
+	if (timeout) {
+		health->timeouts++;
+	}
+	
+	// The DMA must not write into the buffer once the transfer is repeated or ended
+	SENSORS_I2C_DMA_RX_STREAM->CR &= ~DMA_SxCR_EN;
+	SENSORS_I2C->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_DMAEN | I2C_CR2_LAST);
+	sensors_i2c_recover();
+	time = sensors_time_now() - start;
+	health->recoveries++;
+	health->recoveryTime = time;
+	if (time > health->recoveryTimeMax) {
+		health->recoveryTimeMax = time;
+	}
+	
+	if (sensors_i2c_attempt < SENSORS_I2C_RETRIES) {
+		sensors_i2c_attempt++;
+		health->retries++;
+		_sensors_i2c_run(transfer);
+	} else {
+		_sensors_i2c_finish(SENSORS_BUS_ERROR);
+	}
+}
+
+/**
+ * @brief  Stop the interrupts and the DMA, start the next queued transfer and tell the owner of the finished one
+ * @param  status  SENSORS_BUS_DONE or SENSORS_BUS_ERROR
+ * @retval None
+ */
+static void _sensors_i2c_finish(u8 status) {
+	Sensors_Transfer* transfer = sensors_i2c_current;
+	Sensors_Transfer* next;
+	u32 primask;
+	
+	SENSORS_I2C_DMA_RX_STREAM->CR &= ~DMA_SxCR_EN;
+	SENSORS_I2C->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_DMAEN | I2C_CR2_LAST);
+	sensors_i2c_state = SENSORS_I2C_IDLE;
+	if (!transfer) {
+		return;
+	}
+	
+	if (status == SENSORS_BUS_DONE) {
+		sensors_i2c_transfers++;
+	} else {
+		sensors_i2c_errors++;
+	}
+	_sensors_i2c_health(((const Sensors_I2cDevice*)transfer->device)->health, status);
+	
+	// Chain the next transfer before the callback runs, the bus does not wait for it
+	primask = __get_PRIMASK();
+	__disable_irq();
+	next = sensors_i2c_head;
+	if (next) {
+		sensors_i2c_head = next->next;
+		if (!sensors_i2c_head) {
+			sensors_i2c_tail = 0;
+		}
+		_sensors_i2c_begin(next);
+	} else {
+		sensors_i2c_current = 0;
+	}
+	__set_PRIMASK(primask);
+	
+	transfer->status = status;
+	if (transfer->callback) {
+		transfer->callback(transfer);
+	}
+}
+
+/**
+ * @brief  Track the transfers of a device in a row: it is degraded after SENSORS_BUS_DEGRADED_FAILURES
+ *         failed transfers, it is healthy again after SENSORS_BUS_HEALTHY_TRANSFERS good ones in a row
+ * @param  health  Counters of the device
+ * @param  status  SENSORS_BUS_DONE or SENSORS_BUS_ERROR
+ * @retval None
+ */
+static void _sensors_i2c_health(Sensors_BusHealth* health, u8 status) {
+	if (status == SENSORS_BUS_DONE) {
+		health->failedInRow = 0;
+		if (health->degraded && (++health->goodInRow >= SENSORS_BUS_HEALTHY_TRANSFERS)) {
+			health->degraded = 0;
+		}
+	} else {
+		health->failures++;
+		health->goodInRow = 0;
+		if (++health->failedInRow >= SENSORS_BUS_DEGRADED_FAILURES) {
+			health->degraded = 1;
+		}
+	}
+}
@@ -0,0 +1,405 @@
+/** @file    sensors_spi.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Non-blocking SPI bus manager for the sensors. Transfers to any device on
+ *           the bus are queued and run back to back over DMA, each one selects its chip
+ *           with its own clock and mode; the caller is told by a status flag and an
+ *           optional callback.
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/sensors.h"
+#include "../inc/sensors_spi.h"
+
+volatile u32 sensors_spi_transfers = 0;
+volatile u32 sensors_spi_errors = 0;
+volatile u32 sensors_spi_queued = 0;
+
+/**** Private declarations ****/
+
+// The running transfer, 0 while the bus is idle, and the transfers waiting behind it
+static Sensors_Transfer* volatile sensors_spi_current = 0;
+static Sensors_Transfer* sensors_spi_head = 0;
+static Sensors_Transfer* sensors_spi_tail = 0;
+
+// Sent without a tx buffer and written without an rx buffer, the DMA does not increment on it
+static const u8 sensors_spi_zero = 0;
+static u8 sensors_spi_drop;
+
+// Start of the running attempt, the attempts made so far and the first byte to send,
+// a transfer in place has overwritten it with the answer when it has to be repeated
+static u32 sensors_spi_started;
+static u8 sensors_spi_attempt;
+static u8 sensors_spi_first;
+
+static void _sensors_spi_configure();
+static void _sensors_spi_begin(Sensors_Transfer* transfer);
+static void _sensors_spi_run(Sensors_Transfer* transfer);
+static void _sensors_spi_fail(u8 timeout);
+static void _sensors_spi_recover(const Sensors_SpiDevice* device);
+static void _sensors_spi_finish(u8 status);
+static void _sensors_spi_health(Sensors_BusHealth* health, u8 status);
+
+
+/**** Public implementations ****/
+
+void sensors_spi_init() {
+	DMA_InitTypeDef DMA_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+
+	RCC_AHB1PeriphClockCmd(SENSORS_SPI_DMA_CLK, ENABLE);
+	_sensors_spi_configure();
+
+	// Both streams move single bytes between the data register and memory
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = SENSORS_SPI_DMA_CHANNEL;
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (u32)&SENSORS_SPI->DR;
+	DMA_InitStructure.DMA_BufferSize = 1;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+
+	// RX has the higher priority, it must never overrun while TX is waiting
+	DMA_DeInit(SENSORS_SPI_DMA_RX_STREAM);
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+	DMA_InitStructure.DMA_Memory0BaseAddr = (u32)&sensors_spi_drop;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_Init(SENSORS_SPI_DMA_RX_STREAM, &DMA_InitStructure);
+
+	DMA_DeInit(SENSORS_SPI_DMA_TX_STREAM);
+	DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+	DMA_InitStructure.DMA_Memory0BaseAddr = (u32)&sensors_spi_zero;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+	DMA_Init(SENSORS_SPI_DMA_TX_STREAM, &DMA_InitStructure);
+
+	// The last received byte ends the transfer
+	DMA_ITConfig(SENSORS_SPI_DMA_RX_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+	NVIC_InitStructure.NVIC_IRQChannel = SENSORS_SPI_DMA_RX_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+}
+
+void sensors_spi_device_init(const Sensors_SpiDevice* device) {
+	GPIO_InitTypeDef GPIO_InitStructure;
+
+	GPIO_InitStructure.GPIO_Pin   = device->csPin;
+	GPIO_InitStructure.GPIO_Mode  = GPIO_Mode_OUT;
+	GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_InitStructure.GPIO_PuPd  = GPIO_PuPd_UP;
+	GPIO_Init(device->csPort, &GPIO_InitStructure);
+	GPIO_SetBits(device->csPort, device->csPin);
+}
+
+u8 sensors_spi_start(Sensors_Transfer* transfer) {
+	u32 primask;
+
+	if (!transfer->length) {
+		return 0;
+	}
+
+	// The queue is shared by all interrupts and the main loop
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if ((transfer->status == SENSORS_BUS_BUSY) || (transfer->status == SENSORS_BUS_QUEUED)) {
+		__set_PRIMASK(primask);
+		return 0;
+	}
+	if (sensors_spi_current) {
+		transfer->status = SENSORS_BUS_QUEUED;
+		transfer->next = 0;
+		if (sensors_spi_tail) {
+			sensors_spi_tail->next = transfer;
+		} else {
+			sensors_spi_head = transfer;
+		}
+		sensors_spi_tail = transfer;
+		sensors_spi_queued++;
+	} else {
+		_sensors_spi_begin(transfer);
+	}
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+u8 sensors_spi_busy() {
+	return sensors_spi_current != 0;
+}
+
+u8 sensors_spi_wait(Sensors_Transfer* transfer, u32 timeout) {
+	while ((transfer->status == SENSORS_BUS_BUSY) || (transfer->status == SENSORS_BUS_QUEUED)) {
+		if (!timeout--) {
+			break;
+		}
+		sensors_spi_check();
+	}
+	return transfer->status;
+}
+
+u8 sensors_spi_check() {
+	u32 primask;
+	u8 recovered = 0;
+
+	// The DMA interrupt must not finish the transfer while it is taken down
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (sensors_spi_current && ((sensors_time_now() - sensors_spi_started) > SENSORS_SPI_TIMEOUT(sensors_spi_current->length))) {
+		_sensors_spi_fail(1);
+		recovered = 1;
+	}
+	__set_PRIMASK(primask);
+	return recovered;
+}
+
+/**
+ * Interrupt handler for the SPI RX DMA stream, ends the running transfer
+ */
+void DMA2_Stream0_IRQHandler(void) {
+	if (DMA_GetITStatus(SENSORS_SPI_DMA_RX_STREAM, DMA_IT_TEIF0)) {
+		DMA_ClearITPendingBit(SENSORS_SPI_DMA_RX_STREAM, DMA_IT_TEIF0);
+		if (sensors_spi_current) {
+			_sensors_spi_fail(0);
+		}
+	} else if (DMA_GetITStatus(SENSORS_SPI_DMA_RX_STREAM, DMA_IT_TCIF0)) {
+		DMA_ClearITPendingBit(SENSORS_SPI_DMA_RX_STREAM, DMA_IT_TCIF0);
+		_sensors_spi_finish(SENSORS_BUS_DONE);
+	}
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Configure SENSORS_SPI as master in fullduplex mode (4-wire) and let it request the DMA.
+ *         Clock polarity, phase and speed are set per device when a transfer runs.
+ * @param  None
+ * @retval None
+ */
+static void _sensors_spi_configure() {
+	SPI_InitTypeDef SPI_InitStructure;
+
+	SPI_I2S_DeInit(SENSORS_SPI);
+	SPI_InitStructure.SPI_Direction = SPI_Direction_2Lines_FullDuplex;
+	SPI_InitStructure.SPI_DataSize = SPI_DataSize_8b;
+	SPI_InitStructure.SPI_CPOL = SPI_CPOL_Low;
+	SPI_InitStructure.SPI_CPHA = SPI_CPHA_1Edge;
+	SPI_InitStructure.SPI_NSS = SPI_NSS_Soft;
+	SPI_InitStructure.SPI_BaudRatePrescaler = SPI_BaudRatePrescaler_4;
+	SPI_InitStructure.SPI_FirstBit = SPI_FirstBit_MSB;
+	SPI_InitStructure.SPI_CRCPolynomial = 7;
+	SPI_InitStructure.SPI_Mode = SPI_Mode_Master;
+	SPI_Init(SENSORS_SPI, &SPI_InitStructure);
+	SPI_Cmd(SENSORS_SPI, ENABLE);
+	SPI_I2S_DMACmd(SENSORS_SPI, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, ENABLE);
+}
+
+/**
+ * @brief  Run the first attempt of a transfer
+ *         Interrupts have to be disabled or this is called from the DMA interrupt.
+ * @param  transfer  The transfer to run
+ * @retval None
+ */
+static void _sensors_spi_begin(Sensors_Transfer* transfer) {
+	sensors_spi_attempt = 0;
+	sensors_spi_first = transfer->tx ? transfer->tx[0] : 0;
+	_sensors_spi_run(transfer);
+}
+
+/**
+ * @brief  Switch the bus to the clock of the device, select it and start the DMA streams.
+ *         Interrupts have to be disabled or this is called from the DMA interrupt.
+ * @param  transfer  The transfer to run
+ * @retval None
+ */
+static void _sensors_spi_run(Sensors_Transfer* transfer) {
+	DMA_Stream_TypeDef* rx = SENSORS_SPI_DMA_RX_STREAM;
+	DMA_Stream_TypeDef* tx = SENSORS_SPI_DMA_TX_STREAM;
+	const Sensors_SpiDevice* device = transfer->device;
+	u16 cr1 = (SENSORS_SPI->CR1 & ~SENSORS_SPI_CR1_DEVICE) | device->mode | device->prescaler;
+
+	sensors_spi_current = transfer;
+	sensors_spi_started = sensors_time_now();
+	transfer->status = SENSORS_BUS_BUSY;
+
+	// Clock polarity, phase and speed can only be changed while the SPI is disabled
+	if (cr1 != SENSORS_SPI->CR1) {
+		SENSORS_SPI->CR1 = cr1 & ~SPI_CR1_SPE;
+		SENSORS_SPI->CR1 = cr1 | SPI_CR1_SPE;
+	}
+
+	// A byte left in the data register from a blocking access would shift the answer
+	(void)SENSORS_SPI->DR;
+
+	DMA_ClearFlag(rx, SENSORS_SPI_DMA_RX_FLAGS);
+	DMA_ClearFlag(tx, SENSORS_SPI_DMA_TX_FLAGS);
+	rx->NDTR = transfer->length;
+	tx->NDTR = transfer->length;
+	if (transfer->rx) {
+		rx->M0AR = (u32)transfer->rx;
+		rx->CR |= DMA_SxCR_MINC;
+	} else {
+		rx->M0AR = (u32)&sensors_spi_drop;
+		rx->CR &= ~DMA_SxCR_MINC;
+	}
+	if (transfer->tx) {
+		tx->M0AR = (u32)transfer->tx;
+		tx->CR |= DMA_SxCR_MINC;
+	} else {
+		tx->M0AR = (u32)&sensors_spi_zero;
+		tx->CR &= ~DMA_SxCR_MINC;
+	}
+
+	// Select the chip, then start receiving before the first byte is sent
+	GPIO_ResetBits(device->csPort, device->csPin);
+	rx->CR |= DMA_SxCR_EN;
+	tx->CR |= DMA_SxCR_EN;
+}
+
+/**
+ * @brief  Count a failed attempt of the running transfer, recover the bus and repeat the
+ *         transfer or end it with SENSORS_BUS_ERROR after SENSORS_SPI_RETRIES.
+ *         Interrupts have to be disabled or this is called from the DMA interrupt.
+ * @param  timeout  1 if the transfer did not finish in time, 0 on a DMA error
+ * @retval None
+ */
+static void _sensors_spi_fail(u8 timeout) {
+	Sensors_Transfer* transfer = sensors_spi_current;
+	const Sensors_SpiDevice* device = transfer->device;
+
+	device->health->errors++;
+	if (timeout) {
+		device->health->timeouts++;
+	}
+	_sensors_spi_recover(device);
+
+	if (sensors_spi_attempt < SENSORS_SPI_RETRIES) {
+		sensors_spi_attempt++;
+		device->health->retries++;
+		if (transfer->rx && (transfer->rx == transfer->tx)) {
+			transfer->rx[0] = sensors_spi_first;
+		}
+		_sensors_spi_run(transfer);
+	} else {
+		_sensors_spi_finish(SENSORS_BUS_ERROR);
+	}
+}
+
+/**
+ * @brief  Stop both DMA streams, deselect the device and reset the SPI to a known state.
+ *         A few microseconds, far less than a control loop.
+ * @param  device  The device of the failed transfer
+ * @retval None
+ */
+static void _sensors_spi_recover(const Sensors_SpiDevice* device) {
+	Sensors_BusHealth* health = device->health;
+	u32 start = sensors_time_now();
+	u32 time;
+	u8 wait = 0xFF;
+
+	// A stream only stops after its current beat, it must not write into the next transfer
+	SENSORS_SPI_DMA_TX_STREAM->CR &= ~DMA_SxCR_EN;
+	SENSORS_SPI_DMA_RX_STREAM->CR &= ~DMA_SxCR_EN;
+	while (((SENSORS_SPI_DMA_TX_STREAM->CR | SENSORS_SPI_DMA_RX_STREAM->CR) & DMA_SxCR_EN) && --wait);
+	DMA_ClearFlag(SENSORS_SPI_DMA_RX_STREAM, SENSORS_SPI_DMA_RX_FLAGS);
+	DMA_ClearFlag(SENSORS_SPI_DMA_TX_STREAM, SENSORS_SPI_DMA_TX_FLAGS);
+
+	// Ends the command for the device, the next select starts a new one
+	GPIO_SetBits(device->csPort, device->csPin);
+	_sensors_spi_configure();
+
+	time = sensors_time_now() - start;
+	health->recoveries++;
+	health->recoveryTime = time;
+	if (time > health->recoveryTimeMax) {
+		health->recoveryTimeMax = time;
+	}
+}
+
+/**
+ * @brief  Release the chip, start the next queued transfer and tell the owner of the finished one
+ * @param  status  SENSORS_BUS_DONE or SENSORS_BUS_ERROR
+ * @retval None
+ */
+static void _sensors_spi_finish(u8 status) {
+	Sensors_Transfer* transfer = sensors_spi_current;
+	Sensors_Transfer* next;
+	const Sensors_SpiDevice* device;
+	u32 primask;
+
+	SENSORS_SPI_DMA_TX_STREAM->CR &= ~DMA_SxCR_EN;
+	SENSORS_SPI_DMA_RX_STREAM->CR &= ~DMA_SxCR_EN;
+	if (!transfer) {
+		return;
+	}
+
+	device = transfer->device;
+	GPIO_SetBits(device->csPort, device->csPin);
+	if (status == SENSORS_BUS_DONE) {
+		sensors_spi_transfers++;
+	} else {
+		sensors_spi_errors++;
+	}
+	_sensors_spi_health(device->health, status);
+
+	// Chain the next transfer before the callback runs, the bus does not wait for it
+	primask = __get_PRIMASK();
+	__disable_irq();
+	next = sensors_spi_head;
+	if (next) {
+		sensors_spi_head = next->next;
+		if (!sensors_spi_head) {
+			sensors_spi_tail = 0;
+		}
+		_sensors_spi_begin(next);
+	} else {
+		sensors_spi_current = 0;
+	}
+	__set_PRIMASK(primask);
+
+	transfer->status = status;
+	if (transfer->callback) {
+		transfer->callback(transfer);
+	}
+}
+
+/**
+ * @brief  Degrade a device after SENSORS_BUS_DEGRADED_FAILURES failed transfers in a row,
+ *         it is healthy again after SENSORS_BUS_HEALTHY_TRANSFERS good ones in a row
+ * @param  health  Counters of the device
+ * @param  status  SENSORS_BUS_DONE or SENSORS_BUS_ERROR
+ * @retval None
+ */
+static void _sensors_spi_health(Sensors_BusHealth* health, u8 status) {
+	if (status == SENSORS_BUS_DONE) {
+		health->failedInRow = 0;
+		if (health->degraded && (++health->goodInRow >= SENSORS_BUS_HEALTHY_TRANSFERS)) {
+			health->degraded = 0;
+		}
+	} else {
+		health->failures++;
+		health->goodInRow = 0;
+		if (++health->failedInRow >= SENSORS_BUS_DEGRADED_FAILURES) {
+			health->degraded = 1;
+		}
+	}
+}
@@ -0,0 +1,95 @@
+/** @file    sensors_time.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Free running microsecond timebase and timestamped sample streams. Every
+ *           sample is stamped at its data ready edge, so streams with different
+ *           output data rates can be resampled onto the same control loop tick.
+ * 
+ * 
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ * 
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/sensors_time.h"
+
+/**** Public implementations ****/
+
+void sensors_time_init() {
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	
+	RCC_APB1PeriphClockCmd(SENSORS_TIME_TIM_CLK, ENABLE);
+	
+	// APB1 timers are clocked with SystemCoreClock / 2, the full 32bit range is used
+	TIM_TimeBaseStructure.TIM_Prescaler = (u16)((SystemCoreClock / 2) / SENSORS_TIME_FREQUENCY) - 1;
+	TIM_TimeBaseStructure.TIM_Period = 0xFFFFFFFF;
+	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(SENSORS_TIME_TIM, &TIM_TimeBaseStructure);
+	TIM_Cmd(SENSORS_TIME_TIM, ENABLE);
+}
+
+u32 sensors_time_now() {
+	return SENSORS_TIME_TIM->CNT;
+}
+
+void sensors_stream_push(Sensors_Stream* stream, u32 time, const s32* value) {
+	u32 i = stream->count & (SENSORS_STREAM_SIZE - 1);
+	
+	stream->time[i] = time;
+	stream->value[i][0] = value[0];
+	stream->value[i][1] = value[1];
+	stream->value[i][2] = value[2];
+	
+	// Publish the sample only after it is complete
+	stream->count++;
+}
+
+u8 sensors_stream_sample(const Sensors_Stream* stream, u32 time, s32* out) {
+	u32 count = stream->count;
+	u32 oldest, n, older, newer, span, offset;
+	u8 i;
+	
+	if (!count) {
+		return 0;
+	}
+	oldest = (count > SENSORS_STREAM_SIZE) ? (count - SENSORS_STREAM_SIZE) : 0;
+	
+	// Walk back from the newest sample to the first one not after the time;
+	// signed differences keep this right over the timer wrap around
+	for (n = count - 1; n > oldest; n--) {
+		if ((s32)(time - stream->time[(n - 1) & (SENSORS_STREAM_SIZE - 1)]) >= 0) {
+			break;
+		}
+	}
+	newer = n & (SENSORS_STREAM_SIZE - 1);
+	older = (n - 1) & (SENSORS_STREAM_SIZE - 1);
+	
+	// Before the oldest or after the newest sample the nearest one is held
+	if ((n == oldest) || (n == count - 1 && (s32)(time - stream->time[newer]) >= 0)) {
+		for (i = 0; i < 3; i++) {
+			out[i] = stream->value[newer][i];
+		}
+		return 0;
+	}
+	
+	span = stream->time[newer] - stream->time[older];
+	offset = time - stream->time[older];
+	for (i = 0; i < 3; i++) {
+		out[i] = stream->value[older][i] + (s32)(((int64_t)(stream->value[newer][i] - stream->value[older][i]) * offset) / (int64_t)span);
+	}
+	return 1;
+}
@@ -22,12 +22,64 @@
  */
 #include "../inc/servo.h"
 
-volatile float servo_angle[4] = { 0, 0, 0, 0 };
-volatile u16 servo_period[4] = { 0, 0, 0, 0 };
+volatile float servo_angle[SERVO_CHANNELS] = { 0, 0, 0, 0 };
+volatile u16 servo_period[SERVO_CHANNELS] = { 0, 0, 0, 0 };
 volatile u16 servo_count = 0;
+volatile u32 servo_commit_skipped = 0;
+volatile u32 servo_commit_late = 0;
+
+#if SERVO_MODE == SERVO_MODE_SOFT
+/**
+ * Staged output vectors: servo_commit() writes the buffer not published, then publishes it.
+ * TIM3_IRQHandler copies the published one at the frame start; it is never preempted by
+ * servo_commit(), so it never sees a half written vector.
+ */
+static volatile u16 servo_staged[2][SERVO_CHANNELS] = {
+	{ SERVO_TIM_MICROSECOND, SERVO_TIM_MICROSECOND, SERVO_TIM_MICROSECOND, SERVO_TIM_MICROSECOND },
+	{ SERVO_TIM_MICROSECOND, SERVO_TIM_MICROSECOND, SERVO_TIM_MICROSECOND, SERVO_TIM_MICROSECOND }
+};
+static volatile u8 servo_staged_index = 0;
+static volatile u8 servo_staged_ready = 0;
+static u8 servo_committed = 0;
+#endif
+
+// Last positions, servo_set_pos() commits them with the changed one
+static u16 servo_position[SERVO_CHANNELS];
 
 void servo_gpio_init() {
 	GPIO_InitTypeDef GPIO_Config;
+#if SERVO_MODE == SERVO_MODE_BSRR
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOD, ENABLE);
+
+	GPIO_Config.GPIO_Pin = SERVO_BSRR_PINS;
+	GPIO_Config.GPIO_Mode = GPIO_Mode_OUT;
+	GPIO_Config.GPIO_OType = GPIO_OType_PP;
+	GPIO_Config.GPIO_Speed = GPIO_Speed_100MHz;
+	GPIO_Config.GPIO_PuPd = GPIO_PuPd_DOWN;
+	GPIO_Init(SERVO_REGISTER, &GPIO_Config);
+	GPIO_ResetBits(SERVO_REGISTER, SERVO_BSRR_PINS);
+#elif SERVO_MODE != SERVO_MODE_SOFT
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOB | RCC_AHB1Periph_GPIOC, ENABLE);
+
+	GPIO_Config.GPIO_Mode = GPIO_Mode_AF;
+	GPIO_Config.GPIO_OType = GPIO_OType_PP;
+	GPIO_Config.GPIO_Speed = GPIO_Speed_100MHz;
+#if (SERVO_MODE == SERVO_MODE_DSHOT) && SERVO_DSHOT_BIDIR
+	GPIO_Config.GPIO_PuPd = GPIO_PuPd_UP; // Inverted lines, also idle while receiving the reply
+#else
+	GPIO_Config.GPIO_PuPd = GPIO_PuPd_DOWN; // No pulse while the timer is not running
+#endif
+
+	GPIO_Config.GPIO_Pin = SERVO_OUT1 | SERVO_OUT2;
+	GPIO_Init(SERVO_OUT_REGISTER_C, &GPIO_Config);
+	GPIO_Config.GPIO_Pin = SERVO_OUT3 | SERVO_OUT4;
+	GPIO_Init(SERVO_OUT_REGISTER_B, &GPIO_Config);
+
+	GPIO_PinAFConfig(SERVO_OUT_REGISTER_C, GPIO_PinSource6, SERVO_OUT_AF);
+	GPIO_PinAFConfig(SERVO_OUT_REGISTER_C, GPIO_PinSource7, SERVO_OUT_AF);
+	GPIO_PinAFConfig(SERVO_OUT_REGISTER_B, GPIO_PinSource0, SERVO_OUT_AF);
+	GPIO_PinAFConfig(SERVO_OUT_REGISTER_B, GPIO_PinSource1, SERVO_OUT_AF);
+#else
 	GPIO_Config.GPIO_Pin = SERVO_PORTS;
 	GPIO_Config.GPIO_Mode = GPIO_Mode_OUT;
 	GPIO_Config.GPIO_OType = GPIO_OType_PP;
@@ -39,9 +91,19 @@ void servo_gpio_init() {
 	//GPIO_PinAFConfig(SERVO_REGISTER, GPIO_PinSource1, GPIO_AF_TIM3);
 	//GPIO_PinAFConfig(SERVO_REGISTER, GPIO_PinSource2, GPIO_AF_TIM3);
 	//GPIO_PinAFConfig(SERVO_REGISTER, GPIO_PinSource3, GPIO_AF_TIM3);
+#endif
 }
 
 void servo_init() {
+#if SERVO_MODE == SERVO_MODE_PWM
+	servo_pwm_init();
+#elif SERVO_MODE == SERVO_MODE_DSHOT
+	servo_dshot_init();
+#elif SERVO_MODE == SERVO_MODE_ONESHOT
+	servo_oneshot_init();
+#elif SERVO_MODE == SERVO_MODE_BSRR
+	servo_bsrr_init();
+#else
 	u16 prescalerValue = (u16)((SystemCoreClock / 2) / SERVO_TIM_PRESCALE) - 1;
 	
 	// ---------- Interrupt configuration for the servos on TIM3 ---------- //
@@ -93,14 +155,56 @@ void servo_init() {
 	TIM_Cmd(TIM3, ENABLE);
 	TIM_ITConfig(TIM3, TIM_IT_Update, ENABLE);
 	//TIM_CtrlPWMOutputs(TIM3, ENABLE);
+#endif
 }
 
 void servo_set_pos(u16 num, u16 position) {
-	if (num <= sizeof(servo_angle)/sizeof(float)) {
-		servo_angle[num] = position % (SERVO_TIM_COUNTER - 1);
+	if (num < SERVO_CHANNELS) {
+		servo_position[num] = position;
+		servo_commit(servo_position);
+	}
+}
+
+void servo_commit(const u16* position) {
+#if SERVO_MODE != SERVO_MODE_SOFT
+	u8 i;
+
+	// servo_set_pos() commits these with the next changed servo
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		servo_position[i] = position[i];
 	}
+#endif
+
+#if SERVO_MODE == SERVO_MODE_PWM
+	servo_pwm_write(0, SERVO_CHANNELS, position);
+#elif SERVO_MODE == SERVO_MODE_DSHOT
+	servo_dshot_write(0, SERVO_CHANNELS, position);
+#elif SERVO_MODE == SERVO_MODE_ONESHOT
+	servo_oneshot_write(0, SERVO_CHANNELS, position);
+#elif SERVO_MODE == SERVO_MODE_BSRR
+	servo_bsrr_write(0, SERVO_CHANNELS, position);
+#else
+	u8 next = servo_staged_index ^ 1;
+	u8 i;
+
+	// The periods are calculated here, the interrupt only copies them
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		servo_position[i] = position[i];
+		servo_angle[i] = position[i] % (SERVO_TIM_COUNTER - 1);
+		servo_staged[next][i] = (position[i] % (SERVO_TIM_COUNTER - 1)) + SERVO_TIM_MICROSECOND;
+	}
+
+	if (servo_staged_ready) {
+		servo_commit_skipped++;
+	}
+	servo_staged_index = next;
+	servo_staged_ready = 1;
+	servo_committed = 1;
+#endif
 }
 
+#if SERVO_MODE == SERVO_MODE_SOFT
+
 /**
  * Interrupt handler for TIM3
  */
@@ -113,10 +217,17 @@ void TIM3_IRQHandler(void) {
 		// Count down from 1000 to 0
 		servo_count--;
 		if (!servo_count) {
-			servo_period[0] = servo_angle[0] + SERVO_TIM_MICROSECOND;
-			servo_period[1] = servo_angle[1] + SERVO_TIM_MICROSECOND;
-			servo_period[2] = servo_angle[2] + SERVO_TIM_MICROSECOND;
-			servo_period[3] = servo_angle[3] + SERVO_TIM_MICROSECOND;
+			// Publish the staged positions of all servos together at the frame start
+			const volatile u16* staged = servo_staged[servo_staged_index];
+			servo_period[0] = staged[0];
+			servo_period[1] = staged[1];
+			servo_period[2] = staged[2];
+			servo_period[3] = staged[3];
+			if (servo_staged_ready) {
+				servo_staged_ready = 0;
+			} else if (servo_committed) {
+				servo_commit_late++; // No new positions since the last frame
+			}
 			servo_count = SERVO_TIM_COUNTER;
 			GPIO_ResetBits(SERVO_REGISTER, SERVO_PORTS);
 			return;
@@ -163,3 +274,4 @@ void TIM3_IRQHandler(void) {
 		//TIM3->CCR4 = 1000 + (u32)(servo_angle[3] * servo_step);
 	}
 }
+#endif // SERVO_MODE == SERVO_MODE_SOFT
@@ -0,0 +1,213 @@
+/** @file    servo_bsrr.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Software PWM on any pin of the servo port without CPU load. A precomputed
+ *           waveform of BSRR words is written by timer-triggered DMA into the port,
+ *           the CPU only updates the waveform when a position changes.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/servo.h"
+#include "../inc/receiver.h"
+
+#if SERVO_MODE == SERVO_MODE_BSRR
+
+#if RECEIVER_MODE == RECEIVER_MODE_SAMPLE
+#error "The BSRR servo mode needs TIM8, select another receiver mode"
+#endif
+#if (SERVO_CHANNELS + SERVO_BSRR_SHIFT) > 16
+#error "SERVO_BSRR_CHANNELS and SERVO_BSRR_SHIFT are not on one port"
+#endif
+#if (SERVO_CHANNELS + SERVO_BSRR_SHIFT) > 12
+#error "SERVO_BSRR_CHANNELS and SERVO_BSRR_SHIFT overlap the LEDs on PD12-PD15"
+#endif
+#if (SERVO_BSRR_STEPS * SERVO_BSRR_RESOLUTION) >= (SERVO_BSRR_TIM_FREQUENCY / SERVO_BSRR_RATE)
+#error "SERVO_BSRR_RATE is too high, the waveform does not fit into one frame"
+#endif
+
+/**** Private declarations ****/
+
+#define SERVO_BSRR_STREAM DMA2_Stream3
+#define SERVO_BSRR_FLAGS (DMA_FLAG_TCIF3 | DMA_FLAG_HTIF3 | DMA_FLAG_TEIF3 | DMA_FLAG_DMEIF3 | DMA_FLAG_FEIF3)
+
+/**
+ * Two waveforms: servo_bsrr_write() updates the one not output and marks it ready,
+ * TIM3_IRQHandler switches to it at the next frame start. The handler is never
+ * preempted by servo_bsrr_write(), so it never outputs a half built waveform.
+ */
+static u32 servo_bsrr_wave[2][SERVO_BSRR_STEPS];
+static u16 servo_bsrr_built[2][SERVO_CHANNELS];
+static volatile u8 servo_bsrr_active = 0;
+static volatile u8 servo_bsrr_ready = 0;
+
+// Pulse widths in steps of the last positions
+static u16 servo_bsrr_width[SERVO_CHANNELS];
+
+static void _servo_bsrr_start(void);
+
+
+/**** Public implementations ****/
+
+void servo_bsrr_init() {
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	TIM_OCInitTypeDef TIM_OCInitStructure;
+	DMA_InitTypeDef DMA_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+	u16 position[SERVO_CHANNELS];
+	u8 i;
+
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM8, ENABLE);
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+
+	// Both waveforms start with the shortest pulse on all servos
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		position[i] = 0;
+		servo_bsrr_width[i] = ~0;
+	}
+	servo_bsrr_write(0, SERVO_CHANNELS, position);
+	servo_bsrr_build(servo_bsrr_wave[0], servo_bsrr_built[0], servo_bsrr_width, SERVO_CHANNELS, SERVO_BSRR_SHIFT);
+	servo_bsrr_ready = 0;
+
+	// ---------- DMA2 Stream3 / Waveform into the port ---------- //
+	DMA_DeInit(SERVO_BSRR_STREAM);
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = DMA_Channel_7;
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (u32)&SERVO_REGISTER->BSRRL; // 32bit write to BSRRL/BSRRH
+	DMA_InitStructure.DMA_Memory0BaseAddr = (u32)servo_bsrr_wave[0];
+	DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+	DMA_InitStructure.DMA_BufferSize = SERVO_BSRR_STEPS;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+	DMA_Init(SERVO_BSRR_STREAM, &DMA_InitStructure);
+
+	// ---------- TIM8 / One DMA request per step ---------- //
+	TIM_TimeBaseStructure.TIM_Prescaler = 0;
+	TIM_TimeBaseStructure.TIM_Period = (u16)((SystemCoreClock / SERVO_BSRR_TIM_FREQUENCY) * SERVO_BSRR_RESOLUTION) - 1;
+	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(TIM8, &TIM_TimeBaseStructure);
+
+	// CH2 only compares, it has no output; the compare match at 0 requests the next word
+	TIM_OCStructInit(&TIM_OCInitStructure);
+	TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_Timing;
+	TIM_OCInitStructure.TIM_Pulse = 0;
+	TIM_OC2Init(TIM8, &TIM_OCInitStructure);
+	TIM_DMACmd(TIM8, TIM_DMA_CC2, ENABLE);
+
+	// ---------- TIM3 / Frame start ---------- //
+	TIM_TimeBaseStructure.TIM_Prescaler = (u16)((SystemCoreClock / 2) / SERVO_BSRR_TIM_FREQUENCY) - 1;
+	TIM_TimeBaseStructure.TIM_Period = (SERVO_BSRR_TIM_FREQUENCY / SERVO_BSRR_RATE) - 1;
+	TIM_TimeBaseInit(TIM3, &TIM_TimeBaseStructure);
+
+	NVIC_InitStructure.NVIC_IRQChannel = TIM3_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+
+	TIM_Cmd(TIM8, ENABLE);
+	TIM_ITConfig(TIM3, TIM_IT_Update, ENABLE);
+	TIM_Cmd(TIM3, ENABLE);
+}
+
+void servo_bsrr_write(u16 first, u16 count, const u16* position) {
+	u16 width, i;
+	u8 next, changed = 0;
+
+	for (i = 0; (i < count) && (first + i < SERVO_CHANNELS); i++) {
+		width = (SERVO_PULSE_MIN + (position[i] > SERVO_POSITION_MAX ? SERVO_POSITION_MAX : position[i])) / SERVO_BSRR_RESOLUTION;
+		if (width != servo_bsrr_width[first + i]) {
+			servo_bsrr_width[first + i] = width;
+			changed = 1;
+		}
+	}
+	if (!changed) {
+		return; // The waveform is still valid, the DMA repeats it every frame
+	}
+
+	// Take the ready waveform back before the frame start can switch to it
+	if (servo_bsrr_ready) {
+		servo_bsrr_ready = 0;
+		servo_commit_skipped++;
+	}
+	next = servo_bsrr_active ^ 1;
+	servo_bsrr_build(servo_bsrr_wave[next], servo_bsrr_built[next], servo_bsrr_width, SERVO_CHANNELS, SERVO_BSRR_SHIFT);
+	servo_bsrr_ready = 1;
+}
+
+void servo_bsrr_build(u32* wave, u16* old, const u16* width, u8 count, u8 shift) {
+	u32 pin;
+	u16 end;
+	u8 i;
+
+	for (i = 0; i < count; i++) {
+		pin = 1UL << (shift + i);
+
+		// A pulse of 0 steps would set and reset the pin in the same word, the set wins
+		end = width[i];
+		if (end < 1) {
+			end = 1;
+		} else if (end > SERVO_BSRR_STEPS - 1) {
+			end = SERVO_BSRR_STEPS - 1;
+		}
+
+		wave[0] |= pin;
+		wave[old[i]] &= ~(pin << 16);
+		wave[end] |= pin << 16;
+		old[i] = end;
+	}
+}
+
+/**
+ * Interrupt handler for TIM3, starts the waveform at every frame
+ */
+void TIM3_IRQHandler(void) {
+	if (TIM_GetITStatus(TIM3, TIM_IT_Update)) {
+		TIM_ClearITPendingBit(TIM3, TIM_IT_Update);
+		if (servo_bsrr_ready) {
+			servo_bsrr_active ^= 1;
+			servo_bsrr_ready = 0;
+		}
+		_servo_bsrr_start();
+	}
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Restart the DMA stream from the first step of the active waveform
+ *         The last frame finished long before, the stream is already disabled.
+ * @param  None
+ * @retval None
+ */
+static void _servo_bsrr_start(void) {
+	DMA_ClearFlag(SERVO_BSRR_STREAM, SERVO_BSRR_FLAGS);
+	SERVO_BSRR_STREAM->M0AR = (u32)servo_bsrr_wave[servo_bsrr_active];
+	SERVO_BSRR_STREAM->NDTR = SERVO_BSRR_STEPS;
+	DMA_Cmd(SERVO_BSRR_STREAM, ENABLE);
+}
+
+#endif // SERVO_MODE == SERVO_MODE_BSRR
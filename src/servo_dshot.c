@@ -0,0 +1,455 @@
+/** @file    servo_dshot.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   DShot150/300/600 digital ESC protocol. The frames of all four motors
+ *           are encoded into compare values and streamed by one DMA burst per bit
+ *           into the TIM3 compare registers.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/servo.h"
+#include "../inc/receiver.h"
+
+#if SERVO_MODE == SERVO_MODE_DSHOT
+
+#if SERVO_DSHOT_BIDIR && ((RECEIVER_MODE == RECEIVER_MODE_SERIAL) || (RECEIVER_MODE == RECEIVER_MODE_CAPTURE))
+#error "Bidirectional DShot needs DMA1 Stream5 and Stream7, select another receiver mode"
+#endif
+
+volatile u32 servo_dshot_skipped = 0;
+volatile u32 servo_dshot_encode_cycles = 0;
+volatile u32 servo_dshot_telemetry_frames[SERVO_CHANNELS] = { 0, 0, 0, 0 };
+volatile u32 servo_dshot_telemetry_errors[SERVO_CHANNELS] = { 0, 0, 0, 0 };
+
+/**** Private declarations ****/
+
+// Compare values of all motors interleaved per bit, the order of a TIM3 DMA burst
+static u16 servo_dshot_buffer[SERVO_DSHOT_BUFFER];
+
+// Last frame values sent by servo_dshot_update()
+static u16 servo_dshot_value[SERVO_CHANNELS];
+
+// Pending commands and how many times they have still to be sent
+static u8 servo_dshot_commands[SERVO_CHANNELS];
+static u8 servo_dshot_repeat[SERVO_CHANNELS];
+
+// Last valid eRPM per motor
+static u32 servo_dshot_erpm_last[SERVO_CHANNELS];
+
+// GCR: Every nibble is sent as a 5 bit group, all other groups are invalid (0xFF)
+static const u8 servo_dshot_gcr[32] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x09, 0x0A, 0x0B, 0xFF, 0x0D, 0x0E, 0x0F,
+	0xFF, 0xFF, 0x02, 0x03, 0xFF, 0x05, 0x06, 0x07, 0xFF, 0x00, 0x08, 0x01, 0xFF, 0x04, 0x0C, 0xFF
+};
+
+#if SERVO_DSHOT_BIDIR
+/**
+ * Everything to receive the reply of one motor: the DMA stream which copies the capture
+ * register and the timer DMA request of the channel.
+ */
+typedef struct {
+	DMA_Stream_TypeDef* stream;
+	u32 flags;
+	volatile u32* ccr;
+	u16 dmaSource;
+} Servo_DShotCapture;
+
+static const Servo_DShotCapture servo_dshot_capture[SERVO_CHANNELS] = {
+	{ DMA1_Stream4, DMA_FLAG_TCIF4 | DMA_FLAG_HTIF4 | DMA_FLAG_TEIF4 | DMA_FLAG_DMEIF4 | DMA_FLAG_FEIF4, &TIM3->CCR1, TIM_DMA_CC1 },
+	{ DMA1_Stream5, DMA_FLAG_TCIF5 | DMA_FLAG_HTIF5 | DMA_FLAG_TEIF5 | DMA_FLAG_DMEIF5 | DMA_FLAG_FEIF5, &TIM3->CCR2, TIM_DMA_CC2 },
+	{ DMA1_Stream7, DMA_FLAG_TCIF7 | DMA_FLAG_HTIF7 | DMA_FLAG_TEIF7 | DMA_FLAG_DMEIF7 | DMA_FLAG_FEIF7, &TIM3->CCR3, TIM_DMA_CC3 },
+	{ DMA1_Stream2, SERVO_DSHOT_DMA_FLAGS,                                                         &TIM3->CCR4, TIM_DMA_CC4 }
+};
+
+// Stream configuration shared by the output burst and the captures, only the direction differs
+#define SERVO_DSHOT_DMA_CR (DMA_Channel_5 | DMA_Priority_High | DMA_MemoryDataSize_HalfWord | DMA_PeripheralDataSize_HalfWord | DMA_MemoryInc_Enable)
+
+// Captured edges per motor and the timer configuration of both directions
+static volatile u16 servo_dshot_edges[SERVO_CHANNELS][SERVO_DSHOT_EDGES];
+static u16 servo_dshot_ccmr1[2], servo_dshot_ccmr2[2], servo_dshot_ccer[2];
+static volatile u8 servo_dshot_receiving = 0;
+
+static void _servo_dshot_stream(DMA_Stream_TypeDef* stream, u32 flags, u32 dir, u32 peripheral, u32 memory, u16 count);
+static void _servo_dshot_output();
+static void _servo_dshot_receive();
+#endif // SERVO_DSHOT_BIDIR
+
+
+/**** Public implementations ****/
+
+void servo_dshot_init() {
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	TIM_OCInitTypeDef TIM_OCInitStructure;
+	DMA_InitTypeDef DMA_InitStructure;
+	u8 i;
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1, ENABLE);
+
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		servo_dshot_value[i] = 0;
+		servo_dshot_commands[i] = 0;
+		servo_dshot_repeat[i] = 0;
+		servo_dshot_erpm_last[i] = 0;
+	}
+
+	// ---------- TIM3 / One period per bit ---------- //
+	TIM_TimeBaseStructure.TIM_Prescaler = 0;
+	TIM_TimeBaseStructure.TIM_Period = SERVO_DSHOT_BIT_PERIOD - 1;
+	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseInit(TIM3, &TIM_TimeBaseStructure);
+
+#if SERVO_DSHOT_BIDIR
+	// Remember the input capture configuration to switch the direction with three writes
+	TIM_ICInitTypeDef TIM_ICInitStructure;
+	TIM_ICStructInit(&TIM_ICInitStructure);
+	TIM_ICInitStructure.TIM_ICPolarity = TIM_ICPolarity_BothEdge;
+	TIM_ICInitStructure.TIM_ICSelection = TIM_ICSelection_DirectTI;
+	TIM_ICInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+	TIM_ICInitStructure.TIM_ICFilter = 0x02;
+	TIM_ICInitStructure.TIM_Channel = TIM_Channel_1;
+	TIM_ICInit(TIM3, &TIM_ICInitStructure);
+	TIM_ICInitStructure.TIM_Channel = TIM_Channel_2;
+	TIM_ICInit(TIM3, &TIM_ICInitStructure);
+	TIM_ICInitStructure.TIM_Channel = TIM_Channel_3;
+	TIM_ICInit(TIM3, &TIM_ICInitStructure);
+	TIM_ICInitStructure.TIM_Channel = TIM_Channel_4;
+	TIM_ICInit(TIM3, &TIM_ICInitStructure);
+	servo_dshot_ccmr1[1] = TIM3->CCMR1;
+	servo_dshot_ccmr2[1] = TIM3->CCMR2;
+	servo_dshot_ccer[1] = TIM3->CCER;
+	TIM3->CCER = 0;
+#endif
+
+	// All channels start idle; the preload switches the bits exactly at the update event.
+	// In bidirectional mode the lines are inverted, idle is high.
+	TIM_OCStructInit(&TIM_OCInitStructure);
+	TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
+	TIM_OCInitStructure.TIM_OCPolarity = SERVO_DSHOT_BIDIR ? TIM_OCPolarity_Low : TIM_OCPolarity_High;
+	TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+	TIM_OCInitStructure.TIM_Pulse = 0;
+	TIM_OC1Init(TIM3, &TIM_OCInitStructure);
+	TIM_OC1PreloadConfig(TIM3, TIM_OCPreload_Enable);
+	TIM_OC2Init(TIM3, &TIM_OCInitStructure);
+	TIM_OC2PreloadConfig(TIM3, TIM_OCPreload_Enable);
+	TIM_OC3Init(TIM3, &TIM_OCInitStructure);
+	TIM_OC3PreloadConfig(TIM3, TIM_OCPreload_Enable);
+	TIM_OC4Init(TIM3, &TIM_OCInitStructure);
+	TIM_OC4PreloadConfig(TIM3, TIM_OCPreload_Enable);
+	TIM_ARRPreloadConfig(TIM3, ENABLE);
+#if SERVO_DSHOT_BIDIR
+	servo_dshot_ccmr1[0] = TIM3->CCMR1;
+	servo_dshot_ccmr2[0] = TIM3->CCMR2;
+	servo_dshot_ccer[0] = TIM3->CCER;
+#endif
+
+	// ---------- DMA writes CCR1-CCR4 with every update ---------- //
+	DMA_DeInit(SERVO_DSHOT_DMA_STREAM);
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = SERVO_DSHOT_DMA_CHANNEL;
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (u32)&TIM3->DMAR;
+	DMA_InitStructure.DMA_Memory0BaseAddr = (u32)servo_dshot_buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+	DMA_InitStructure.DMA_BufferSize = SERVO_DSHOT_BUFFER;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+	DMA_Init(SERVO_DSHOT_DMA_STREAM, &DMA_InitStructure);
+
+	TIM_DMAConfig(TIM3, TIM_DMABase_CCR1, TIM_DMABurstLength_4Transfers);
+	TIM_DMACmd(TIM3, TIM_DMA_Update, ENABLE);
+	TIM_Cmd(TIM3, ENABLE);
+
+#if SERVO_DSHOT_BIDIR
+	// The end of a frame switches to receive the reply
+	NVIC_InitTypeDef NVIC_InitStructure;
+	NVIC_InitStructure.NVIC_IRQChannel = DMA1_Stream2_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+	DMA_ITConfig(SERVO_DSHOT_DMA_STREAM, DMA_IT_TC, ENABLE);
+#endif
+}
+
+void servo_dshot_update(const u16* value) {
+	u32 start;
+	u16 frame;
+	u8 i;
+
+#if SERVO_DSHOT_BIDIR
+	// Collect the replies to the last frame before the lines are switched back to output
+	if (servo_dshot_receiving) {
+		_servo_dshot_receive();
+	}
+#endif
+
+	// The DMA disables the stream when the last slot is written
+	if (DMA_GetCmdStatus(SERVO_DSHOT_DMA_STREAM) == ENABLE) {
+		servo_dshot_skipped++;
+		return;
+	}
+
+	start = receiver_now();
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		// A throttle cancels a pending command, the motor must not stop for it
+		if (servo_dshot_repeat[i] && !value[i]) {
+			frame = servo_dshot_frame(servo_dshot_commands[i], 1);
+			servo_dshot_repeat[i]--;
+		} else {
+			frame = servo_dshot_frame(value[i], 0);
+			servo_dshot_repeat[i] = 0;
+		}
+		servo_dshot_value[i] = value[i];
+		servo_dshot_encode(&servo_dshot_buffer[i], SERVO_CHANNELS, frame, SERVO_DSHOT_BIT_ONE, SERVO_DSHOT_BIT_ZERO);
+	}
+	servo_dshot_encode_cycles = receiver_now() - start;
+
+#if SERVO_DSHOT_BIDIR
+	_servo_dshot_output();
+#else
+	DMA_ClearFlag(SERVO_DSHOT_DMA_STREAM, SERVO_DSHOT_DMA_FLAGS);
+	DMA_SetCurrDataCounter(SERVO_DSHOT_DMA_STREAM, SERVO_DSHOT_BUFFER);
+	DMA_Cmd(SERVO_DSHOT_DMA_STREAM, ENABLE);
+#endif
+}
+
+void servo_dshot_write(u16 first, u16 count, const u16* position) {
+	u16 i;
+	for (i = 0; (i < count) && (first + i < SERVO_CHANNELS); i++) {
+		// Position 0 stops the motor, all others are mapped onto the throttle range
+		if (!position[i]) {
+			servo_dshot_value[first + i] = 0;
+		} else if (position[i] >= SERVO_POSITION_MAX) {
+			servo_dshot_value[first + i] = SERVO_DSHOT_THROTTLE_MAX;
+		} else {
+			servo_dshot_value[first + i] = SERVO_DSHOT_THROTTLE_MIN - 1 + position[i];
+		}
+	}
+	servo_dshot_update(servo_dshot_value);
+}
+
+u8 servo_dshot_command(u16 num, u8 command) {
+	// The ESC ignores commands while the motor spins, and the command would stop it
+	if ((num >= SERVO_CHANNELS) || (command > SERVO_DSHOT_CMD_MAX) || servo_dshot_value[num]) {
+		return 0;
+	}
+
+	servo_dshot_commands[num] = command;
+	if (command >= SERVO_DSHOT_CMD_SPIN_DIRECTION_1) {
+		servo_dshot_repeat[num] = SERVO_DSHOT_CMD_REPEAT;
+	} else {
+		servo_dshot_repeat[num] = 1;
+	}
+	return 1;
+}
+
+u16 servo_dshot_frame(u16 value, u8 telemetry) {
+	u16 frame;
+	if (value > SERVO_DSHOT_THROTTLE_MAX) {
+		value = SERVO_DSHOT_THROTTLE_MAX;
+	}
+	frame = (value << 1) | (telemetry ? 1 : 0);
+
+	// Checksum: XOR of the three nibbles, inverted for bidirectional ESCs
+#if SERVO_DSHOT_BIDIR
+	return (frame << 4) | (~(frame ^ (frame >> 4) ^ (frame >> 8)) & 0x0F);
+#else
+	return (frame << 4) | ((frame ^ (frame >> 4) ^ (frame >> 8)) & 0x0F);
+#endif
+}
+
+void servo_dshot_encode(u16* buffer, u16 stride, u16 frame, u16 one, u16 zero) {
+	u8 i;
+	for (i = 0; i < SERVO_DSHOT_FRAME_BITS; i++, frame <<= 1) {
+		*buffer = (frame & 0x8000) ? one : zero;
+		buffer += stride;
+	}
+	// The two slots after the frame are never written and stay zero
+}
+
+u32 servo_dshot_get_erpm(u16 num) {
+	return (num < SERVO_CHANNELS) ? servo_dshot_erpm_last[num] : 0;
+}
+
+u32 servo_dshot_get_rpm(u16 num) {
+	return servo_dshot_get_erpm(num) * 2 / SERVO_MOTOR_POLES;
+}
+
+u16 servo_dshot_gcr_decode(const volatile u16* edges, u8 count, u16 bit) {
+	u32 value = 0;
+	u16 telemetry = 0;
+	u8 bits = 0, len, nibble, i;
+
+	if (count < 2) {
+		return SERVO_DSHOT_TELEMETRY_INVALID;
+	}
+
+	// Unsigned arithmetic handles the timer overflow between two edges
+	for (i = 1; i < count; i++) {
+		len = ((u16)(edges[i] - edges[i - 1]) + bit / 2) / bit;
+		bits += len;
+		if (!len || (bits > SERVO_DSHOT_GCR_BITS)) {
+			return SERVO_DSHOT_TELEMETRY_INVALID;
+		}
+		value = (value << len) | (1UL << (len - 1));
+	}
+
+	// The last interval ends with the frame, there is no edge after it
+	if (bits >= SERVO_DSHOT_GCR_BITS) {
+		return SERVO_DSHOT_TELEMETRY_INVALID;
+	}
+	len = SERVO_DSHOT_GCR_BITS - bits;
+	value = (value << len) | (1UL << (len - 1));
+
+	// Every one is a transition of the line, back to the GCR bits
+	value ^= value >> 1;
+	for (i = 0; i < 4; i++) {
+		nibble = servo_dshot_gcr[(value >> (i * 5)) & 0x1F];
+		if (nibble == 0xFF) {
+			return SERVO_DSHOT_TELEMETRY_INVALID;
+		}
+		telemetry |= (u16)nibble << (i * 4);
+	}
+	return telemetry;
+}
+
+u8 servo_dshot_telemetry_crc(u16 telemetry) {
+	return ((telemetry ^ (telemetry >> 4) ^ (telemetry >> 8) ^ (telemetry >> 12)) & 0x0F) == 0x0F;
+}
+
+u32 servo_dshot_erpm(u16 telemetry) {
+	u32 period;
+
+	// The period is the value without the checksum: 3 bit shift, 9 bit mantissa
+	telemetry >>= 4;
+	if (telemetry == 0x0FFF) {
+		return 0;
+	}
+	period = (u32)(telemetry & 0x01FF) << (telemetry >> 9);
+	return period ? (60000000 / period) : 0;
+}
+
+#if SERVO_DSHOT_BIDIR
+/**
+ * Interrupt handler for the output DMA stream; the frame is out, listen for the reply
+ */
+void DMA1_Stream2_IRQHandler(void) {
+	u8 i;
+
+	if (!DMA_GetITStatus(SERVO_DSHOT_DMA_STREAM, DMA_IT_TCIF2)) {
+		return;
+	}
+	DMA_ClearITPendingBit(SERVO_DSHOT_DMA_STREAM, DMA_IT_TCIF2);
+
+	// The channel bits in CCMR can only be changed while the channels are disabled
+	TIM_DMACmd(TIM3, TIM_DMA_Update, DISABLE);
+	TIM3->CCER = 0;
+	TIM3->CCMR1 = servo_dshot_ccmr1[1];
+	TIM3->CCMR2 = servo_dshot_ccmr2[1];
+	TIM3->ARR = 0xFFFF;
+	TIM3->EGR = TIM_EGR_UG;
+
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		const Servo_DShotCapture* capture = &servo_dshot_capture[i];
+		_servo_dshot_stream(capture->stream, capture->flags, DMA_DIR_PeripheralToMemory, (u32)capture->ccr, (u32)servo_dshot_edges[i], SERVO_DSHOT_EDGES);
+	}
+	servo_dshot_receiving = 1;
+	TIM3->CCER = servo_dshot_ccer[1];
+	TIM_DMACmd(TIM3, TIM_DMA_CC1 | TIM_DMA_CC2 | TIM_DMA_CC3 | TIM_DMA_CC4, ENABLE);
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Restart a DMA stream with a new direction and buffer
+ * @param  stream  The DMA stream
+ * @param  flags  All flags of the stream to clear
+ * @param  dir  DMA_DIR_PeripheralToMemory or DMA_DIR_MemoryToPeripheral
+ * @param  peripheral  Address of the timer register
+ * @param  memory  Address of the buffer
+ * @param  count  Number of transfers
+ * @retval None
+ */
+static void _servo_dshot_stream(DMA_Stream_TypeDef* stream, u32 flags, u32 dir, u32 peripheral, u32 memory, u16 count) {
+	stream->CR &= ~DMA_SxCR_EN;
+	while (stream->CR & DMA_SxCR_EN);
+	DMA_ClearFlag(stream, flags);
+	stream->CR = SERVO_DSHOT_DMA_CR | dir | ((stream == SERVO_DSHOT_DMA_STREAM) && (dir == DMA_DIR_MemoryToPeripheral) ? DMA_IT_TC : 0);
+	stream->PAR = peripheral;
+	stream->M0AR = memory;
+	stream->NDTR = count;
+	stream->CR |= DMA_SxCR_EN;
+}
+
+/**
+ * @brief  Switch the lines back to output and start the burst DMA of the new frame
+ * @param  None
+ * @retval None
+ */
+static void _servo_dshot_output() {
+	TIM3->CCER = 0;
+	TIM3->CCMR1 = servo_dshot_ccmr1[0];
+	TIM3->CCMR2 = servo_dshot_ccmr2[0];
+	TIM3->CCR1 = 0;
+	TIM3->CCR2 = 0;
+	TIM3->CCR3 = 0;
+	TIM3->CCR4 = 0;
+	TIM3->ARR = SERVO_DSHOT_BIT_PERIOD - 1;
+	TIM3->EGR = TIM_EGR_UG; // Load the idle compare values and the bit period
+	TIM3->CCER = servo_dshot_ccer[0];
+
+	_servo_dshot_stream(SERVO_DSHOT_DMA_STREAM, SERVO_DSHOT_DMA_FLAGS, DMA_DIR_MemoryToPeripheral, (u32)&TIM3->DMAR, (u32)servo_dshot_buffer, SERVO_DSHOT_BUFFER);
+	TIM_DMACmd(TIM3, TIM_DMA_Update, ENABLE);
+}
+
+/**
+ * @brief  Stop the captures and decode the replies of all motors
+ * @param  None
+ * @retval None
+ */
+static void _servo_dshot_receive() {
+	u16 telemetry;
+	u8 i, count;
+
+	TIM_DMACmd(TIM3, TIM_DMA_CC1 | TIM_DMA_CC2 | TIM_DMA_CC3 | TIM_DMA_CC4, DISABLE);
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		const Servo_DShotCapture* capture = &servo_dshot_capture[i];
+		capture->stream->CR &= ~DMA_SxCR_EN;
+		while (capture->stream->CR & DMA_SxCR_EN);
+		count = SERVO_DSHOT_EDGES - capture->stream->NDTR;
+
+		telemetry = servo_dshot_gcr_decode(servo_dshot_edges[i], count, SERVO_DSHOT_GCR_BIT);
+		if ((telemetry != SERVO_DSHOT_TELEMETRY_INVALID) && servo_dshot_telemetry_crc(telemetry)) {
+			servo_dshot_erpm_last[i] = servo_dshot_erpm(telemetry);
+			servo_dshot_telemetry_frames[i]++;
+		} else {
+			servo_dshot_telemetry_errors[i]++;
+		}
+	}
+	servo_dshot_receiving = 0;
+}
+#endif // SERVO_DSHOT_BIDIR
+
+#endif // SERVO_MODE == SERVO_MODE_DSHOT
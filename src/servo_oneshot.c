@@ -0,0 +1,104 @@
+/** @file    servo_oneshot.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   OneShot125 and Multishot ESC pulses. TIM3 runs in one pulse mode and
+ *           every update of the control loop triggers exactly one pulse per motor,
+ *           so the ESC gets the new value without waiting for a PWM frame.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/servo.h"
+
+#if SERVO_MODE == SERVO_MODE_ONESHOT
+
+volatile u32 servo_oneshot_skipped = 0;
+
+/**** Private declarations ****/
+
+// Compare registers of the channels in the order of the servos
+static volatile u32* const servo_oneshot_ccr[SERVO_CHANNELS] = { &TIM3->CCR1, &TIM3->CCR2, &TIM3->CCR3, &TIM3->CCR4 };
+
+// Pulse widths in timer ticks and the period of one pulse; the longest pulse plus one tick
+static u16 servo_oneshot_width[SERVO_CHANNELS];
+static u16 servo_oneshot_period;
+
+
+/**** Public implementations ****/
+
+void servo_oneshot_init() {
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	TIM_OCInitTypeDef TIM_OCInitStructure;
+	u8 i;
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
+
+	servo_oneshot_period = servo_oneshot_pulse(SERVO_POSITION_MAX, SERVO_ONESHOT_MIN, SERVO_ONESHOT_MAX, SERVO_ONESHOT_TICKS_PER_US) + 1;
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		servo_oneshot_width[i] = servo_oneshot_pulse(0, SERVO_ONESHOT_MIN, SERVO_ONESHOT_MAX, SERVO_ONESHOT_TICKS_PER_US);
+	}
+
+	// ---------- TIM3 / One pulse per start ---------- //
+	TIM_TimeBaseStructure.TIM_Prescaler = 0;
+	TIM_TimeBaseStructure.TIM_Period = servo_oneshot_period - 1;
+	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseInit(TIM3, &TIM_TimeBaseStructure);
+	TIM_SelectOnePulseMode(TIM3, TIM_OPMode_Single);
+
+	// PWM2 is high from the compare value up to the end of the period, so all pulses end
+	// together at the update event. The counter stops at 0 where every output is low.
+	// No preload, the compare registers are only written while the timer stands still.
+	TIM_OCStructInit(&TIM_OCInitStructure);
+	TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM2;
+	TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+	TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+	TIM_OCInitStructure.TIM_Pulse = servo_oneshot_period;
+	TIM_OC1Init(TIM3, &TIM_OCInitStructure);
+	TIM_OC2Init(TIM3, &TIM_OCInitStructure);
+	TIM_OC3Init(TIM3, &TIM_OCInitStructure);
+	TIM_OC4Init(TIM3, &TIM_OCInitStructure);
+}
+
+void servo_oneshot_write(u16 first, u16 count, const u16* position) {
+	u16 i;
+
+	for (i = 0; (i < count) && (first + i < SERVO_CHANNELS); i++) {
+		servo_oneshot_width[first + i] = servo_oneshot_pulse(position[i], SERVO_ONESHOT_MIN, SERVO_ONESHOT_MAX, SERVO_ONESHOT_TICKS_PER_US);
+	}
+
+	// The one pulse mode clears the enable bit at the end of the pulse
+	if (TIM3->CR1 & TIM_CR1_CEN) {
+		servo_oneshot_skipped++;
+		return;
+	}
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		*servo_oneshot_ccr[i] = servo_oneshot_period - servo_oneshot_width[i];
+	}
+	TIM_Cmd(TIM3, ENABLE);
+}
+
+u16 servo_oneshot_pulse(u16 position, u32 min, u32 max, u32 ticks) {
+	if (position > SERVO_POSITION_MAX) {
+		position = SERVO_POSITION_MAX;
+	}
+	min = min * ticks / 1000;
+	max = max * ticks / 1000;
+	return (u16)(min + (max - min) * position / SERVO_POSITION_MAX);
+}
+
+#endif // SERVO_MODE == SERVO_MODE_ONESHOT
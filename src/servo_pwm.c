@@ -0,0 +1,104 @@
+/** @file    servo_pwm.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Servo and ESC pulses generated by the TIM3 output compare channels.
+ *           The compare registers are preloaded, so all channels take a new pulse
+ *           width at the same update event and no interrupt is needed.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/servo.h"
+
+#if SERVO_MODE == SERVO_MODE_PWM
+
+/**** Private declarations ****/
+
+// Compare registers of the channels in the order of the servos
+static volatile u32* const servo_pwm_ccr[SERVO_CHANNELS] = { &TIM3->CCR1, &TIM3->CCR2, &TIM3->CCR3, &TIM3->CCR4 };
+
+
+/**** Public implementations ****/
+
+void servo_pwm_init() {
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	TIM_OCInitTypeDef TIM_OCInitStructure;
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
+
+	// ---------- TIM3 / Time Management configuration ---------- //
+	// TIM3 is clocked from APB1 with SystemCoreClock / 2
+	TIM_TimeBaseStructure.TIM_Prescaler = (u16)((SystemCoreClock / 2) / SERVO_PWM_TIM_FREQUENCY) - 1;
+	TIM_TimeBaseStructure.TIM_Period = servo_pwm_period(SERVO_PWM_RATE);
+	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseInit(TIM3, &TIM_TimeBaseStructure);
+
+	// Set up 4 channels for servo; all start with the shortest pulse
+	TIM_OCStructInit(&TIM_OCInitStructure);
+	TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
+	TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+	TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+	TIM_OCInitStructure.TIM_Pulse = servo_pwm_compare(0);
+
+	TIM_OC1Init(TIM3, &TIM_OCInitStructure); // Channel 1 configuration = SERVO1 TIM3_CH1
+	TIM_OC1PreloadConfig(TIM3, TIM_OCPreload_Enable);
+	TIM_OC2Init(TIM3, &TIM_OCInitStructure); // Channel 2 configuration = SERVO2 TIM3_CH2
+	TIM_OC2PreloadConfig(TIM3, TIM_OCPreload_Enable);
+	TIM_OC3Init(TIM3, &TIM_OCInitStructure); // Channel 3 configuration = SERVO3 TIM3_CH3
+	TIM_OC3PreloadConfig(TIM3, TIM_OCPreload_Enable);
+	TIM_OC4Init(TIM3, &TIM_OCInitStructure); // Channel 4 configuration = SERVO4 TIM3_CH4
+	TIM_OC4PreloadConfig(TIM3, TIM_OCPreload_Enable);
+
+	// The frame rate can change at runtime, a preloaded ARR never cuts a frame
+	TIM_ARRPreloadConfig(TIM3, ENABLE);
+	TIM_Cmd(TIM3, ENABLE);
+}
+
+void servo_pwm_set_rate(u16 rate) {
+	TIM_SetAutoreload(TIM3, servo_pwm_period(rate));
+}
+
+u16 servo_pwm_period(u16 rate) {
+	if (rate < SERVO_PWM_RATE_MIN) {
+		rate = SERVO_PWM_RATE_MIN;
+	} else if (rate > SERVO_PWM_RATE_MAX) {
+		rate = SERVO_PWM_RATE_MAX;
+	}
+	return (u16)(SERVO_PWM_TIM_FREQUENCY / rate) - 1;
+}
+
+u16 servo_pwm_compare(u16 position) {
+	if (position > SERVO_POSITION_MAX) {
+		position = SERVO_POSITION_MAX;
+	}
+	return (u16)((u32)(SERVO_PULSE_MIN + position) * (SERVO_PWM_TIM_FREQUENCY / 1000000));
+}
+
+void servo_pwm_write(u16 first, u16 count, const u16* position) {
+	u16 i;
+
+	// Hold back the update event while writing, otherwise the channels written before
+	// and after an update would start their new pulse in different frames
+	TIM_UpdateDisableConfig(TIM3, ENABLE);
+	for (i = 0; (i < count) && (first + i < SERVO_CHANNELS); i++) {
+		*servo_pwm_ccr[first + i] = servo_pwm_compare(position[i]);
+	}
+	TIM_UpdateDisableConfig(TIM3, DISABLE);
+}
+
+#endif // SERVO_MODE == SERVO_MODE_PWM
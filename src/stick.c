@@ -0,0 +1,103 @@
+/** @file    stick.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Stick shaping between the receiver and the controller: Deadband, expo and
+ *           rates by lookup tables with linear interpolation.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../inc/stick.h"
+
+/**** Private declarations ****/
+
+// The default tables are generated by the compiler, so there is no calculation on startup
+static Stick_Curve stick_curves[STICK_CHANNELS] = {
+	{ STICK_ROLL_EXPO,     STICK_ROLL_RATE,     STICK_ROLL_DEADBAND,     STICK_TABLE(STICK_ROLL_EXPO, STICK_ROLL_RATE) },
+	{ STICK_PITCH_EXPO,    STICK_PITCH_RATE,    STICK_PITCH_DEADBAND,    STICK_TABLE(STICK_PITCH_EXPO, STICK_PITCH_RATE) },
+	{ STICK_YAW_EXPO,      STICK_YAW_RATE,      STICK_YAW_DEADBAND,      STICK_TABLE(STICK_YAW_EXPO, STICK_YAW_RATE) },
+	{ STICK_THROTTLE_EXPO, STICK_THROTTLE_RATE, STICK_THROTTLE_DEADBAND, STICK_TABLE(STICK_THROTTLE_EXPO, STICK_THROTTLE_RATE) }
+};
+
+
+/**** Public implementations ****/
+
+void stick_set_curve(u8 num, u8 expo, u8 rate, u16 deadband) {
+	Stick_Curve* curve;
+	s32 x;
+	u8 i;
+
+	if (num >= STICK_CHANNELS) {
+		return;
+	}
+	if (expo > 100) {
+		expo = 100;
+	}
+	if (deadband >= STICK_RANGE) {
+		deadband = STICK_RANGE - 1;
+	}
+
+	curve = &stick_curves[num];
+	curve->expo = expo;
+	curve->rate = rate;
+	curve->deadband = deadband;
+	for (i = 0; i < STICK_TABLE_POINTS; i++) {
+		x = STICK_X(i);
+		curve->table[i] = (s16)STICK_CURVE(x, (s32)expo, (s32)rate);
+	}
+}
+
+s16 stick_shape(u8 num, u16 position) {
+	const Stick_Curve* curve;
+	s32 x, offset;
+	u16 index;
+
+	if (num >= STICK_CHANNELS) {
+		return 0;
+	}
+	curve = &stick_curves[num];
+	if (position > RECEIVER_POSITION_MAX) {
+		position = RECEIVER_POSITION_MAX;
+	}
+
+	// Center the position and scale it to -STICK_RANGE..STICK_RANGE
+	x = (s32)position * (2 * STICK_RANGE) / RECEIVER_POSITION_MAX - STICK_RANGE;
+
+	// The deadband is cut out and the rest is stretched to the full range again
+	if (curve->deadband) {
+		if (x > curve->deadband) {
+			x = (x - curve->deadband) * STICK_RANGE / (STICK_RANGE - curve->deadband);
+		} else if (x < -curve->deadband) {
+			x = (x + curve->deadband) * STICK_RANGE / (STICK_RANGE - curve->deadband);
+		} else {
+			x = 0;
+		}
+	}
+
+	// Linear interpolation between the two neighbouring table points
+	offset = x + STICK_RANGE;
+	index = offset / STICK_STEP;
+	if (index >= STICK_TABLE_POINTS - 1) {
+		return curve->table[STICK_TABLE_POINTS - 1];
+	}
+	offset -= index * STICK_STEP;
+	return curve->table[index] + (curve->table[index + 1] - curve->table[index]) * offset / STICK_STEP;
+}
+
+s16 stick_get(u8 num) {
+	return stick_shape(num, receiver_get_pos(num));
+}
@@ -0,0 +1,104 @@
+/** @file    bench_mixer.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host benchmark of the motor mixer: cycles per mix of every frame geometry
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "mixer.h"
+#include "receiver.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+#define BENCH_ROUNDS 200000
+#define BENCH_DEMANDS 64
+
+static const char* const bench_geometry[] = { "quad x", "quad +", "hexa x", "octo x" };
+
+// Keeps the compiler from dropping the loops
+static volatile float bench_sink;
+
+static void _bench_demands(Mixer_Demand* demand);
+
+
+/**** Public implementations ****/
+
+u32 receiver_now() {
+	return 0;
+}
+
+void servo_commit(const u16* position) {
+}
+
+int main(void) {
+	Mixer_Demand demand[BENCH_DEMANDS];
+	float motor[MIXER_MOTORS_MAX], sum = 0.0f;
+	uint64_t cycles;
+	u32 round, outside = 0;
+	u8 geometry, motors, i;
+
+	_bench_demands(demand);
+	for (geometry = MIXER_QUAD_X; geometry <= MIXER_OCTO_X; geometry++) {
+		motors = mixer_init(geometry);
+		TEST_EQUAL(motors, (geometry == MIXER_OCTO_X) ? 8 : (geometry == MIXER_HEXA_X) ? 6 : 4);
+
+		// Whatever the demand, the desaturation keeps every motor inside its range
+		for (round = 0; round < BENCH_DEMANDS; round++) {
+			mixer_mix(&demand[round], motor);
+			for (i = 0; i < motors; i++) {
+				outside += (motor[i] < -1e-5f) || (motor[i] > 1.0f + 1e-5f);
+			}
+		}
+
+		cycles = test_cycles();
+		for (round = 0; round < BENCH_ROUNDS; round++) {
+			mixer_mix(&demand[round % BENCH_DEMANDS], motor);
+			sum += motor[0];
+		}
+		cycles = test_cycles() - cycles;
+		bench_sink = sum;
+
+		printf("%s  %6.1f cycles/mix (hardware float on the host)\n", bench_geometry[geometry], (double)cycles / BENCH_ROUNDS);
+	}
+	TEST_EQUAL(outside, 0);
+	TEST_CHECK(mixer_saturations > 0);
+	return test_report("bench_mixer");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Demands from hover to full deflections on all axes, about half of them saturate
+ * @param  demand  Receives BENCH_DEMANDS demands
+ * @retval None
+ */
+static void _bench_demands(Mixer_Demand* demand) {
+	u32 seed = 1;
+	u8 i, axis;
+
+	for (i = 0; i < BENCH_DEMANDS; i++) {
+		for (axis = 0; axis < MIXER_AXES; axis++) {
+			seed = seed * 1103515245 + 12345;
+			demand[i].axis[axis] = (float)((seed >> 16) & 0x7FFF) / 16383.5f - 1.0f;
+		}
+		seed = seed * 1103515245 + 12345;
+		demand[i].throttle = (float)((seed >> 16) & 0x7FFF) / 32767.0f;
+	}
+}
@@ -0,0 +1,211 @@
+/** @file    bench_receiver_protocol.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Throughput of the SBUS, IBUS and CRSF parsers in frames per second on a
+ *           ring buffer like the one of the serial receiver DMA
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "receiver_protocol.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+// Same size as RECEIVER_SERIAL_BUFFER, the frames wrap around its end
+#define BENCH_RING 128
+#define BENCH_MASK (BENCH_RING - 1)
+#define BENCH_FRAMES 2000000
+
+typedef struct {
+	const char* name;
+	Receiver_ProtocolParser parser;
+	uint8_t frame[RECEIVER_CRSF_FRAME_LENGTH_MAX];
+	uint8_t length;
+	uint32_t wire;          //!< Frames per second at the full baud rate of the protocol
+	uint16_t channel;       //!< Expected value of the first channel in microseconds
+} Bench_Protocol;
+
+static uint8_t bench_ring[BENCH_RING];
+
+static void _bench_pack_11bit(uint8_t* data, const uint16_t* raw);
+static void _bench_sbus(Bench_Protocol* protocol);
+static void _bench_ibus(Bench_Protocol* protocol);
+static void _bench_crsf(Bench_Protocol* protocol);
+static void _bench_run(Bench_Protocol* protocol);
+
+
+/**** Public implementations ****/
+
+int main(void) {
+	Bench_Protocol protocol;
+
+	_bench_sbus(&protocol);
+	_bench_run(&protocol);
+	_bench_ibus(&protocol);
+	_bench_run(&protocol);
+	_bench_crsf(&protocol);
+	_bench_run(&protocol);
+	return test_report("bench_receiver_protocol");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Pack 16 channels with 11 bits each, LSB first
+ * @param  data  Receives 22 bytes
+ * @param  raw  The 16 raw channel values
+ * @retval None
+ */
+static void _bench_pack_11bit(uint8_t* data, const uint16_t* raw) {
+	uint32_t bits = 0;
+	uint8_t available = 0, i;
+
+	memset(data, 0, 22);
+	for (i = 0; i < RECEIVER_PROTOCOL_CHANNELS; i++) {
+		bits |= (uint32_t)(raw[i] & 0x07FF) << available;
+		available += 11;
+		while (available >= 8) {
+			*data++ = bits & 0xFF;
+			bits >>= 8;
+			available -= 8;
+		}
+	}
+}
+
+/**
+ * @brief  SBUS frame, 100000 baud 8E2 gives 12 bits per byte
+ * @param  protocol  Receives the frame
+ * @retval None
+ */
+static void _bench_sbus(Bench_Protocol* protocol) {
+	uint16_t raw[RECEIVER_PROTOCOL_CHANNELS];
+	uint8_t i;
+
+	for (i = 0; i < RECEIVER_PROTOCOL_CHANNELS; i++) {
+		raw[i] = 1000 + 37 * i;
+	}
+	protocol->name = "sbus";
+	protocol->parser = receiver_sbus_parse;
+	protocol->length = RECEIVER_SBUS_FRAME_LENGTH;
+	protocol->frame[0] = RECEIVER_SBUS_START;
+	_bench_pack_11bit(&protocol->frame[1], raw);
+	protocol->frame[23] = 0;
+	protocol->frame[24] = 0;
+	protocol->wire = 100000 / 12 / RECEIVER_SBUS_FRAME_LENGTH;
+	protocol->channel = ((1000 * 5) >> 3) + 880;
+}
+
+/**
+ * @brief  IBUS frame, 115200 baud 8N1
+ * @param  protocol  Receives the frame
+ * @retval None
+ */
+static void _bench_ibus(Bench_Protocol* protocol) {
+	uint16_t sum = 0xFFFF;
+	uint8_t i;
+
+	protocol->name = "ibus";
+	protocol->parser = receiver_ibus_parse;
+	protocol->length = RECEIVER_IBUS_FRAME_LENGTH;
+	protocol->frame[0] = RECEIVER_IBUS_LENGTH;
+	protocol->frame[1] = RECEIVER_IBUS_COMMAND;
+	for (i = 0; i < RECEIVER_IBUS_CHANNELS; i++) {
+		protocol->frame[2 + 2 * i] = (1100 + 50 * i) & 0xFF;
+		protocol->frame[3 + 2 * i] = (1100 + 50 * i) >> 8;
+	}
+	for (i = 0; i < RECEIVER_IBUS_FRAME_LENGTH - 2; i++) {
+		sum -= protocol->frame[i];
+	}
+	protocol->frame[30] = sum & 0xFF;
+	protocol->frame[31] = sum >> 8;
+	protocol->wire = 115200 / 10 / RECEIVER_IBUS_FRAME_LENGTH;
+	protocol->channel = 1100;
+}
+
+/**
+ * @brief  CRSF RC channels frame, 420000 baud 8N1
+ * @param  protocol  Receives the frame
+ * @retval None
+ */
+static void _bench_crsf(Bench_Protocol* protocol) {
+	uint16_t raw[RECEIVER_PROTOCOL_CHANNELS];
+	uint8_t i;
+
+	for (i = 0; i < RECEIVER_PROTOCOL_CHANNELS; i++) {
+		raw[i] = 992 + 41 * i;
+	}
+	protocol->name = "crsf";
+	protocol->parser = receiver_crsf_parse;
+	protocol->length = RECEIVER_CRSF_RC_PAYLOAD + 4;
+	protocol->frame[0] = RECEIVER_CRSF_ADDRESS;
+	protocol->frame[1] = RECEIVER_CRSF_RC_PAYLOAD + 2;
+	protocol->frame[2] = RECEIVER_CRSF_TYPE_RC_CHANNELS;
+	_bench_pack_11bit(&protocol->frame[3], raw);
+	protocol->frame[RECEIVER_CRSF_RC_PAYLOAD + 3] = receiver_crsf_crc(protocol->frame, 0xFFFF, 2, RECEIVER_CRSF_RC_PAYLOAD + 1);
+	protocol->wire = 420000 / 10 / (RECEIVER_CRSF_RC_PAYLOAD + 4);
+	protocol->channel = 1500;
+}
+
+/**
+ * @brief  Fill the ring with back to back frames and parse them like the serial receiver,
+ *         refilling each parsed frame behind the others, so every frame start moves around the ring
+ * @param  protocol  The frame and parser
+ * @retval None
+ */
+static void _bench_run(Bench_Protocol* protocol) {
+	uint16_t channels[RECEIVER_PROTOCOL_CHANNELS];
+	uint16_t start = 0, write = 0, used;
+	uint32_t frame, parsed = 0, wrong = 0;
+	uint64_t cycles;
+	struct timespec begin, end;
+	double seconds;
+	uint8_t count, i;
+
+	// Fill as many complete frames as fit, one byte stays free like in a DMA ring
+	while ((uint16_t)(write + protocol->length) < BENCH_RING) {
+		for (i = 0; i < protocol->length; i++) {
+			bench_ring[(write + i) & BENCH_MASK] = protocol->frame[i];
+		}
+		write += protocol->length;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	cycles = test_cycles();
+	for (frame = 0; frame < BENCH_FRAMES; frame++) {
+		used = protocol->parser(bench_ring, BENCH_MASK, start, (write - start) & BENCH_MASK, channels, &count);
+		if (count) {
+			parsed++;
+			wrong += (channels[0] != protocol->channel);
+		}
+		for (i = 0; i < used; i++) {
+			bench_ring[(write + i) & BENCH_MASK] = bench_ring[(start + i) & BENCH_MASK];
+		}
+		start = (start + used) & BENCH_MASK;
+		write = (write + used) & BENCH_MASK;
+	}
+	cycles = test_cycles() - cycles;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+	TEST_EQUAL(parsed, BENCH_FRAMES);
+	TEST_EQUAL(wrong, 0);
+	printf("%-6s %8.1f cycles/frame %12.0f frames/s, the wire carries %u frames/s\n",
+		protocol->name, (double)cycles / BENCH_FRAMES, BENCH_FRAMES / seconds, protocol->wire);
+}
@@ -0,0 +1,99 @@
+/** @file    bench_sensors_filter.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host benchmark of the accelerometer decimator: cycles per output and per input
+ *           sample for every decimation factor
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "sensors_filter.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+#define BENCH_SAMPLES 400000
+#define BENCH_INPUTS 64
+
+static const u8 bench_factor[] = { 1, 2, 4, 8 };
+
+// Keeps the compiler from dropping the loops
+static volatile s32 bench_sink;
+
+static void _bench_inputs(s32 (*in)[3]);
+
+
+/**** Public implementations ****/
+
+int main(void) {
+	static Sensors_Decimator decimator;
+	s32 in[BENCH_INPUTS][3], out[3], dc[3] = { 1000, -1000, 18 }, sum = 0;
+	uint64_t cycles;
+	u32 sample, outputs;
+	u8 f;
+
+	_bench_inputs(in);
+	for (f = 0; f < sizeof(bench_factor); f++) {
+		TEST_EQUAL(sensors_decimator_init(&decimator, bench_factor[f]), 1);
+
+		// Once the delay line is full a constant passes unchanged, the coefficients sum up to 1.0
+		for (sample = 0; sample < 2 * SENSORS_FILTER_MAX_TAPS; sample++) {
+			sensors_decimator_push(&decimator, dc, out);
+		}
+		TEST_EQUAL(out[0], dc[0]);
+		TEST_EQUAL(out[1], dc[1]);
+		TEST_EQUAL(out[2], dc[2]);
+
+		sensors_decimator_init(&decimator, bench_factor[f]);
+		outputs = 0;
+		cycles = test_cycles();
+		for (sample = 0; sample < BENCH_SAMPLES; sample++) {
+			if (sensors_decimator_push(&decimator, in[sample % BENCH_INPUTS], out)) {
+				sum += out[0];
+				outputs++;
+			}
+		}
+		cycles = test_cycles() - cycles;
+		bench_sink = sum;
+		TEST_EQUAL(outputs, BENCH_SAMPLES / bench_factor[f]);
+
+		printf("decimate by %u, %2u taps  %6.1f cycles/output  %5.1f cycles/sample\n", bench_factor[f], decimator.taps,
+			(double)cycles / outputs, (double)cycles / BENCH_SAMPLES);
+	}
+	TEST_EQUAL(sensors_decimator_init(&decimator, 3), 0);
+	return test_report("bench_sensors_filter");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Accelerometer samples in mg over the whole range of the LIS302DL, some beyond s16
+ * @param  in  Receives BENCH_INPUTS samples of X, Y and Z
+ * @retval None
+ */
+static void _bench_inputs(s32 (*in)[3]) {
+	u32 seed = 1;
+	u8 i, axis;
+
+	for (i = 0; i < BENCH_INPUTS; i++) {
+		for (axis = 0; axis < 3; axis++) {
+			seed = seed * 1103515245 + 12345;
+			in[i][axis] = (s32)((seed >> 16) & 0xFFFF) - 32768 + ((i & 7) ? 0 : 40000);
+		}
+	}
+}
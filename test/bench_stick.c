@@ -0,0 +1,132 @@
+/** @file    bench_stick.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Stick shaping with the lookup tables against the direct evaluation of the
+ *           curve in float, with the largest difference between both
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <math.h>
+#include "stick.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+#define BENCH_ROUNDS 2000
+
+// Keeps the compiler from dropping the loops
+static volatile s32 bench_sink;
+
+static float _bench_direct(u8 num, u16 position, const float* expo, const float* rate, const float* deadband);
+
+
+/**** Public implementations ****/
+
+u16 receiver_get_pos(u16 num) {
+	return num;
+}
+
+int main(void) {
+	const u8 expo[STICK_CHANNELS] = { STICK_ROLL_EXPO, STICK_PITCH_EXPO, STICK_YAW_EXPO, STICK_THROTTLE_EXPO };
+	const u8 rate[STICK_CHANNELS] = { STICK_ROLL_RATE, STICK_PITCH_RATE, STICK_YAW_RATE, STICK_THROTTLE_RATE };
+	const u16 deadband[STICK_CHANNELS] = { STICK_ROLL_DEADBAND, STICK_PITCH_DEADBAND, STICK_YAW_DEADBAND, STICK_THROTTLE_DEADBAND };
+	float expoF[STICK_CHANNELS], rateF[STICK_CHANNELS], deadbandF[STICK_CHANNELS], error, errorMax = 0;
+	uint64_t lut, direct, rebuild;
+	u32 round, samples = BENCH_ROUNDS * (RECEIVER_POSITION_MAX + 1) * STICK_CHANNELS;
+	s32 sum = 0;
+	float sumF = 0;
+	u16 position;
+	u8 num;
+
+	for (num = 0; num < STICK_CHANNELS; num++) {
+		expoF[num] = expo[num] / 100.0f;
+		rateF[num] = rate[num] / 100.0f;
+		deadbandF[num] = deadband[num];
+	}
+
+	// The tables follow the curves within 0.5% of the range, the interpolation and integer rounding error
+	for (num = 0; num < STICK_CHANNELS; num++) {
+		for (position = 0; position <= RECEIVER_POSITION_MAX; position++) {
+			error = fabsf(stick_shape(num, position) - _bench_direct(num, position, expoF, rateF, deadbandF));
+			if (error > errorMax) {
+				errorMax = error;
+			}
+		}
+	}
+	TEST_CHECK(errorMax < STICK_RANGE / 200.0f);
+
+	lut = test_cycles();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		for (num = 0; num < STICK_CHANNELS; num++) {
+			for (position = 0; position <= RECEIVER_POSITION_MAX; position++) {
+				sum += stick_shape(num, position);
+			}
+		}
+	}
+	lut = test_cycles() - lut;
+	bench_sink = sum;
+
+	direct = test_cycles();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		for (num = 0; num < STICK_CHANNELS; num++) {
+			for (position = 0; position <= RECEIVER_POSITION_MAX; position++) {
+				sumF += _bench_direct(num, position, expoF, rateF, deadbandF);
+			}
+		}
+	}
+	direct = test_cycles() - direct;
+	bench_sink = (s32)sumF;
+
+	rebuild = test_cycles();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		stick_set_curve(STICK_ROLL, (u8)(round % 100), STICK_ROLL_RATE, STICK_ROLL_DEADBAND);
+	}
+	rebuild = test_cycles() - rebuild;
+
+	printf("lookup table  %6.1f cycles/sample\n", (double)lut / samples);
+	printf("direct float  %6.1f cycles/sample (hardware float on the host, the soft float build is slower)\n", (double)direct / samples);
+	printf("rebuild       %6.0f cycles/table\n", (double)rebuild / BENCH_ROUNDS);
+	printf("largest difference %.2f of %d\n", errorMax, STICK_RANGE);
+	return test_report("bench_stick");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  The curve of stick_shape() evaluated directly with powf() in float
+ * @param  num  Number of the channel
+ * @param  position  Receiver position 0..RECEIVER_POSITION_MAX
+ * @param  expo  Expo of the channels, 0..1
+ * @param  rate  Rate of the channels, 0..1
+ * @param  deadband  Deadband of the channels in STICK_RANGE units
+ * @retval float Shaped value
+ */
+static float _bench_direct(u8 num, u16 position, const float* expo, const float* rate, const float* deadband) {
+	float x = position * (2.0f / RECEIVER_POSITION_MAX) - 1.0f;
+	float band = deadband[num] / STICK_RANGE;
+
+	if (x > band) {
+		x = (x - band) / (1.0f - band);
+	} else if (x < -band) {
+		x = (x + band) / (1.0f - band);
+	} else {
+		x = 0.0f;
+	}
+	return STICK_RANGE * rate[num] * ((1.0f - expo[num]) * x + expo[num] * copysignf(powf(fabsf(x), 3.0f), x));
+}
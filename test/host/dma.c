@@ -0,0 +1,227 @@
+/** @file    dma.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Model of a DMA stream for the host tests
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "dma.h"
+
+/**** Private declarations ****/
+
+// Transfer of a stream as the model last left it, to notice when the firmware programs a new one
+typedef struct {
+	uint16_t length;
+	uint16_t left;
+} Host_DmaTransfer;
+
+static Host_DmaTransfer host_dma_transfer[16];
+
+static uint8_t _host_dma_index(DMA_Stream_TypeDef* stream);
+
+static DMA_TypeDef* _host_dma_controller(DMA_Stream_TypeDef* stream);
+static uint8_t _host_dma_shift(DMA_Stream_TypeDef* stream);
+static volatile uint32_t* _host_dma_isr(DMA_Stream_TypeDef* stream);
+static uint8_t _host_dma_size(DMA_Stream_TypeDef* stream);
+static Host_DmaTransfer* _host_dma_latch(DMA_Stream_TypeDef* stream);
+static void _host_dma_count(DMA_Stream_TypeDef* stream);
+
+
+/**** Public implementations ****/
+
+void host_dma_reset(void) {
+	memset(host_dma_transfer, 0, sizeof(host_dma_transfer));
+}
+
+uint32_t host_dma_flags(DMA_Stream_TypeDef* stream) {
+	return (*_host_dma_isr(stream) >> _host_dma_shift(stream)) & 0x3D;
+}
+
+void host_dma_raise(DMA_Stream_TypeDef* stream, uint32_t flags) {
+	*_host_dma_isr(stream) |= flags << _host_dma_shift(stream);
+}
+
+void host_dma_acknowledge(DMA_Stream_TypeDef* stream) {
+	DMA_TypeDef* dma = _host_dma_controller(stream);
+	volatile uint32_t* ifcr = (_host_dma_isr(stream) == &dma->LISR) ? &dma->LIFCR : &dma->HIFCR;
+	uint32_t mask = 0x3D << _host_dma_shift(stream);
+
+	*_host_dma_isr(stream) &= ~(*ifcr & mask);
+	*ifcr &= ~mask;
+}
+
+uint8_t host_dma_pending(DMA_Stream_TypeDef* stream) {
+	uint32_t flags = host_dma_flags(stream);
+	return ((flags & HOST_DMA_TCIF) && (stream->CR & DMA_SxCR_TCIE))
+	    || ((flags & HOST_DMA_HTIF) && (stream->CR & DMA_SxCR_HTIE))
+	    || ((flags & HOST_DMA_TEIF) && (stream->CR & DMA_SxCR_TEIE));
+}
+
+uint8_t host_dma_receive(DMA_Stream_TypeDef* stream, uint32_t value) {
+	uint8_t size = _host_dma_size(stream);
+	uint8_t* memory;
+
+	if (!(stream->CR & DMA_SxCR_EN) || !stream->NDTR) {
+		return 0;
+	}
+	memory = (uint8_t*)(uintptr_t)stream->M0AR;
+	if (stream->CR & DMA_SxCR_MINC) {
+		memory += (_host_dma_latch(stream)->length - stream->NDTR) * size;
+	}
+	if (size == 1) {
+		*memory = (uint8_t)value;
+	} else if (size == 2) {
+		*(uint16_t*)memory = (uint16_t)value;
+	} else {
+		*(uint32_t*)memory = value;
+	}
+	_host_dma_count(stream);
+	return 1;
+}
+
+uint8_t host_dma_send(DMA_Stream_TypeDef* stream, uint32_t* value) {
+	uint8_t size = _host_dma_size(stream);
+	const uint8_t* memory;
+
+	if (!(stream->CR & DMA_SxCR_EN) || !stream->NDTR) {
+		return 0;
+	}
+	memory = (const uint8_t*)(uintptr_t)stream->M0AR;
+	if (stream->CR & DMA_SxCR_MINC) {
+		memory += (_host_dma_latch(stream)->length - stream->NDTR) * size;
+	}
+	if (size == 1) {
+		*value = *memory;
+	} else if (size == 2) {
+		*value = *(const uint16_t*)memory;
+	} else {
+		*value = *(const uint32_t*)memory;
+	}
+	_host_dma_count(stream);
+	return 1;
+}
+
+uint8_t host_dma_interrupt(DMA_Stream_TypeDef* stream, void (*handler)(void)) {
+	uint8_t runs = 0;
+
+	while (host_dma_pending(stream) && (runs < 8)) {
+		handler();
+		host_dma_acknowledge(stream);
+		runs++;
+	}
+	return runs;
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Number of a stream over both controllers
+ * @param  stream  The stream
+ * @retval uint8_t 0-7 for DMA1, 8-15 for DMA2
+ */
+static uint8_t _host_dma_index(DMA_Stream_TypeDef* stream) {
+	DMA_TypeDef* dma = _host_dma_controller(stream);
+	uintptr_t index = ((uintptr_t)stream - (uintptr_t)dma - 0x10) / 0x18;
+	return (uint8_t)(index & 7) + ((dma == DMA2) ? 8 : 0);
+}
+
+/**
+ * @brief  Transfer of a stream, a new one starts when NDTR is not what the model left
+ * @param  stream  The stream
+ * @retval Host_DmaTransfer* The transfer
+ */
+static Host_DmaTransfer* _host_dma_latch(DMA_Stream_TypeDef* stream) {
+	Host_DmaTransfer* transfer = &host_dma_transfer[_host_dma_index(stream)];
+	if (stream->NDTR != transfer->left) {
+		transfer->length = stream->NDTR;
+		transfer->left = stream->NDTR;
+	}
+	return transfer;
+}
+
+/**
+ * @brief  Controller of a stream
+ * @param  stream  The stream
+ * @retval DMA_TypeDef* DMA1 or DMA2
+ */
+static DMA_TypeDef* _host_dma_controller(DMA_Stream_TypeDef* stream) {
+	return ((uintptr_t)stream < DMA2_BASE) ? DMA1 : DMA2;
+}
+
+/**
+ * @brief  Position of the flags of a stream in LISR/HISR
+ * @param  stream  The stream
+ * @retval uint8_t 0, 6, 16 or 22
+ */
+static uint8_t _host_dma_shift(DMA_Stream_TypeDef* stream) {
+	static const uint8_t shift[4] = { 0, 6, 16, 22 };
+	uintptr_t index = ((uintptr_t)stream - (uintptr_t)_host_dma_controller(stream) - 0x10) / 0x18;
+	return shift[index & 3];
+}
+
+/**
+ * @brief  Status register of a stream
+ * @param  stream  The stream
+ * @retval volatile uint32_t* LISR for stream 0-3, HISR for 4-7
+ */
+static volatile uint32_t* _host_dma_isr(DMA_Stream_TypeDef* stream) {
+	DMA_TypeDef* dma = _host_dma_controller(stream);
+	uintptr_t index = ((uintptr_t)stream - (uintptr_t)dma - 0x10) / 0x18;
+	return (index < 4) ? &dma->LISR : &dma->HISR;
+}
+
+/**
+ * @brief  Size of one item in memory
+ * @param  stream  The stream
+ * @retval uint8_t 1, 2 or 4 bytes
+ */
+static uint8_t _host_dma_size(DMA_Stream_TypeDef* stream) {
+	switch (stream->CR & DMA_SxCR_MSIZE) {
+		case DMA_MemoryDataSize_HalfWord:
+			return 2;
+		case DMA_MemoryDataSize_Word:
+			return 4;
+		default:
+			return 1;
+	}
+}
+
+/**
+ * @brief  Count one item down, raise the half and full transfer flags and reload in circular mode
+ * @param  stream  The stream
+ * @retval None
+ */
+static void _host_dma_count(DMA_Stream_TypeDef* stream) {
+	Host_DmaTransfer* transfer = _host_dma_latch(stream);
+
+	stream->NDTR--;
+	if (stream->NDTR == transfer->length / 2) {
+		host_dma_raise(stream, HOST_DMA_HTIF);
+	}
+	if (!stream->NDTR) {
+		host_dma_raise(stream, HOST_DMA_TCIF);
+		if (stream->CR & DMA_SxCR_CIRC) {
+			stream->NDTR = transfer->length;
+		} else {
+			stream->CR &= ~DMA_SxCR_EN;
+		}
+	}
+	transfer->left = stream->NDTR;
+}
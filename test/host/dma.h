@@ -0,0 +1,98 @@
+/** @file    dma.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Model of a DMA stream for the host tests: moves the data between the
+ *           memory and a peripheral and raises the flags like the controller does
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_DMA_H
+#define HOST_DMA_H
+
+#include "host.h"
+#include "stm32f4xx_dma.h"
+
+// Flags of one stream as they are in LISR/HISR for stream 0
+#define HOST_DMA_FEIF  0x01
+#define HOST_DMA_DMEIF 0x04
+#define HOST_DMA_TEIF  0x08
+#define HOST_DMA_HTIF  0x10
+#define HOST_DMA_TCIF  0x20
+
+/**
+ * @brief  Forget the transfers of all streams, called by host_reset()
+ * @param  None
+ * @retval None
+ */
+void host_dma_reset(void);
+
+/**
+ * @brief  Flags of a stream
+ * @param  stream  The stream
+ * @retval uint32_t HOST_DMA_* flags
+ */
+uint32_t host_dma_flags(DMA_Stream_TypeDef* stream);
+
+/**
+ * @brief  Raise flags of a stream, e.g. a transfer error
+ * @param  stream  The stream
+ * @param  flags  HOST_DMA_* flags
+ * @retval None
+ */
+void host_dma_raise(DMA_Stream_TypeDef* stream, uint32_t flags);
+
+/**
+ * @brief  Clear the flags the firmware wrote into LIFCR/HIFCR, like the controller does
+ * @param  stream  The stream
+ * @retval None
+ */
+void host_dma_acknowledge(DMA_Stream_TypeDef* stream);
+
+/**
+ * @brief  Check if an enabled interrupt of the stream is pending
+ * @param  stream  The stream
+ * @retval uint8_t 1 if the interrupt handler has to run
+ */
+uint8_t host_dma_pending(DMA_Stream_TypeDef* stream);
+
+/**
+ * @brief  Move one data item from the peripheral into the memory at M0AR
+ * @param  stream  The stream, nothing happens while it is disabled
+ * @param  value  The value read from the peripheral
+ * @retval uint8_t 1 if the item was moved
+ */
+uint8_t host_dma_receive(DMA_Stream_TypeDef* stream, uint32_t value);
+
+/**
+ * @brief  Move one data item from the memory at M0AR to the peripheral
+ * @param  stream  The stream
+ * @param  value  Receives the item
+ * @retval uint8_t 1 if an item was moved, 0 while the stream is disabled
+ */
+uint8_t host_dma_send(DMA_Stream_TypeDef* stream, uint32_t* value);
+
+/**
+ * @brief  Run the interrupt handler of the stream while one of its interrupts is
+ *         pending and clear the flags it acknowledged after each run
+ * @param  stream  The stream
+ * @param  handler  The interrupt handler of the stream
+ * @retval uint8_t Number of runs
+ */
+uint8_t host_dma_interrupt(DMA_Stream_TypeDef* stream, void (*handler)(void));
+
+#endif // HOST_DMA_H
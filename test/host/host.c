@@ -0,0 +1,56 @@
+/** @file    host.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Memory behind the peripheral registers of the host build
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "host.h"
+#include "dma.h"
+#include "spi.h"
+#include "i2c.h"
+
+volatile uint32_t host_primask = 0;
+void (*host_interrupt)(void) = 0;
+uint8_t host_periph[HOST_PERIPH_SIZE] __attribute__((aligned(1024)));
+uint8_t host_scs[HOST_SCS_SIZE] __attribute__((aligned(1024)));
+
+// Defined by lib/system_stm32f4xx.c on the target, the PLL runs the core with 168MHz
+uint32_t SystemCoreClock = 168000000;
+
+void host_reset(void) {
+	memset(host_periph, 0, sizeof(host_periph));
+	memset(host_scs, 0, sizeof(host_scs));
+	host_primask = 0;
+	host_interrupt = 0;
+	host_dma_reset();
+	host_spi_reset();
+	host_i2c_reset();
+}
+
+void host_unmask(void) {
+	static uint8_t active = 0;
+
+	// The handler does not preempt itself when it enables the interrupts
+	if (host_interrupt && !active) {
+		active = 1;
+		host_interrupt();
+		active = 0;
+	}
+}
@@ -0,0 +1,77 @@
+/** @file    host.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host build of the firmware sources for the tests: force included in front
+ *           of every file, it replaces the Cortex-M instructions and maps all peripheral
+ *           registers into plain memory the tests can read and write.
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+
+// The core headers only hold ARM instructions, the host versions are below
+#define __CORE_CMINSTR_H
+#define __CORE_CMFUNC_H
+#define __CORE_CM4_SIMD_H
+
+// PRIMASK of the simulated core, 1 while the interrupts are disabled
+extern volatile uint32_t host_primask;
+
+// Pending interrupt of the simulated core, it runs whenever the interrupts are enabled again
+extern void (*host_interrupt)(void);
+void host_unmask(void);
+
+static inline void __disable_irq(void) { host_primask = 1; }
+static inline void __enable_irq(void) { host_primask = 0; host_unmask(); }
+static inline uint32_t __get_PRIMASK(void) { return host_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { host_primask = primask; if (!primask) host_unmask(); }
+static inline void __DMB(void) { __sync_synchronize(); }
+static inline void __DSB(void) { __sync_synchronize(); }
+static inline void __ISB(void) { __sync_synchronize(); }
+static inline void __NOP(void) { }
+static inline void __WFI(void) { }
+static inline void __WFE(void) { }
+static inline uint32_t __REV(uint32_t value) { return __builtin_bswap32(value); }
+
+#include "stm32f4xx.h"
+
+// APB1, APB2 and AHB1 with all timers, USARTs, SPIs, I2Cs, GPIOs, RCC and DMAs,
+// and the system control space with NVIC, SCB and CoreDebug
+#define HOST_PERIPH_SIZE 0x30000
+#define HOST_SCS_SIZE 0x1000
+extern uint8_t host_periph[HOST_PERIPH_SIZE];
+extern uint8_t host_scs[HOST_SCS_SIZE];
+
+#undef PERIPH_BASE
+#define PERIPH_BASE ((uintptr_t)host_periph)
+#undef SCS_BASE
+#define SCS_BASE ((uintptr_t)host_scs)
+#undef CoreDebug_BASE
+#define CoreDebug_BASE (SCS_BASE + 0x0DF0UL)
+
+/**
+ * @brief  Clear all peripheral registers, the DMA, SPI and I2C models and the pending interrupt
+ * @param  None
+ * @retval None
+ */
+void host_reset(void);
+
+#endif // HOST_H
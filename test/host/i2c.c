@@ -0,0 +1,244 @@
+/** @file    i2c.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Model of I2C slaves for the host tests: register files behind a 7bit address
+ *           which the I2C1 state machine of the firmware talks to through its event interrupt
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "i2c.h"
+#include "dma.h"
+
+/**** Private declarations ****/
+
+#define HOST_I2C_DEVICES 4
+
+// DR never holds this, it marks the data register as empty until the firmware writes it
+#define HOST_I2C_EMPTY 0x100
+
+// Phases of the bus between a start and a stop
+#define HOST_I2C_IDLE    0
+#define HOST_I2C_ADDRESS 1 // Start sent, waiting for the address in DR
+#define HOST_I2C_WRITE   2
+#define HOST_I2C_READ    3
+
+static Host_I2cDevice* host_i2c_device[HOST_I2C_DEVICES];
+static Host_I2cDevice* host_i2c_addressed;
+static uint8_t host_i2c_phase;
+static uint16_t host_i2c_index;
+
+static uint8_t _host_i2c_step(I2C_TypeDef* i2c, DMA_Stream_TypeDef* rx, void (*event)(void), void (*error)(void), void (*dma)(void));
+static void _host_i2c_stop(I2C_TypeDef* i2c);
+static void _host_i2c_write(Host_I2cDevice* device, uint8_t value);
+static uint8_t _host_i2c_read(Host_I2cDevice* device);
+
+
+/**** Public implementations ****/
+
+void host_i2c_reset(void) {
+	memset(host_i2c_device, 0, sizeof(host_i2c_device));
+	host_i2c_addressed = 0;
+	host_i2c_phase = HOST_I2C_IDLE;
+	host_i2c_index = 0;
+}
+
+void host_i2c_attach(Host_I2cDevice* device) {
+	uint8_t i;
+
+	for (i = 0; i < HOST_I2C_DEVICES; i++) {
+		if (!host_i2c_device[i] || (host_i2c_device[i] == device)) {
+			host_i2c_device[i] = device;
+			return;
+		}
+	}
+}
+
+void host_i2c_run(I2C_TypeDef* i2c, DMA_Stream_TypeDef* rx, void (*event)(void), void (*error)(void), void (*dma)(void)) {
+	static uint8_t active = 0;
+	uint16_t steps;
+
+	// The interrupts enable the interrupts again, they must not run inside themselves
+	if (active) {
+		return;
+	}
+	active = 1;
+	for (steps = 0; (steps < 1000) && _host_i2c_step(i2c, rx, event, error, dma); steps++);
+	active = 0;
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  One event on the bus
+ * @param  i2c  The I2C
+ * @param  rx  The stream which reads the data register
+ * @param  event  The event interrupt handler
+ * @param  error  The error interrupt handler
+ * @param  dma  The interrupt handler of the RX stream
+ * @retval uint8_t 1 if something happened, 0 while the bus waits for the firmware
+ */
+static uint8_t _host_i2c_step(I2C_TypeDef* i2c, DMA_Stream_TypeDef* rx, void (*event)(void), void (*error)(void), void (*dma)(void)) {
+	Host_I2cDevice* device = host_i2c_addressed;
+	uint8_t value, i;
+
+	if (!(i2c->CR1 & I2C_CR1_PE) || (device && device->mute)) {
+		return 0;
+	}
+
+	// A stop set while reading comes after the byte which is on the line
+	if ((i2c->CR1 & I2C_CR1_STOP) && ((host_i2c_phase != HOST_I2C_READ) || host_i2c_index)) {
+		_host_i2c_stop(i2c);
+		return 1;
+	}
+	if (i2c->CR1 & I2C_CR1_START) {
+		i2c->CR1 &= ~I2C_CR1_START;
+		i2c->SR1 = I2C_SR1_SB;
+		i2c->SR2 |= I2C_SR2_MSL;
+		i2c->DR = HOST_I2C_EMPTY;
+		host_i2c_phase = HOST_I2C_ADDRESS;
+		host_i2c_index = 0;
+		if (i2c->CR2 & I2C_CR2_ITEVTEN) {
+			event();
+		}
+		return 1;
+	}
+
+	switch (host_i2c_phase) {
+		case HOST_I2C_ADDRESS:
+			if (i2c->DR == HOST_I2C_EMPTY) {
+				return 0;
+			}
+			value = (uint8_t)i2c->DR;
+			i2c->DR = HOST_I2C_EMPTY;
+			host_i2c_addressed = 0;
+			for (i = 0; i < HOST_I2C_DEVICES; i++) {
+				if (host_i2c_device[i] && (host_i2c_device[i]->address == (value >> 1))) {
+					host_i2c_addressed = host_i2c_device[i];
+				}
+			}
+
+			// Nobody acknowledges the address, the master keeps the bus until it sends a stop
+			if (!host_i2c_addressed) {
+				i2c->SR1 = I2C_SR1_AF;
+				host_i2c_phase = HOST_I2C_IDLE;
+				if (i2c->CR2 & I2C_CR2_ITERREN) {
+					error();
+				}
+				return 1;
+			}
+			host_i2c_addressed->starts++;
+			host_i2c_phase = (value & 0x01) ? HOST_I2C_READ : HOST_I2C_WRITE;
+			i2c->SR1 = I2C_SR1_ADDR | ((value & 0x01) ? 0 : I2C_SR1_TXE);
+			if (i2c->CR2 & I2C_CR2_ITEVTEN) {
+				event();
+			}
+			// Reading SR2 in the interrupt cleared ADDR
+			i2c->SR1 &= ~I2C_SR1_ADDR;
+			return 1;
+
+		case HOST_I2C_WRITE:
+			// TXE with every byte the shift register took, BTF once it ran empty
+			if (i2c->DR != HOST_I2C_EMPTY) {
+				_host_i2c_write(device, (uint8_t)i2c->DR);
+				i2c->DR = HOST_I2C_EMPTY;
+				i2c->SR1 = I2C_SR1_TXE;
+				if (!(i2c->CR2 & I2C_CR2_ITBUFEN)) {
+					return 1;
+				}
+			} else if (host_i2c_index) {
+				i2c->SR1 = I2C_SR1_TXE | I2C_SR1_BTF;
+			}
+			if (!(i2c->CR2 & I2C_CR2_ITEVTEN) || (!(i2c->SR1 & I2C_SR1_BTF) && !(i2c->CR2 & I2C_CR2_ITBUFEN))) {
+				return 0;
+			}
+			event();
+			return 1;
+
+		case HOST_I2C_READ:
+			if (i2c->CR2 & I2C_CR2_DMAEN) {
+				if (!(rx->CR & DMA_SxCR_EN) || !rx->NDTR) {
+					return 0;
+				}
+				host_dma_receive(rx, _host_i2c_read(device));
+				host_dma_interrupt(rx, dma);
+				return 1;
+			}
+			if (!(i2c->CR2 & I2C_CR2_ITEVTEN) || !(i2c->CR2 & I2C_CR2_ITBUFEN)) {
+				return 0;
+			}
+			i2c->DR = _host_i2c_read(device);
+			i2c->SR1 = I2C_SR1_RXNE;
+			event();
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief  Stop condition, the bus is free
+ * @param  i2c  The I2C
+ * @retval None
+ */
+static void _host_i2c_stop(I2C_TypeDef* i2c) {
+	i2c->CR1 &= ~I2C_CR1_STOP;
+	i2c->SR1 = 0;
+	i2c->SR2 &= ~I2C_SR2_MSL;
+	if (host_i2c_addressed) {
+		host_i2c_addressed->stops++;
+	}
+	host_i2c_addressed = 0;
+	host_i2c_phase = HOST_I2C_IDLE;
+}
+
+/**
+ * @brief  A byte written by the master: the first one after the address is the register
+ *         address, every following one goes into the register
+ * @param  device  The addressed device
+ * @param  value  The byte
+ * @retval None
+ */
+static void _host_i2c_write(Host_I2cDevice* device, uint8_t value) {
+	if (!host_i2c_index++) {
+		device->command = value;
+		device->addr = value & (HOST_I2C_REGISTERS - 1);
+		return;
+	}
+	device->bytes++;
+	device->reg[device->addr] = value;
+	if (device->command & HOST_I2C_INCREMENT) {
+		device->addr = (device->addr + 1) & (HOST_I2C_REGISTERS - 1);
+	}
+}
+
+/**
+ * @brief  A byte read by the master from the register the last write pointed to
+ * @param  device  The addressed device
+ * @retval uint8_t The byte
+ */
+static uint8_t _host_i2c_read(Host_I2cDevice* device) {
+	uint8_t value = device->reg[device->addr];
+
+	host_i2c_index++;
+	device->bytes++;
+	if (device->command & HOST_I2C_INCREMENT) {
+		device->addr = (device->addr + 1) & (HOST_I2C_REGISTERS - 1);
+	}
+	return value;
+}
@@ -0,0 +1,79 @@
+/** @file    i2c.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Model of I2C slaves for the host tests: register files behind a 7bit address
+ *           which the I2C1 state machine of the firmware talks to through its event interrupt
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_I2C_H
+#define HOST_I2C_H
+
+#include "host.h"
+#include "stm32f4xx_dma.h"
+#include "stm32f4xx_i2c.h"
+
+// Bit 7 of the register address increments it with every byte, like the ST sensors do
+#define HOST_I2C_INCREMENT 0x80
+#define HOST_I2C_REGISTERS 64
+
+/**
+ * One device on the bus; the test fills in the address and the registers
+ */
+typedef struct {
+	uint8_t address;      //!< 7bit slave address, the model does not acknowledge any other
+	uint8_t reg[HOST_I2C_REGISTERS];
+	uint8_t mute;         //!< Set to stretch SCL forever once the device is addressed, a stuck bus
+	uint8_t command;      //!< Register address written after the last start
+	uint8_t addr;         //!< Register of the next data byte
+	uint32_t starts;      //!< Starts and repeated starts to the device
+	uint32_t stops;
+	uint32_t bytes;       //!< Data bytes read and written, the addresses not counted
+} Host_I2cDevice;
+
+/**
+ * @brief  Forget all devices and the state of the bus, called by host_reset()
+ * @param  None
+ * @retval None
+ */
+void host_i2c_reset(void);
+
+/**
+ * @brief  Put a device on the bus
+ * @param  device  The device, it has to stay valid until the next host_reset()
+ * @retval None
+ */
+void host_i2c_attach(Host_I2cDevice* device);
+
+/**
+ * @brief  Run the bus until it is idle: start and stop conditions the firmware wrote into CR1,
+ *         the addresses and data bytes it wrote into DR, and the bytes read into the RX stream
+ *         or DR. SR1 is set for each event and the enabled interrupt runs; a wrong address
+ *         sets AF for the error interrupt. Does nothing when called from the interrupts.
+ *         SR2 BUSY is left to the test, the firmware only looks at it before a start and
+ *         a real I2C clears it during the recovery, which the model cannot see.
+ * @param  i2c  The I2C
+ * @param  rx  The stream which reads the data register
+ * @param  event  The event interrupt handler
+ * @param  error  The error interrupt handler
+ * @param  dma  The interrupt handler of the RX stream
+ * @retval None
+ */
+void host_i2c_run(I2C_TypeDef* i2c, DMA_Stream_TypeDef* rx, void (*event)(void), void (*error)(void), void (*dma)(void));
+
+#endif // HOST_I2C_H
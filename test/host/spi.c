@@ -0,0 +1,159 @@
+/** @file    spi.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Model of SPI slaves for the host tests: register files behind a chip select
+ *           which answer the bytes the DMA streams send, like the ST sensors do
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "spi.h"
+#include "dma.h"
+
+/**** Private declarations ****/
+
+#define HOST_SPI_DEVICES 4
+
+static Host_SpiDevice* host_spi_device[HOST_SPI_DEVICES];
+
+static void _host_spi_select(void);
+static uint8_t _host_spi_byte(Host_SpiDevice* device, uint8_t value);
+
+
+/**** Public implementations ****/
+
+void host_spi_reset(void) {
+	memset(host_spi_device, 0, sizeof(host_spi_device));
+}
+
+void host_spi_attach(Host_SpiDevice* device) {
+	uint8_t i;
+
+	device->selected = 0;
+	for (i = 0; i < HOST_SPI_DEVICES; i++) {
+		if (!host_spi_device[i] || (host_spi_device[i] == device)) {
+			host_spi_device[i] = device;
+			return;
+		}
+	}
+}
+
+uint32_t host_spi_clock(DMA_Stream_TypeDef* tx, DMA_Stream_TypeDef* rx, uint32_t count) {
+	Host_SpiDevice* selected = 0;
+	uint32_t value, clocked = 0;
+	uint8_t i;
+
+	_host_spi_select();
+	for (i = 0; i < HOST_SPI_DEVICES; i++) {
+		if (host_spi_device[i] && host_spi_device[i]->selected) {
+			selected = host_spi_device[i];
+		}
+	}
+	if (selected && selected->mute) {
+		return 0;
+	}
+
+	// Full duplex: a byte is only sent when the received one can be taken
+	while ((clocked < count) && (rx->CR & DMA_SxCR_EN) && host_dma_send(tx, &value)) {
+		host_dma_receive(rx, selected ? _host_spi_byte(selected, (uint8_t)value) : 0xFF);
+		clocked++;
+	}
+	return clocked;
+}
+
+void host_spi_run(DMA_Stream_TypeDef* tx, DMA_Stream_TypeDef* rx, void (*handler)(void)) {
+	static uint8_t active = 0;
+	uint32_t clocked;
+	uint8_t runs;
+
+	// The interrupt enables the interrupts again, it must not run inside itself
+	if (active) {
+		return;
+	}
+	active = 1;
+	do {
+		clocked = host_spi_clock(tx, rx, 0xFFFFFFFF);
+		runs = host_dma_interrupt(rx, handler);
+	} while (clocked || runs);
+
+	// The deselect of the last transfer
+	host_spi_clock(tx, rx, 0);
+	active = 0;
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Apply the chip selects written into BSRR; a deselect written together with a
+ *         select ended the last command before the next one started
+ * @param  None
+ * @retval None
+ */
+static void _host_spi_select(void) {
+	Host_SpiDevice* device;
+	uint8_t i;
+
+	for (i = 0; i < HOST_SPI_DEVICES; i++) {
+		device = host_spi_device[i];
+		if (!device) {
+			continue;
+		}
+		if (device->csPort->BSRRL & device->csPin) {
+			device->csPort->BSRRL &= ~device->csPin;
+			device->selected = 0;
+		}
+		if (device->csPort->BSRRH & device->csPin) {
+			device->csPort->BSRRH &= ~device->csPin;
+			device->selected = 1;
+			device->index = 0;
+			device->selects++;
+		}
+	}
+}
+
+/**
+ * @brief  One byte of a command: the first one is the command, the answer to each following
+ *         one is the register it reads
+ * @param  device  The selected device
+ * @param  value  The byte sent by the master
+ * @retval uint8_t The byte sent back
+ */
+static uint8_t _host_spi_byte(Host_SpiDevice* device, uint8_t value) {
+	uint8_t answer = 0xFF, addr;
+
+	device->bytes++;
+	if (!device->index++) {
+		device->command = value;
+		device->addr = value & (HOST_SPI_REGISTERS - 1);
+		return answer;
+	}
+
+	addr = device->addr;
+	if (device->command & HOST_SPI_READ) {
+		answer = device->read ? device->read(device, addr) : device->reg[addr];
+	} else if (device->write) {
+		device->write(device, addr, value);
+	} else {
+		device->reg[addr] = value;
+	}
+	if (device->command & HOST_SPI_INCREMENT) {
+		device->addr = (device->next ? device->next(device, addr) : addr + 1) & (HOST_SPI_REGISTERS - 1);
+	}
+	return answer;
+}
@@ -0,0 +1,90 @@
+/** @file    spi.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Model of SPI slaves for the host tests: register files behind a chip select
+ *           which answer the bytes the DMA streams send, like the ST sensors do
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include "host.h"
+#include "stm32f4xx_dma.h"
+
+// First byte of a command: bit 7 reads, bit 6 increments the address with every byte
+#define HOST_SPI_READ 0x80
+#define HOST_SPI_INCREMENT 0x40
+#define HOST_SPI_REGISTERS 64
+
+/**
+ * One device on the bus; the test fills in the chip select and the registers, the read, write
+ * and next functions may replace the plain register access, e.g. for a FIFO behind a register.
+ */
+typedef struct Host_SpiDevice {
+	GPIO_TypeDef* csPort;
+	uint16_t csPin;
+	uint8_t reg[HOST_SPI_REGISTERS];
+	uint8_t (*read)(struct Host_SpiDevice* device, uint8_t addr);
+	void (*write)(struct Host_SpiDevice* device, uint8_t addr, uint8_t value);
+	uint8_t (*next)(struct Host_SpiDevice* device, uint8_t addr);  //!< Register after addr in a burst
+	uint8_t mute;         //!< Set to stop the clock while the device is selected, a stuck bus
+	uint8_t selected;
+	uint8_t command;      //!< First byte since the select
+	uint8_t addr;         //!< Register of the next data byte
+	uint16_t index;       //!< Bytes since the select
+	uint32_t selects;     //!< Commands, each starts with a select
+	uint32_t bytes;       //!< Bytes clocked while the device was selected
+} Host_SpiDevice;
+
+/**
+ * @brief  Forget all devices, called by host_reset()
+ * @param  None
+ * @retval None
+ */
+void host_spi_reset(void);
+
+/**
+ * @brief  Put a device on the bus, deselected
+ * @param  device  The device, it has to stay valid until the next host_reset()
+ * @retval None
+ */
+void host_spi_attach(Host_SpiDevice* device);
+
+/**
+ * @brief  Clock bytes: every byte the TX stream sends goes to the selected device and its
+ *         answer to the RX stream. The chip selects the firmware wrote into BSRR are applied
+ *         first; without a selected device the answer is 0xFF.
+ * @param  tx  The stream which writes the data register
+ * @param  rx  The stream which reads the data register
+ * @param  count  Most bytes to clock
+ * @retval uint32_t Number of bytes clocked
+ */
+uint32_t host_spi_clock(DMA_Stream_TypeDef* tx, DMA_Stream_TypeDef* rx, uint32_t count);
+
+/**
+ * @brief  Clock all bytes and run the interrupt of the RX stream until the bus is idle, the
+ *         transfers the interrupt chains included. Does nothing when called from the interrupt.
+ * @param  tx  The stream which writes the data register
+ * @param  rx  The stream which reads the data register
+ * @param  handler  The interrupt handler of the RX stream
+ * @retval None
+ */
+void host_spi_run(DMA_Stream_TypeDef* tx, DMA_Stream_TypeDef* rx, void (*handler)(void));
+
+#endif // HOST_SPI_H
@@ -0,0 +1,74 @@
+/** @file    test.h
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Minimal checks and a cycle counter for the host tests and benchmarks
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+extern int test_checks;
+extern int test_failures;
+
+// Count a check and print it if it failed, the test goes on with the next one
+#define TEST_CHECK(condition) do { \
+	test_checks++; \
+	if (!(condition)) { \
+		test_failures++; \
+		printf("%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+	} \
+} while (0)
+
+#define TEST_EQUAL(actual, expected) do { \
+	long long _actual = (long long)(actual), _expected = (long long)(expected); \
+	test_checks++; \
+	if (_actual != _expected) { \
+		test_failures++; \
+		printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _actual, _expected); \
+	} \
+} while (0)
+
+/**
+ * @brief  Print the result of all checks
+ * @param  name  Name of the test
+ * @retval int Exit code of the test, 0 if all checks passed
+ */
+int test_report(const char* name);
+
+/**
+ * @brief  Cycle counter of the host for the benchmarks; the time stamp counter on x86,
+ *         nanoseconds on other machines
+ * @param  None
+ * @retval uint64_t The counter
+ */
+static inline uint64_t test_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+#endif // TEST_H
@@ -0,0 +1,327 @@
+/** @file    test_l3g4200d.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the L3G4200D driver against a register model of the gyro with
+ *           its 32 level FIFO in stream mode, on the SPI slave model
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "sensors.h"
+#include "sensors_spi.h"
+#include "spi.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+/**
+ * The gyro: its registers in the SPI slave model and the FIFO behind OUT_X_L..OUT_Z_H.
+ * With the FIFO enabled a burst wraps from OUT_Z_H back to OUT_X_L and reading OUT_Z_H
+ * pops the sample; in stream mode a new sample overwrites the oldest one when it is full.
+ */
+typedef struct {
+	Host_SpiDevice spi;
+	L3G4200D_Sample fifo[L3G4200D_FIFO_SIZE];
+	uint8_t first;
+	uint8_t level;
+} Test_Gyro;
+
+// The DMA addresses are 32 bit, so all transfers and their buffers are static
+static Test_Gyro test_gyro;
+
+u32 sensors_time_now() {
+	return 0;
+}
+
+static void _test_setup(void);
+static void _test_clock(void);
+static void _test_push(int16_t value);
+static uint8_t _test_read(Host_SpiDevice* device, uint8_t addr);
+static uint8_t _test_next(Host_SpiDevice* device, uint8_t addr);
+static void test_init(void);
+static void test_samples(void);
+static void test_fifo(void);
+static void test_overrun(void);
+static void test_async(void);
+
+
+/**** Public implementations ****/
+
+int main(void) {
+	test_init();
+	test_samples();
+	test_fifo();
+	test_overrun();
+	test_async();
+	return test_report("l3g4200d");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Fresh registers, the SPI engine and the gyro on PE6 with an empty FIFO; the
+ *         blocking driver calls are served whenever the interrupts are enabled
+ * @param  None
+ * @retval None
+ */
+static void _test_setup(void) {
+	host_reset();
+	memset(&test_gyro, 0, sizeof(test_gyro));
+	test_gyro.spi.csPort = GPIOE;
+	test_gyro.spi.csPin = GPIO_Pin_6;
+	test_gyro.spi.reg[L3G4200D_WHO_AM_I_ADDR] = 0xD3;
+	test_gyro.spi.read = _test_read;
+	test_gyro.spi.next = _test_next;
+	host_spi_attach(&test_gyro.spi);
+	host_interrupt = _test_clock;
+
+	sensors_spi_init();
+	sensors_spi_device_init(&L3G4200D_Device);
+}
+
+/**
+ * @brief  Run the bus until all transfers are done
+ * @param  None
+ * @retval None
+ */
+static void _test_clock(void) {
+	host_spi_run(SENSORS_SPI_DMA_TX_STREAM, SENSORS_SPI_DMA_RX_STREAM, DMA2_Stream0_IRQHandler);
+}
+
+/**
+ * @brief  The gyro measures a sample: value on X, value + 1000 on Y and -value on Z
+ * @param  value  The sample
+ * @retval None
+ */
+static void _test_push(int16_t value) {
+	L3G4200D_Sample* sample;
+
+	if (test_gyro.level == L3G4200D_FIFO_SIZE) {
+		test_gyro.first = (test_gyro.first + 1) % L3G4200D_FIFO_SIZE;
+		test_gyro.level--;
+	}
+	sample = &test_gyro.fifo[(test_gyro.first + test_gyro.level) % L3G4200D_FIFO_SIZE];
+	sample->X = value;
+	sample->Y = value + 1000;
+	sample->Z = -value;
+	test_gyro.level++;
+}
+
+/**
+ * @brief  Register read of the gyro: FIFO_SRC and the output registers come from the FIFO
+ * @param  device  The gyro
+ * @param  addr  The register
+ * @retval uint8_t The register value
+ */
+static uint8_t _test_read(Host_SpiDevice* device, uint8_t addr) {
+	const L3G4200D_Sample* sample = &test_gyro.fifo[test_gyro.first];
+	uint8_t wtm = device->reg[L3G4200D_FIFO_CTRL_REG_ADDR] & L3G4200D_FIFO_WTM;
+	uint8_t value;
+
+	switch (addr) {
+		case L3G4200D_FIFO_SRC_REG_ADDR:
+			return (test_gyro.level >= wtm ? L3G4200D_FIFO_SRC_WTM : 0)
+			     | (test_gyro.level == L3G4200D_FIFO_SIZE ? L3G4200D_FIFO_SRC_OVRN : 0)
+			     | (!test_gyro.level ? L3G4200D_FIFO_SRC_EMPTY : 0)
+			     | (test_gyro.level & L3G4200D_FIFO_SRC_FSS);
+		case L3G4200D_OUT_X_L_ADDR: return (uint8_t)sample->X;
+		case L3G4200D_OUT_X_H_ADDR: return (uint8_t)(sample->X >> 8);
+		case L3G4200D_OUT_Y_L_ADDR: return (uint8_t)sample->Y;
+		case L3G4200D_OUT_Y_H_ADDR: return (uint8_t)(sample->Y >> 8);
+		case L3G4200D_OUT_Z_L_ADDR: return (uint8_t)sample->Z;
+		case L3G4200D_OUT_Z_H_ADDR:
+			value = (uint8_t)(sample->Z >> 8);
+			if (test_gyro.level && (device->reg[L3G4200D_CTRL_REG5_ADDR] & L3G4200D_CTRL_REG5_FIFO_EN)) {
+				test_gyro.first = (test_gyro.first + 1) % L3G4200D_FIFO_SIZE;
+				test_gyro.level--;
+			}
+			return value;
+		default:
+			return device->reg[addr];
+	}
+}
+
+/**
+ * @brief  Next register of a burst, the output registers wrap around with the FIFO enabled
+ * @param  device  The gyro
+ * @param  addr  The register just read or written
+ * @retval uint8_t The next register
+ */
+static uint8_t _test_next(Host_SpiDevice* device, uint8_t addr) {
+	if ((addr == L3G4200D_OUT_Z_H_ADDR) && (device->reg[L3G4200D_CTRL_REG5_ADDR] & L3G4200D_CTRL_REG5_FIFO_EN)) {
+		return L3G4200D_OUT_X_L_ADDR;
+	}
+	return addr + 1;
+}
+
+/**
+ * @brief  CTRL_REG1-5 go in one burst with the data rate, bandwidth and full scale, then the
+ *         FIFO mode; the gyro runs in SPI mode 3
+ * @param  None
+ * @retval None
+ */
+static void test_init(void) {
+	const L3G4200D_Config stream = { L3G4200D_ODR_800, 3, L3G4200D_FS_2000, 16 };
+	const L3G4200D_Config bypass = { L3G4200D_ODR_100, 0, L3G4200D_FS_250, 0 };
+	const uint8_t* reg = test_gyro.spi.reg;
+
+	_test_setup();
+	L3G4200D_Init(&L3G4200D_SpiBus, &stream);
+	TEST_EQUAL(reg[L3G4200D_CTRL_REG1_ADDR], 0xFF);
+	TEST_EQUAL(reg[L3G4200D_CTRL_REG2_ADDR], 0x00);
+	TEST_EQUAL(reg[L3G4200D_CTRL_REG3_ADDR], L3G4200D_CTRL_REG3_I2_WTM | L3G4200D_CTRL_REG3_I2_ORUN);
+	TEST_EQUAL(reg[L3G4200D_CTRL_REG4_ADDR], L3G4200D_CTRL_REG4_BDU | 0x20);
+	TEST_EQUAL(reg[L3G4200D_CTRL_REG5_ADDR], L3G4200D_CTRL_REG5_FIFO_EN);
+	TEST_EQUAL(reg[L3G4200D_FIFO_CTRL_REG_ADDR], L3G4200D_FIFO_MODE_STREAM | 16);
+	TEST_EQUAL(test_gyro.spi.selects, 2);
+	TEST_EQUAL(test_gyro.spi.bytes, 6 + 2);
+	TEST_EQUAL(SPI1->CR1 & (SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_BR), SPI_CPOL_High | SPI_CPHA_2Edge | SPI_BaudRatePrescaler_16);
+
+	L3G4200D_Init(&L3G4200D_SpiBus, &bypass);
+	TEST_EQUAL(reg[L3G4200D_CTRL_REG1_ADDR], L3G4200D_CTRL_REG1_PD | L3G4200D_CTRL_REG1_AXES);
+	TEST_EQUAL(reg[L3G4200D_CTRL_REG5_ADDR], 0x00);
+	TEST_EQUAL(reg[L3G4200D_FIFO_CTRL_REG_ADDR], L3G4200D_FIFO_MODE_BYPASS);
+}
+
+/**
+ * @brief  The sample count from FIFO_SRC and the conversion of the raw bytes
+ * @param  None
+ * @retval None
+ */
+static void test_samples(void) {
+	const uint8_t raw[12] = { 0x34, 0x12, 0xFF, 0xFF, 0x00, 0x80, 0x01, 0x00, 0x00, 0x00, 0xFF, 0x7F };
+	L3G4200D_Sample sample[2];
+	int32_t rate[3];
+
+	TEST_EQUAL(L3G4200D_FifoSamples(L3G4200D_FIFO_SRC_EMPTY), 0);
+	TEST_EQUAL(L3G4200D_FifoSamples(L3G4200D_FIFO_SRC_WTM | 17), 17);
+	TEST_EQUAL(L3G4200D_FifoSamples(L3G4200D_FIFO_SRC_OVRN | L3G4200D_FIFO_SRC_WTM), L3G4200D_FIFO_SIZE);
+
+	L3G4200D_DecodeSamples(raw, sample, 2);
+	TEST_EQUAL(sample[0].X, 0x1234);
+	TEST_EQUAL(sample[0].Y, -1);
+	TEST_EQUAL(sample[0].Z, -32768);
+	TEST_EQUAL(sample[1].X, 1);
+	TEST_EQUAL(sample[1].Z, 32767);
+
+	// 70 millidegrees per second and digit at 2000dps
+	L3G4200D_AngularRate(&sample[1], L3G4200D_FS_2000, rate);
+	TEST_EQUAL(rate[0], 70);
+	TEST_EQUAL(rate[2], 32767 * 70);
+	L3G4200D_AngularRate(&sample[1], L3G4200D_FS_250, rate);
+	TEST_EQUAL(rate[2], 32767 * 875 / 100);
+}
+
+/**
+ * @brief  The driver asks for the level and drains all samples in one burst, oldest first
+ * @param  None
+ * @retval None
+ */
+static void test_fifo(void) {
+	const L3G4200D_Config config = { L3G4200D_ODR_800, 3, L3G4200D_FS_2000, 16 };
+	L3G4200D_Sample sample[L3G4200D_FIFO_SIZE];
+	u32 selects, bytes;
+	uint8_t i;
+
+	_test_setup();
+	L3G4200D_Init(&L3G4200D_SpiBus, &config);
+	TEST_EQUAL(L3G4200D_FifoLevel(&L3G4200D_SpiBus), 0);
+	TEST_EQUAL(L3G4200D_ReadFifo(&L3G4200D_SpiBus, sample, L3G4200D_FIFO_SIZE), 0);
+
+	for (i = 0; i < 20; i++) {
+		_test_push(i * 100 - 1000);
+	}
+	selects = test_gyro.spi.selects;
+	bytes = test_gyro.spi.bytes;
+	TEST_EQUAL(L3G4200D_ReadFifo(&L3G4200D_SpiBus, sample, L3G4200D_FIFO_SIZE), 20);
+	for (i = 0; i < 20; i++) {
+		TEST_EQUAL(sample[i].X, i * 100 - 1000);
+		TEST_EQUAL(sample[i].Y, i * 100);
+		TEST_EQUAL(sample[i].Z, 1000 - i * 100);
+	}
+	TEST_EQUAL(test_gyro.level, 0);
+
+	// FIFO_SRC and one burst of 20 samples, not one command per sample
+	TEST_EQUAL(test_gyro.spi.selects - selects, 2);
+	TEST_EQUAL(test_gyro.spi.bytes - bytes, 2 + 1 + 20 * L3G4200D_SAMPLE_SIZE);
+
+	// Less than there are: the rest stays for the next read
+	for (i = 0; i < 5; i++) {
+		_test_push(i);
+	}
+	TEST_EQUAL(L3G4200D_ReadFifo(&L3G4200D_SpiBus, sample, 3), 3);
+	TEST_EQUAL(sample[2].X, 2);
+	TEST_EQUAL(L3G4200D_FifoLevel(&L3G4200D_SpiBus), 2);
+}
+
+/**
+ * @brief  A full FIFO lost its oldest samples; the overrun is counted and the 32 newest are read
+ * @param  None
+ * @retval None
+ */
+static void test_overrun(void) {
+	const L3G4200D_Config config = { L3G4200D_ODR_800, 3, L3G4200D_FS_2000, 16 };
+	L3G4200D_Sample sample[L3G4200D_FIFO_SIZE];
+	u32 overruns = L3G4200D_FifoOverruns;
+	uint8_t i;
+
+	_test_setup();
+	L3G4200D_Init(&L3G4200D_SpiBus, &config);
+	for (i = 0; i < 40; i++) {
+		_test_push(i);
+	}
+	TEST_EQUAL(L3G4200D_ReadFifo(&L3G4200D_SpiBus, sample, L3G4200D_FIFO_SIZE), L3G4200D_FIFO_SIZE);
+	TEST_EQUAL(L3G4200D_FifoOverruns, overruns + 1);
+	TEST_EQUAL(sample[0].X, 8);
+	TEST_EQUAL(sample[L3G4200D_FIFO_SIZE - 1].X, 39);
+	TEST_EQUAL(test_gyro.level, 0);
+}
+
+/**
+ * @brief  The asynchronous drain is limited to the FIFO and decoded from the second byte
+ * @param  None
+ * @retval None
+ */
+static void test_async(void) {
+	const L3G4200D_Config config = { L3G4200D_ODR_800, 3, L3G4200D_FS_2000, 16 };
+	static Sensors_Transfer transfer;
+	static uint8_t buffer[L3G4200D_MAX_TRANSFER + 1];
+	L3G4200D_Sample sample[L3G4200D_FIFO_SIZE];
+	uint8_t i;
+
+	_test_setup();
+	L3G4200D_Init(&L3G4200D_SpiBus, &config);
+	for (i = 0; i < L3G4200D_FIFO_SIZE; i++) {
+		_test_push(-i);
+	}
+	host_interrupt = 0;
+	TEST_EQUAL(L3G4200D_ReadFifoAsync(&L3G4200D_SpiBus, &transfer, buffer, 40, 0), 1);
+	TEST_EQUAL(transfer.length, 1 + L3G4200D_MAX_TRANSFER);
+	TEST_EQUAL(buffer[0], L3G4200D_OUT_X_L_ADDR | L3G4200D_READ | L3G4200D_MULTIPLE);
+	TEST_EQUAL(transfer.status, SENSORS_BUS_BUSY);
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_DONE);
+
+	L3G4200D_DecodeSamples(&buffer[1], sample, L3G4200D_FIFO_SIZE);
+	for (i = 0; i < L3G4200D_FIFO_SIZE; i++) {
+		TEST_EQUAL(sample[i].X, -i);
+		TEST_EQUAL(sample[i].Y, 1000 - i);
+	}
+	TEST_EQUAL(test_gyro.level, 0);
+}
@@ -0,0 +1,258 @@
+/** @file    test_lis302dl.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the LIS302DL driver on the SPI slave model: the SPI bytes per
+ *           sample with and without the register shadow, the batched writes and the decoding
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "sensors.h"
+#include "sensors_spi.h"
+#include "spi.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+static Host_SpiDevice test_accel;
+
+// Bytes and commands on the bus since the last _test_count()
+static u32 test_bytes, test_selects;
+
+u32 sensors_time_now() {
+	return 0;
+}
+
+static void _test_setup(void);
+static void _test_clock(void);
+static void _test_count(void);
+static void test_sample_bytes(void);
+static void test_shadow(void);
+static void test_batch(void);
+static void test_decode(void);
+
+
+/**** Public implementations ****/
+
+int main(void) {
+	test_sample_bytes();
+	test_shadow();
+	test_batch();
+	test_decode();
+	return test_report("lis302dl");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Fresh registers, the SPI engine and an active LIS302DL at 400Hz and 2.3g with new data
+ * @param  None
+ * @retval None
+ */
+static void _test_setup(void) {
+	const LIS302DL_Config config = { 1, 1, 0, 0, 0, 1, 1, 1 };
+
+	host_reset();
+	memset(&test_accel, 0, sizeof(test_accel));
+	test_accel.csPort = GPIOE;
+	test_accel.csPin = GPIO_Pin_3;
+	test_accel.reg[LIS302DL_STATUS_REG_ADDR] = LIS302DL_STATUS_ZYXDA;
+	test_accel.reg[LIS302DL_OUT_X_ADDR] = (uint8_t)-5;
+	test_accel.reg[LIS302DL_OUT_Y_ADDR] = 10;
+	test_accel.reg[LIS302DL_OUT_Z_ADDR] = 56;
+	host_spi_attach(&test_accel);
+	host_interrupt = _test_clock;
+	LIS302DL_InvalidateShadow();
+
+	sensors_spi_init();
+	sensors_spi_device_init(&LIS302DL_Device);
+	LIS302DL_Init(SPI1, &config);
+	_test_count();
+}
+
+/**
+ * @brief  Run the bus until all transfers are done
+ * @param  None
+ * @retval None
+ */
+static void _test_clock(void) {
+	host_spi_run(SENSORS_SPI_DMA_TX_STREAM, SENSORS_SPI_DMA_RX_STREAM, DMA2_Stream0_IRQHandler);
+}
+
+/**
+ * @brief  Bytes and commands since the last call into test_bytes and test_selects
+ * @param  None
+ * @retval None
+ */
+static void _test_count(void) {
+	static u32 bytes = 0, selects = 0;
+
+	test_bytes = test_accel.bytes - bytes;
+	test_selects = test_accel.selects - selects;
+	bytes = test_accel.bytes;
+	selects = test_accel.selects;
+}
+
+/**
+ * @brief  Without the shadow every sample read CTRL_REG1 for the full scale first; with it
+ *         a sample is one burst. Prints the bytes per sample of both.
+ * @param  None
+ * @retval None
+ */
+static void test_sample_bytes(void) {
+	int32_t out[3];
+	u32 before, after;
+
+	_test_setup();
+	TEST_EQUAL(test_accel.reg[LIS302DL_CTRL_REG1_ADDR], 0xC7);
+
+	// The old path: a read of CTRL_REG1 and the axes
+	LIS302DL_InvalidateShadow();
+	LIS302DL_Acceleration(SPI1, out);
+	_test_count();
+	before = test_bytes;
+	TEST_EQUAL(test_selects, 2);
+	TEST_EQUAL(test_bytes, 2 + 6);
+
+	// The shadow holds CTRL_REG1 now
+	LIS302DL_Acceleration(SPI1, out);
+	_test_count();
+	after = test_bytes;
+	TEST_EQUAL(test_selects, 1);
+	TEST_EQUAL(test_bytes, 6);
+	TEST_EQUAL(out[0], -5 * 18);
+	TEST_EQUAL(out[1], 10 * 18);
+	TEST_EQUAL(out[2], 56 * 18);
+
+	// STATUS_REG and the axes in one burst
+	printf("SPI bytes per sample: %u reading CTRL_REG1 first, %u with the shadow, %u for STATUS_REG and the axes\n", before, after, 1 + LIS302DL_SAMPLE_SIZE);
+}
+
+/**
+ * @brief  The configuration changes do their read-modify-write on the shadow: no reads, and
+ *         a register which does not change is not written
+ * @param  None
+ * @retval None
+ */
+static void test_shadow(void) {
+	_test_setup();
+
+	LIS302DL_ChangeScaleMode(SPI1, 0);
+	_test_count();
+	TEST_EQUAL(test_selects, 1);
+	TEST_EQUAL(test_bytes, 2);
+	TEST_EQUAL(test_accel.command, LIS302DL_CTRL_REG1_ADDR);
+	TEST_EQUAL(test_accel.reg[LIS302DL_CTRL_REG1_ADDR], 0xC7 | LIS302DL_BIT2);
+	TEST_EQUAL(LIS302DL_Sensitivity(SPI1), 72);
+
+	LIS302DL_ChangeScaleMode(SPI1, 0);
+	LIS302D_ChangePowerControl(SPI1, 1);
+	LIS302D_ChangeDataRate(SPI1, 0);
+	_test_count();
+	TEST_EQUAL(test_selects, 0);
+
+	LIS302D_ChangePowerControl(SPI1, 0);
+	_test_count();
+	TEST_EQUAL(test_selects, 1);
+	TEST_EQUAL(test_accel.reg[LIS302DL_CTRL_REG1_ADDR] & LIS302DL_BIT1, 0);
+
+	// Registers outside the shadow are read every time
+	TEST_EQUAL(LIS302DL_ReadRegister(SPI1, LIS302DL_STATUS_REG_ADDR), LIS302DL_STATUS_ZYXDA);
+	TEST_EQUAL(LIS302DL_ReadRegister(SPI1, LIS302DL_STATUS_REG_ADDR), LIS302DL_STATUS_ZYXDA);
+	_test_count();
+	TEST_EQUAL(test_selects, 2);
+
+	// A reboot loads the defaults, the next read asks the device again
+	LIS302DL_Reboot(SPI1);
+	_test_count();
+	test_accel.reg[LIS302DL_CTRL_REG1_ADDR] = 0x07;
+	TEST_EQUAL(LIS302DL_Sensitivity(SPI1), 18);
+	_test_count();
+	TEST_EQUAL(test_selects, 1);
+}
+
+/**
+ * @brief  Consecutive registers go in one auto increment write up to the last changed one
+ * @param  None
+ * @retval None
+ */
+static void test_batch(void) {
+	const LIS302DL_Register config[] = {
+		{ LIS302DL_CTRL_REG1_ADDR, 0xC7 },
+		{ LIS302DL_CTRL_REG2_ADDR, 0x10 },
+		{ LIS302DL_CTRL_REG3_ADDR, 0x04 },
+		{ 0x30, 0x0F },
+		{ 0x32, 0x20 }
+	};
+	const LIS302DL_Register same[] = {
+		{ LIS302DL_CTRL_REG1_ADDR, 0x47 },
+		{ LIS302DL_CTRL_REG2_ADDR, 0x10 },
+		{ LIS302DL_CTRL_REG3_ADDR, 0x04 }
+	};
+
+	_test_setup();
+	LIS302DL_WriteRegisters(SPI1, config, 5);
+	_test_count();
+	TEST_EQUAL(test_selects, 3);
+	TEST_EQUAL(test_bytes, 4 + 2 + 2);
+	TEST_EQUAL(test_accel.reg[LIS302DL_CTRL_REG3_ADDR], 0x04);
+	TEST_EQUAL(test_accel.reg[0x32], 0x20);
+
+	// Only CTRL_REG1 changed, the run is cut after it
+	LIS302DL_WriteRegisters(SPI1, same, 3);
+	_test_count();
+	TEST_EQUAL(test_selects, 1);
+	TEST_EQUAL(test_bytes, 2);
+	TEST_EQUAL(test_accel.reg[LIS302DL_CTRL_REG1_ADDR], 0x47);
+
+	LIS302DL_WriteRegisters(SPI1, same, 3);
+	_test_count();
+	TEST_EQUAL(test_selects, 0);
+}
+
+/**
+ * @brief  A sample is only converted with new data; the overruns are counted
+ * @param  None
+ * @retval None
+ */
+static void test_decode(void) {
+	LIS302DL_Sample sample;
+	u32 overruns = LIS302DL_Overruns;
+
+	_test_setup();
+	TEST_EQUAL(LIS302DL_ReadSample(SPI1, &sample), 1);
+	_test_count();
+	TEST_EQUAL(test_selects, 1);
+	TEST_EQUAL(test_bytes, 1 + LIS302DL_SAMPLE_SIZE);
+	TEST_EQUAL(sample.NewData, 1);
+	TEST_EQUAL(sample.X, -5 * 18);
+	TEST_EQUAL(sample.Z, 56 * 18);
+
+	test_accel.reg[LIS302DL_STATUS_REG_ADDR] = 0;
+	test_accel.reg[LIS302DL_OUT_X_ADDR] = 1;
+	TEST_EQUAL(LIS302DL_ReadSample(SPI1, &sample), 0);
+	TEST_EQUAL(sample.NewData, 0);
+	TEST_EQUAL(sample.X, -5 * 18);
+
+	test_accel.reg[LIS302DL_STATUS_REG_ADDR] = LIS302DL_STATUS_ZYXOR | LIS302DL_STATUS_ZYXDA;
+	TEST_EQUAL(LIS302DL_ReadSample(SPI1, &sample), 1);
+	TEST_EQUAL(sample.Overrun, 1);
+	TEST_EQUAL(sample.X, 18);
+	TEST_EQUAL(LIS302DL_Overruns, overruns + 1);
+}
@@ -0,0 +1,231 @@
+/** @file    test_receiver_capture.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the input capture receiver: the timers and DMA streams run
+ *           on memory, edges of a 50Hz receiver are fed through the DMA model
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "receiver.h"
+#include "dma.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+// Everything the capture decoder published through the receiver stubs below
+static u16 test_position[RECEIVER_CHANNELS];
+static u32 test_updates[RECEIVER_CHANNELS];
+static u32 test_publishes;
+
+static DMA_Stream_TypeDef* const test_streams[RECEIVER_CHANNELS] = {
+	DMA2_Stream1, DMA2_Stream2, DMA2_Stream6, DMA2_Stream4, DMA1_Stream5, DMA1_Stream6, DMA1_Stream1, DMA1_Stream7
+};
+
+static void (* const test_handlers[RECEIVER_CHANNELS])(void) = {
+	DMA2_Stream1_IRQHandler, DMA2_Stream2_IRQHandler, DMA2_Stream6_IRQHandler, DMA2_Stream4_IRQHandler,
+	DMA1_Stream5_IRQHandler, DMA1_Stream6_IRQHandler, DMA1_Stream1_IRQHandler, DMA1_Stream7_IRQHandler
+};
+
+static void _test_init(void);
+static u8 _test_edge(u8 num, u32 time);
+static void test_decode(void);
+static void test_registers(void);
+static void test_frames(void);
+static void test_glitch(void);
+
+
+/**** Public implementations ****/
+
+void receiver_set_pos(u16 num, u16 position) {
+	test_position[num] = position;
+	test_updates[num]++;
+}
+
+void receiver_publish() {
+	test_publishes++;
+}
+
+int main(void) {
+	test_decode();
+	test_registers();
+	test_frames();
+	test_glitch();
+	return test_report("receiver_capture");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Start the capture on cleared registers
+ * @param  None
+ * @retval None
+ */
+static void _test_init(void) {
+	host_reset();
+	memset(test_position, 0, sizeof(test_position));
+	memset(test_updates, 0, sizeof(test_updates));
+	test_publishes = 0;
+	receiver_capture_init();
+}
+
+/**
+ * @brief  Latch an edge on a channel like the timer and its DMA request do and run the
+ *         interrupt of the stream if it is raised
+ * @param  num  Number of the channel
+ * @param  time  Time of the edge in microseconds, the 16bit timer wraps it
+ * @retval u8 Number of interrupts which ran
+ */
+static u8 _test_edge(u8 num, u32 time) {
+	host_dma_receive(test_streams[num], time & RECEIVER_CAPTURE_TIM_PERIOD);
+	return host_dma_interrupt(test_streams[num], test_handlers[num]);
+}
+
+/**
+ * @brief  The decoder on a ring: pauses are skipped, pulses clamped, the timer overflow handled
+ * @param  None
+ * @retval None
+ */
+static void test_decode(void) {
+	u16 edges[RECEIVER_CAPTURE_EDGES] = { 0xFF00, 0x0498 };
+	u16 read = 0, last = 0xC000, width = 0;
+
+	// Pause and a 1432µs pulse over the overflow
+	TEST_EQUAL(receiver_capture_decode(edges, &read, 1, &last, &width), 0);
+	TEST_EQUAL(receiver_capture_decode(edges, &read, 0, &last, &width), 1);
+	TEST_EQUAL(width, 0x0498 + 0x10000 - 0xFF00);
+	TEST_EQUAL(read, 0);
+	TEST_EQUAL(last, 0x0498);
+
+	// Nothing new, then 850µs and 2150µs clamped into the servo range
+	width = 0;
+	TEST_EQUAL(receiver_capture_decode(edges, &read, 0, &last, &width), 0);
+	edges[0] = last + 850;
+	TEST_EQUAL(receiver_capture_decode(edges, &read, 1, &last, &width), 1);
+	TEST_EQUAL(width, RECEIVER_PULSE_MIN);
+	edges[1] = last + 2150;
+	TEST_EQUAL(receiver_capture_decode(edges, &read, 0, &last, &width), 1);
+	TEST_EQUAL(width, RECEIVER_PULSE_MAX);
+
+	// 2300µs is no pulse anymore
+	width = 0;
+	edges[0] = last + 2300;
+	TEST_EQUAL(receiver_capture_decode(edges, &read, 1, &last, &width), 0);
+	TEST_EQUAL(width, 0);
+}
+
+/**
+ * @brief  Both timers count microseconds over 16bit and every stream runs circular with interrupts
+ * @param  None
+ * @retval None
+ */
+static void test_registers(void) {
+	u8 i;
+
+	_test_init();
+	TEST_EQUAL(TIM1->PSC, 167);
+	TEST_EQUAL(TIM2->PSC, 83);
+	TEST_EQUAL(TIM1->ARR, 0xFFFF);
+	TEST_EQUAL(TIM2->ARR, 0xFFFF);
+	TEST_CHECK(TIM1->CR1 & TIM_CR1_CEN);
+	TEST_CHECK(TIM2->CR1 & TIM_CR1_CEN);
+	TEST_EQUAL(TIM1->CCER, (TIM_CCER_CC1E | TIM_CCER_CC1P | TIM_CCER_CC1NP) * 0x1111);
+	TEST_EQUAL(TIM2->CCER, (TIM_CCER_CC1E | TIM_CCER_CC1P | TIM_CCER_CC1NP) * 0x1111);
+	TEST_EQUAL(TIM1->DIER & (TIM_DIER_CC1DE | TIM_DIER_CC2DE | TIM_DIER_CC3DE | TIM_DIER_CC4DE), TIM_DIER_CC1DE | TIM_DIER_CC2DE | TIM_DIER_CC3DE | TIM_DIER_CC4DE);
+	TEST_EQUAL(TIM2->DIER & (TIM_DIER_CC1DE | TIM_DIER_CC2DE | TIM_DIER_CC3DE | TIM_DIER_CC4DE), TIM_DIER_CC1DE | TIM_DIER_CC2DE | TIM_DIER_CC3DE | TIM_DIER_CC4DE);
+
+	for (i = 0; i < RECEIVER_CHANNELS; i++) {
+		DMA_Stream_TypeDef* stream = test_streams[i];
+		TEST_EQUAL(stream->NDTR, RECEIVER_CAPTURE_EDGES);
+		TEST_CHECK(stream->CR & DMA_SxCR_EN);
+		TEST_CHECK(stream->CR & DMA_SxCR_CIRC);
+		TEST_CHECK(stream->CR & DMA_SxCR_MINC);
+		TEST_CHECK(stream->CR & DMA_SxCR_HTIE);
+		TEST_CHECK(stream->CR & DMA_SxCR_TCIE);
+		TEST_EQUAL(stream->CR & DMA_SxCR_CHSEL, (i < 4) ? DMA_Channel_6 : DMA_Channel_3);
+		TEST_EQUAL(stream->PAR, (i < 4) ? (u32)&TIM1->CCR1 + 4 * i : (u32)&TIM2->CCR1 + 4 * (i - 4));
+	}
+}
+
+/**
+ * @brief  Ten seconds of 50Hz frames on all channels without any main loop: every edge raises
+ *         the interrupt of its half of the ring and each pulse is decoded over all timer overflows
+ * @param  None
+ * @retval None
+ */
+static void test_frames(void) {
+	u32 frame, time, errors = 0, runs = 0;
+	u16 width;
+	u8 i;
+
+	_test_init();
+	for (frame = 0; frame < 500; frame++) {
+		for (i = 0; i < RECEIVER_CHANNELS; i++) {
+			// Each channel sweeps its own pulse width, starting 300µs after the previous one
+			time = 5000 + frame * 20000 + i * 300;
+			width = RECEIVER_PULSE_MIN + (frame * 7 + i * 111) % (RECEIVER_PULSE_MAX - RECEIVER_PULSE_MIN + 1);
+			runs += _test_edge(i, time);
+			runs += _test_edge(i, time + width);
+			if (test_position[i] != width - RECEIVER_PULSE_MIN) {
+				errors++;
+			}
+		}
+	}
+	TEST_EQUAL(errors, 0);
+	TEST_EQUAL(runs, 2 * 500 * RECEIVER_CHANNELS);
+	TEST_EQUAL(test_publishes, 500 * RECEIVER_CHANNELS);
+	for (i = 0; i < RECEIVER_CHANNELS; i++) {
+		TEST_EQUAL(test_updates[i], 500);
+	}
+}
+
+/**
+ * @brief  A spike in the pause and a lost edge do not publish wrong positions,
+ *         the channel locks on again with the next frames
+ * @param  None
+ * @retval None
+ */
+static void test_glitch(void) {
+	u32 time = 5000;
+	u8 i;
+
+	_test_init();
+	for (i = 0; i < 4; i++, time += 20000) {
+		_test_edge(0, time);
+		_test_edge(0, time + 1500);
+	}
+	TEST_EQUAL(test_position[0], 500);
+	TEST_EQUAL(test_updates[0], 4);
+
+	// A 3µs spike 4ms after the pulse: the spike and the pause around it are out of range
+	_test_edge(0, time - 20000 + 5500);
+	_test_edge(0, time - 20000 + 5503);
+	TEST_EQUAL(test_updates[0], 4);
+
+	// The rising edge gets lost, so the next pulse ends 18.2ms after the last edge
+	_test_edge(0, time + 1200);
+	TEST_EQUAL(test_updates[0], 4);
+	time += 20000;
+	for (i = 0; i < 3; i++, time += 20000) {
+		_test_edge(0, time);
+		_test_edge(0, time + 1800);
+	}
+	TEST_EQUAL(test_position[0], 800);
+	TEST_EQUAL(test_updates[0], 7);
+}
@@ -0,0 +1,236 @@
+/** @file    test_receiver_ppm.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the PPM decoder with jittered, truncated and shortened frames
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "receiver.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+static u16 test_position[RECEIVER_CHANNELS];
+static u32 test_publishes;
+
+// Time of the next rising edge in microseconds, the decoder only sees the lower 16bit
+static u32 test_time;
+
+static u32 test_seed = 1;
+
+static s16 _test_jitter(s16 range);
+static u8 _test_edge(u32 interval);
+static u8 _test_frame(u8 channels, u16 base, s16 jitter);
+static void test_registers(void);
+static void test_jitter(void);
+static void test_truncated(void);
+static void test_shorter(void);
+
+
+/**** Public implementations ****/
+
+void receiver_set_pos(u16 num, u16 position) {
+	test_position[num] = position;
+}
+
+void receiver_publish() {
+	test_publishes++;
+}
+
+int main(void) {
+	test_registers();
+	test_jitter();
+	test_truncated();
+	test_shorter();
+	return test_report("receiver_ppm");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Pseudo random jitter, the same sequence on every run
+ * @param  range  Largest deviation in microseconds
+ * @retval s16 Jitter between -range and range
+ */
+static s16 _test_jitter(s16 range) {
+	test_seed = test_seed * 1103515245 + 12345;
+	return (s16)((test_seed >> 16) % (2 * range + 1)) - range;
+}
+
+/**
+ * @brief  Latch the next rising edge in TIM1 CH1 and run the capture interrupt
+ * @param  interval  Time since the last edge in microseconds
+ * @retval u8 1 if the interrupt published a frame
+ */
+static u8 _test_edge(u32 interval) {
+	u32 publishes = test_publishes;
+
+	test_time += interval;
+	TIM1->CCR1 = test_time & 0xFFFF;
+	TIM1->SR |= TIM_SR_CC1IF;
+	TIM1_CC_IRQHandler();
+	return test_publishes != publishes;
+}
+
+/**
+ * @brief  Send one frame: the channels one after the other and the sync gap
+ * @param  channels  Number of channels in the frame
+ * @param  base  Pulse width of the first channel, each next one is 50µs longer
+ * @param  jitter  Largest jitter on every edge in microseconds
+ * @retval u8 1 if the sync gap published the frame
+ */
+static u8 _test_frame(u8 channels, u16 base, s16 jitter) {
+	u32 used = 0;
+	u16 width;
+	u8 i;
+
+	for (i = 0; i < channels; i++) {
+		width = base + 50 * i + _test_jitter(jitter);
+		used += width;
+		_test_edge(width);
+	}
+	return _test_edge(22500 - used);
+}
+
+/**
+ * @brief  TIM1 counts microseconds over 16bit and captures the rising edges of CH1 with an interrupt
+ * @param  None
+ * @retval None
+ */
+static void test_registers(void) {
+	host_reset();
+	receiver_ppm_init();
+	TEST_EQUAL(TIM1->PSC, 167);
+	TEST_EQUAL(TIM1->ARR, 0xFFFF);
+	TEST_EQUAL(TIM1->CCER & (TIM_CCER_CC1E | TIM_CCER_CC1P | TIM_CCER_CC1NP), TIM_CCER_CC1E);
+	TEST_EQUAL(TIM1->CCMR1 & TIM_CCMR1_CC1S, TIM_CCMR1_CC1S_0);
+	TEST_CHECK(TIM1->DIER & TIM_DIER_CC1IE);
+	TEST_CHECK(TIM1->CR1 & TIM_CR1_CEN);
+}
+
+/**
+ * @brief  Jittered 8 channel frames over many timer overflows, the jitter beyond the
+ *         servo range is clamped
+ * @param  None
+ * @retval None
+ */
+static void test_jitter(void) {
+	u32 frame, published = 0, errors = 0;
+	u8 i;
+
+	// Nothing is published before the first sync gap
+	TEST_EQUAL(_test_frame(8, 1100, 0), 0);
+	for (frame = 0; frame < 200; frame++) {
+		published += _test_frame(8, 1100, 4);
+		for (i = 0; i < 8; i++) {
+			s16 error = (s16)test_position[i] - (100 + 50 * i);
+			if ((error < -4) || (error > 4)) {
+				errors++;
+			}
+		}
+	}
+	TEST_EQUAL(published, 200);
+	TEST_EQUAL(errors, 0);
+	TEST_EQUAL(receiver_ppm_channels, 8);
+	TEST_EQUAL(receiver_ppm_errors, 0);
+
+	// 980µs and 2150µs are jitter around the limits
+	TEST_EQUAL(_test_frame(4, 980, 0), 0);
+	TEST_EQUAL(receiver_ppm_errors, 1);
+	_test_edge(980);
+	_test_edge(2150);
+	for (i = 0; i < 6; i++) {
+		_test_edge(1500);
+	}
+	TEST_EQUAL(_test_edge(20000), 1);
+	TEST_EQUAL(test_position[0], 0);
+	TEST_EQUAL(test_position[1], RECEIVER_PULSE_MAX - RECEIVER_PULSE_MIN);
+}
+
+/**
+ * @brief  Lost edges: A merged interval breaks the frame, a lost last channel truncates it.
+ *         Neither is published and the next complete frame is again.
+ * @param  None
+ * @retval None
+ */
+static void test_truncated(void) {
+	u32 errors = receiver_ppm_errors;
+	u8 i;
+
+	// Two channels merge into one 2700µs interval
+	_test_edge(1200);
+	_test_edge(2700);
+	for (i = 0; i < 6; i++) {
+		_test_edge(1200);
+	}
+	TEST_EQUAL(_test_edge(12000), 0);
+	TEST_EQUAL(receiver_ppm_errors, errors + 1);
+
+	// The last channel merges into the sync gap
+	TEST_EQUAL(_test_frame(7, 1300, 3), 0);
+	TEST_EQUAL(receiver_ppm_errors, errors + 2);
+	TEST_EQUAL(test_position[7], 500);
+	TEST_EQUAL(_test_frame(8, 1300, 0), 1);
+	TEST_EQUAL(test_position[7], 650);
+	TEST_EQUAL(receiver_ppm_channels, 8);
+
+	// A short pulse between two channels
+	_test_edge(1300);
+	_test_edge(400);
+	_test_edge(900);
+	TEST_EQUAL(_test_edge(15000), 0);
+	TEST_EQUAL(receiver_ppm_errors, errors + 3);
+	TEST_EQUAL(_test_frame(8, 1200, 2), 1);
+}
+
+/**
+ * @brief  After a 12 channel frame the receiver changes to 8 channels: the short frames
+ *         are dropped as truncated until they repeated, then they are accepted for good.
+ *         A truncated frame in between starts the counting again.
+ * @param  None
+ * @retval None
+ */
+static void test_shorter(void) {
+	u32 errors;
+	u8 i;
+
+	TEST_EQUAL(_test_frame(12, 1050, 3), 1);
+	TEST_EQUAL(receiver_ppm_channels, 12);
+	errors = receiver_ppm_errors;
+
+	TEST_EQUAL(_test_frame(8, 1050, 3), 0);
+	TEST_EQUAL(_test_frame(7, 1050, 3), 0);
+	for (i = 1; i < RECEIVER_PPM_CHANNELS_REPEAT; i++) {
+		TEST_EQUAL(_test_frame(8, 1050, 3), 0);
+	}
+	TEST_EQUAL(receiver_ppm_channels, 12);
+	TEST_EQUAL(receiver_ppm_errors, errors + RECEIVER_PPM_CHANNELS_REPEAT + 1);
+
+	TEST_EQUAL(_test_frame(8, 1050, 3), 1);
+	TEST_EQUAL(receiver_ppm_channels, 8);
+	for (i = 0; i < 20; i++) {
+		TEST_EQUAL(_test_frame(8, 1050, 3), 1);
+	}
+	TEST_EQUAL(receiver_ppm_errors, errors + RECEIVER_PPM_CHANNELS_REPEAT + 1);
+
+	// Longer frames are taken at once
+	TEST_EQUAL(_test_frame(12, 1050, 3), 1);
+	TEST_EQUAL(receiver_ppm_channels, 12);
+}
@@ -0,0 +1,148 @@
+/** @file    test_receiver_quality.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the receiver signal quality: interval average, dropped frames,
+ *           a changed frame rate and the failsafe latch
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "receiver.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+// receiver_now() counts core clock cycles
+#define TEST_US(us) ((u32)(us) * 168)
+
+static void test_interval(void);
+static void test_rate(void);
+static void test_stale(void);
+
+
+/**** Public implementations ****/
+
+u32 receiver_elapsed(u32 from, u32 to) {
+	return (to - from) / 168;
+}
+
+int main(void) {
+	test_interval();
+	test_rate();
+	test_stale();
+	return test_report("receiver_quality");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  A steady 50Hz frame rate with jitter, a single lost frame is counted as dropped
+ *         but not taken into the average
+ * @param  None
+ * @retval None
+ */
+static void test_interval(void) {
+	Receiver_ChannelStats stats;
+	u32 now = 0;
+	u16 i;
+
+	receiver_quality_init(RECEIVER_FAILSAFE_TIMEOUT);
+	for (i = 0; i < 100; i++) {
+		now += TEST_US(20000 + ((i & 1) ? 40 : -40));
+		receiver_quality_filter(0, 500, now);
+	}
+	receiver_quality_stats(0, &stats);
+	TEST_CHECK((stats.interval > 19950) && (stats.interval < 20050));
+	TEST_CHECK(stats.jitter <= 80);
+	TEST_EQUAL(stats.dropped, 0);
+	TEST_EQUAL(stats.frames, 100);
+
+	now += TEST_US(40000);
+	receiver_quality_filter(0, 500, now);
+	now += TEST_US(20000);
+	receiver_quality_filter(0, 500, now);
+	receiver_quality_stats(0, &stats);
+	TEST_EQUAL(stats.dropped, 1);
+	TEST_EQUAL(stats.late, 0);
+	TEST_CHECK((stats.interval > 19950) && (stats.interval < 20050));
+
+	// The median filter drops a single spike
+	TEST_EQUAL(receiver_quality_filter(0, 900, now + TEST_US(20000)), 500);
+	receiver_quality_stats(0, &stats);
+	TEST_EQUAL(stats.glitches, 1);
+}
+
+/**
+ * @brief  The receiver changes from 50Hz to 25Hz: after RECEIVER_LATE_ADAPT late frames in a
+ *         row the average follows and no more frames are counted as dropped
+ * @param  None
+ * @retval None
+ */
+static void test_rate(void) {
+	Receiver_ChannelStats stats;
+	u32 now = 0, dropped;
+	u16 i;
+
+	receiver_quality_init(RECEIVER_FAILSAFE_TIMEOUT);
+	for (i = 0; i < 50; i++) {
+		now += TEST_US(20000);
+		receiver_quality_filter(1, 300, now);
+	}
+	for (i = 0; i < 100; i++) {
+		now += TEST_US(40000);
+		receiver_quality_filter(1, 300, now);
+	}
+	receiver_quality_stats(1, &stats);
+	TEST_EQUAL(stats.dropped, RECEIVER_LATE_ADAPT - 1);
+	TEST_CHECK((stats.interval > 39900) && (stats.interval <= 40000));
+	TEST_EQUAL(stats.late, 0);
+
+	// A lost frame at the new rate is dropped again
+	dropped = stats.dropped;
+	now += TEST_US(80000);
+	receiver_quality_filter(1, 300, now);
+	receiver_quality_stats(1, &stats);
+	TEST_EQUAL(stats.dropped, dropped + 1);
+	TEST_CHECK((stats.interval > 39900) && (stats.interval <= 40000));
+}
+
+/**
+ * @brief  A channel is stale before its first update and after the timeout; the stale state
+ *         holds over the overflow of the cycle counter until the next update
+ * @param  None
+ * @retval None
+ */
+static void test_stale(void) {
+	Receiver_ChannelStats stats;
+	u32 now = 0xFFFF0000;
+
+	receiver_quality_init(RECEIVER_FAILSAFE_TIMEOUT);
+	TEST_EQUAL(receiver_quality_stale(2, now), 1);
+	receiver_quality_filter(2, 100, now);
+	TEST_EQUAL(receiver_quality_stale(2, now + TEST_US(RECEIVER_FAILSAFE_TIMEOUT)), 0);
+	TEST_EQUAL(receiver_quality_stale(2, now + TEST_US(RECEIVER_FAILSAFE_TIMEOUT + 1)), 1);
+
+	// 25.56s later the cycle counter is back at the last update
+	TEST_EQUAL(receiver_quality_stale(2, now + 1000), 1);
+	receiver_quality_stats(2, &stats);
+	TEST_EQUAL(stats.frames, 1);
+
+	receiver_quality_filter(2, 100, now + 2000);
+	TEST_EQUAL(receiver_quality_stale(2, now + 3000), 0);
+	TEST_EQUAL(receiver_quality_stale(3, now + 3000), 1);
+}
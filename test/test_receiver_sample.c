@@ -0,0 +1,220 @@
+/** @file    test_receiver_sample.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the sampling receiver: recorded input register streams run
+ *           through the DMA model into the batch decoder
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "receiver.h"
+#include "dma.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+/**
+ * One run of equal input register samples as a logic analyzer records them. The
+ * recording is one 20ms frame of a receiver which sends its channels one after the
+ * other, so each falling edge comes in the same sample as the next rising one. PE0-PE6
+ * and PE15 belong to other hardware and toggle on their own.
+ */
+typedef struct {
+	u16 samples;
+	u16 idr;
+} Test_Run;
+
+#define TEST_CH(n) (1 << (RECEIVER_SAMPLE_SHIFT + (n)))
+
+static const Test_Run test_recording[] = {
+	{ 1500, TEST_CH(0) | 0x0001 },
+	{ 1100, TEST_CH(1) | 0x0003 },
+	{ 1900, TEST_CH(2) | 0x8001 },
+	{  990, TEST_CH(3) | 0x8000 },
+	{ 2010, TEST_CH(4) | 0x0040 },
+	{ 1250, TEST_CH(5) },
+	{    1, TEST_CH(5) | TEST_CH(6) },        // A one sample spike on channel 7
+	{  499, TEST_CH(5) | 0x0004 },
+	{ 1500, TEST_CH(7) | 0x8004 },
+	{ 9250, 0x0000 }
+};
+
+static const u16 test_widths[RECEIVER_CHANNELS] = { 1500, 1100, 1900, 1000, 2000, 1750, 0, 1500 };
+
+static u16 test_position[RECEIVER_CHANNELS];
+static u32 test_updates[RECEIVER_CHANNELS];
+static u32 test_publishes;
+
+static void _test_play(u32 frames, u8 dma);
+static void test_registers(void);
+static void test_decode(void);
+static void test_dma(void);
+static void test_overflow(void);
+
+
+/**** Public implementations ****/
+
+void receiver_set_pos(u16 num, u16 position) {
+	test_position[num] = position;
+	test_updates[num]++;
+}
+
+void receiver_publish() {
+	test_publishes++;
+}
+
+int main(void) {
+	test_registers();
+	test_decode();
+	test_dma();
+	test_overflow();
+	return test_report("receiver_sample");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Play the recording into the DMA stream and run its interrupt
+ * @param  frames  Number of times the recording is played
+ * @param  dma  Run the interrupt after each sample
+ * @retval None
+ */
+static void _test_play(u32 frames, u8 dma) {
+	u32 frame;
+	u16 run, i;
+
+	for (frame = 0; frame < frames; frame++) {
+		for (run = 0; run < sizeof(test_recording) / sizeof(test_recording[0]); run++) {
+			for (i = 0; i < test_recording[run].samples; i++) {
+				host_dma_receive(RECEIVER_SAMPLE_DMA_STREAM, test_recording[run].idr);
+				if (dma) {
+					host_dma_interrupt(RECEIVER_SAMPLE_DMA_STREAM, DMA2_Stream1_IRQHandler);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief  TIM8 requests the DMA every microsecond, which copies GPIOE->IDR into the circular buffer
+ * @param  None
+ * @retval None
+ */
+static void test_registers(void) {
+	host_reset();
+	receiver_sample_init();
+	TEST_EQUAL(TIM8->PSC, 0);
+	TEST_EQUAL(TIM8->ARR, 167);
+	TEST_CHECK(TIM8->DIER & TIM_DIER_UDE);
+	TEST_CHECK(TIM8->CR1 & TIM_CR1_CEN);
+	TEST_EQUAL(RECEIVER_SAMPLE_DMA_STREAM->PAR, (u32)&GPIOE->IDR);
+	TEST_EQUAL(RECEIVER_SAMPLE_DMA_STREAM->NDTR, RECEIVER_SAMPLE_BUFFER);
+	TEST_EQUAL(RECEIVER_SAMPLE_DMA_STREAM->CR & DMA_SxCR_CHSEL, RECEIVER_SAMPLE_DMA_CHANNEL);
+	TEST_EQUAL(RECEIVER_SAMPLE_DMA_STREAM->CR & (DMA_SxCR_CIRC | DMA_SxCR_HTIE | DMA_SxCR_TCIE | DMA_SxCR_EN), DMA_SxCR_CIRC | DMA_SxCR_HTIE | DMA_SxCR_TCIE | DMA_SxCR_EN);
+}
+
+/**
+ * @brief  The decoder on blocks of the recording directly, a pulse over a block border included
+ * @param  None
+ * @retval None
+ */
+static void test_decode(void) {
+	static u16 samples[20000];
+	Receiver_SampleDecoder decoder;
+	u32 found = 0, n = 0;
+	u16 run, i;
+	u8 ch;
+
+	for (run = 0; run < sizeof(test_recording) / sizeof(test_recording[0]); run++) {
+		for (i = 0; i < test_recording[run].samples; i++) {
+			samples[n++] = test_recording[run].idr;
+		}
+	}
+	TEST_EQUAL(n, 20000);
+
+	// Odd block sizes, so the edges fall anywhere into the blocks
+	memset(&decoder, 0, sizeof(decoder));
+	for (n = 0; n < 20000; n += 777) {
+		found |= receiver_sample_decode(&decoder, &samples[n], (20000 - n < 777) ? 20000 - n : 777);
+	}
+	TEST_EQUAL(decoder.time, 20000);
+	TEST_EQUAL(decoder.last, test_recording[sizeof(test_recording) / sizeof(test_recording[0]) - 1].idr);
+
+	TEST_EQUAL(found, 0xBF);
+
+	// Again with the blocks of the DMA interrupt
+	found = 0;
+	for (n = 0; n < 20000; n += 512) {
+		found |= receiver_sample_decode(&decoder, &samples[n], (20000 - n < 512) ? 20000 - n : 512);
+	}
+	TEST_EQUAL(found, 0xBF);
+	for (ch = 0; ch < RECEIVER_CHANNELS; ch++) {
+		if (test_widths[ch]) {
+			TEST_EQUAL(decoder.width[ch], test_widths[ch]);
+		}
+	}
+}
+
+/**
+ * @brief  Two seconds of frames through the DMA and its half and full buffer interrupts
+ * @param  None
+ * @retval None
+ */
+static void test_dma(void) {
+	u32 blocks;
+	u8 ch;
+
+	host_reset();
+	memset(test_updates, 0, sizeof(test_updates));
+	test_publishes = 0;
+	receiver_sample_init();
+	blocks = receiver_sample_blocks;
+
+	_test_play(100, 1);
+	TEST_EQUAL(receiver_sample_blocks - blocks, 100 * 20000 / (RECEIVER_SAMPLE_BUFFER / 2));
+	for (ch = 0; ch < RECEIVER_CHANNELS; ch++) {
+		if (test_widths[ch]) {
+			TEST_EQUAL(test_position[ch], test_widths[ch] - RECEIVER_PULSE_MIN);
+			TEST_CHECK(test_updates[ch] >= 99);
+		} else {
+			TEST_EQUAL(test_updates[ch], 0);
+		}
+	}
+	TEST_CHECK(test_publishes <= receiver_sample_blocks - blocks);
+}
+
+/**
+ * @brief  The sample counter overflows within a pulse
+ * @param  None
+ * @retval None
+ */
+static void test_overflow(void) {
+	Receiver_SampleDecoder decoder;
+	u16 samples[2000];
+	u16 i;
+
+	memset(&decoder, 0, sizeof(decoder));
+	decoder.time = 0xFFFFFF00;
+	for (i = 0; i < 2000; i++) {
+		samples[i] = (i < 1234) ? TEST_CH(2) : 0;
+	}
+	TEST_EQUAL(receiver_sample_decode(&decoder, samples, 2000), 1 << 2);
+	TEST_EQUAL(decoder.width[2], 1234);
+	TEST_EQUAL(decoder.time, 0xFFFFFF00 + 2000);
+}
@@ -0,0 +1,419 @@
+/** @file    test_sensors_i2c.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the I2C1 transfer state machine and the L3G4200D transfers on it,
+ *           run against the I2C slave model behind the event, error and DMA interrupts
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "sensors_i2c.h"
+#include "../sensors/inc/l3g4200d.h"
+#include "i2c.h"
+#include "dma.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+// The DMA addresses are 32 bit, so all transfers and their buffers are static
+static Host_I2cDevice test_gyro;
+static Sensors_BusHealth test_nobody_health;
+static const Sensors_I2cDevice test_nobody = { 0x68, &test_nobody_health };
+static u32 test_time = 0;
+static u8 test_callbacks = 0;
+
+u32 sensors_time_now() {
+	return test_time;
+}
+
+static void _test_setup(void);
+static void _test_clock(void);
+static void _test_callback(Sensors_Transfer* transfer);
+static void test_init(void);
+static void test_read_byte(void);
+static void test_read_dma(void);
+static void test_write(void);
+static void test_nack(void);
+static void test_timeout(void);
+static void test_stuck(void);
+
+
+/**** Public implementations ****/
+
+int main(void) {
+	test_init();
+	test_read_byte();
+	test_read_dma();
+	test_write();
+	test_nack();
+	test_timeout();
+	test_stuck();
+	return test_report("sensors_i2c");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Fresh registers, the I2C engine and a L3G4200D at 0x69 which answers its WHO_AM_I
+ * @param  None
+ * @retval None
+ */
+static void _test_setup(void) {
+	host_reset();
+	memset(&test_gyro, 0, sizeof(test_gyro));
+	test_gyro.address = L3G4200D_I2C_ADDRESS;
+	test_gyro.reg[L3G4200D_WHO_AM_I_ADDR] = 0xD3;
+	host_i2c_attach(&test_gyro);
+	memset(&L3G4200D_Health, 0, sizeof(L3G4200D_Health));
+	memset(&test_nobody_health, 0, sizeof(test_nobody_health));
+	test_callbacks = 0;
+	test_time = 0;
+
+	// SDA is released, the recovery does not have to clock out a byte
+	GPIOB->IDR = GPIO_Pin_9;
+	sensors_i2c_init();
+	sensors_i2c_errors = 0;
+	sensors_i2c_transfers = 0;
+}
+
+/**
+ * @brief  Run the bus until all transfers are done
+ * @param  None
+ * @retval None
+ */
+static void _test_clock(void) {
+	host_i2c_run(I2C1, SENSORS_I2C_DMA_RX_STREAM, I2C1_EV_IRQHandler, I2C1_ER_IRQHandler, DMA1_Stream0_IRQHandler);
+}
+
+/**
+ * @brief  Count the finished transfer
+ * @param  transfer  The transfer
+ * @retval None
+ */
+static void _test_callback(Sensors_Transfer* transfer) {
+	test_callbacks++;
+}
+
+/**
+ * @brief  I2C1 is enabled with its error interrupt off until a transfer runs, the RX stream
+ *         reads its data register and ends a read with its interrupt
+ * @param  None
+ * @retval None
+ */
+static void test_init(void) {
+	_test_setup();
+
+	TEST_CHECK(I2C1->CR1 & I2C_CR1_PE);
+	TEST_CHECK(I2C1->CR1 & I2C_CR1_ACK);
+	TEST_EQUAL(I2C1->CR2 & (I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_DMAEN), 0);
+	TEST_EQUAL(DMA1_Stream0->PAR, (u32)&I2C1->DR);
+	TEST_EQUAL(DMA1_Stream0->CR & DMA_SxCR_CHSEL, DMA_Channel_1);
+	TEST_EQUAL(DMA1_Stream0->CR & DMA_SxCR_DIR, DMA_DIR_PeripheralToMemory);
+	TEST_EQUAL(DMA1_Stream0->CR & (DMA_SxCR_TCIE | DMA_SxCR_TEIE | DMA_SxCR_MINC), DMA_SxCR_TCIE | DMA_SxCR_TEIE | DMA_SxCR_MINC);
+	TEST_EQUAL(GPIOB->MODER & (GPIO_MODER_MODER6 | GPIO_MODER_MODER9), GPIO_MODER_MODER6_1 | GPIO_MODER_MODER9_1);
+	TEST_EQUAL(GPIOB->OTYPER & (GPIO_Pin_6 | GPIO_Pin_9), GPIO_Pin_6 | GPIO_Pin_9);
+	TEST_EQUAL(sensors_i2c_recoveries, 0);
+	TEST_CHECK(!sensors_i2c_busy());
+}
+
+/**
+ * @brief  A single byte is read without the DMA: the NACK is prepared before the read address,
+ *         the stop set right after it and the byte taken from the data register
+ * @param  None
+ * @retval None
+ */
+static void test_read_byte(void) {
+	static Sensors_Transfer transfer;
+	static u8 tx[1] = { L3G4200D_WHO_AM_I_ADDR }, rx[2] = { 0xAA, 0xAA };
+
+	_test_setup();
+	transfer.device = &L3G4200D_I2cDevice;
+	transfer.tx = tx;
+	transfer.rx = rx;
+	transfer.length = 2;
+	transfer.callback = _test_callback;
+	TEST_EQUAL(sensors_i2c_start(&transfer), 1);
+	TEST_EQUAL(transfer.status, SENSORS_BUS_BUSY);
+	TEST_CHECK(sensors_i2c_busy());
+	TEST_CHECK(I2C1->CR1 & I2C_CR1_START);
+	TEST_EQUAL(I2C1->CR2 & (I2C_CR2_ITEVTEN | I2C_CR2_ITERREN), I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+
+	// Running again or without a byte to read is refused
+	TEST_EQUAL(sensors_i2c_start(&transfer), 0);
+	transfer.length = 1;
+	TEST_EQUAL(sensors_i2c_start(&transfer), 0);
+	transfer.length = 2;
+
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_DONE);
+	TEST_EQUAL(test_callbacks, 1);
+	TEST_EQUAL(rx[0], 0xAA);
+	TEST_EQUAL(rx[1], 0xD3);
+	TEST_EQUAL(test_gyro.command, L3G4200D_WHO_AM_I_ADDR);
+	TEST_EQUAL(test_gyro.starts, 2);
+	TEST_EQUAL(test_gyro.stops, 1);
+	TEST_EQUAL(test_gyro.bytes, 1);
+	TEST_EQUAL(I2C1->CR1 & I2C_CR1_ACK, 0);
+	TEST_EQUAL(DMA1_Stream0->CR & DMA_SxCR_EN, 0);
+	TEST_EQUAL(I2C1->CR2 & (I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_DMAEN), 0);
+	TEST_EQUAL(sensors_i2c_transfers, 1);
+	TEST_CHECK(!sensors_i2c_busy());
+
+	// The blocking read of the driver takes the same way
+	host_interrupt = _test_clock;
+	test_gyro.reg[L3G4200D_FIFO_SRC_REG_ADDR] = 0x05;
+	TEST_EQUAL(L3G4200D_FifoLevel(&L3G4200D_I2cBus), 5);
+	TEST_EQUAL(test_gyro.command, L3G4200D_FIFO_SRC_REG_ADDR);
+	TEST_EQUAL(sensors_i2c_transfers, 2);
+}
+
+/**
+ * @brief  More bytes are read by the DMA behind a repeated start, with the increment flag in
+ *         the register address; the hardware does not acknowledge the last one
+ * @param  None
+ * @retval None
+ */
+static void test_read_dma(void) {
+	static Sensors_Transfer transfer;
+	static u8 buffer[1 + L3G4200D_SAMPLE_SIZE];
+	u8 i;
+
+	_test_setup();
+	for (i = 0; i < L3G4200D_SAMPLE_SIZE; i++) {
+		test_gyro.reg[L3G4200D_OUT_X_L_ADDR + i] = 0x10 + i;
+	}
+	TEST_EQUAL(L3G4200D_ReadAsync(&L3G4200D_I2cBus, &transfer, buffer, L3G4200D_OUT_X_L_ADDR, L3G4200D_SAMPLE_SIZE, _test_callback), 1);
+	TEST_EQUAL(transfer.length, 1 + L3G4200D_SAMPLE_SIZE);
+	TEST_EQUAL(test_callbacks, 0);
+
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_DONE);
+	TEST_EQUAL(test_callbacks, 1);
+	TEST_EQUAL(buffer[0], L3G4200D_OUT_X_L_ADDR | L3G4200D_I2C_MULTIPLE);
+	for (i = 0; i < L3G4200D_SAMPLE_SIZE; i++) {
+		TEST_EQUAL(buffer[1 + i], 0x10 + i);
+	}
+	TEST_EQUAL(test_gyro.command, L3G4200D_OUT_X_L_ADDR | HOST_I2C_INCREMENT);
+	TEST_EQUAL(test_gyro.starts, 2);
+	TEST_EQUAL(test_gyro.stops, 1);
+	TEST_EQUAL(test_gyro.bytes, L3G4200D_SAMPLE_SIZE);
+	TEST_EQUAL(DMA1_Stream0->NDTR, 0);
+	TEST_EQUAL(DMA1_Stream0->M0AR, (u32)&buffer[1]);
+	TEST_EQUAL(DMA1_Stream0->CR & DMA_SxCR_EN, 0);
+	TEST_CHECK(I2C1->CR1 & I2C_CR1_ACK);
+	TEST_EQUAL(I2C1->CR2 & (I2C_CR2_DMAEN | I2C_CR2_LAST), 0);
+	TEST_EQUAL(sensors_i2c_transfers, 1);
+	TEST_EQUAL(sensors_i2c_errors, 0);
+}
+
+/**
+ * @brief  A write sends the register address and the data from the interrupt, the stop
+ *         follows once the last byte left the shift register
+ * @param  None
+ * @retval None
+ */
+static void test_write(void) {
+	static const u8 value[2] = { 0x0F, 0x30 };
+
+	_test_setup();
+	host_interrupt = _test_clock;
+	TEST_EQUAL(L3G4200D_Write(&L3G4200D_I2cBus, value, L3G4200D_CTRL_REG1_ADDR, 2), 1);
+	TEST_EQUAL(test_gyro.command, L3G4200D_CTRL_REG1_ADDR | HOST_I2C_INCREMENT);
+	TEST_EQUAL(test_gyro.reg[L3G4200D_CTRL_REG1_ADDR], 0x0F);
+	TEST_EQUAL(test_gyro.reg[L3G4200D_CTRL_REG1_ADDR + 1], 0x30);
+	TEST_EQUAL(test_gyro.starts, 1);
+	TEST_EQUAL(test_gyro.stops, 1);
+	TEST_EQUAL(test_gyro.bytes, 2);
+
+	// A single byte without the increment flag
+	TEST_EQUAL(L3G4200D_Write(&L3G4200D_I2cBus, value, L3G4200D_FIFO_CTRL_REG_ADDR, 1), 1);
+	TEST_EQUAL(test_gyro.command, L3G4200D_FIFO_CTRL_REG_ADDR);
+	TEST_EQUAL(test_gyro.reg[L3G4200D_FIFO_CTRL_REG_ADDR], 0x0F);
+	TEST_EQUAL(test_gyro.reg[L3G4200D_FIFO_CTRL_REG_ADDR + 1], 0x00);
+	TEST_EQUAL(sensors_i2c_transfers, 2);
+	TEST_CHECK(!sensors_i2c_busy());
+}
+
+/**
+ * @brief  An address nobody acknowledges fails from the error interrupt; the bus is recovered
+ *         and the transfer repeated before it ends with an error, a device which fails again
+ *         and again is degraded. The next transfer to another device runs normally.
+ * @param  None
+ * @retval None
+ */
+static void test_nack(void) {
+	static Sensors_Transfer transfer;
+	static u8 tx[1] = { L3G4200D_WHO_AM_I_ADDR }, rx[2];
+	u8 i;
+
+	_test_setup();
+	transfer.device = &test_nobody;
+	transfer.tx = tx;
+	transfer.rx = rx;
+	transfer.length = 2;
+	transfer.callback = _test_callback;
+	TEST_EQUAL(sensors_i2c_start(&transfer), 1);
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_ERROR);
+	TEST_EQUAL(test_callbacks, 1);
+	TEST_EQUAL(test_nobody_health.errors, 1 + SENSORS_I2C_RETRIES);
+	TEST_EQUAL(test_nobody_health.retries, SENSORS_I2C_RETRIES);
+	TEST_EQUAL(test_nobody_health.recoveries, 1 + SENSORS_I2C_RETRIES);
+	TEST_EQUAL(test_nobody_health.timeouts, 0);
+	TEST_EQUAL(test_nobody_health.failures, 1);
+	TEST_EQUAL(test_nobody_health.degraded, 0);
+	TEST_EQUAL(sensors_i2c_errors, 1);
+	TEST_EQUAL(sensors_i2c_recoveries, 1 + SENSORS_I2C_RETRIES);
+	TEST_EQUAL(I2C1->SR1 & I2C_SR1_AF, 0);
+	TEST_EQUAL(I2C1->CR1 & I2C_CR1_STOP, 0);
+	TEST_EQUAL(test_gyro.starts, 0);
+	TEST_CHECK(!sensors_i2c_busy());
+
+	for (i = 1; i < SENSORS_BUS_DEGRADED_FAILURES; i++) {
+		TEST_EQUAL(sensors_i2c_start(&transfer), 1);
+		_test_clock();
+	}
+	TEST_EQUAL(test_nobody_health.failures, SENSORS_BUS_DEGRADED_FAILURES);
+	TEST_EQUAL(test_nobody_health.degraded, 1);
+
+	transfer.device = &L3G4200D_I2cDevice;
+	TEST_EQUAL(sensors_i2c_start(&transfer), 1);
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_DONE);
+	TEST_EQUAL(rx[1], 0xD3);
+	TEST_EQUAL(sensors_i2c_errors, SENSORS_BUS_DEGRADED_FAILURES);
+	TEST_EQUAL(L3G4200D_Health.errors, 0);
+	TEST_EQUAL(L3G4200D_Health.failures, 0);
+}
+
+/**
+ * @brief  A slave which stretches SCL forever hangs the transfer; the check takes it down after
+ *         its timeout, recovers the bus and repeats it. After all retries it fails and the
+ *         transfer queued behind it starts.
+ * @param  None
+ * @retval None
+ */
+static void test_timeout(void) {
+	static Sensors_Transfer first, second;
+	static u8 a[1 + L3G4200D_SAMPLE_SIZE], b[2];
+	u8 i;
+
+	_test_setup();
+	for (i = 0; i < L3G4200D_SAMPLE_SIZE; i++) {
+		test_gyro.reg[L3G4200D_OUT_X_L_ADDR + i] = 0x20 + i;
+	}
+	test_gyro.mute = 1;
+	TEST_EQUAL(L3G4200D_ReadAsync(&L3G4200D_I2cBus, &first, a, L3G4200D_OUT_X_L_ADDR, L3G4200D_SAMPLE_SIZE, _test_callback), 1);
+	_test_clock();
+	TEST_EQUAL(first.status, SENSORS_BUS_BUSY);
+	TEST_EQUAL(test_gyro.starts, 1);
+
+	// Not yet overdue
+	test_time += SENSORS_I2C_TIMEOUT(1 + L3G4200D_SAMPLE_SIZE);
+	TEST_EQUAL(sensors_i2c_check(), 0);
+	TEST_EQUAL(first.status, SENSORS_BUS_BUSY);
+
+	// The recovery resets the slave, the repeated transfer starts with the write address again
+	test_time++;
+	test_gyro.mute = 0;
+	TEST_EQUAL(sensors_i2c_check(), 1);
+	TEST_EQUAL(first.status, SENSORS_BUS_BUSY);
+	TEST_EQUAL(L3G4200D_Health.timeouts, 1);
+	TEST_EQUAL(L3G4200D_Health.retries, 1);
+	TEST_EQUAL(L3G4200D_Health.recoveries, 1);
+	TEST_EQUAL(sensors_i2c_recoveries, 1);
+	TEST_EQUAL(DMA1_Stream0->CR & DMA_SxCR_EN, 0);
+	TEST_CHECK(I2C1->CR1 & I2C_CR1_PE);
+	TEST_CHECK(I2C1->CR1 & I2C_CR1_START);
+	TEST_EQUAL(I2C1->CR1 & I2C_CR1_SWRST, 0);
+
+	// The timeout of the repeated transfer counts from its own start
+	TEST_EQUAL(sensors_i2c_check(), 0);
+	_test_clock();
+	TEST_EQUAL(first.status, SENSORS_BUS_DONE);
+	for (i = 0; i < L3G4200D_SAMPLE_SIZE; i++) {
+		TEST_EQUAL(a[1 + i], 0x20 + i);
+	}
+	TEST_EQUAL(test_gyro.starts, 1 + 2);
+	TEST_EQUAL(test_callbacks, 1);
+	TEST_EQUAL(L3G4200D_Health.failures, 0);
+	TEST_EQUAL(sensors_i2c_errors, 0);
+
+	// A slave which never lets go fails after SENSORS_I2C_RETRIES repetitions
+	test_gyro.mute = 1;
+	TEST_EQUAL(L3G4200D_ReadAsync(&L3G4200D_I2cBus, &first, a, L3G4200D_OUT_X_L_ADDR, L3G4200D_SAMPLE_SIZE, _test_callback), 1);
+	TEST_EQUAL(L3G4200D_ReadAsync(&L3G4200D_I2cBus, &second, b, L3G4200D_WHO_AM_I_ADDR, 1, _test_callback), 1);
+	TEST_EQUAL(second.status, SENSORS_BUS_QUEUED);
+	_test_clock();
+	while (first.status == SENSORS_BUS_BUSY) {
+		test_time += SENSORS_I2C_TIMEOUT(1 + L3G4200D_SAMPLE_SIZE) + 1;
+		sensors_i2c_check();
+		_test_clock();
+	}
+	TEST_EQUAL(first.status, SENSORS_BUS_ERROR);
+	TEST_EQUAL(L3G4200D_Health.timeouts, 1 + SENSORS_I2C_RETRIES + 1);
+	TEST_EQUAL(L3G4200D_Health.failures, 1);
+	TEST_EQUAL(sensors_i2c_errors, 1);
+	TEST_EQUAL(test_callbacks, 2);
+
+	// The failure started the queued transfer
+	TEST_EQUAL(second.status, SENSORS_BUS_BUSY);
+	test_gyro.mute = 0;
+	_test_clock();
+	TEST_EQUAL(second.status, SENSORS_BUS_DONE);
+	TEST_EQUAL(b[1], 0xD3);
+	TEST_EQUAL(test_callbacks, 3);
+	TEST_CHECK(!sensors_i2c_busy());
+
+	// The blocking wait gives up after its polls without a retry
+	test_gyro.mute = 1;
+	TEST_EQUAL(L3G4200D_ReadAsync(&L3G4200D_I2cBus, &first, a, L3G4200D_WHO_AM_I_ADDR, 1, 0), 1);
+	_test_clock();
+	TEST_EQUAL(sensors_i2c_wait(&first, 10), SENSORS_BUS_ERROR);
+	TEST_EQUAL(L3G4200D_Health.retries, 1 + SENSORS_I2C_RETRIES);
+	TEST_EQUAL(L3G4200D_Health.failures, 2);
+	TEST_CHECK(!sensors_i2c_busy());
+}
+
+/**
+ * @brief  A slave which still holds SDA from before, e.g. after a reset of the controller in the
+ *         middle of a byte, leaves the bus busy; the next start recovers it first
+ * @param  None
+ * @retval None
+ */
+static void test_stuck(void) {
+	static Sensors_Transfer transfer;
+	static u8 buffer[2];
+
+	_test_setup();
+	I2C1->SR2 |= I2C_SR2_BUSY;
+	GPIOB->IDR = 0;
+	TEST_EQUAL(L3G4200D_ReadAsync(&L3G4200D_I2cBus, &transfer, buffer, L3G4200D_WHO_AM_I_ADDR, 1, 0), 1);
+	TEST_EQUAL(sensors_i2c_recoveries, 1);
+
+	// Both lines are back at the I2C and the start follows the recovery
+	TEST_EQUAL(GPIOB->MODER & (GPIO_MODER_MODER6 | GPIO_MODER_MODER9), GPIO_MODER_MODER6_1 | GPIO_MODER_MODER9_1);
+	TEST_CHECK(I2C1->CR1 & I2C_CR1_PE);
+	TEST_CHECK(I2C1->CR1 & I2C_CR1_START);
+	I2C1->SR2 &= ~I2C_SR2_BUSY;
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_DONE);
+	TEST_EQUAL(buffer[1], 0xD3);
+	TEST_EQUAL(sensors_i2c_errors, 0);
+}
@@ -0,0 +1,309 @@
+/** @file    test_sensors_spi.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the SPI DMA transfer engine and the LIS302DL transfers on it,
+ *           run against the SPI slave model behind the DMA2 streams
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "sensors.h"
+#include "sensors_spi.h"
+#include "spi.h"
+#include "dma.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+// The DMA addresses are 32 bit, so all transfers and their buffers are static
+static Host_SpiDevice test_accel;
+static u32 test_time = 0;
+
+// Transfers in the order their callbacks ran
+static Sensors_Transfer* test_finished[4];
+static u8 test_callbacks = 0;
+
+u32 sensors_time_now() {
+	return test_time;
+}
+
+static void _test_setup(void);
+static void _test_clock(void);
+static void _test_callback(Sensors_Transfer* transfer);
+static void test_init(void);
+static void test_async(void);
+static void test_queue(void);
+static void test_blocking(void);
+static void test_timeout(void);
+static void test_dma_error(void);
+
+
+/**** Public implementations ****/
+
+int main(void) {
+	test_init();
+	test_async();
+	test_queue();
+	test_blocking();
+	test_timeout();
+	test_dma_error();
+	return test_report("sensors_spi");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Fresh registers, the SPI engine and a LIS302DL on PE3 which answers its WHO_AM_I
+ * @param  None
+ * @retval None
+ */
+static void _test_setup(void) {
+	host_reset();
+	memset(&test_accel, 0, sizeof(test_accel));
+	test_accel.csPort = GPIOE;
+	test_accel.csPin = GPIO_Pin_3;
+	test_accel.reg[LIS302DL_WHO_AM_I_ADDR] = 0x3B;
+	host_spi_attach(&test_accel);
+	memset(&LIS302DL_Health, 0, sizeof(LIS302DL_Health));
+	LIS302DL_InvalidateShadow();
+	test_callbacks = 0;
+	test_time = 0;
+
+	sensors_spi_init();
+	sensors_spi_device_init(&LIS302DL_Device);
+}
+
+/**
+ * @brief  Run the bus until all transfers are done
+ * @param  None
+ * @retval None
+ */
+static void _test_clock(void) {
+	host_spi_run(SENSORS_SPI_DMA_TX_STREAM, SENSORS_SPI_DMA_RX_STREAM, DMA2_Stream0_IRQHandler);
+}
+
+/**
+ * @brief  Remember the finished transfer
+ * @param  transfer  The transfer
+ * @retval None
+ */
+static void _test_callback(Sensors_Transfer* transfer) {
+	if (test_callbacks < 4) {
+		test_finished[test_callbacks] = transfer;
+	}
+	test_callbacks++;
+}
+
+/**
+ * @brief  SPI1 is a master which requests both DMA streams for its data register, the RX
+ *         stream ends a transfer with its interrupt; the chip is deselected
+ * @param  None
+ * @retval None
+ */
+static void test_init(void) {
+	_test_setup();
+
+	TEST_CHECK(SPI1->CR1 & SPI_CR1_MSTR);
+	TEST_CHECK(SPI1->CR1 & SPI_CR1_SPE);
+	TEST_EQUAL(SPI1->CR2 & (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN), SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+	TEST_EQUAL(DMA2_Stream0->PAR, (u32)&SPI1->DR);
+	TEST_EQUAL(DMA2_Stream5->PAR, (u32)&SPI1->DR);
+	TEST_EQUAL(DMA2_Stream0->CR & DMA_SxCR_CHSEL, DMA_Channel_3);
+	TEST_EQUAL(DMA2_Stream5->CR & DMA_SxCR_CHSEL, DMA_Channel_3);
+	TEST_EQUAL(DMA2_Stream0->CR & (DMA_SxCR_TCIE | DMA_SxCR_TEIE), DMA_SxCR_TCIE | DMA_SxCR_TEIE);
+	TEST_EQUAL(DMA2_Stream0->CR & DMA_SxCR_EN, 0);
+	TEST_EQUAL(GPIOE->BSRRL, GPIO_Pin_3);
+	TEST_CHECK(!sensors_spi_busy());
+}
+
+/**
+ * @brief  A read returns at once with the chip selected and both streams running; the
+ *         answer is in the buffer when the RX interrupt calls back
+ * @param  None
+ * @retval None
+ */
+static void test_async(void) {
+	static Sensors_Transfer transfer;
+	static u8 buffer[3];
+
+	_test_setup();
+	TEST_EQUAL(LIS302DL_ReadAsync(SPI1, &transfer, buffer, LIS302DL_WHO_AM_I_ADDR, 1, _test_callback), 1);
+	TEST_EQUAL(transfer.status, SENSORS_BUS_BUSY);
+	TEST_CHECK(sensors_spi_busy());
+	TEST_EQUAL(DMA2_Stream0->NDTR, 2);
+	TEST_EQUAL(DMA2_Stream5->NDTR, 2);
+	TEST_CHECK(DMA2_Stream0->CR & DMA2_Stream5->CR & DMA_SxCR_EN);
+
+	// Starting it again while it runs is refused
+	TEST_EQUAL(sensors_spi_start(&transfer), 0);
+	TEST_EQUAL(test_callbacks, 0);
+
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_DONE);
+	TEST_EQUAL(test_callbacks, 1);
+	TEST_EQUAL(buffer[0], 0xFF);
+	TEST_EQUAL(buffer[1], 0x3B);
+	TEST_EQUAL(test_accel.command, LIS302DL_WHO_AM_I_ADDR | HOST_SPI_READ);
+	TEST_EQUAL(test_accel.selects, 1);
+	TEST_EQUAL(test_accel.selected, 0);
+	TEST_EQUAL(sensors_spi_transfers, 1);
+	TEST_CHECK(!sensors_spi_busy());
+
+	// A write without rx buffer drops the answer, the address increments over the burst
+	buffer[1] = 0x47;
+	buffer[2] = 0x20;
+	TEST_EQUAL(LIS302DL_WriteAsync(SPI1, &transfer, buffer, LIS302DL_CTRL_REG1_ADDR, 2, 0), 1);
+	TEST_EQUAL(DMA2_Stream0->CR & DMA_SxCR_MINC, 0);
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_DONE);
+	TEST_EQUAL(test_accel.command, LIS302DL_CTRL_REG1_ADDR | HOST_SPI_INCREMENT);
+	TEST_EQUAL(test_accel.reg[LIS302DL_CTRL_REG1_ADDR], 0x47);
+	TEST_EQUAL(test_accel.reg[LIS302DL_CTRL_REG1_ADDR + 1], 0x20);
+	TEST_EQUAL(test_callbacks, 1);
+}
+
+/**
+ * @brief  Transfers started while the bus runs wait in the queue and follow one after the
+ *         other from the interrupt, each with its own select
+ * @param  None
+ * @retval None
+ */
+static void test_queue(void) {
+	static Sensors_Transfer first, second, third;
+	static u8 a[2], b[8], c[2];
+	u32 queued = sensors_spi_queued;
+
+	_test_setup();
+	test_accel.reg[LIS302DL_STATUS_REG_ADDR] = 0x0F;
+	test_accel.reg[LIS302DL_OUT_X_ADDR] = 0x12;
+	TEST_EQUAL(LIS302DL_ReadAsync(SPI1, &first, a, LIS302DL_WHO_AM_I_ADDR, 1, _test_callback), 1);
+	TEST_EQUAL(LIS302DL_ReadSampleAsync(SPI1, &second, b, _test_callback), 1);
+	TEST_EQUAL(LIS302DL_ReadAsync(SPI1, &third, c, LIS302DL_WHO_AM_I_ADDR, 1, _test_callback), 1);
+	TEST_EQUAL(second.status, SENSORS_BUS_QUEUED);
+	TEST_EQUAL(third.status, SENSORS_BUS_QUEUED);
+	TEST_EQUAL(sensors_spi_queued, queued + 2);
+
+	_test_clock();
+	TEST_EQUAL(test_callbacks, 3);
+	TEST_CHECK(test_finished[0] == &first);
+	TEST_CHECK(test_finished[1] == &second);
+	TEST_CHECK(test_finished[2] == &third);
+	TEST_EQUAL(a[1], 0x3B);
+	TEST_EQUAL(b[1], 0x0F);
+	TEST_EQUAL(b[3], 0x12);
+	TEST_EQUAL(c[1], 0x3B);
+	TEST_EQUAL(test_accel.selects, 3);
+	TEST_EQUAL(test_accel.bytes, 2 + 8 + 2);
+	TEST_CHECK(!sensors_spi_busy());
+}
+
+/**
+ * @brief  The blocking calls are a thin wrapper: they start a transfer and wait while the
+ *         DMA interrupt runs whenever the interrupts are enabled
+ * @param  None
+ * @retval None
+ */
+static void test_blocking(void) {
+	u8 value[3] = { 0x11, 0x22, 0x33 }, read[3];
+
+	_test_setup();
+	host_interrupt = _test_clock;
+
+	TEST_EQUAL(LIS302DL_Write(SPI1, value, 0x30, 3), SENSORS_BUS_DONE);
+	TEST_EQUAL(test_accel.reg[0x32], 0x33);
+	TEST_EQUAL(LIS302DL_Read(SPI1, read, 0x30, 3), SENSORS_BUS_DONE);
+	TEST_CHECK(!memcmp(read, value, 3));
+	TEST_EQUAL(LIS302DL_ReadRegister(SPI1, LIS302DL_WHO_AM_I_ADDR), 0x3B);
+	TEST_EQUAL(test_accel.selects, 3);
+	TEST_EQUAL(LIS302DL_Health.errors, 0);
+}
+
+/**
+ * @brief  A transfer which hangs is taken down by the check after its timeout, the bus is
+ *         reset and the transfer repeated; after all retries it fails
+ * @param  None
+ * @retval None
+ */
+static void test_timeout(void) {
+	static Sensors_Transfer transfer;
+	static u8 buffer[3];
+	u32 errors = sensors_spi_errors;
+
+	_test_setup();
+	TEST_EQUAL(LIS302DL_ReadAsync(SPI1, &transfer, buffer, LIS302DL_WHO_AM_I_ADDR, 1, _test_callback), 1);
+	test_accel.mute = 1;
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_BUSY);
+
+	// Not yet overdue
+	test_time += SENSORS_SPI_TIMEOUT(2);
+	TEST_EQUAL(sensors_spi_check(), 0);
+
+	// The repeated command starts with a new select and the address byte again
+	test_time++;
+	TEST_EQUAL(sensors_spi_check(), 1);
+	TEST_EQUAL(LIS302DL_Health.timeouts, 1);
+	TEST_EQUAL(LIS302DL_Health.retries, 1);
+	TEST_EQUAL(LIS302DL_Health.recoveries, 1);
+	TEST_EQUAL(transfer.status, SENSORS_BUS_BUSY);
+	test_accel.mute = 0;
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_DONE);
+	TEST_EQUAL(buffer[1], 0x3B);
+	TEST_EQUAL(test_accel.selects, 2);
+
+	// A device which never answers fails after SENSORS_SPI_RETRIES repetitions
+	TEST_EQUAL(LIS302DL_ReadAsync(SPI1, &transfer, buffer, LIS302DL_WHO_AM_I_ADDR, 1, _test_callback), 1);
+	test_accel.mute = 1;
+	_test_clock();
+	while (transfer.status == SENSORS_BUS_BUSY) {
+		test_time += SENSORS_SPI_TIMEOUT(2) + 1;
+		sensors_spi_check();
+		_test_clock();
+	}
+	TEST_EQUAL(transfer.status, SENSORS_BUS_ERROR);
+	TEST_EQUAL(LIS302DL_Health.timeouts, 1 + SENSORS_SPI_RETRIES + 1);
+	TEST_EQUAL(LIS302DL_Health.failures, 1);
+	TEST_EQUAL(sensors_spi_errors, errors + 1);
+	TEST_EQUAL(test_callbacks, 2);
+	TEST_CHECK(!sensors_spi_busy());
+	TEST_EQUAL(test_accel.selected, 0);
+}
+
+/**
+ * @brief  A DMA transfer error repeats the transfer at once
+ * @param  None
+ * @retval None
+ */
+static void test_dma_error(void) {
+	static Sensors_Transfer transfer;
+	static u8 buffer[3];
+
+	_test_setup();
+	TEST_EQUAL(LIS302DL_ReadAsync(SPI1, &transfer, buffer, LIS302DL_WHO_AM_I_ADDR, 1, 0), 1);
+	host_dma_raise(SENSORS_SPI_DMA_RX_STREAM, HOST_DMA_TEIF);
+	TEST_EQUAL(host_dma_interrupt(SENSORS_SPI_DMA_RX_STREAM, DMA2_Stream0_IRQHandler), 1);
+	TEST_EQUAL(LIS302DL_Health.errors, 1);
+	TEST_EQUAL(LIS302DL_Health.timeouts, 0);
+	TEST_EQUAL(LIS302DL_Health.retries, 1);
+	TEST_EQUAL(transfer.status, SENSORS_BUS_BUSY);
+	_test_clock();
+	TEST_EQUAL(transfer.status, SENSORS_BUS_DONE);
+	TEST_EQUAL(buffer[1], 0x3B);
+}
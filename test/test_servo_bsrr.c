@@ -0,0 +1,187 @@
+/** @file    test_servo_bsrr.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the BSRR servo waveform: pulse widths of the built waveforms
+ *           and their output through TIM3 and DMA2 Stream3
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "servo.h"
+#include "dma.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+static void _test_widths(const u32* wave, u16 steps, u16* width);
+static void test_build(void);
+static void test_rebuild(void);
+static void test_output(void);
+
+
+/**** Public implementations ****/
+
+int main(void) {
+	test_build();
+	test_rebuild();
+	test_output();
+	return test_report("servo_bsrr");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Write a waveform into a port like the DMA does and measure how long every pin is high
+ *         A word sets the pins in its low half and resets those in its high half, set wins.
+ * @param  wave  The BSRR words
+ * @param  steps  Number of words
+ * @param  width  Receives the high time of all 16 pins in steps
+ * @retval None
+ */
+static void _test_widths(const u32* wave, u16 steps, u16* width) {
+	u16 port = 0, step;
+	u8 pin;
+
+	memset(width, 0, 16 * sizeof(u16));
+	for (step = 0; step < steps; step++) {
+		port = (port & ~(wave[step] >> 16)) | (wave[step] & 0xFFFF);
+		for (pin = 0; pin < 16; pin++) {
+			width[pin] += (port >> pin) & 1;
+		}
+	}
+	// All pulses ended before the frame does
+	TEST_EQUAL(port, 0);
+}
+
+/**
+ * @brief  A waveform built from zero has one pulse per servo on its own pin with the given
+ *         width; 0 and too long widths are limited to the waveform
+ * @param  None
+ * @retval None
+ */
+static void test_build(void) {
+	static u32 wave[SERVO_BSRR_STEPS];
+	const u16 width[SERVO_CHANNELS] = { 1000, 1500, 2000, 1001, 0, 5000 };
+	u16 old[SERVO_CHANNELS] = { 0 }, measured[16];
+
+	servo_bsrr_build(wave, old, width, SERVO_CHANNELS, 2);
+	_test_widths(wave, SERVO_BSRR_STEPS, measured);
+	TEST_EQUAL(measured[0], 0);
+	TEST_EQUAL(measured[1], 0);
+	TEST_EQUAL(measured[2], 1000);
+	TEST_EQUAL(measured[3], 1500);
+	TEST_EQUAL(measured[4], 2000);
+	TEST_EQUAL(measured[5], 1001);
+	TEST_EQUAL(measured[6], 1);
+	TEST_EQUAL(measured[7], SERVO_BSRR_STEPS - 1);
+	TEST_EQUAL(measured[8], 0);
+	TEST_EQUAL(old[4], 1);
+	TEST_EQUAL(old[5], SERVO_BSRR_STEPS - 1);
+
+	// Only step 0 and the pulse ends are written
+	TEST_EQUAL(wave[0], 0xFC);
+	TEST_EQUAL(wave[1000], (1UL << 2) << 16);
+	TEST_EQUAL(wave[1001], (1UL << 5) << 16);
+	TEST_EQUAL(wave[999], 0);
+}
+
+/**
+ * @brief  Moving the pulse ends gives the same waveform as building it from zero, also when
+ *         two servos share a step
+ * @param  None
+ * @retval None
+ */
+static void test_rebuild(void) {
+	static u32 wave[SERVO_BSRR_STEPS], fresh[SERVO_BSRR_STEPS];
+	const u16 first[SERVO_CHANNELS] = { 1000, 1200, 1400, 1600, 1800, 2000 };
+	const u16 second[SERVO_CHANNELS] = { 2000, 1200, 1000, 1000, 1999, 1 };
+	u16 old[SERVO_CHANNELS] = { 0 }, built[SERVO_CHANNELS] = { 0 }, measured[16];
+	u8 i;
+
+	servo_bsrr_build(wave, old, first, SERVO_CHANNELS, 0);
+	servo_bsrr_build(wave, old, second, SERVO_CHANNELS, 0);
+	servo_bsrr_build(fresh, built, second, SERVO_CHANNELS, 0);
+	TEST_CHECK(!memcmp(wave, fresh, sizeof(wave)));
+	TEST_CHECK(!memcmp(old, second, sizeof(old)));
+
+	_test_widths(wave, SERVO_BSRR_STEPS, measured);
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		TEST_EQUAL(measured[i], second[i]);
+	}
+}
+
+/**
+ * @brief  The frame start restarts the DMA with the waveform of the last write; the port gets
+ *         pulses of 1-2ms on SERVO_BSRR_PINS only
+ * @param  None
+ * @retval None
+ */
+static void test_output(void) {
+	const u16 positions[SERVO_CHANNELS] = { 0, 200, 400, 600, 800, SERVO_POSITION_MAX };
+	const u16 partial[3] = { 100, 300, 500 };
+	static u32 wave[SERVO_BSRR_STEPS];
+	u16 measured[16], steps;
+	u32 skipped;
+	u8 i;
+
+	host_reset();
+	servo_init();
+	TEST_EQUAL(DMA2_Stream3->PAR, (u32)&GPIOD->BSRRL);
+	TEST_EQUAL(TIM3->ARR, 1000000 / SERVO_BSRR_RATE - 1);
+
+	// The write goes out from the next frame start on and is repeated by every frame
+	servo_commit(positions);
+	for (i = 0; i < 2; i++) {
+		TIM3->SR = TIM_SR_UIF;
+		TIM3_IRQHandler();
+		for (steps = 0; host_dma_send(DMA2_Stream3, &wave[steps]); steps++);
+		TEST_EQUAL(steps, SERVO_BSRR_STEPS);
+	}
+	_test_widths(wave, SERVO_BSRR_STEPS, measured);
+	for (i = 0; i < SERVO_CHANNELS; i++) {
+		TEST_EQUAL(measured[i], (SERVO_PULSE_MIN + positions[i]) / SERVO_BSRR_RESOLUTION);
+	}
+	TEST_EQUAL(measured[SERVO_CHANNELS], 0);
+
+	// A second write before the frame start replaces the first one
+	skipped = servo_commit_skipped;
+	servo_set_pos(0, SERVO_POSITION_MAX);
+	servo_set_pos(1, 0);
+	TEST_EQUAL(servo_commit_skipped, skipped + 1);
+	TIM3->SR = TIM_SR_UIF;
+	TIM3_IRQHandler();
+	for (steps = 0; host_dma_send(DMA2_Stream3, &wave[steps]); steps++);
+	_test_widths(wave, SERVO_BSRR_STEPS, measured);
+	TEST_EQUAL(measured[0], SERVO_PULSE_MAX / SERVO_BSRR_RESOLUTION);
+	TEST_EQUAL(measured[1], SERVO_PULSE_MIN / SERVO_BSRR_RESOLUTION);
+	TEST_EQUAL(measured[2], (SERVO_PULSE_MIN + positions[2]) / SERVO_BSRR_RESOLUTION);
+
+	// A write from a later servo on takes its positions from the start of the array,
+	// the servos behind the last one are left out
+	servo_bsrr_write(SERVO_CHANNELS - 2, 3, partial);
+	TIM3->SR = TIM_SR_UIF;
+	TIM3_IRQHandler();
+	for (steps = 0; host_dma_send(DMA2_Stream3, &wave[steps]); steps++);
+	_test_widths(wave, SERVO_BSRR_STEPS, measured);
+	TEST_EQUAL(measured[0], SERVO_PULSE_MAX / SERVO_BSRR_RESOLUTION);
+	TEST_EQUAL(measured[SERVO_CHANNELS - 3], (SERVO_PULSE_MIN + positions[SERVO_CHANNELS - 3]) / SERVO_BSRR_RESOLUTION);
+	TEST_EQUAL(measured[SERVO_CHANNELS - 2], (SERVO_PULSE_MIN + partial[0]) / SERVO_BSRR_RESOLUTION);
+	TEST_EQUAL(measured[SERVO_CHANNELS - 1], (SERVO_PULSE_MIN + partial[1]) / SERVO_BSRR_RESOLUTION);
+	TEST_EQUAL(measured[SERVO_CHANNELS], 0);
+}
@@ -0,0 +1,238 @@
+/** @file    test_servo_dshot.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the DShot output: bit exact frames, the burst DMA buffer and
+ *           the command gating
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "servo.h"
+#include "receiver.h"
+#include "dma.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+static u32 test_now;
+
+static u16 _test_sent(u16* frames, u16* values);
+static void test_frame(void);
+static void test_encode(void);
+static void test_registers(void);
+static void test_burst(void);
+static void test_command(void);
+
+
+/**** Public implementations ****/
+
+u32 receiver_now() {
+	return test_now += 100;
+}
+
+int main(void) {
+	test_frame();
+	test_encode();
+	test_registers();
+	test_burst();
+	test_command();
+	return test_report("servo_dshot");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Pull the whole burst out of the output DMA stream and decode the frames of all
+ *         motors from the compare values
+ * @param  frames  Receives the frames, 0xFFFF if a compare value is neither a one nor a zero
+ * @param  values  Receives the SERVO_DSHOT_BUFFER compare values, NULL if not needed
+ * @retval u16 Number of values sent
+ */
+static u16 _test_sent(u16* frames, u16* values) {
+	u16 burst[SERVO_DSHOT_BUFFER];
+	u16 count, i;
+	u32 value;
+	u8 motor;
+
+	memset(burst, 0xFF, sizeof(burst));
+	for (count = 0; (count < SERVO_DSHOT_BUFFER) && host_dma_send(SERVO_DSHOT_DMA_STREAM, &value); count++) {
+		burst[count] = value;
+	}
+	if (values) {
+		memcpy(values, burst, sizeof(burst));
+	}
+	for (motor = 0; motor < SERVO_CHANNELS; motor++) {
+		frames[motor] = 0;
+		for (i = 0; i < SERVO_DSHOT_FRAME_BITS; i++) {
+			value = burst[i * SERVO_CHANNELS + motor];
+			if ((value != SERVO_DSHOT_BIT_ONE) && (value != SERVO_DSHOT_BIT_ZERO)) {
+				frames[motor] = 0xFFFF;
+				break;
+			}
+			frames[motor] = (frames[motor] << 1) | (value == SERVO_DSHOT_BIT_ONE);
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief  Frames with the checksums worked out by hand: 1046 without telemetry is
+ *         10000010110 0 0110
+ * @param  None
+ * @retval None
+ */
+static void test_frame(void) {
+	TEST_EQUAL(servo_dshot_frame(1046, 0), 0x82C6);
+	TEST_EQUAL(servo_dshot_frame(1046, 1), 0x82D7);
+	TEST_EQUAL(servo_dshot_frame(0, 0), 0x0000);
+	TEST_EQUAL(servo_dshot_frame(48, 0), 0x0606);
+	TEST_EQUAL(servo_dshot_frame(2047, 0), 0xFFEE);
+	TEST_EQUAL(servo_dshot_frame(2047, 1), 0xFFFF);
+	TEST_EQUAL(servo_dshot_frame(SERVO_DSHOT_CMD_SPIN_DIRECTION_1, 1), 0x00FF);
+	TEST_EQUAL(servo_dshot_frame(5000, 0), servo_dshot_frame(2047, 0));
+}
+
+/**
+ * @brief  The most significant bit comes first, the bits of a motor are stride apart
+ * @param  None
+ * @retval None
+ */
+static void test_encode(void) {
+	u16 buffer[SERVO_DSHOT_FRAME_BITS * 3 + 1];
+	u8 i;
+
+	memset(buffer, 0, sizeof(buffer));
+	servo_dshot_encode(&buffer[1], 3, 0x82C6, 7, 3);
+	for (i = 0; i < SERVO_DSHOT_FRAME_BITS; i++) {
+		TEST_EQUAL(buffer[1 + 3 * i], ((0x82C6 << i) & 0x8000) ? 7 : 3);
+		TEST_EQUAL(buffer[2 + 3 * i], 0);
+	}
+	TEST_EQUAL(buffer[0], 0);
+	TEST_EQUAL(SERVO_DSHOT_BIT_PERIOD, 140);
+	TEST_EQUAL(SERVO_DSHOT_BIT_ONE, 105);
+	TEST_EQUAL(SERVO_DSHOT_BIT_ZERO, 52);
+}
+
+/**
+ * @brief  TIM3 runs one period per bit without prescaler, its update event requests a burst
+ *         of four transfers into CCR1-CCR4 through DMAR
+ * @param  None
+ * @retval None
+ */
+static void test_registers(void) {
+	host_reset();
+	servo_init();
+
+	TEST_EQUAL(TIM3->PSC, 0);
+	TEST_EQUAL(TIM3->ARR, SERVO_DSHOT_BIT_PERIOD - 1);
+	TEST_EQUAL(TIM3->DCR, TIM_DMABase_CCR1 | TIM_DMABurstLength_4Transfers);
+	TEST_CHECK(TIM3->DIER & TIM_DIER_UDE);
+	TEST_CHECK(TIM3->CR1 & TIM_CR1_CEN);
+	TEST_EQUAL(SERVO_DSHOT_DMA_STREAM->PAR, (u32)&TIM3->DMAR);
+	TEST_EQUAL(SERVO_DSHOT_DMA_STREAM->CR & DMA_SxCR_DIR, DMA_DIR_MemoryToPeripheral);
+	TEST_EQUAL(SERVO_DSHOT_DMA_STREAM->CR & DMA_SxCR_CHSEL, SERVO_DSHOT_DMA_CHANNEL);
+	TEST_EQUAL(SERVO_DSHOT_DMA_STREAM->CR & DMA_SxCR_EN, 0);
+}
+
+/**
+ * @brief  A write starts the burst with the interleaved frames of all motors and two zero
+ *         slots at the end; a write while the burst still runs is skipped
+ * @param  None
+ * @retval None
+ */
+static void test_burst(void) {
+	const u16 positions[SERVO_CHANNELS] = { 0, 1, 999, SERVO_POSITION_MAX };
+	u16 values[SERVO_DSHOT_BUFFER], frames[SERVO_CHANNELS];
+	u32 skipped = servo_dshot_skipped;
+	u8 i;
+
+	servo_commit(positions);
+	TEST_EQUAL(SERVO_DSHOT_DMA_STREAM->NDTR, SERVO_DSHOT_BUFFER);
+	TEST_CHECK(SERVO_DSHOT_DMA_STREAM->CR & DMA_SxCR_EN);
+	TEST_EQUAL(servo_dshot_encode_cycles, 100);
+
+	// Skipped while the DMA is busy
+	servo_commit(positions);
+	TEST_EQUAL(servo_dshot_skipped, skipped + 1);
+
+	TEST_EQUAL(_test_sent(frames, values), SERVO_DSHOT_BUFFER);
+	TEST_EQUAL(frames[0], 0x0000);
+	TEST_EQUAL(frames[1], 0x0606);
+	TEST_EQUAL(frames[2], 0x82C6);
+	TEST_EQUAL(frames[3], 0xFFEE);
+	for (i = 0; i < 2 * SERVO_CHANNELS; i++) {
+		TEST_EQUAL(values[SERVO_DSHOT_FRAME_BITS * SERVO_CHANNELS + i], 0);
+	}
+
+	// The stream stopped after the burst, so the next write is sent
+	TEST_EQUAL(SERVO_DSHOT_DMA_STREAM->CR & DMA_SxCR_EN, 0);
+	servo_commit(positions);
+	TEST_EQUAL(servo_dshot_skipped, skipped + 1);
+	TEST_EQUAL(_test_sent(frames, NULL), SERVO_DSHOT_BUFFER);
+	TEST_EQUAL(frames[2], 0x82C6);
+}
+
+/**
+ * @brief  Commands are only taken while the motor is stopped, settings are repeated and
+ *         a throttle cancels a pending command
+ * @param  None
+ * @retval None
+ */
+static void test_command(void) {
+	u16 positions[SERVO_CHANNELS] = { 500, 0, 0, 0 };
+	u16 frames[SERVO_CHANNELS];
+	u8 i;
+
+	// The last frame of motor 0 was a throttle
+	servo_commit(positions);
+	_test_sent(frames, NULL);
+	TEST_EQUAL(servo_dshot_command(0, SERVO_DSHOT_CMD_BEEP1), 0);
+	TEST_EQUAL(servo_dshot_command(SERVO_CHANNELS, SERVO_DSHOT_CMD_BEEP1), 0);
+	TEST_EQUAL(servo_dshot_command(1, SERVO_DSHOT_CMD_MAX + 1), 0);
+	servo_commit(positions);
+	_test_sent(frames, NULL);
+	TEST_EQUAL(frames[0], servo_dshot_frame(SERVO_DSHOT_THROTTLE_MIN - 1 + 500, 0));
+	TEST_EQUAL(frames[1], 0x0000);
+
+	// Stopped: a beep is sent once, a setting SERVO_DSHOT_CMD_REPEAT times
+	positions[0] = 0;
+	servo_commit(positions);
+	_test_sent(frames, NULL);
+	TEST_EQUAL(servo_dshot_command(0, SERVO_DSHOT_CMD_BEEP1), 1);
+	TEST_EQUAL(servo_dshot_command(1, SERVO_DSHOT_CMD_SPIN_DIRECTION_REVERSED), 1);
+	for (i = 0; i < SERVO_DSHOT_CMD_REPEAT + 1; i++) {
+		servo_commit(positions);
+		_test_sent(frames, NULL);
+		TEST_EQUAL(frames[0], (i == 0) ? servo_dshot_frame(SERVO_DSHOT_CMD_BEEP1, 1) : 0x0000);
+		TEST_EQUAL(frames[1], (i < SERVO_DSHOT_CMD_REPEAT) ? servo_dshot_frame(SERVO_DSHOT_CMD_SPIN_DIRECTION_REVERSED, 1) : 0x0000);
+	}
+
+	// A throttle in the middle of the repetitions cancels the command for good
+	TEST_EQUAL(servo_dshot_command(2, SERVO_DSHOT_CMD_SAVE_SETTINGS), 1);
+	servo_commit(positions);
+	_test_sent(frames, NULL);
+	TEST_EQUAL(frames[2], servo_dshot_frame(SERVO_DSHOT_CMD_SAVE_SETTINGS, 1));
+	servo_set_pos(2, 10);
+	_test_sent(frames, NULL);
+	TEST_EQUAL(frames[2], servo_dshot_frame(SERVO_DSHOT_THROTTLE_MIN - 1 + 10, 0));
+	servo_set_pos(2, 0);
+	_test_sent(frames, NULL);
+	TEST_EQUAL(frames[2], 0x0000);
+	TEST_EQUAL(servo_dshot_command(2, SERVO_DSHOT_CMD_BEEP2), 1);
+}
@@ -0,0 +1,264 @@
+/** @file    test_servo_dshot_bidir.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of bidirectional DShot: GCR and checksum decoding of recorded
+ *           reply timings and the switch between the output burst and the captures
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "servo.h"
+#include "receiver.h"
+#include "dma.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+/**
+ * Replies as TIM3 captures their edges at 600kbit/s, 112 ticks per GCR bit, with up to
+ * 8 ticks of jitter on every edge. The second one runs over the timer overflow.
+ */
+typedef struct {
+	u16 telemetry;   //!< The reply with its checksum
+	u32 erpm;        //!< eRPM of the reply
+	u8 count;        //!< Number of edges
+	u16 edges[SERVO_DSHOT_EDGES];
+} Test_Reply;
+
+static const Test_Reply test_replies[] = {
+	{ 0x3F47, 60000, 10, { 0x03EA, 0x05A4, 0x06FC, 0x07D1, 0x08B2, 0x0993, 0x0A0B, 0x0AE1, 0x0B60, 0x0C36 } },
+	{ 0xFFF0, 0, 13, { 0xFF79, 0xFFEA, 0x00D5, 0x01B5, 0x021A, 0x02FF, 0x03DA, 0x0455, 0x0529, 0x060B, 0x06EF, 0x0759, 0x07D4 } },
+	{ 0x0C8B, 300000, 11, { 0x7529, 0x760F, 0x7679, 0x76EC, 0x77D1, 0x78B5, 0x79FC, 0x7B4B, 0x7BC1, 0x7C2D, 0x7D7B } }
+};
+
+#define TEST_REPLIES (sizeof(test_replies) / sizeof(test_replies[0]))
+
+static DMA_Stream_TypeDef* const test_capture[SERVO_CHANNELS] = { DMA1_Stream4, DMA1_Stream5, DMA1_Stream7, DMA1_Stream2 };
+
+u32 receiver_now() {
+	return 0;
+}
+
+static const u8 test_gcr[16] = {
+	0x19, 0x1B, 0x12, 0x13, 0x1D, 0x15, 0x16, 0x17, 0x1A, 0x09, 0x0A, 0x0B, 0x1E, 0x0D, 0x0E, 0x0F
+};
+
+static u8 _test_encode(u16 telemetry, u16 start, u16* edges);
+static void _test_frame(const u16* positions);
+static void test_frame(void);
+static void test_decode(void);
+static void test_roundtrip(void);
+static void test_crc(void);
+static void test_erpm(void);
+static void test_exchange(void);
+
+
+/**** Public implementations ****/
+
+int main(void) {
+	test_frame();
+	test_decode();
+	test_roundtrip();
+	test_crc();
+	test_erpm();
+	test_exchange();
+	return test_report("servo_dshot_bidir");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Edge times of a reply as the ESC sends it: GCR coded, the start bit and every one
+ *         of the 21 bits toggle the line
+ * @param  telemetry  The reply with its checksum
+ * @param  start  Time of the start edge
+ * @param  edges  Receives the edge times
+ * @retval u8 Number of edges
+ */
+static u8 _test_encode(u16 telemetry, u16 start, u16* edges) {
+	u32 value = 1UL << 20;
+	u8 count = 0, level = 0, i;
+
+	for (i = 0; i < 4; i++) {
+		value |= (u32)test_gcr[(telemetry >> (i * 4)) & 0x0F] << (i * 5);
+	}
+	for (i = 0; i < SERVO_DSHOT_GCR_BITS; i++) {
+		level ^= (value >> (20 - i)) & 1;
+		if (level) {
+			edges[count++] = start + i * SERVO_DSHOT_GCR_BIT;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief  Commit positions and pull the burst out of the output DMA up to its end interrupt
+ * @param  positions  Positions of the motors
+ * @retval None
+ */
+static void _test_frame(const u16* positions) {
+	u32 value;
+
+	servo_commit(positions);
+	while (host_dma_send(SERVO_DSHOT_DMA_STREAM, &value));
+	host_dma_interrupt(SERVO_DSHOT_DMA_STREAM, DMA1_Stream2_IRQHandler);
+}
+
+/**
+ * @brief  The checksum of a bidirectional frame is inverted
+ * @param  None
+ * @retval None
+ */
+static void test_frame(void) {
+	TEST_EQUAL(servo_dshot_frame(1046, 0), 0x82C9);
+	TEST_EQUAL(servo_dshot_frame(0, 0), 0x000F);
+	TEST_EQUAL(SERVO_DSHOT_GCR_BIT, 112);
+}
+
+/**
+ * @brief  The recorded replies decode with jitter and over the overflow; missing, extra or
+ *         shifted edges do not give a reply
+ * @param  None
+ * @retval None
+ */
+static void test_decode(void) {
+	u16 edges[SERVO_DSHOT_EDGES];
+	u8 i;
+
+	for (i = 0; i < TEST_REPLIES; i++) {
+		TEST_EQUAL(servo_dshot_gcr_decode(test_replies[i].edges, test_replies[i].count, SERVO_DSHOT_GCR_BIT), test_replies[i].telemetry);
+	}
+
+	// The last edge lost: the frame decodes to another GCR group or is too long
+	TEST_CHECK(servo_dshot_gcr_decode(test_replies[0].edges, test_replies[0].count - 1, SERVO_DSHOT_GCR_BIT) != test_replies[0].telemetry);
+
+	// An edge 60 ticks late makes two intervals a bit off, a glitch adds an empty interval
+	memcpy(edges, test_replies[2].edges, sizeof(edges));
+	edges[4] += 60;
+	TEST_CHECK(servo_dshot_gcr_decode(edges, test_replies[2].count, SERVO_DSHOT_GCR_BIT) != test_replies[2].telemetry);
+	memcpy(edges, test_replies[2].edges, sizeof(edges));
+	edges[5] = edges[4] + 20;
+	TEST_EQUAL(servo_dshot_gcr_decode(edges, test_replies[2].count, SERVO_DSHOT_GCR_BIT), SERVO_DSHOT_TELEMETRY_INVALID);
+
+	// Too few edges, and a line which stays low for the whole frame
+	TEST_EQUAL(servo_dshot_gcr_decode(edges, 1, SERVO_DSHOT_GCR_BIT), SERVO_DSHOT_TELEMETRY_INVALID);
+	edges[1] = edges[0] + 21 * SERVO_DSHOT_GCR_BIT;
+	TEST_EQUAL(servo_dshot_gcr_decode(edges, 2, SERVO_DSHOT_GCR_BIT), SERVO_DSHOT_TELEMETRY_INVALID);
+}
+
+/**
+ * @brief  Every period with its checksum survives the encoding, also over the timer overflow
+ * @param  None
+ * @retval None
+ */
+static void test_roundtrip(void) {
+	u16 edges[SERVO_DSHOT_EDGES];
+	u32 errors = 0;
+	u16 value, telemetry;
+	u8 count;
+
+	for (value = 0; value < 0x1000; value++) {
+		telemetry = (value << 4) | (~(value ^ (value >> 4) ^ (value >> 8)) & 0x0F);
+		count = _test_encode(telemetry, 0xFC00 + value, edges);
+		errors += (servo_dshot_gcr_decode(edges, count, SERVO_DSHOT_GCR_BIT) != telemetry) || !servo_dshot_telemetry_crc(telemetry);
+	}
+	TEST_EQUAL(errors, 0);
+	TEST_EQUAL(_test_encode(test_replies[0].telemetry, 0, edges), test_replies[0].count);
+}
+
+/**
+ * @brief  The XOR of all four nibbles is 0xF, every single bit error is found
+ * @param  None
+ * @retval None
+ */
+static void test_crc(void) {
+	u32 errors = 0;
+	u8 i, bit;
+
+	for (i = 0; i < TEST_REPLIES; i++) {
+		TEST_EQUAL(servo_dshot_telemetry_crc(test_replies[i].telemetry), 1);
+		for (bit = 0; bit < 16; bit++) {
+			errors += !servo_dshot_telemetry_crc(test_replies[i].telemetry ^ (1 << bit));
+		}
+	}
+	TEST_EQUAL(errors, 16 * TEST_REPLIES);
+}
+
+/**
+ * @brief  The period is a 9 bit mantissa with a 3 bit shift in microseconds
+ * @param  None
+ * @retval None
+ */
+static void test_erpm(void) {
+	u8 i;
+
+	for (i = 0; i < TEST_REPLIES; i++) {
+		TEST_EQUAL(servo_dshot_erpm(test_replies[i].telemetry), test_replies[i].erpm);
+	}
+	TEST_EQUAL(servo_dshot_erpm(0x0010), 60000000);
+	TEST_EQUAL(servo_dshot_erpm(0xE010), 60000000 / (1 << 7));
+	TEST_EQUAL(servo_dshot_erpm(0x0000), 0);
+}
+
+/**
+ * @brief  After the burst each motor gets its own capture stream; the replies captured there
+ *         are decoded with the next frame, the rpm follows the eRPM and the pole count
+ * @param  None
+ * @retval None
+ */
+static void test_exchange(void) {
+	const u16 positions[SERVO_CHANNELS] = { 100, 200, 300, 0 };
+	u8 i, motor;
+
+	host_reset();
+	servo_init();
+	TEST_EQUAL(TIM3->CCER, (TIM_CCER_CC1E | TIM_CCER_CC1P) * 0x1111);
+	TEST_CHECK(SERVO_DSHOT_DMA_STREAM->CR & DMA_SxCR_TCIE);
+
+	_test_frame(positions);
+
+	// Input capture on both edges of all four channels, each with a DMA request
+	TEST_EQUAL(TIM3->CCER, (TIM_CCER_CC1E | TIM_CCER_CC1P | TIM_CCER_CC1NP) * 0x1111);
+	TEST_EQUAL(TIM3->CCMR1 & (TIM_CCMR1_CC1S | TIM_CCMR1_CC2S), TIM_CCMR1_CC1S_0 | TIM_CCMR1_CC2S_0);
+	TEST_EQUAL(TIM3->DIER & (TIM_DIER_UDE | TIM_DIER_CC1DE | TIM_DIER_CC2DE | TIM_DIER_CC3DE | TIM_DIER_CC4DE), TIM_DIER_CC1DE | TIM_DIER_CC2DE | TIM_DIER_CC3DE | TIM_DIER_CC4DE);
+	for (motor = 0; motor < SERVO_CHANNELS; motor++) {
+		TEST_EQUAL(test_capture[motor]->NDTR, SERVO_DSHOT_EDGES);
+		TEST_EQUAL(test_capture[motor]->CR & DMA_SxCR_DIR, DMA_DIR_PeripheralToMemory);
+		TEST_EQUAL(test_capture[motor]->PAR, (u32)&TIM3->CCR1 + 4 * motor);
+	}
+
+	// Motors 1-3 answer, motor 4 does not
+	for (motor = 0; motor < TEST_REPLIES; motor++) {
+		for (i = 0; i < test_replies[motor].count; i++) {
+			host_dma_receive(test_capture[motor], test_replies[motor].edges[i]);
+		}
+	}
+	_test_frame(positions);
+	for (motor = 0; motor < TEST_REPLIES; motor++) {
+		TEST_EQUAL(servo_dshot_get_erpm(motor), test_replies[motor].erpm);
+		TEST_EQUAL(servo_dshot_telemetry_frames[motor], 1);
+		TEST_EQUAL(servo_dshot_telemetry_errors[motor], 0);
+	}
+	TEST_EQUAL(servo_dshot_get_rpm(0), 60000 * 2 / SERVO_MOTOR_POLES);
+	TEST_EQUAL(servo_dshot_get_erpm(3), 0);
+	TEST_EQUAL(servo_dshot_telemetry_errors[3], 1);
+
+	// The captures were stopped in time, the second burst was not skipped
+	TEST_EQUAL(servo_dshot_skipped, 0);
+}
@@ -0,0 +1,130 @@
+/** @file    test_servo_oneshot.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the OneShot125 and Multishot pulse widths on TIM3, built once
+ *           per protocol
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "servo.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+static u32 _test_width(volatile u32* ccr);
+static void test_pulse(void);
+static void test_registers(void);
+static void test_write(void);
+
+
+/**** Public implementations ****/
+
+int main(void) {
+	test_pulse();
+	test_registers();
+	test_write();
+#if SERVO_ONESHOT_PROTOCOL == SERVO_ONESHOT_MULTISHOT
+	return test_report("servo_oneshot multishot");
+#else
+	return test_report("servo_oneshot 125");
+#endif
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  Width of the pulse a channel gives in PWM2 one pulse mode: high from the compare
+ *         value to the end of the period
+ * @param  ccr  Compare register of the channel
+ * @retval u32 Pulse width in nanoseconds
+ */
+static u32 _test_width(volatile u32* ccr) {
+	return (TIM3->ARR + 1 - *ccr) * 1000 / SERVO_ONESHOT_TICKS_PER_US;
+}
+
+/**
+ * @brief  Both protocols from the shortest to the longest pulse in ticks of the 84MHz timer
+ * @param  None
+ * @retval None
+ */
+static void test_pulse(void) {
+	TEST_EQUAL(SERVO_ONESHOT_TICKS_PER_US, 84);
+	TEST_EQUAL(servo_oneshot_pulse(0, SERVO_ONESHOT125_MIN, SERVO_ONESHOT125_MAX, 84), 10500);
+	TEST_EQUAL(servo_oneshot_pulse(500, SERVO_ONESHOT125_MIN, SERVO_ONESHOT125_MAX, 84), 15750);
+	TEST_EQUAL(servo_oneshot_pulse(SERVO_POSITION_MAX, SERVO_ONESHOT125_MIN, SERVO_ONESHOT125_MAX, 84), 21000);
+	TEST_EQUAL(servo_oneshot_pulse(0xFFFF, SERVO_ONESHOT125_MIN, SERVO_ONESHOT125_MAX, 84), 21000);
+	TEST_EQUAL(servo_oneshot_pulse(0, SERVO_MULTISHOT_MIN, SERVO_MULTISHOT_MAX, 84), 420);
+	TEST_EQUAL(servo_oneshot_pulse(500, SERVO_MULTISHOT_MIN, SERVO_MULTISHOT_MAX, 84), 1260);
+	TEST_EQUAL(servo_oneshot_pulse(SERVO_POSITION_MAX, SERVO_MULTISHOT_MIN, SERVO_MULTISHOT_MAX, 84), 2100);
+	TEST_EQUAL(servo_oneshot_pulse(1, SERVO_MULTISHOT_MIN, SERVO_MULTISHOT_MAX, 84), 421);
+}
+
+/**
+ * @brief  TIM3 in one pulse mode without prescaler, the period is the longest pulse plus one
+ *         tick and all channels are PWM2 outputs without preload
+ * @param  None
+ * @retval None
+ */
+static void test_registers(void) {
+	host_reset();
+	servo_init();
+
+	TEST_EQUAL(TIM3->PSC, 0);
+	TEST_EQUAL(TIM3->ARR, SERVO_ONESHOT_MAX * SERVO_ONESHOT_TICKS_PER_US / 1000);
+	TEST_CHECK(TIM3->CR1 & TIM_CR1_OPM);
+	TEST_EQUAL(TIM3->CR1 & TIM_CR1_CEN, 0);
+	TEST_EQUAL(TIM3->CCMR1, (TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1M_0) * 0x0101);
+	TEST_EQUAL(TIM3->CCMR2, (TIM_CCMR2_OC3M_2 | TIM_CCMR2_OC3M_1 | TIM_CCMR2_OC3M_0) * 0x0101);
+	TEST_EQUAL(TIM3->CCER, TIM_CCER_CC1E * 0x1111);
+
+	// Nothing is high before the first pulse
+	TEST_EQUAL(_test_width(&TIM3->CCR1), 0);
+}
+
+/**
+ * @brief  A write starts one pulse per channel with the width of the protocol, all ending
+ *         at the update event; a write during the pulse only stores the new widths
+ * @param  None
+ * @retval None
+ */
+static void test_write(void) {
+	const u16 positions[SERVO_CHANNELS] = { 0, 250, 500, SERVO_POSITION_MAX };
+	const u16 next[SERVO_CHANNELS] = { 1000, 750, 0, 1 };
+	const u32 span = SERVO_ONESHOT_MAX - SERVO_ONESHOT_MIN;
+	u32 skipped = servo_oneshot_skipped;
+
+	servo_commit(positions);
+	TEST_CHECK(TIM3->CR1 & TIM_CR1_CEN);
+	TEST_EQUAL(_test_width(&TIM3->CCR1), SERVO_ONESHOT_MIN);
+	TEST_EQUAL(_test_width(&TIM3->CCR2), SERVO_ONESHOT_MIN + span / 4);
+	TEST_EQUAL(_test_width(&TIM3->CCR3), SERVO_ONESHOT_MIN + span / 2);
+	TEST_EQUAL(_test_width(&TIM3->CCR4), SERVO_ONESHOT_MAX);
+
+	// Still running: skipped, the compare registers are untouched
+	servo_commit(next);
+	TEST_EQUAL(servo_oneshot_skipped, skipped + 1);
+	TEST_EQUAL(_test_width(&TIM3->CCR1), SERVO_ONESHOT_MIN);
+
+	// The one pulse mode stopped the counter, the stored widths go out with the next write
+	TIM3->CR1 &= ~TIM_CR1_CEN;
+	servo_set_pos(2, 0);
+	TEST_EQUAL(_test_width(&TIM3->CCR1), SERVO_ONESHOT_MAX);
+	TEST_EQUAL(_test_width(&TIM3->CCR2), SERVO_ONESHOT_MIN + span * 3 / 4);
+	TEST_EQUAL(_test_width(&TIM3->CCR3), SERVO_ONESHOT_MIN);
+}
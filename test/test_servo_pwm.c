@@ -0,0 +1,131 @@
+/** @file    test_servo_pwm.c
+ *  @author  Lukas Zurschmiede <lukas@ranta.ch>
+ *  @email   <lukas@ranta.ch>
+ *  @version 0.0.1
+ *  @date    2014-01-01
+ *  @brief   Host test of the hardware PWM servo outputs on the TIM3 compare registers
+ *
+ *  Copyright (C) 2013-2014 @em Lukas @em Zurschmiede <lukas@ranta.ch>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "servo.h"
+#include "test.h"
+
+/**** Private declarations ****/
+
+static void test_registers(void);
+static void test_compare(void);
+static void test_rate(void);
+
+
+/**** Public implementations ****/
+
+int main(void) {
+	test_registers();
+	test_compare();
+	test_rate();
+	return test_report("servo_pwm");
+}
+
+
+/**** Private implementations ****/
+
+/**
+ * @brief  TIM3 counts microseconds in 50Hz frames, all four channels are preloaded PWM1 outputs
+ *         on PC6, PC7, PB0 and PB1 which start with the shortest pulse
+ * @param  None
+ * @retval None
+ */
+static void test_registers(void) {
+	host_reset();
+	servo_gpio_init();
+	servo_init();
+
+	TEST_EQUAL(TIM3->PSC, 83);
+	TEST_EQUAL(TIM3->ARR, 19999);
+	TEST_CHECK(TIM3->CR1 & TIM_CR1_CEN);
+	TEST_CHECK(TIM3->CR1 & TIM_CR1_ARPE);
+	TEST_EQUAL(TIM3->CCMR1, (TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE) * 0x0101);
+	TEST_EQUAL(TIM3->CCMR2, (TIM_CCMR2_OC3M_2 | TIM_CCMR2_OC3M_1 | TIM_CCMR2_OC3PE) * 0x0101);
+	TEST_EQUAL(TIM3->CCER, TIM_CCER_CC1E * 0x1111);
+	TEST_EQUAL(TIM3->CCR1, SERVO_PULSE_MIN);
+	TEST_EQUAL(TIM3->CCR4, SERVO_PULSE_MIN);
+
+	// Alternate function 2 (TIM3) on the four pins
+	TEST_EQUAL(GPIOC->MODER, (GPIO_Mode_AF << 12) | (GPIO_Mode_AF << 14));
+	TEST_EQUAL(GPIOB->MODER, GPIO_Mode_AF | (GPIO_Mode_AF << 2));
+	TEST_EQUAL(GPIOC->AFR[0], (GPIO_AF_TIM3 << 24) | (GPIO_AF_TIM3 << 28));
+	TEST_EQUAL(GPIOB->AFR[0], GPIO_AF_TIM3 | (GPIO_AF_TIM3 << 4));
+}
+
+/**
+ * @brief  Committed positions end in the compare registers as pulse widths in microseconds,
+ *         too large ones are limited; the update event is enabled again after the write
+ * @param  None
+ * @retval None
+ */
+static void test_compare(void) {
+	const u16 positions[SERVO_CHANNELS] = { 0, 250, 999, 1000 };
+	const u16 limited[SERVO_CHANNELS] = { 1001, 5000, 0xFFFF, 500 };
+
+	servo_commit(positions);
+	TEST_EQUAL(TIM3->CCR1, 1000);
+	TEST_EQUAL(TIM3->CCR2, 1250);
+	TEST_EQUAL(TIM3->CCR3, 1999);
+	TEST_EQUAL(TIM3->CCR4, 2000);
+	TEST_EQUAL(TIM3->CR1 & TIM_CR1_UDIS, 0);
+
+	servo_commit(limited);
+	TEST_EQUAL(TIM3->CCR1, 2000);
+	TEST_EQUAL(TIM3->CCR2, 2000);
+	TEST_EQUAL(TIM3->CCR3, 2000);
+	TEST_EQUAL(TIM3->CCR4, 1500);
+
+	// A single servo commits the last positions of the others with it
+	servo_set_pos(0, 500);
+	servo_set_pos(1, 100);
+	TEST_EQUAL(TIM3->CCR1, 1500);
+	TEST_EQUAL(TIM3->CCR2, 1100);
+	TEST_EQUAL(TIM3->CCR3, 2000);
+	servo_set_pos(SERVO_CHANNELS, 100);
+	TEST_EQUAL(TIM3->CCR2, 1100);
+
+	// The same after a commit of all servos
+	servo_commit(limited);
+	servo_set_pos(1, 100);
+	TEST_EQUAL(TIM3->CCR1, 2000);
+	TEST_EQUAL(TIM3->CCR2, 1100);
+	TEST_EQUAL(TIM3->CCR4, 1500);
+
+	// Writing past the last channel stops at it
+	servo_pwm_write(3, 4, positions);
+	TEST_EQUAL(TIM3->CCR4, 1000);
+	TEST_EQUAL(TIM3->CCR3, 2000);
+}
+
+/**
+ * @brief  The frame rate goes into the preloaded auto reload register, limited to the ESC range
+ * @param  None
+ * @retval None
+ */
+static void test_rate(void) {
+	servo_pwm_set_rate(400);
+	TEST_EQUAL(TIM3->ARR, 2499);
+	servo_pwm_set_rate(1000);
+	TEST_EQUAL(TIM3->ARR, 1000000 / SERVO_PWM_RATE_MAX - 1);
+	servo_pwm_set_rate(10);
+	TEST_EQUAL(TIM3->ARR, 1000000 / SERVO_PWM_RATE_MIN - 1);
+	TEST_EQUAL(servo_pwm_period(333), 3002);
+}